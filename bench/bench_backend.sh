@@ -0,0 +1,47 @@
+#!/usr/bin/env bash
+
+# 后端性能测试：单个巨大函数，语句数量成倍增加，耗时应该近似线性增长
+# 用法 bench/bench_backend.sh <compiler> [对比用的 compiler]
+
+set -e
+
+script_dir="$(cd "$(dirname "$0")" && pwd)"
+compiler="${1:?usage: $0 <compiler> [baseline_compiler]}"
+baseline="$2"
+sizes="${SIZES:-5000 10000 20000 40000}"
+runs="${RUNS:-3}"
+
+best_ms() {
+    local bin="$1" mode="$2" input="$3"
+    local best=""
+    for _ in $(seq "$runs"); do
+        local start end ms
+        start=$(date +%s%N)
+        "$bin" "$mode" "$input" -o /tmp/bench_huge_function.s
+        end=$(date +%s%N)
+        ms=$(( (end - start) / 1000000 ))
+        if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then
+            best=$ms
+        fi
+    done
+    echo "$best"
+}
+
+bench() {
+    local bin="$1"
+    echo "$bin (best of $runs)"
+    printf "%10s %10s %10s %10s\n" stmts koopa riscv perf
+    for n in $sizes; do
+        local input=/tmp/bench_huge_function_$n.c
+        python3 "$script_dir/gen_huge_function.py" "$n" > "$input"
+        printf "%10s %8s ms %8s ms %8s ms\n" "$n" \
+            "$(best_ms "$bin" -koopa "$input")" \
+            "$(best_ms "$bin" -riscv "$input")" \
+            "$(best_ms "$bin" -perf "$input")"
+    done
+}
+
+bench "$compiler"
+if [ -n "$baseline" ]; then
+    bench "$baseline"
+fi
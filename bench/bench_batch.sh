@@ -0,0 +1,60 @@
+#!/usr/bin/env bash
+
+# 批量编译测试：同一批小文件，比较每个文件启动一个进程和 -j N 在一个进程里编译
+# 用法 bench/bench_batch.sh <compiler> [模式，默认 -perf]
+
+set -e
+
+script_dir="$(cd "$(dirname "$0")" && pwd)"
+compiler="${1:?usage: $0 <compiler> [-koopa|-riscv|-perf]}"
+mode="${2:--perf}"
+files="${FILES:-200}"
+stmts="${STMTS:-200}"
+jobs="${JOBS:-1 2 4 8}"
+runs="${RUNS:-3}"
+
+input_dir=/tmp/bench_batch_input
+output_dir=/tmp/bench_batch_output
+rm -rf "$input_dir" "$output_dir"
+mkdir -p "$input_dir" "$output_dir"
+for i in $(seq "$files"); do
+    python3 "$script_dir/gen_huge_function.py" $((stmts + i % 50)) \
+        > "$input_dir/f$i.c"
+done
+inputs=("$input_dir"/*.c)
+
+# 运行 runs 次命令，输出最快一次的毫秒数
+best_ms() {
+    local best=""
+    for _ in $(seq "$runs"); do
+        local start end ms
+        start=$(date +%s%N)
+        "$@"
+        end=$(date +%s%N)
+        ms=$(( (end - start) / 1000000 ))
+        if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then
+            best=$ms
+        fi
+    done
+    echo "$best"
+}
+
+one_process_per_file() {
+    printf '%s\n' "${inputs[@]}" | xargs -P "$1" -I{} \
+        sh -c '"$0" "$1" "$2" -o "$3/$(basename "$2" .c).S"' \
+        "$compiler" "$mode" {} "$output_dir"
+}
+
+in_process() {
+    "$compiler" "$mode" -j "$1" "${inputs[@]}" -o "$output_dir"
+}
+
+echo "$files 个文件，每个约 $stmts 条语句，$mode ，best of $runs ，$(nproc) 个 CPU"
+printf "%6s %16s %16s\n" jobs "每个文件一个进程" "-j N 单进程"
+for j in $jobs; do
+    a=$(best_ms one_process_per_file "$j")
+    b=$(best_ms in_process "$j")
+    printf "%6s %8s ms %5s/s %8s ms %5s/s\n" "$j" \
+        "$a" $((files * 1000 / (a > 0 ? a : 1))) \
+        "$b" $((files * 1000 / (b > 0 ? b : 1)))
+done
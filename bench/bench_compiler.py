@@ -0,0 +1,135 @@
+"""
+编译器吞吐量测试：用 gen_stress.py 生成每种压力输入的几个规模，
+分别用 -koopa 和 -perf 编译，从 -time-report=json 读出每个阶段的耗时，
+写成 JSON 报告，并且按相邻规模的耗时比例估计增长的阶数
+阶数明显大于 1 的阶段说明存在超线性的路径（比如符号查找、栈偏移查找）
+用法
+python3 bench/bench_compiler.py <compiler> [报告路径] [--runs N] [--scale K]
+cmake --build build --target bench_compiler
+"""
+
+import argparse
+import json
+import math
+import pathlib
+import subprocess
+import sys
+import tempfile
+
+import gen_stress
+
+script_path = pathlib.Path(__file__).resolve()
+
+# 每种输入的基础规模，依次测试 1 倍、2 倍、4 倍
+base_sizes = {
+    "long_expr": 5000,
+    "many_funcs": 500,
+    "deep_nesting": 500,
+    "big_array": 20000,
+    "many_globals": 2000,
+}
+multipliers = [1, 2, 4]
+modes = ["koopa", "perf"]
+# 增长阶数超过这个值时在输出中标出来
+superlinear_order = 1.5
+# 太短的阶段计时误差大，不估计阶数
+min_phase_ms = 5.0
+
+
+def run_once(compiler: str, mode: str, input_path: str, output_path: str):
+    result = subprocess.run(
+        [compiler, f"-{mode}", "-time-report=json", input_path,
+         "-o", output_path],
+        capture_output=True,
+        text=True,
+    )
+    if result.returncode != 0:
+        sys.stderr.write(result.stderr)
+        raise RuntimeError(f"编译失败: {compiler} -{mode} {input_path}")
+    # 报告是标准错误输出中最后一个 JSON 对象
+    return json.loads(result.stderr[result.stderr.rindex('{"phases"'):])
+
+
+def measure(compiler: str, mode: str, input_path: str, output_path: str,
+            runs: int):
+    # 取总耗时最短的一次
+    reports = [run_once(compiler, mode, input_path, output_path)
+               for _ in range(runs)]
+    return min(reports, key=lambda report: report["total"]["wall_ms"])
+
+
+def growth_order(points):
+    """相邻两个规模之间耗时的增长阶数，取最大的一个"""
+    orders = []
+    for (size_a, a), (size_b, b) in zip(points, points[1:]):
+        if a < min_phase_ms or b < min_phase_ms:
+            continue
+        orders.append(math.log(b / a) / math.log(size_b / size_a))
+    return max(orders) if orders else None
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("compiler")
+    parser.add_argument("report", nargs="?", default="bench_compiler.json")
+    parser.add_argument("--runs", type=int, default=3)
+    parser.add_argument("--scale", type=float, default=1.0)
+    args = parser.parse_args()
+
+    results = []
+    with tempfile.TemporaryDirectory() as work_dir:
+        for kind, base_size in base_sizes.items():
+            for multiplier in multipliers:
+                size = max(int(base_size * args.scale * multiplier), 1)
+                input_path = f"{work_dir}/{kind}_{size}.c"
+                source = gen_stress.generators[kind](size)
+                pathlib.Path(input_path).write_text(source)
+                for mode in modes:
+                    output_path = f"{work_dir}/{kind}_{size}.{mode}"
+                    report = measure(args.compiler, mode, input_path,
+                                     output_path, args.runs)
+                    results.append({
+                        "input": kind,
+                        "size": size,
+                        "bytes": len(source),
+                        "mode": mode,
+                        "phases": report["phases"],
+                        "total": report["total"],
+                    })
+                    wall = report["total"]["wall_ms"]
+                    print(f"{kind:<14} {size:>8} -{mode:<6} {wall:>10.1f} ms",
+                          flush=True)
+
+    # 每种输入、每种模式、每个阶段的增长阶数
+    scaling = []
+    for kind in base_sizes:
+        for mode in modes:
+            rows = [r for r in results if r["input"] == kind and r["mode"] == mode]
+            phase_names = [p["name"] for p in rows[0]["phases"]] + ["total"]
+            for name in phase_names:
+                points = []
+                for r in rows:
+                    if name == "total":
+                        wall = r["total"]["wall_ms"]
+                    else:
+                        wall = next(p["wall_ms"] for p in r["phases"]
+                                    if p["name"] == name)
+                    points.append((r["size"], wall))
+                order = growth_order(points)
+                if order is None:
+                    continue
+                scaling.append({"input": kind, "mode": mode, "phase": name,
+                                "order": round(order, 2)})
+                if order > superlinear_order:
+                    times = ", ".join(f"{s}: {w:.1f} ms" for s, w in points)
+                    print(f"超线性: {kind} -{mode} {name} "
+                          f"阶数 {order:.2f} ({times})")
+
+    report = {"runs": args.runs, "results": results, "scaling": scaling}
+    text = json.dumps(report, indent=2, ensure_ascii=False)
+    pathlib.Path(args.report).write_text(text + "\n")
+    print(f"报告写到 {args.report}")
+
+
+if __name__ == "__main__":
+    main()
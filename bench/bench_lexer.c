@@ -0,0 +1,73 @@
+/*
+ * 词法分析吞吐量测试
+ * 反复对同一个输入调用 next_token 直到 EOF ，输出 MB/s
+ * 用法 bench_lexer <输入文件> [重复次数]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "intern.h"
+#include "tokenize.h"
+
+static char *read_file(const char *filename, long *length) {
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "无法打开文件 %s\n", filename);
+    exit(1);
+  }
+  fseek(file, 0, SEEK_END);
+  *length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char *buffer = malloc(*length + 1);
+  if (buffer == NULL || fread(buffer, 1, *length, file) != (size_t)*length) {
+    fprintf(stderr, "读取文件 %s 失败\n", filename);
+    exit(1);
+  }
+  buffer[*length] = '\0';
+  fclose(file);
+  return buffer;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <input_file> [iterations]\n", argv[0]);
+    return 1;
+  }
+  long length;
+  char *input = read_file(argv[1], &length);
+  int iterations = argc > 2 ? atoi(argv[2]) : 10;
+
+  InternPool pool;
+  intern_pool_init(&pool);
+  Tokenizer tokenizer;
+  long tokens = 0;
+  double best = 0;
+  for (int i = 0; i < iterations; i++) {
+    double start = now_seconds();
+    init_tokenizer(&tokenizer, input, &pool);
+    long count = 0;
+    while (next_token(&tokenizer).type != TOKEN_EOF) {
+      count++;
+    }
+    double elapsed = now_seconds() - start;
+    if (i == 0 || elapsed < best) {
+      best = elapsed;
+    }
+    tokens = count;
+  }
+
+  double mb = length / (1024.0 * 1024.0);
+  printf("input: %.2f MB, %ld tokens\n", mb, tokens);
+  printf("best of %d: %.3f s, %.1f MB/s, %.1f Mtokens/s\n", iterations, best,
+         mb / best, tokens / best / 1e6);
+  intern_pool_free(&pool);
+  free(input);
+  return 0;
+}
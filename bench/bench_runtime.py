@@ -0,0 +1,202 @@
+"""
+运行时性能测试：把 bench/runtime 下的几个经典内核和 examples/sdf_sysy.c
+分别用 -riscv 、-perf 和 clang -O2 编译成 RV32 程序，在 qemu-riscv32-static 中运行，
+记录 starttime / stoptime 之间的时间（运行时库输出的 TOTAL）、整个进程的耗时，
+以及动态指令数（需要 qemu 的 libinsn 插件），和保存的基线比较
+三种编译方式的输出必须相同，否则报错
+
+需要 clang 、ld.lld 、qemu-riscv32-static 和 RV32 的 libsysy（编译实践的 docker 环境里都有）
+用法
+python3 bench/bench_runtime.py <compiler> [--report report.json]
+    [--baseline bench/runtime/baseline.json] [--update-baseline]
+    [--qemu-plugin /path/to/libinsn.so] [--runs N] [--only matmul,sort]
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import pathlib
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+script_dir = pathlib.Path(__file__).resolve().parent
+runtime_dir = script_dir / "runtime"
+repo_dir = script_dir.parent
+
+# 名字、源文件、标准输入（内核的规模）
+benchmarks = [
+    ("matmul", runtime_dir / "matmul.c", "96\n"),
+    ("sort", runtime_dir / "sort.c", "60000\n"),
+    ("recursion", runtime_dir / "recursion.c", "24\n"),
+    ("prefix_sum", runtime_dir / "prefix_sum.c", "100000\n"),
+    ("stencil", runtime_dir / "stencil.c", "200\n"),
+    ("sdf", repo_dir / "examples" / "sdf_sysy.c", ""),
+]
+variants = ["riscv", "perf", "clang"]
+# sdf_sysy.c 一直循环播放动画，测试时只渲染这么多帧
+sdf_frames = 4
+
+target_flags = ["-target", "riscv32-unknown-linux-elf", "-march=rv32im",
+                "-mabi=ilp32"]
+
+
+def run(args, **kwargs):
+    result = subprocess.run(args, capture_output=True, **kwargs)
+    if result.returncode != 0:
+        sys.stderr.write(result.stderr.decode(errors="replace"))
+        raise RuntimeError(f"命令失败: {' '.join(map(str, args))}")
+    return result
+
+
+def bounded_sdf(source: str) -> str:
+    """把 loop_forever 的无限循环改成只渲染 sdf_frames 帧"""
+    old = "  while (1) {\n"
+    if source.count(old) != 1:
+        raise RuntimeError("sdf_sysy.c 的主循环变了，需要更新 bounded_sdf")
+    new = (f"  int frame = 0;\n  while (frame < {sdf_frames}) {{\n"
+           "    frame = frame + 1;\n")
+    return source.replace(old, new)
+
+
+def build(compiler, variant, source_path, work_dir, lib_dir):
+    """编译并链接一个程序，返回可执行文件的路径"""
+    base = work_dir / f"{source_path.stem}.{variant}"
+    obj = base.with_suffix(".o")
+    if variant == "clang":
+        # SysY 是 C 的子集，加上运行时库的声明就能当作 C 编译
+        # -fno-builtin 避免生成 libsysy 里没有的 memset / memcpy 调用
+        run(["clang", "-O2", "-fno-builtin", "-w", *target_flags,
+             "-include", str(runtime_dir / "sysy.h"), "-x", "c",
+             str(source_path), "-c", "-o", str(obj)])
+    else:
+        asm = base.with_suffix(".S")
+        run([compiler, f"-{variant}", str(source_path), "-o", str(asm)])
+        run(["clang", *target_flags, str(asm), "-c", "-o", str(obj)])
+    exe = base.with_suffix(".elf")
+    run(["ld.lld", str(obj), f"-L{lib_dir}", "-lsysy", "-o", str(exe)])
+    return exe
+
+
+def parse_total_us(stderr: str):
+    # 运行时库在退出时输出 TOTAL: xH-xM-xS-xus
+    match = re.search(r"TOTAL: (\d+)H-(\d+)M-(\d+)S-(\d+)us", stderr)
+    if match is None:
+        return None
+    h, m, s, us = map(int, match.groups())
+    return ((h * 60 + m) * 60 + s) * 1000000 + us
+
+
+def run_once(qemu, plugin, exe, stdin, work_dir):
+    args = [qemu]
+    log = work_dir / "insn.log"
+    if plugin:
+        args += ["-plugin", f"{plugin},inline=on", "-d", "plugin",
+                 "-D", str(log)]
+    args.append(str(exe))
+    start = time.perf_counter()
+    result = subprocess.run(args, input=stdin.encode(), capture_output=True)
+    wall_ms = (time.perf_counter() - start) * 1000
+    # SysY 程序的返回值就是退出码，不检查
+    insns = None
+    if plugin and log.exists():
+        match = re.search(r"insns: (\d+)", log.read_text())
+        if match:
+            insns = int(match.group(1))
+    return {
+        "timer_us": parse_total_us(result.stderr.decode(errors="replace")),
+        "wall_ms": round(wall_ms, 3),
+        "insns": insns,
+        "stdout_md5": hashlib.md5(result.stdout).hexdigest(),
+    }
+
+
+def measure(qemu, plugin, exe, stdin, work_dir, runs):
+    # 指令数每次都一样，时间取最短的一次
+    results = [run_once(qemu, plugin, exe, stdin, work_dir)
+               for _ in range(runs)]
+    best = min(results, key=lambda r: r["wall_ms"])
+    timers = [r["timer_us"] for r in results if r["timer_us"] is not None]
+    best["timer_us"] = min(timers) if timers else None
+    return best
+
+
+def ratio(value, base):
+    if value is None or not base:
+        return None
+    return round(value / base, 3)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("compiler")
+    parser.add_argument("--report", default="bench_runtime.json")
+    parser.add_argument("--baseline", default=runtime_dir / "baseline.json",
+                        type=pathlib.Path)
+    parser.add_argument("--update-baseline", action="store_true")
+    parser.add_argument("--qemu", default="qemu-riscv32-static")
+    parser.add_argument("--qemu-plugin",
+                        default=os.environ.get("QEMU_INSN_PLUGIN"))
+    parser.add_argument("--lib-dir", default=os.path.join(
+        os.environ.get("CDE_LIBRARY_PATH", "/opt/lib"), "riscv32"))
+    parser.add_argument("--runs", type=int, default=3)
+    parser.add_argument("--only", default=None)
+    args = parser.parse_args()
+
+    selected = benchmarks
+    if args.only:
+        names = args.only.split(",")
+        selected = [b for b in benchmarks if b[0] in names]
+
+    baseline = {}
+    if args.baseline.exists() and not args.update_baseline:
+        for r in json.loads(args.baseline.read_text())["results"]:
+            baseline[(r["name"], r["variant"])] = r
+
+    results = []
+    with tempfile.TemporaryDirectory() as work:
+        work_dir = pathlib.Path(work)
+        for name, source_path, stdin in selected:
+            if name == "sdf":
+                bounded = work_dir / "sdf.c"
+                bounded.write_text(bounded_sdf(source_path.read_text()))
+                source_path = bounded
+            outputs = {}
+            for variant in variants:
+                exe = build(args.compiler, variant, source_path, work_dir,
+                            args.lib_dir)
+                r = measure(args.qemu, args.qemu_plugin, exe, stdin,
+                            work_dir, args.runs)
+                r.update({"name": name, "variant": variant})
+                outputs[variant] = r["stdout_md5"]
+                results.append(r)
+            if len(set(outputs.values())) != 1:
+                raise RuntimeError(f"{name} 的输出不一致: {outputs}")
+
+    # 和 clang -O2 以及基线比较
+    clang = {r["name"]: r for r in results if r["variant"] == "clang"}
+    print(f"{'benchmark':<12} {'variant':<8} {'timer_us':>12} "
+          f"{'insns':>14} {'vs clang':>9} {'vs baseline':>12}")
+    for r in results:
+        key = "insns" if r["insns"] is not None else "timer_us"
+        r["vs_clang"] = ratio(r[key], clang[r["name"]][key])
+        base = baseline.get((r["name"], r["variant"]))
+        r["vs_baseline"] = ratio(r[key], base[key]) if base else None
+        print(f"{r['name']:<12} {r['variant']:<8} {str(r['timer_us']):>12} "
+              f"{str(r['insns']):>14} {str(r['vs_clang']):>9} "
+              f"{str(r['vs_baseline']):>12}")
+
+    report = {"runs": args.runs, "qemu_plugin": args.qemu_plugin,
+              "results": results}
+    text = json.dumps(report, indent=2) + "\n"
+    pathlib.Path(args.report).write_text(text)
+    if args.update_baseline:
+        args.baseline.write_text(text)
+        print(f"基线写到 {args.baseline}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,73 @@
+#!/usr/bin/env bash
+
+# 编译服务测试：同一批小文件，比较每个文件启动一个编译器进程、
+# 每个文件启动一个客户端连接编译服务、一个客户端在同一个连接上编译全部文件
+# 用法 bench/bench_server.sh <compiler> <compiler_client> [模式，默认 -perf]
+
+set -e
+
+script_dir="$(cd "$(dirname "$0")" && pwd)"
+compiler="${1:?usage: $0 <compiler> <compiler_client> [-koopa|-riscv|-perf]}"
+client="${2:?usage: $0 <compiler> <compiler_client> [-koopa|-riscv|-perf]}"
+mode="${3:--perf}"
+files="${FILES:-200}"
+stmts="${STMTS:-20}"
+runs="${RUNS:-3}"
+
+input_dir=/tmp/bench_server_input
+output_dir=/tmp/bench_server_output
+socket=/tmp/bench_server.sock
+rm -rf "$input_dir" "$output_dir"
+mkdir -p "$input_dir" "$output_dir"
+for i in $(seq "$files"); do
+    python3 "$script_dir/gen_huge_function.py" $((stmts + i % 10)) \
+        > "$input_dir/f$i.c"
+done
+inputs=("$input_dir"/*.c)
+
+"$compiler" -server "$socket" &
+server_pid=$!
+trap 'kill $server_pid' EXIT
+while [ ! -S "$socket" ]; do
+    sleep 0.1
+done
+
+# 运行 runs 次命令，输出最快一次的毫秒数
+best_ms() {
+    local best=""
+    for _ in $(seq "$runs"); do
+        local start end ms
+        start=$(date +%s%N)
+        "$@"
+        end=$(date +%s%N)
+        ms=$(( (end - start) / 1000000 ))
+        if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then
+            best=$ms
+        fi
+    done
+    echo "$best"
+}
+
+one_process_per_file() {
+    for f in "${inputs[@]}"; do
+        "$compiler" "$mode" "$f" -o "$output_dir/$(basename "$f" .c).S"
+    done
+}
+
+one_client_per_file() {
+    for f in "${inputs[@]}"; do
+        "$client" "$socket" "$mode" "$f" \
+            -o "$output_dir/$(basename "$f" .c).S"
+    done
+}
+
+one_connection() {
+    "$client" "$socket" "$mode" "${inputs[@]}" -o "$output_dir"
+}
+
+echo "$files 个文件，每个约 $stmts 条语句，$mode ，best of $runs"
+for name in one_process_per_file one_client_per_file one_connection; do
+    ms=$(best_ms "$name")
+    printf "%-22s %6s ms %8s 个文件/s\n" "$name" "$ms" \
+        $((files * 1000 / (ms > 0 ? ms : 1)))
+done
@@ -0,0 +1,38 @@
+#!/usr/bin/env bash
+
+# 符号表性能测试：生成大量全局变量和嵌套作用域，统计生成 Koopa IR 的耗时
+# 用法 bench/bench_symbols.sh <compiler> [对比用的 compiler]
+
+set -e
+
+script_dir="$(cd "$(dirname "$0")" && pwd)"
+compiler="${1:?usage: $0 <compiler> [baseline_compiler]}"
+baseline="$2"
+globals="${GLOBALS:-20000}"
+funcs="${FUNCS:-2000}"
+runs="${RUNS:-3}"
+
+input=/tmp/bench_many_symbols.c
+python3 "$script_dir/gen_many_symbols.py" "$globals" "$funcs" > "$input"
+echo "input: $input ($(wc -l < "$input") lines, $globals globals, $funcs functions)"
+
+bench() {
+    local bin="$1"
+    local best=""
+    for _ in $(seq "$runs"); do
+        local start end ms
+        start=$(date +%s%N)
+        "$bin" -koopa "$input" -o /tmp/bench_many_symbols.koopa
+        end=$(date +%s%N)
+        ms=$(( (end - start) / 1000000 ))
+        if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then
+            best=$ms
+        fi
+    done
+    echo "$bin: best of $runs: ${best} ms"
+}
+
+bench "$compiler"
+if [ -n "$baseline" ]; then
+    bench "$baseline"
+fi
@@ -0,0 +1,149 @@
+/*
+ * 编译服务的客户端，协议见 src/server.h
+ * 用法 compiler_client <socket> -koopa|-riscv|-perf <输入文件> -o <输出文件>
+ *      compiler_client <socket> -koopa|-riscv|-perf <输入文件>... -o <输出目录>
+ * 多个输入文件在同一个连接上依次编译，输出为 输出目录/<文件名>.koopa 或 .S
+ * 编译出错时把错误信息输出到 stderr ，继续编译其余文件，最后返回 1
+ */
+#include <libgen.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static char *read_file(const char *filename, size_t *length) {
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "无法打开文件 %s\n", filename);
+    exit(1);
+  }
+  fseek(file, 0, SEEK_END);
+  *length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char *buffer = malloc(*length + 1);
+  if (buffer == NULL || fread(buffer, 1, *length, file) != *length) {
+    fprintf(stderr, "读取文件 %s 失败\n", filename);
+    exit(1);
+  }
+  fclose(file);
+  return buffer;
+}
+
+static void read_full(FILE *connection, char *data, size_t length) {
+  if (fread(data, 1, length, connection) != length) {
+    fprintf(stderr, "编译服务断开了连接\n");
+    exit(1);
+  }
+}
+
+static FILE *connect_server(const char *path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    fprintf(stderr, "无法连接编译服务 %s\n", path);
+    exit(1);
+  }
+  // 请求和回复都用 stdio 缓冲，一问一答之间 fflush
+  FILE *connection = fdopen(fd, "r+");
+  if (connection == NULL) {
+    fprintf(stderr, "无法连接编译服务 %s\n", path);
+    exit(1);
+  }
+  return connection;
+}
+
+// 编译一个文件，成功时写到 output_file
+static bool compile_remote(FILE *connection, const char *mode,
+                           const char *input_file, const char *output_file) {
+  size_t length;
+  char *source = read_file(input_file, &length);
+  fprintf(connection, "%s %zu\n", mode, length);
+  fwrite(source, 1, length, connection);
+  fflush(connection);
+  free(source);
+
+  int status;
+  size_t size;
+  if (fscanf(connection, "%d %zu", &status, &size) != 2 ||
+      fgetc(connection) != '\n') {
+    fprintf(stderr, "编译服务的回复格式错误\n");
+    exit(1);
+  }
+  char *result = malloc(size + 1);
+  if (result == NULL) {
+    fprintf(stderr, "无法分配内存\n");
+    exit(1);
+  }
+  read_full(connection, result, size);
+  if (status != 0) {
+    fprintf(stderr, "%s: ", input_file);
+    fwrite(result, 1, size, stderr);
+    free(result);
+    return false;
+  }
+  FILE *output = fopen(output_file, "wb");
+  if (output == NULL) {
+    fprintf(stderr, "无法打开文件 %s\n", output_file);
+    exit(1);
+  }
+  fwrite(result, 1, size, output);
+  fclose(output);
+  free(result);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  const char *mode = NULL;
+  const char *output = NULL;
+  const char **inputs = malloc(sizeof(char *) * argc);
+  int input_count = 0;
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "-koopa") == 0 || strcmp(argv[i], "-riscv") == 0 ||
+        strcmp(argv[i], "-perf") == 0) {
+      mode = argv[i] + 1;
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    } else {
+      inputs[input_count++] = argv[i];
+    }
+  }
+  if (argc < 2 || mode == NULL || output == NULL || input_count == 0) {
+    fprintf(stderr,
+            "Usage: %s <socket> -koopa|-riscv|-perf <input_file>... -o "
+            "<output_file|output_dir>\n",
+            argv[0]);
+    return 1;
+  }
+
+  FILE *connection = connect_server(argv[1]);
+  const char *extension = strcmp(mode, "koopa") == 0 ? "koopa" : "S";
+  bool ok = true;
+  for (int i = 0; i < input_count; i++) {
+    if (input_count == 1) {
+      ok = compile_remote(connection, mode, inputs[i], output) && ok;
+      continue;
+    }
+    // basename 可能修改参数，复制一份
+    char *copy = strdup(inputs[i]);
+    char *name = basename(copy);
+    char *dot = strrchr(name, '.');
+    if (dot != NULL) {
+      *dot = '\0';
+    }
+    size_t size = strlen(output) + strlen(name) + 16;
+    char *path = malloc(size);
+    snprintf(path, size, "%s/%s.%s", output, name, extension);
+    ok = compile_remote(connection, mode, inputs[i], path) && ok;
+    free(path);
+    free(copy);
+  }
+  fclose(connection);
+  free(inputs);
+  return ok ? 0 : 1;
+}
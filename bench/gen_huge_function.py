@@ -0,0 +1,32 @@
+"""
+生成只有一个巨大 main 函数的测试用例，用来测试后端的性能
+局部变量和语句数量都和参数成正比，每条语句会产生若干个临时值
+用法
+python3 bench/gen_huge_function.py [语句数量] > huge_function.c
+"""
+
+import sys
+
+
+def generate(stmt_count: int) -> str:
+    var_count = max(stmt_count // 8, 1)
+    lines = ["int main() {"]
+    for i in range(var_count):
+        lines.append(f"  int v{i} = {i % 17};")
+    for s in range(stmt_count):
+        a = s % var_count
+        b = (s * 7 + 3) % var_count
+        c = (s * 13 + 5) % var_count
+        lines.append(f"  v{a} = v{b} + v{c} * {s % 5 + 1} - (v{a} / 3);")
+    lines.append(f"  return v{(stmt_count - 1) % var_count} % 256;")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    stmt_count = int(sys.argv[1]) if len(sys.argv) > 1 else 20000
+    sys.stdout.write(generate(stmt_count))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,63 @@
+"""
+生成用来测试词法分析速度的大文件
+包含缩进、单行注释、多行注释、各种进制的数字和运算符
+用法
+python3 bench/gen_lexer_input.py [大小(MB)] > lexer_input.c
+"""
+
+import random
+import sys
+
+
+def generate_function(rng: random.Random, index: int) -> str:
+    lines = [
+        "/*",
+        f" * function {index}",
+        " * 多行注释，测试注释跳过的速度",
+        " */",
+        f"int func_{index}(int a, int b[], int c) {{",
+    ]
+    for i in range(rng.randint(10, 30)):
+        kind = rng.randrange(5)
+        if kind == 0:
+            lines.append(f"    // 单行注释 {i}: a = a + b[{i}] * c")
+        if kind == 1:
+            lines.append(
+                f"    int value_{i} = {rng.randint(0, 99999)} + 0x{rng.randint(0, 0xFFFF):X} - 0{rng.randint(0, 0o777):o};"
+            )
+        elif kind == 2:
+            lines.append(f"    if (a <= {i} && c != b[{i}] || !a) {{")
+            lines.append(f"        a = a * {i} / (c + 1) % 7;")
+            lines.append("    } else {")
+            lines.append("        c = c - 1;")
+            lines.append("    }")
+        elif kind == 3:
+            lines.append(f"    while (c >= {i}) {{")
+            lines.append("        c = c - 2;          /* 行尾注释 */")
+            lines.append("        if (c == 3) break; else continue;")
+            lines.append("    }")
+        else:
+            lines.append(f"    b[{i}] = func_{max(index - 1, 0)}(a, b, c);")
+    lines.append("    return a + c;")
+    lines.append("}")
+    lines.append("")
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    size_mb = float(sys.argv[1]) if len(sys.argv) > 1 else 16
+    target = int(size_mb * 1024 * 1024)
+    rng = random.Random(42)
+    chunks = []
+    total = 0
+    index = 0
+    while total < target:
+        chunk = generate_function(rng, index)
+        chunks.append(chunk)
+        total += len(chunk.encode())
+        index += 1
+    sys.stdout.write("".join(chunks))
+
+
+if __name__ == "__main__":
+    main()
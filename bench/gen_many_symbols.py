@@ -0,0 +1,50 @@
+"""
+生成符号很多的测试用例，用来测试符号表的性能
+大量全局变量 + 深层嵌套的作用域，每个作用域里都会引用外层的符号
+用法
+python3 bench/gen_many_symbols.py [全局变量数量] [函数数量] > many_symbols.c
+"""
+
+import sys
+
+
+def generate(global_count: int, func_count: int) -> str:
+    lines = []
+    for i in range(global_count):
+        lines.append(f"int g{i} = {i % 100};")
+
+    for f in range(func_count):
+        lines.append(f"int f{f}(int x) {{")
+        lines.append("  int s = x;")
+        # 嵌套作用域，内层声明同名变量遮蔽外层
+        depth = 8
+        for d in range(depth):
+            indent = "  " * (d + 1)
+            lines.append(f"{indent}{{")
+            lines.append(f"{indent}  int s{d} = s;")
+            lines.append(f"{indent}  int x = s{d} + {d};")
+            for k in range(8):
+                g = (f * 131 + d * 17 + k * 7) % global_count
+                lines.append(f"{indent}  s = s + g{g} + x;")
+        for d in reversed(range(depth)):
+            lines.append("  " * (d + 1) + "}")
+        lines.append("  return s;")
+        lines.append("}")
+
+    lines.append("int main() {")
+    lines.append("  int sum = 0;")
+    for f in range(func_count):
+        lines.append(f"  sum = sum + f{f}({f});")
+    lines.append("  return sum;")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    global_count = int(sys.argv[1]) if len(sys.argv) > 1 else 20000
+    func_count = int(sys.argv[2]) if len(sys.argv) > 2 else 2000
+    sys.stdout.write(generate(global_count, func_count))
+
+
+if __name__ == "__main__":
+    main()
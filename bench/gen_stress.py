@@ -0,0 +1,104 @@
+"""
+生成压力测试用例，每种输入只放大编译器的一个方面，用来发现随输入规模超线性增长的路径
+类型
+  long_expr     一条有 size 个操作数的表达式
+  many_funcs    size 个小函数，每个调用前一个
+  deep_nesting  嵌套 size 层的语句块，每层声明变量并引用外层的变量
+  big_array     size 个元素的全局数组和局部数组初始化
+  many_globals  size 个全局变量，main 依次读写
+用法
+python3 bench/gen_stress.py <类型> <size> > stress.c
+"""
+
+import sys
+
+
+def long_expr(size: int) -> str:
+    ops = ["+", "-", "*", "+", "/", "-", "%", "+"]
+    lines = ["int main() {"]
+    for i in range(8):
+        lines.append(f"  int v{i} = getint() + {i + 1};")
+    terms = [f"v{i % 8}" if i % 3 else str(i % 97 + 1) for i in range(size)]
+    exp = terms[0]
+    for i in range(1, size):
+        exp += f" {ops[i % len(ops)]} {terms[i]}"
+    lines.append(f"  int r = {exp};")
+    lines.append("  return r % 256;")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+def many_funcs(size: int) -> str:
+    lines = ["int f0(int x) { return x + 1; }"]
+    for i in range(1, size):
+        lines.append(f"int f{i}(int x) {{")
+        lines.append(f"  int a = x * {i % 13 + 1};")
+        lines.append(f"  if (a > {i}) {{ a = a - {i}; }}")
+        lines.append(f"  return f{i - 1}(a) + {i % 7};")
+        lines.append("}")
+    lines.append(f"int main() {{ return f{size - 1}(getint()) % 256; }}")
+    return "\n".join(lines) + "\n"
+
+
+def deep_nesting(size: int) -> str:
+    lines = ["int main() {", "  int s = getint();"]
+    # 不缩进，输入大小和层数成正比
+    for d in range(size):
+        lines.append("{")
+        lines.append(f"int x{d} = s + {d % 11};")
+        # 引用最外层和上一层的变量，查找要跨过很多层作用域
+        outer = f"x{d - 1}" if d > 0 else "s"
+        lines.append(f"s = s + x{d} - {outer};")
+    lines.extend("}" * size)
+    lines.append("  return s % 256;")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+def big_array(size: int) -> str:
+    values = ", ".join(str(i % 1000) for i in range(size))
+    lines = [f"int g[{size}] = {{{values}}};"]
+    lines.append("int main() {")
+    lines.append(f"  int a[{size}] = {{{values}}};")
+    lines.append("  int i = 0;")
+    lines.append("  int s = 0;")
+    lines.append(f"  while (i < {size}) {{")
+    lines.append("    s = s + a[i] - g[i] + i;")
+    lines.append("    i = i + 1;")
+    lines.append("  }")
+    lines.append("  return s % 256;")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+def many_globals(size: int) -> str:
+    lines = [f"int g{i} = {i % 100};" for i in range(size)]
+    lines.append("int main() {")
+    lines.append("  int s = 0;")
+    for i in range(size):
+        lines.append(f"  s = s + g{i};")
+        lines.append(f"  g{(i * 7) % size} = s;")
+    lines.append("  return s % 256;")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+generators = {
+    "long_expr": long_expr,
+    "many_funcs": many_funcs,
+    "deep_nesting": deep_nesting,
+    "big_array": big_array,
+    "many_globals": many_globals,
+}
+
+
+def main():
+    if len(sys.argv) != 3 or sys.argv[1] not in generators:
+        kinds = "|".join(generators)
+        sys.stderr.write(f"usage: {sys.argv[0]} <{kinds}> <size>\n")
+        sys.exit(1)
+    sys.stdout.write(generators[sys.argv[1]](int(sys.argv[2])))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,55 @@
+// 矩阵乘法，n x n ，n 从输入读取（不超过 128）
+// 输出结果矩阵的校验和
+
+int a[128][128];
+int b[128][128];
+int c[128][128];
+
+int main() {
+  int n = getint();
+  int seed = 12345;
+  int i = 0;
+  while (i < n) {
+    int j = 0;
+    while (j < n) {
+      seed = (seed * 1103 + 12347) % 65536;
+      a[i][j] = seed % 100 - 50;
+      seed = (seed * 1103 + 12347) % 65536;
+      b[i][j] = seed % 100 - 50;
+      j = j + 1;
+    }
+    i = i + 1;
+  }
+
+  starttime();
+  i = 0;
+  while (i < n) {
+    int j = 0;
+    while (j < n) {
+      int sum = 0;
+      int k = 0;
+      while (k < n) {
+        sum = sum + a[i][k] * b[k][j];
+        k = k + 1;
+      }
+      c[i][j] = sum;
+      j = j + 1;
+    }
+    i = i + 1;
+  }
+  stoptime();
+
+  int checksum = 0;
+  i = 0;
+  while (i < n) {
+    int j = 0;
+    while (j < n) {
+      checksum = (checksum * 31 + c[i][j]) % 1000007;
+      j = j + 1;
+    }
+    i = i + 1;
+  }
+  putint(checksum);
+  putch(10);
+  return 0;
+}
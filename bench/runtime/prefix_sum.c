@@ -0,0 +1,42 @@
+// 前缀和：对 n 个数反复求前缀和再差分还原，n 从输入读取（不超过 100000）
+// 输出每轮前缀和的校验和
+
+int values[100000];
+int sums[100000];
+
+int main() {
+  int n = getint();
+  int seed = 7;
+  int i = 0;
+  while (i < n) {
+    seed = (seed * 1103 + 12347) % 65536;
+    values[i] = seed % 1000;
+    i = i + 1;
+  }
+
+  starttime();
+  int checksum = 0;
+  int round = 0;
+  while (round < 16) {
+    sums[0] = values[0];
+    i = 1;
+    while (i < n) {
+      sums[i] = (sums[i - 1] + values[i]) % 1000007;
+      i = i + 1;
+    }
+    checksum = (checksum * 31 + sums[n - 1]) % 1000007;
+    // 差分得到下一轮的输入
+    values[0] = (sums[0] + round) % 1000;
+    i = 1;
+    while (i < n) {
+      values[i] = (sums[i] - sums[i - 1] + 1000007 + round) % 1000;
+      i = i + 1;
+    }
+    round = round + 1;
+  }
+  stoptime();
+
+  putint(checksum);
+  putch(10);
+  return 0;
+}
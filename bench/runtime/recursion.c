@@ -0,0 +1,32 @@
+// 递归：朴素的 fib 和 Ackermann 函数，调用开销占主要部分
+// n 从输入读取，计算 fib(n) 和 ack(2, n)
+
+int fib(int n) {
+  if (n < 2) {
+    return n;
+  }
+  return fib(n - 1) + fib(n - 2);
+}
+
+int ack(int m, int n) {
+  if (m == 0) {
+    return n + 1;
+  }
+  if (n == 0) {
+    return ack(m - 1, 1);
+  }
+  return ack(m - 1, ack(m, n - 1));
+}
+
+int main() {
+  int n = getint();
+  starttime();
+  int f = fib(n);
+  int a = ack(2, n);
+  stoptime();
+  putint(f);
+  putch(32);
+  putint(a);
+  putch(10);
+  return 0;
+}
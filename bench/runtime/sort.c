@@ -0,0 +1,87 @@
+// 排序：同一组随机数分别用快速排序和插入排序（前 n / 16 个）排好
+// n 从输入读取（不超过 100000），输出校验和
+
+int data[100000];
+int work[100000];
+
+void quick_sort(int arr[], int low, int high) {
+  if (low >= high) {
+    return;
+  }
+  int pivot = arr[(low + high) / 2];
+  int i = low;
+  int j = high;
+  while (i <= j) {
+    while (arr[i] < pivot) {
+      i = i + 1;
+    }
+    while (arr[j] > pivot) {
+      j = j - 1;
+    }
+    if (i <= j) {
+      int t = arr[i];
+      arr[i] = arr[j];
+      arr[j] = t;
+      i = i + 1;
+      j = j - 1;
+    }
+  }
+  quick_sort(arr, low, j);
+  quick_sort(arr, i, high);
+}
+
+void insertion_sort(int arr[], int n) {
+  int i = 1;
+  while (i < n) {
+    int key = arr[i];
+    int j = i - 1;
+    while (j >= 0 && arr[j] > key) {
+      arr[j + 1] = arr[j];
+      j = j - 1;
+    }
+    arr[j + 1] = key;
+    i = i + 1;
+  }
+}
+
+int checksum(int arr[], int n) {
+  int sum = 0;
+  int i = 0;
+  while (i < n) {
+    sum = (sum * 31 + arr[i]) % 1000007;
+    i = i + 1;
+  }
+  return sum;
+}
+
+int main() {
+  int n = getint();
+  int seed = 2024;
+  int i = 0;
+  while (i < n) {
+    seed = (seed * 1103 + 12347) % 65536;
+    data[i] = seed;
+    i = i + 1;
+  }
+
+  starttime();
+  i = 0;
+  while (i < n) {
+    work[i] = data[i];
+    i = i + 1;
+  }
+  quick_sort(work, 0, n - 1);
+  int result = checksum(work, n);
+  i = 0;
+  while (i < n) {
+    work[i] = data[i];
+    i = i + 1;
+  }
+  insertion_sort(work, n / 16);
+  result = (result + checksum(work, n / 16)) % 1000007;
+  stoptime();
+
+  putint(result);
+  putch(10);
+  return 0;
+}
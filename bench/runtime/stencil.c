@@ -0,0 +1,58 @@
+// 二维五点模板（Jacobi 迭代），n x n 网格，n 从输入读取（不超过 256）
+// 迭代 10 次，输出网格的校验和
+
+int grid[256][256];
+int next[256][256];
+
+int main() {
+  int n = getint();
+  int i = 0;
+  while (i < n) {
+    int j = 0;
+    while (j < n) {
+      grid[i][j] = (i * 37 + j * 101) % 1000;
+      j = j + 1;
+    }
+    i = i + 1;
+  }
+
+  starttime();
+  int step = 0;
+  while (step < 10) {
+    i = 1;
+    while (i < n - 1) {
+      int j = 1;
+      while (j < n - 1) {
+        next[i][j] = (grid[i][j] * 4 + grid[i - 1][j] + grid[i + 1][j] +
+                      grid[i][j - 1] + grid[i][j + 1]) / 8;
+        j = j + 1;
+      }
+      i = i + 1;
+    }
+    i = 1;
+    while (i < n - 1) {
+      int j = 1;
+      while (j < n - 1) {
+        grid[i][j] = next[i][j];
+        j = j + 1;
+      }
+      i = i + 1;
+    }
+    step = step + 1;
+  }
+  stoptime();
+
+  int checksum = 0;
+  i = 0;
+  while (i < n) {
+    int j = 0;
+    while (j < n) {
+      checksum = (checksum * 31 + grid[i][j]) % 1000007;
+      j = j + 1;
+    }
+    i = i + 1;
+  }
+  putint(checksum);
+  putch(10);
+  return 0;
+}
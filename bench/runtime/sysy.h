@@ -0,0 +1,9 @@
+// 用 clang 把 SysY 程序当作 C 编译时加上的声明（-include），实现在 libsysy 中
+int getint(void);
+int getch(void);
+int getarray(int a[]);
+void putint(int n);
+void putch(int c);
+void putarray(int n, int a[]);
+void starttime(void);
+void stoptime(void);
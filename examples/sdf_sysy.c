@@ -674,8 +674,8 @@ void loop(int ts[]) {
   putch(74); // 'J'
   i = 0;
   while (i < 1620) {
-    i = i + 1;
     putch(frame_chars[i]);
+    i = i + 1;
   }
 }
 
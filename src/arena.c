@@ -0,0 +1,158 @@
+#include "arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+// 每次向系统申请的最小块大小
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGN 8
+
+typedef struct ArenaBlock {
+  ArenaBlock *next;
+  size_t size;
+  size_t offset;
+  // 保证 data 按 ARENA_ALIGN 对齐
+  _Alignas(ARENA_ALIGN) char data[];
+} ArenaBlock;
+
+static size_t align_up(size_t n) {
+  return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+void arena_init(Arena *arena) {
+  arena->head = NULL;
+  arena->used = 0;
+  arena->peak = 0;
+  arena->reserved = 0;
+}
+
+static ArenaBlock *arena_new_block(Arena *arena, size_t min_size) {
+  size_t size = ARENA_BLOCK_SIZE;
+  if (min_size > size) {
+    size = min_size;
+  }
+  ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+  if (block == NULL) {
+    fatalf("无法分配内存\n");
+  }
+  block->size = size;
+  block->offset = 0;
+  block->next = arena->head;
+  arena->head = block;
+  arena->reserved += sizeof(ArenaBlock) + size;
+  return block;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+  size = align_up(size);
+  ArenaBlock *block = arena->head;
+  if (block == NULL || block->size - block->offset < size) {
+    block = arena_new_block(arena, size);
+  }
+  void *ptr = block->data + block->offset;
+  block->offset += size;
+  arena->used += size;
+  if (arena->used > arena->peak) {
+    arena->peak = arena->used;
+  }
+  return ptr;
+}
+
+void *arena_calloc(Arena *arena, size_t count, size_t size) {
+  if (size != 0 && count > SIZE_MAX / size) {
+    fatalf("分配大小溢出: %zu * %zu\n", count, size);
+  }
+  void *ptr = arena_alloc(arena, count * size);
+  memset(ptr, 0, count * size);
+  return ptr;
+}
+
+void *arena_realloc(Arena *arena, void *ptr, size_t old_size,
+                    size_t new_size) {
+  if (ptr == NULL) {
+    return arena_alloc(arena, new_size);
+  }
+  old_size = align_up(old_size);
+  new_size = align_up(new_size);
+  if (new_size <= old_size) {
+    return ptr;
+  }
+  ArenaBlock *block = arena->head;
+  // ptr 是当前块最后一次分配的内存，并且剩余空间足够，直接原地扩容
+  if ((char *)ptr + old_size == block->data + block->offset &&
+      block->size - block->offset >= new_size - old_size) {
+    block->offset += new_size - old_size;
+    arena->used += new_size - old_size;
+    if (arena->used > arena->peak) {
+      arena->peak = arena->used;
+    }
+    return ptr;
+  }
+  void *new_ptr = arena_alloc(arena, new_size);
+  memcpy(new_ptr, ptr, old_size);
+  return new_ptr;
+}
+
+char *arena_strndup(Arena *arena, const char *str, size_t len) {
+  char *s = arena_alloc(arena, len + 1);
+  memcpy(s, str, len);
+  s[len] = '\0';
+  return s;
+}
+
+void arena_absorb(Arena *arena, Arena *other) {
+  ArenaBlock *first = other->head;
+  if (first == NULL) {
+    return;
+  }
+  ArenaBlock *last = first;
+  while (last->next != NULL) {
+    last = last->next;
+  }
+  // 接在 head 后面，head 依然是当前正在切分的块
+  if (arena->head == NULL) {
+    arena->head = first;
+  } else {
+    last->next = arena->head->next;
+    arena->head->next = first;
+  }
+  arena->used += other->used;
+  arena->reserved += other->reserved;
+  if (arena->used > arena->peak) {
+    arena->peak = arena->used;
+  }
+  other->head = NULL;
+  other->used = 0;
+  other->reserved = 0;
+}
+
+void arena_reset(Arena *arena) {
+  ArenaBlock *block = arena->head;
+  if (block == NULL) {
+    return;
+  }
+  while (block->next != NULL) {
+    ArenaBlock *next = block->next;
+    arena->reserved -= sizeof(ArenaBlock) + block->size;
+    free(block);
+    block = next;
+  }
+  block->offset = 0;
+  arena->head = block;
+  arena->used = 0;
+}
+
+void arena_release(Arena *arena) {
+  ArenaBlock *block = arena->head;
+  while (block) {
+    ArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->head = NULL;
+  arena->used = 0;
+  arena->reserved = 0;
+}
@@ -0,0 +1,52 @@
+#ifndef SRC_ARENA_H_
+#define SRC_ARENA_H_
+
+#include <stddef.h>
+
+typedef struct ArenaBlock ArenaBlock;
+
+/**
+ * @struct Arena
+ * @brief 线性（bump pointer）分配器
+ *
+ * 从大块内存中顺序切分小对象，不支持单独释放，
+ * 所有内存在 arena_release 时一次性归还。
+ * AST 节点数量很多且生命周期一致，适合用它来分配。
+ *
+ * @var Arena::head
+ * 当前正在切分的内存块，之前的块通过 next 串起来
+ *
+ * @var Arena::used
+ * 已经分配出去的字节数
+ *
+ * @var Arena::peak
+ * used 的历史最大值（arena_release 之后依然保留）
+ *
+ * @var Arena::reserved
+ * 向系统申请的内存块总字节数
+ */
+typedef struct Arena {
+  ArenaBlock *head;
+  size_t used;
+  size_t peak;
+  size_t reserved;
+} Arena;
+
+void arena_init(Arena *arena);
+// 分配 size 字节，按 8 字节对齐，内容未初始化
+void *arena_alloc(Arena *arena, size_t size);
+// 分配 count * size 字节，内容清零
+void *arena_calloc(Arena *arena, size_t count, size_t size);
+// 扩容 ptr（之前大小为 old_size），ptr 是最后一次分配时原地扩容
+void *arena_realloc(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+char *arena_strndup(Arena *arena, const char *str, size_t len);
+// 把 other 的所有内存块转交给 arena ，之后由 arena 一起释放，other 变为空
+// 用来把其他线程的分配结果并入同一个 arena
+void arena_absorb(Arena *arena, Arena *other);
+// 丢弃所有分配，只保留最早的一个内存块给之后的分配复用
+// 用于反复分配又整体丢弃的场景，比如逐个函数编译
+void arena_reset(Arena *arena);
+// 归还所有内存块，arena 可以继续使用
+void arena_release(Arena *arena);
+
+#endif // SRC_ARENA_H_
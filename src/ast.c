@@ -1,15 +1,24 @@
 #include "ast.h"
+#include "arena.h"
 #include "utils.h"
 
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+// 所有 AST 节点都从调用方传入的 arena 分配，由调用方统一释放
+static void *ast_calloc(Arena *arena, size_t count, size_t size) {
+  return arena_calloc(arena, count, size);
+}
+
 const char *ast_type_to_string(AstType type) {
   switch (type) {
   case AST_NUMBER:
     return "number";
   case AST_ARRAY_VALUE:
     return "array_value";
+  case AST_ARRAY_INIT:
+    return "array_init";
   case AST_UNARY_EXP:
     return "unary_exp";
   case AST_BINARY_EXP:
@@ -107,17 +116,19 @@ const char *binary_op_type_to_string(BinaryOpType type) {
   return "";
 }
 
-void init_exp_array(ExpArray *array) {
+void init_exp_array(Arena *arena, ExpArray *array) {
   array->count = 0;
   array->capacity = 10;
-  array->elements = calloc(array->capacity, sizeof(AstExp *));
+  array->elements = ast_calloc(arena, array->capacity, sizeof(AstExp *));
 }
 
-void exp_array_add(ExpArray *array, AstExp *element) {
+void exp_array_add(Arena *arena, ExpArray *array, AstExp *element) {
   if (array->count >= array->capacity) {
+    int old_capacity = array->capacity;
     array->capacity *= 2;
-    array->elements =
-        realloc(array->elements, array->capacity * sizeof(AstExp *));
+    array->elements = arena_realloc(arena, array->elements,
+                                    old_capacity * sizeof(AstExp *),
+                                    array->capacity * sizeof(AstExp *));
   }
   array->elements[array->count++] = element;
 }
@@ -126,8 +137,8 @@ void ast_number_dump(AstNumber *node, int indent) {
   printf("%d", node->number);
 }
 
-AstNumber *new_ast_number() {
-  AstNumber *node = calloc(1, sizeof(AstNumber));
+AstNumber *new_ast_number(Arena *arena) {
+  AstNumber *node = ast_calloc(arena, 1, sizeof(AstNumber));
   node->base.type = AST_NUMBER;
   node->base.dump = (DumpFunc)ast_number_dump;
   node->number = 0;
@@ -144,41 +155,73 @@ void ast_array_value_dump(AstArrayValue *node, int indent) {
   printf("%*s}", indent, " ");
 }
 
-AstArrayValue *new_ast_array_value() {
-  AstArrayValue *node = calloc(1, sizeof(AstArrayValue));
+AstArrayValue *new_ast_array_value(Arena *arena) {
+  AstArrayValue *node = ast_calloc(arena, 1, sizeof(AstArrayValue));
   node->base.type = AST_ARRAY_VALUE;
   node->base.dump = (DumpFunc)ast_array_value_dump;
   node->count = 0;
   node->capacity = 10;
-  node->elements = calloc(node->capacity, sizeof(AstExp *));
-  return node;
-}
-
-AstArrayValue *new_ast_array_value2(int count, int capacity) {
-  AstArrayValue *node = calloc(1, sizeof(AstArrayValue));
-  node->base.type = AST_ARRAY_VALUE;
-  node->base.dump = (DumpFunc)ast_array_value_dump;
-  node->count = count;
-  node->capacity = capacity;
-  node->elements = calloc(node->capacity, sizeof(AstExp *));
+  node->elements = ast_calloc(arena, node->capacity, sizeof(AstExp *));
   return node;
 }
 
-void ast_array_value_add(AstArrayValue *array_value, AstExp *element) {
+void ast_array_value_add(Arena *arena, AstArrayValue *array_value,
+                         AstExp *element) {
   if (array_value->count >= array_value->capacity) {
+    int old_capacity = array_value->capacity;
     array_value->capacity *= 2;
-    array_value->elements = realloc(array_value->elements,
-                                    array_value->capacity * sizeof(AstExp *));
+    array_value->elements =
+        arena_realloc(arena, array_value->elements,
+                      old_capacity * sizeof(AstExp *),
+                      array_value->capacity * sizeof(AstExp *));
   }
   array_value->elements[array_value->count++] = element;
 }
 
+void ast_array_init_dump(AstArrayInit *node, int indent) {
+  printf("ArrayInit[%d]: {\n", node->total_count);
+  for (int i = 0; i < node->count; i++) {
+    printf("%*s  [%d] = ", indent, " ", node->entries[i].index);
+    AstExp *value = node->entries[i].value;
+    value->dump((AstBase *)value, indent + 2);
+    printf(",\n");
+  }
+  printf("%*s}", indent, " ");
+}
+
+AstArrayInit *new_ast_array_init(Arena *arena, int total_count) {
+  AstArrayInit *node = ast_calloc(arena, 1, sizeof(AstArrayInit));
+  node->base.type = AST_ARRAY_INIT;
+  node->base.dump = (DumpFunc)ast_array_init_dump;
+  node->total_count = total_count;
+  node->count = 0;
+  node->capacity = 10;
+  node->entries = ast_calloc(arena, node->capacity, sizeof(AstArrayInitEntry));
+  return node;
+}
+
+void ast_array_init_add(Arena *arena, AstArrayInit *init, int index,
+                        AstExp *value) {
+  assert(index < init->total_count);
+  assert(init->count == 0 || init->entries[init->count - 1].index < index);
+  if (init->count >= init->capacity) {
+    int old_capacity = init->capacity;
+    init->capacity *= 2;
+    init->entries = arena_realloc(arena, init->entries,
+                                  old_capacity * sizeof(AstArrayInitEntry),
+                                  init->capacity * sizeof(AstArrayInitEntry));
+  }
+  init->entries[init->count].index = index;
+  init->entries[init->count].value = value;
+  init->count++;
+}
+
 void ast_identifier_dump(AstIdentifier *node, int indent) {
   printf("%s", node->name);
 }
 
-AstIdentifier *new_ast_identifier() {
-  AstIdentifier *node = calloc(1, sizeof(AstIdentifier));
+AstIdentifier *new_ast_identifier(Arena *arena) {
+  AstIdentifier *node = ast_calloc(arena, 1, sizeof(AstIdentifier));
   node->base.type = AST_IDENTIFIER;
   node->base.dump = (DumpFunc)ast_identifier_dump;
   node->name = NULL;
@@ -199,12 +242,12 @@ void ast_array_access_dump(AstArrayAccess *node, int indent) {
   printf("%*s}", indent, " ");
 }
 
-AstArrayAccess *new_ast_array_access() {
-  AstArrayAccess *node = calloc(1, sizeof(AstArrayAccess));
+AstArrayAccess *new_ast_array_access(Arena *arena) {
+  AstArrayAccess *node = ast_calloc(arena, 1, sizeof(AstArrayAccess));
   node->base.type = AST_ARRAY_ACCESS;
   node->base.dump = (DumpFunc)ast_array_access_dump;
   node->name = NULL;
-  init_exp_array(&node->indexes);
+  init_exp_array(arena, &node->indexes);
   return node;
 }
 
@@ -217,8 +260,8 @@ void ast_unary_exp_dump(AstUnaryExp *node, int indent) {
   printf("%*s}", indent, " ");
 }
 
-AstUnaryExp *new_ast_unary_exp() {
-  AstUnaryExp *node = calloc(1, sizeof(AstUnaryExp));
+AstUnaryExp *new_ast_unary_exp(Arena *arena) {
+  AstUnaryExp *node = ast_calloc(arena, 1, sizeof(AstUnaryExp));
   node->base.type = AST_UNARY_EXP;
   node->base.dump = (DumpFunc)ast_unary_exp_dump;
   node->op = 0;
@@ -238,8 +281,8 @@ void ast_binary_exp_dump(AstBinaryExp *node, int indent) {
   printf("%*s}", indent, " ");
 }
 
-AstBinaryExp *new_ast_binary_exp() {
-  AstBinaryExp *node = calloc(1, sizeof(AstBinaryExp));
+AstBinaryExp *new_ast_binary_exp(Arena *arena) {
+  AstBinaryExp *node = ast_calloc(arena, 1, sizeof(AstBinaryExp));
   node->base.type = AST_BINARY_EXP;
   node->base.dump = (DumpFunc)ast_binary_exp_dump;
   node->op = 0;
@@ -259,22 +302,24 @@ void ast_call_exp_dump(AstFuncCall *node, int indent) {
   printf("%*s}", indent, " ");
 }
 
-AstFuncCall *new_ast_func_call() {
-  AstFuncCall *node = calloc(1, sizeof(AstFuncCall));
+AstFuncCall *new_ast_func_call(Arena *arena) {
+  AstFuncCall *node = ast_calloc(arena, 1, sizeof(AstFuncCall));
   node->base.type = AST_FUNC_CALL;
   node->base.dump = (DumpFunc)ast_call_exp_dump;
   node->ident = NULL;
   node->count = 0;
   node->capacity = 10;
-  node->args = calloc(node->capacity, sizeof(AstExp *));
+  node->args = ast_calloc(arena, node->capacity, sizeof(AstExp *));
   return node;
 }
 
-void ast_func_call_add(AstFuncCall *func_call, AstExp *arg) {
+void ast_func_call_add(Arena *arena, AstFuncCall *func_call, AstExp *arg) {
   if (func_call->count >= func_call->capacity) {
+    int old_capacity = func_call->capacity;
     func_call->capacity *= 2;
-    func_call->args =
-        realloc(func_call->args, func_call->capacity * sizeof(AstExp *));
+    func_call->args = arena_realloc(arena, func_call->args,
+                                    old_capacity * sizeof(AstExp *),
+                                    func_call->capacity * sizeof(AstExp *));
   }
   func_call->args[func_call->count++] = arg;
 }
@@ -283,8 +328,8 @@ void ast_break_stmt_dump(AstBreakStmt *node, int indent) {
   printf("BreakStmt");
 }
 
-AstBreakStmt *new_ast_break_stmt() {
-  AstBreakStmt *node = calloc(1, sizeof(AstBreakStmt));
+AstBreakStmt *new_ast_break_stmt(Arena *arena) {
+  AstBreakStmt *node = ast_calloc(arena, 1, sizeof(AstBreakStmt));
   node->base.type = AST_BREAK_STMT;
   node->base.dump = (DumpFunc)ast_break_stmt_dump;
   return node;
@@ -294,8 +339,8 @@ void ast_continue_stmt_dump(AstContinueStmt *node, int indent) {
   printf("ContinueStmt");
 }
 
-AstContinueStmt *new_ast_continue_stmt() {
-  AstContinueStmt *node = calloc(1, sizeof(AstContinueStmt));
+AstContinueStmt *new_ast_continue_stmt(Arena *arena) {
+  AstContinueStmt *node = ast_calloc(arena, 1, sizeof(AstContinueStmt));
   node->base.type = AST_CONTINUE_STMT;
   node->base.dump = (DumpFunc)ast_continue_stmt_dump;
   return node;
@@ -312,8 +357,8 @@ void ast_while_stmt_dump(AstWhileStmt *node, int indent) {
   printf("%*s}", indent, " ");
 }
 
-AstWhileStmt *new_ast_while_stmt() {
-  AstWhileStmt *node = calloc(1, sizeof(AstWhileStmt));
+AstWhileStmt *new_ast_while_stmt(Arena *arena) {
+  AstWhileStmt *node = ast_calloc(arena, 1, sizeof(AstWhileStmt));
   node->base.type = AST_WHILE_STMT;
   node->base.dump = (DumpFunc)ast_while_stmt_dump;
   node->condition = NULL;
@@ -337,8 +382,8 @@ void ast_if_stmt_dump(AstIfStmt *node, int indent) {
   printf("%*s}", indent, " ");
 }
 
-AstIfStmt *new_ast_if_stmt() {
-  AstIfStmt *node = calloc(1, sizeof(AstIfStmt));
+AstIfStmt *new_ast_if_stmt(Arena *arena) {
+  AstIfStmt *node = ast_calloc(arena, 1, sizeof(AstIfStmt));
   node->base.type = AST_IF_STMT;
   node->base.dump = (DumpFunc)ast_if_stmt_dump;
   node->condition = NULL;
@@ -351,8 +396,8 @@ void ast_empty_stmt_dump(AstEmptyStmt *node, int indent) {
   printf("EmptyStmt");
 }
 
-AstEmptyStmt *new_ast_empty_stmt() {
-  AstEmptyStmt *node = calloc(1, sizeof(AstEmptyStmt));
+AstEmptyStmt *new_ast_empty_stmt(Arena *arena) {
+  AstEmptyStmt *node = ast_calloc(arena, 1, sizeof(AstEmptyStmt));
   node->base.type = AST_EMPTY_STMT;
   node->base.dump = (DumpFunc)ast_empty_stmt_dump;
   return node;
@@ -366,8 +411,8 @@ void ast_exp_stmt_dump(AstExpStmt *node, int indent) {
   printf("%*s}", indent, " ");
 }
 
-AstExpStmt *new_ast_exp_stmt() {
-  AstExpStmt *node = calloc(1, sizeof(AstExpStmt));
+AstExpStmt *new_ast_exp_stmt(Arena *arena) {
+  AstExpStmt *node = ast_calloc(arena, 1, sizeof(AstExpStmt));
   node->base.type = AST_EXP_STMT;
   node->base.dump = (DumpFunc)ast_exp_stmt_dump;
   node->exp = NULL;
@@ -384,8 +429,8 @@ void ast_return_stmt_dump(AstReturnStmt *node, int indent) {
   printf("%*s}", indent, " ");
 }
 
-AstReturnStmt *new_ast_return_stmt() {
-  AstReturnStmt *node = calloc(1, sizeof(AstReturnStmt));
+AstReturnStmt *new_ast_return_stmt(Arena *arena) {
+  AstReturnStmt *node = ast_calloc(arena, 1, sizeof(AstReturnStmt));
   node->base.type = AST_RETURN_STMT;
   node->base.dump = (DumpFunc)ast_return_stmt_dump;
   node->exp = NULL;
@@ -403,8 +448,8 @@ void ast_assign_stmt_dump(AstAssignStmt *node, int indent) {
   printf("%*s}", indent, indent > 0 ? " " : "");
 }
 
-AstAssignStmt *new_ast_assign_stmt() {
-  AstAssignStmt *node = calloc(1, sizeof(AstAssignStmt));
+AstAssignStmt *new_ast_assign_stmt(Arena *arena) {
+  AstAssignStmt *node = ast_calloc(arena, 1, sizeof(AstAssignStmt));
   node->base.type = AST_ASSIGN_STMT;
   node->base.dump = (DumpFunc)ast_assign_stmt_dump;
   node->lhs = NULL;
@@ -423,11 +468,11 @@ void ast_const_decl_dump(AstConstDecl *node, int indent) {
   printf("%*s}", indent, " ");
 }
 
-AstConstDecl *new_ast_const_decl() {
-  AstConstDecl *node = calloc(1, sizeof(AstConstDecl));
+AstConstDecl *new_ast_const_decl(Arena *arena) {
+  AstConstDecl *node = ast_calloc(arena, 1, sizeof(AstConstDecl));
   node->base.type = AST_CONST_DECL;
   node->base.dump = (DumpFunc)ast_const_decl_dump;
-  init_var_def_array(&node->defs);
+  init_var_def_array(arena, &node->defs);
   return node;
 }
 
@@ -456,27 +501,29 @@ void ast_var_def_dump(AstVarDef *node, int indent) {
   printf("%*s}", indent, " ");
 }
 
-AstVarDef *new_ast_var_def() {
-  AstVarDef *node = calloc(1, sizeof(AstVarDef));
+AstVarDef *new_ast_var_def(Arena *arena) {
+  AstVarDef *node = ast_calloc(arena, 1, sizeof(AstVarDef));
   node->base.type = AST_VAR_DEF;
   node->base.dump = (DumpFunc)ast_var_def_dump;
   node->name = NULL;
   node->val = NULL;
-  init_exp_array(&node->dimensions);
+  init_exp_array(arena, &node->dimensions);
   return node;
 }
 
-void init_var_def_array(VarDefArray *array) {
+void init_var_def_array(Arena *arena, VarDefArray *array) {
   array->count = 0;
   array->capacity = 10;
-  array->elements = calloc(array->capacity, sizeof(AstVarDef *));
+  array->elements = ast_calloc(arena, array->capacity, sizeof(AstVarDef *));
 }
 
-void var_def_array_add(VarDefArray *array, AstVarDef *element) {
+void var_def_array_add(Arena *arena, VarDefArray *array, AstVarDef *element) {
   if (array->count >= array->capacity) {
+    int old_capacity = array->capacity;
     array->capacity *= 2;
-    array->elements =
-        realloc(array->elements, array->capacity * sizeof(AstVarDef *));
+    array->elements = arena_realloc(arena, array->elements,
+                                    old_capacity * sizeof(AstVarDef *),
+                                    array->capacity * sizeof(AstVarDef *));
   }
   array->elements[array->count++] = element;
 }
@@ -492,12 +539,12 @@ void ast_var_decl_dump(AstVarDecl *node, int indent) {
   printf("%*s}", indent, " ");
 }
 
-AstVarDecl *new_ast_var_decl() {
-  AstVarDecl *node = calloc(1, sizeof(AstVarDecl));
+AstVarDecl *new_ast_var_decl(Arena *arena) {
+  AstVarDecl *node = ast_calloc(arena, 1, sizeof(AstVarDecl));
   node->base.type = AST_VAR_DECL;
   node->base.dump = (DumpFunc)ast_var_decl_dump;
   node->type = BType_UNKNOWN;
-  init_var_def_array(&node->defs);
+  init_var_def_array(arena, &node->defs);
   return node;
 }
 
@@ -513,8 +560,8 @@ void ast_block_dump(AstBlock *node, int indent) {
   printf("%*s}", indent, " ");
 }
 
-AstBlock *new_ast_block() {
-  AstBlock *node = calloc(1, sizeof(AstBlock));
+AstBlock *new_ast_block(Arena *arena) {
+  AstBlock *node = ast_calloc(arena, 1, sizeof(AstBlock));
   node->base.type = AST_BLOCK;
   node->base.dump = (DumpFunc)ast_block_dump;
   node->stmt = NULL;
@@ -547,8 +594,17 @@ void ast_func_def_dump(AstFuncDef *node, int indent) {
   printf("%*s}", indent, " ");
 }
 
-AstFuncDef *new_ast_func_def() {
-  AstFuncDef *node = calloc(1, sizeof(AstFuncDef));
+FuncParam *new_func_param(Arena *arena) {
+  FuncParam *param = ast_calloc(arena, 1, sizeof(FuncParam));
+  param->type = BType_UNKNOWN;
+  param->ident = NULL;
+  param->next = NULL;
+  init_exp_array(arena, &param->dimensions);
+  return param;
+}
+
+AstFuncDef *new_ast_func_def(Arena *arena) {
+  AstFuncDef *node = ast_calloc(arena, 1, sizeof(AstFuncDef));
   node->base.type = AST_FUNC_DEF;
   node->base.dump = (DumpFunc)ast_func_def_dump;
   node->func_type = BType_UNKNOWN;
@@ -559,6 +615,16 @@ AstFuncDef *new_ast_func_def() {
   return node;
 }
 
+void ast_func_def_set_idents(Arena *arena, AstFuncDef *node,
+                             const char **idents,
+                             int count) {
+  node->idents = ast_calloc(arena, count + 1, sizeof(const char *));
+  for (int i = 0; i < count; i++) {
+    node->idents[i] = idents[i];
+  }
+  node->ident_count = count;
+}
+
 void ast_comp_unit_dump(AstCompUnit *node, int indent) {
   printf("%*sCompUnit: {\n", indent, indent > 0 ? " " : "");
   for (int i = 0; i < node->count; i++) {
@@ -569,20 +635,22 @@ void ast_comp_unit_dump(AstCompUnit *node, int indent) {
   printf("%*s}", indent, " ");
 }
 
-AstCompUnit *new_ast_comp_unit() {
-  AstCompUnit *node = calloc(1, sizeof(AstCompUnit));
+AstCompUnit *new_ast_comp_unit(Arena *arena) {
+  AstCompUnit *node = ast_calloc(arena, 1, sizeof(AstCompUnit));
   node->base.type = AST_COMP_UNIT;
   node->base.dump = (DumpFunc)ast_comp_unit_dump;
   node->count = 0;
   node->capacity = 10;
-  node->defs = calloc(node->capacity, sizeof(AstBase *));
+  node->defs = ast_calloc(arena, node->capacity, sizeof(AstBase *));
   return node;
 }
-void ast_comp_unit_add(AstCompUnit *comp_unit, AstBase *node) {
+void ast_comp_unit_add(Arena *arena, AstCompUnit *comp_unit, AstBase *node) {
   if (comp_unit->count >= comp_unit->capacity) {
+    int old_capacity = comp_unit->capacity;
     comp_unit->capacity *= 2;
-    comp_unit->defs =
-        realloc(comp_unit->defs, comp_unit->capacity * sizeof(AstBase *));
+    comp_unit->defs = arena_realloc(arena, comp_unit->defs,
+                                    old_capacity * sizeof(AstBase *),
+                                    comp_unit->capacity * sizeof(AstBase *));
   }
   comp_unit->defs[comp_unit->count++] = node;
 }
\ No newline at end of file
@@ -3,9 +3,15 @@
 
 #include <stdbool.h>
 
+#include "arena.h"
+#include "cache.h"
+
+// new_ast_* 和往节点中添加元素的函数都从传入的 arena 分配
+
 typedef enum {
   AST_NUMBER,
   AST_ARRAY_VALUE,
+  AST_ARRAY_INIT,
   AST_UNARY_EXP,
   AST_BINARY_EXP,
   AST_FUNC_CALL,
@@ -75,14 +81,14 @@ typedef struct {
   int count;
   int capacity;
 } ExpArray;
-void init_exp_array(ExpArray *array);
-void exp_array_add(ExpArray *array, AstExp *element);
+void init_exp_array(Arena *arena, ExpArray *array);
+void exp_array_add(Arena *arena, ExpArray *array, AstExp *element);
 
 typedef struct {
   AstExp base;
   int number;
 } AstNumber;
-AstNumber *new_ast_number();
+AstNumber *new_ast_number(Arena *arena);
 
 typedef struct {
   AstExp base;
@@ -90,29 +96,58 @@ typedef struct {
   int count;
   int capacity;
 } AstArrayValue;
-AstArrayValue *new_ast_array_value();
-AstArrayValue *new_ast_array_value2(int count, int capacity);
-void ast_array_value_add(AstArrayValue *array_value, AstExp *element);
+AstArrayValue *new_ast_array_value(Arena *arena);
+void ast_array_value_add(Arena *arena, AstArrayValue *array_value,
+                         AstExp *element);
+
+typedef struct {
+  int index; // 展开成一维之后的下标
+  AstExp *value;
+} AstArrayInitEntry;
+
+/**
+ * @brief 展开之后的数组初始值，只记录不是常量 0 的元素
+ *
+ * 没有记录的下标都是 0 。int a[4000000] = {1}; 只有一个元素，
+ * 内存和处理时间都和数组大小无关。
+ *
+ * @var AstArrayInit::total_count
+ * 数组元素的总数
+ *
+ * @var AstArrayInit::entries
+ * 按下标递增排列
+ */
+typedef struct {
+  AstExp base;
+  int total_count;
+  AstArrayInitEntry *entries;
+  int count;
+  int capacity;
+} AstArrayInit;
+AstArrayInit *new_ast_array_init(Arena *arena, int total_count);
+// index 必须大于之前加入的下标
+void ast_array_init_add(Arena *arena, AstArrayInit *init, int index,
+                        AstExp *value);
 
 typedef struct {
   AstExp base;
   const char *name;
 } AstIdentifier;
-AstIdentifier *new_ast_identifier();
+AstIdentifier *new_ast_identifier(Arena *arena);
 
 typedef struct {
   AstExp base;
   const char *name;
   ExpArray indexes;
 } AstArrayAccess;
-AstArrayAccess *new_ast_array_access();
+AstArrayAccess *new_ast_array_access(Arena *arena);
 
 typedef struct AstUnaryExp {
   AstExp base;
   char op;
   AstExp *operand;
 } AstUnaryExp;
-AstUnaryExp *new_ast_unary_exp();
+AstUnaryExp *new_ast_unary_exp(Arena *arena);
 
 typedef struct AstBinaryExp {
   AstExp base;
@@ -120,7 +155,7 @@ typedef struct AstBinaryExp {
   AstExp *lhs;
   AstExp *rhs;
 } AstBinaryExp;
-AstBinaryExp *new_ast_binary_exp();
+AstBinaryExp *new_ast_binary_exp(Arena *arena);
 
 typedef struct {
   AstBase base;
@@ -129,8 +164,8 @@ typedef struct {
   int count;
   int capacity;
 } AstFuncCall;
-AstFuncCall *new_ast_func_call();
-void ast_func_call_add(AstFuncCall *func_call, AstExp *arg);
+AstFuncCall *new_ast_func_call(Arena *arena);
+void ast_func_call_add(Arena *arena, AstFuncCall *func_call, AstExp *arg);
 
 typedef struct AstStmt AstStmt;
 typedef struct AstStmt {
@@ -142,19 +177,19 @@ typedef struct AstStmt {
 typedef struct {
   AstStmt base;
 } AstBreakStmt;
-AstBreakStmt *new_ast_break_stmt();
+AstBreakStmt *new_ast_break_stmt(Arena *arena);
 
 typedef struct {
   AstStmt base;
 } AstContinueStmt;
-AstContinueStmt *new_ast_continue_stmt();
+AstContinueStmt *new_ast_continue_stmt(Arena *arena);
 
 typedef struct {
   AstStmt base;
   AstExp *condition;
   AstStmt *body;
 } AstWhileStmt;
-AstWhileStmt *new_ast_while_stmt();
+AstWhileStmt *new_ast_while_stmt(Arena *arena);
 
 typedef struct {
   AstStmt base;
@@ -162,31 +197,31 @@ typedef struct {
   AstStmt *then;
   AstStmt *else_;
 } AstIfStmt;
-AstIfStmt *new_ast_if_stmt();
+AstIfStmt *new_ast_if_stmt(Arena *arena);
 
 typedef struct {
   AstStmt base;
 } AstEmptyStmt;
-AstEmptyStmt *new_ast_empty_stmt();
+AstEmptyStmt *new_ast_empty_stmt(Arena *arena);
 
 typedef struct {
   AstStmt base;
   AstExp *exp;
 } AstExpStmt;
-AstExpStmt *new_ast_exp_stmt();
+AstExpStmt *new_ast_exp_stmt(Arena *arena);
 
 typedef struct {
   AstStmt base;
   AstExp *exp;
 } AstReturnStmt;
-AstReturnStmt *new_ast_return_stmt();
+AstReturnStmt *new_ast_return_stmt(Arena *arena);
 
 typedef struct {
   AstStmt base;
   AstExp *lhs;
   AstExp *exp;
 } AstAssignStmt;
-AstAssignStmt *new_ast_assign_stmt();
+AstAssignStmt *new_ast_assign_stmt(Arena *arena);
 
 typedef struct AstVarDef AstVarDef;
 typedef struct AstVarDef {
@@ -195,35 +230,35 @@ typedef struct AstVarDef {
   ExpArray dimensions;
   AstExp *val;
 } AstVarDef;
-AstVarDef *new_ast_var_def();
+AstVarDef *new_ast_var_def(Arena *arena);
 
 typedef struct {
   AstVarDef **elements;
   int count;
   int capacity;
 } VarDefArray;
-void init_var_def_array(VarDefArray *array);
-void var_def_array_add(VarDefArray *array, AstVarDef *def);
+void init_var_def_array(Arena *arena, VarDefArray *array);
+void var_def_array_add(Arena *arena, VarDefArray *array, AstVarDef *def);
 
 typedef struct {
   AstStmt base;
   BType type;
   VarDefArray defs;
 } AstConstDecl;
-AstConstDecl *new_ast_const_decl();
+AstConstDecl *new_ast_const_decl(Arena *arena);
 
 typedef struct {
   AstStmt base;
   BType type;
   VarDefArray defs;
 } AstVarDecl;
-AstVarDecl *new_ast_var_decl();
+AstVarDecl *new_ast_var_decl(Arena *arena);
 
 typedef struct {
   AstStmt base;
   AstStmt *stmt;
 } AstBlock;
-AstBlock *new_ast_block();
+AstBlock *new_ast_block(Arena *arena);
 
 typedef struct FuncParam FuncParam;
 typedef struct FuncParam {
@@ -232,6 +267,7 @@ typedef struct FuncParam {
   ExpArray dimensions;
   FuncParam *next;
 } FuncParam;
+FuncParam *new_func_param(Arena *arena);
 
 typedef struct {
   AstBase base;
@@ -240,8 +276,17 @@ typedef struct {
   AstBlock *block;
   FuncParam *params;
   int param_count;
+  // 开启缓存时由 parse 填写：整个函数定义的 token 序列的键，
+  // 以及函数里出现过的标识符（驻留字符串，去重）
+  CacheKey token_key;
+  const char **idents;
+  int ident_count;
 } AstFuncDef;
-AstFuncDef *new_ast_func_def();
+AstFuncDef *new_ast_func_def(Arena *arena);
+// 把 idents 复制到 AST 的 arena 中
+void ast_func_def_set_idents(Arena *arena, AstFuncDef *node,
+                             const char **idents,
+                             int count);
 
 typedef struct {
   AstBase base;
@@ -249,7 +294,7 @@ typedef struct {
   int count;
   int capacity;
 } AstCompUnit;
-AstCompUnit *new_ast_comp_unit();
-void ast_comp_unit_add(AstCompUnit *comp_unit, AstBase *node);
+AstCompUnit *new_ast_comp_unit(Arena *arena);
+void ast_comp_unit_add(Arena *arena, AstCompUnit *comp_unit, AstBase *node);
 
 #endif // SRC_AST_H_
\ No newline at end of file
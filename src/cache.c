@@ -0,0 +1,239 @@
+#include "cache.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 缓存内容的格式变化时修改，旧的结果不会再被命中
+#define CACHE_FORMAT_VERSION 1
+
+static const char *const kind_names[CACHE_KIND_COUNT] = {"koopa", "perf"};
+static const char *const kind_extensions[CACHE_KIND_COUNT] = {"koopa", "S"};
+
+// #region 键
+
+#define FNV_PRIME 0x100000001b3ull
+
+void cache_key_init(CacheKey *key) {
+  key->high = 0x6c62272e07bb0142ull;
+  key->low = 0xcbf29ce484222325ull;
+}
+
+void cache_key_update(CacheKey *key, const void *data, size_t length) {
+  const unsigned char *bytes = data;
+  uint64_t high = key->high;
+  uint64_t low = key->low;
+  for (size_t i = 0; i < length; i++) {
+    high = (high ^ bytes[i]) * FNV_PRIME;
+    low = (low ^ bytes[i]) * FNV_PRIME;
+  }
+  key->high = high;
+  key->low = low;
+}
+
+void cache_key_update_int(CacheKey *key, long long value) {
+  cache_key_update(key, &value, sizeof(value));
+}
+
+void cache_key_update_str(CacheKey *key, const char *str) {
+  cache_key_update(key, str, strlen(str) + 1);
+}
+
+// 加上结果的种类和编译器的信息
+static CacheKey finish_key(Cache *cache, CacheKey key, CacheKind kind) {
+  cache_key_update_int(&key, CACHE_FORMAT_VERSION);
+  cache_key_update_str(&key, kind_names[kind]);
+  cache_key_update_int(&key, (long long)cache->build.high);
+  cache_key_update_int(&key, (long long)cache->build.low);
+  return key;
+}
+
+// 只改了某一个源文件时增量构建出的可执行文件也不同，
+// 用它的内容而不是构建时间区分编译器的版本
+static void hash_compiler(CacheKey *key) {
+  cache_key_init(key);
+  FILE *file = fopen("/proc/self/exe", "rb");
+  if (file == NULL) {
+    fprintf(stderr, "无法读取编译器的可执行文件，不能使用 -cache\n");
+    exit(1);
+  }
+  char chunk[65536];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    cache_key_update(key, chunk, n);
+  }
+  if (ferror(file)) {
+    fprintf(stderr, "无法读取编译器的可执行文件，不能使用 -cache\n");
+    exit(1);
+  }
+  fclose(file);
+}
+
+// #endregion
+
+// #region 缓存目录
+
+void cache_init(Cache *cache, const char *dir) {
+  if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+    fprintf(stderr, "无法创建缓存目录 %s\n", dir);
+    exit(1);
+  }
+  cache->dir = strdup(dir);
+  hash_compiler(&cache->build);
+  for (int i = 0; i < CACHE_KIND_COUNT; i++) {
+    atomic_init(&cache->hits[i], 0);
+    atomic_init(&cache->misses[i], 0);
+  }
+}
+
+void cache_free(Cache *cache) {
+  free(cache->dir);
+  cache->dir = NULL;
+}
+
+// dir/<键>.<扩展名>
+static char *entry_path(Cache *cache, CacheKey key, CacheKind kind) {
+  size_t size = strlen(cache->dir) + 48;
+  char *path = malloc(size);
+  if (path == NULL) {
+    fatalf("无法分配内存\n");
+  }
+  snprintf(path, size, "%s/%016llx%016llx.%s", cache->dir,
+           (unsigned long long)key.high, (unsigned long long)key.low,
+           kind_extensions[kind]);
+  return path;
+}
+
+bool cache_load(Cache *cache, CacheKey key, CacheKind kind,
+                StringBuffer *output) {
+  char *path = entry_path(cache, finish_key(cache, key, kind), kind);
+  FILE *file = fopen(path, "rb");
+  free(path);
+  if (file == NULL) {
+    atomic_fetch_add(&cache->misses[kind], 1);
+    return false;
+  }
+  size_t size = output->size;
+  char chunk[8192];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    string_buffer_append(output, chunk, n);
+  }
+  bool ok = !ferror(file);
+  fclose(file);
+  if (!ok) {
+    // 读到一半失败，当作没有命中，去掉已经追加的部分
+    output->size = size;
+    if (output->data != NULL) {
+      output->data[size] = '\0';
+    }
+    atomic_fetch_add(&cache->misses[kind], 1);
+    return false;
+  }
+  atomic_fetch_add(&cache->hits[kind], 1);
+  return true;
+}
+
+// 写入失败只是少缓存一个结果，不影响编译
+void cache_store(Cache *cache, CacheKey key, CacheKind kind,
+                 const char *data, size_t length) {
+  char *path = entry_path(cache, finish_key(cache, key, kind), kind);
+  size_t size = strlen(cache->dir) + 16;
+  char *temp_path = malloc(size);
+  if (temp_path == NULL) {
+    fatalf("无法分配内存\n");
+  }
+  snprintf(temp_path, size, "%s/tmp.XXXXXX", cache->dir);
+  int fd = mkstemp(temp_path);
+  if (fd < 0) {
+    warnf("无法写入缓存目录 %s\n", cache->dir);
+    free(temp_path);
+    free(path);
+    return;
+  }
+  FILE *file = fdopen(fd, "wb");
+  bool ok = file != NULL && fwrite(data, 1, length, file) == length;
+  if (file != NULL) {
+    ok = fclose(file) == 0 && ok;
+  } else {
+    close(fd);
+  }
+  // 其他读者只会看到完整的文件
+  if (!ok || rename(temp_path, path) != 0) {
+    unlink(temp_path);
+  }
+  free(temp_path);
+  free(path);
+}
+
+void cache_report(Cache *cache, FILE *file) {
+  for (int i = 0; i < CACHE_KIND_COUNT; i++) {
+    int hits = atomic_load(&cache->hits[i]);
+    int misses = atomic_load(&cache->misses[i]);
+    if (hits + misses == 0) {
+      continue;
+    }
+    fprintf(file, "缓存 %s: 命中 %d, 未命中 %d, 命中率 %.1f%%\n",
+            kind_names[i], hits, misses, 100.0 * hits / (hits + misses));
+  }
+}
+
+// #endregion
+
+// #region 函数名到键的映射
+
+void cache_key_map_init(CacheKeyMap *map) {
+  pthread_mutex_init(&map->mutex, NULL);
+  intern_pool_init(&map->names);
+  value_map_init(&map->indexes);
+  map->count = 0;
+  map->capacity = 64;
+  map->keys = malloc(sizeof(CacheKey) * map->capacity);
+  if (map->keys == NULL) {
+    fatalf("无法分配内存\n");
+  }
+}
+
+void cache_key_map_free(CacheKeyMap *map) {
+  pthread_mutex_destroy(&map->mutex);
+  intern_pool_free(&map->names);
+  value_map_free(&map->indexes);
+  free(map->keys);
+  map->keys = NULL;
+}
+
+void cache_key_map_put(CacheKeyMap *map, const char *name, CacheKey key) {
+  pthread_mutex_lock(&map->mutex);
+  const char *interned = intern_cstr(&map->names, name);
+  int index;
+  if (!value_map_get(&map->indexes, interned, &index)) {
+    if (map->count == map->capacity) {
+      map->capacity *= 2;
+      map->keys = realloc(map->keys, sizeof(CacheKey) * map->capacity);
+      if (map->keys == NULL) {
+        fatalf("无法分配内存\n");
+      }
+    }
+    index = map->count++;
+    value_map_put(&map->indexes, interned, index);
+  }
+  map->keys[index] = key;
+  pthread_mutex_unlock(&map->mutex);
+}
+
+bool cache_key_map_get(CacheKeyMap *map, const char *name, CacheKey *key) {
+  pthread_mutex_lock(&map->mutex);
+  const char *interned = intern_find(&map->names, name, strlen(name));
+  int index;
+  bool found =
+      interned != NULL && value_map_get(&map->indexes, interned, &index);
+  if (found) {
+    *key = map->keys[index];
+  }
+  pthread_mutex_unlock(&map->mutex);
+  return found;
+}
+
+// #endregion
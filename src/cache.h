@@ -0,0 +1,100 @@
+#ifndef SRC_CACHE_H_
+#define SRC_CACHE_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "intern.h"
+#include "utils.h"
+#include "value_map.h"
+
+/*
+ * 按函数缓存编译结果，命中时直接使用之前生成的 Koopa IR 和汇编
+ *
+ * 缓存的键由这几部分计算得到：
+ * - 函数定义的 token 序列（空白和注释不影响）
+ * - 函数里出现的每个标识符对应的全局符号：IR 中的名字、类型、常量值、
+ *   数组维度和函数签名
+ * - 缓存格式的版本和编译器可执行文件内容的哈希，
+ *   任何源文件改动后重新构建，旧的结果都不会再被命中
+ * 汇编的键在 IR 的键上再加上后端的名字。
+ *
+ * 每个结果保存为 dir/<32 位十六进制的键>.<koopa|S> 文件，
+ * 先写临时文件再 rename ，多个线程或进程可以同时读写同一个目录。
+ */
+
+// 128 位的键，两个不同初始值的 64 位 FNV-1a
+typedef struct CacheKey {
+  uint64_t high;
+  uint64_t low;
+} CacheKey;
+
+void cache_key_init(CacheKey *key);
+void cache_key_update(CacheKey *key, const void *data, size_t length);
+void cache_key_update_int(CacheKey *key, long long value);
+// 字符串连同结尾的 '\0' 一起计算，"ab" "c" 和 "a" "bc" 的结果不同
+void cache_key_update_str(CacheKey *key, const char *str);
+
+typedef enum {
+  CACHE_KOOPA, // 函数的 Koopa IR
+  CACHE_PERF,  // perf 后端生成的函数汇编
+  CACHE_KIND_COUNT,
+} CacheKind;
+
+/**
+ * @struct Cache
+ * @brief 磁盘上的缓存目录，所有编译任务共享一个，可以在多个线程中同时使用
+ *
+ * @var Cache::hits
+ * 每种结果命中的次数
+ *
+ * @var Cache::misses
+ * 每种结果没有命中的次数
+ *
+ * @var Cache::build
+ * 编译器可执行文件（/proc/self/exe）的哈希，加到每个键里
+ */
+typedef struct Cache {
+  char *dir;
+  atomic_int hits[CACHE_KIND_COUNT];
+  atomic_int misses[CACHE_KIND_COUNT];
+  CacheKey build;
+} Cache;
+
+// 目录不存在时创建，并计算编译器可执行文件的哈希
+void cache_init(Cache *cache, const char *dir);
+void cache_free(Cache *cache);
+// 查找 key 对应的 kind 结果，命中时把内容追加到 output 并返回 true
+// 同一个 key 的不同 kind 分别保存，命中和没有命中的次数也分别统计
+bool cache_load(Cache *cache, CacheKey key, CacheKind kind,
+                StringBuffer *output);
+void cache_store(Cache *cache, CacheKey key, CacheKind kind,
+                 const char *data, size_t length);
+void cache_report(Cache *cache, FILE *file);
+
+/**
+ * @struct CacheKeyMap
+ * @brief 一次编译中函数名到 IR 键的映射
+ *
+ * IR 生成时记录每个函数的键，后端按函数名查到键再去缓存里找汇编。
+ * 流式编译时两者在不同线程中，所以用互斥锁保护。
+ */
+typedef struct CacheKeyMap {
+  pthread_mutex_t mutex;
+  InternPool names; // 函数名（不含 @）
+  ValueMap indexes; // 驻留的函数名 -> keys 中的下标
+  CacheKey *keys;
+  int count;
+  int capacity;
+} CacheKeyMap;
+
+void cache_key_map_init(CacheKeyMap *map);
+void cache_key_map_free(CacheKeyMap *map);
+void cache_key_map_put(CacheKeyMap *map, const char *name, CacheKey key);
+bool cache_key_map_get(CacheKeyMap *map, const char *name, CacheKey *key);
+
+#endif // SRC_CACHE_H_
@@ -0,0 +1,114 @@
+#include "compile.h"
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ast.h"
+#include "ir.h"
+#include "ir_gen.h"
+#include "ir_lower.h"
+#include "koopa_ir.h"
+#include "parse.h"
+#include "pass.h"
+#include "riscv.h"
+#include "riscv_perf.h"
+#include "time_report.h"
+#include "utils.h"
+
+// #define DEBUG_LOG
+
+// 从 AST 生成 ir.h 中的 IR ，运行 pass 之后直接交给后端，不经过文本
+static void compile_native(CompileContext *ctx, CodegenTarget target,
+                           AstCompUnit *comp_unit, Emitter *output) {
+  IrModule module;
+  ir_module_init(&module);
+  // raw program 的内存
+  Arena raw_arena;
+  arena_init(&raw_arena);
+  // 和文本 IR 一样，出错时先释放，再跳回外层设置的位置
+  jmp_buf trap;
+  jmp_buf *outer = set_error_trap(NULL);
+  if (outer != NULL) {
+    set_error_trap(&trap);
+    if (setjmp(trap) != 0) {
+      arena_release(&raw_arena);
+      ir_module_free(&module);
+      set_error_trap(outer);
+      compile_error_exit();
+    }
+  }
+  ir_gen(ctx, comp_unit, &module);
+  if (ctx->verify_ir) {
+    ir_verify_module(&module);
+  }
+  ir_run_passes(&module, ctx->verify_ir);
+  if (target == CODEGEN_TARGET_KOOPA) {
+    ir_print_module(&module, output);
+  } else {
+    phase_begin(PHASE_KOOPA_BUILD);
+    koopa_raw_program_t raw = ir_lower(&module, &raw_arena);
+    phase_end(PHASE_KOOPA_BUILD);
+    if (target == CODEGEN_TARGET_RISCV) {
+      riscv_codegen_program(&raw, output);
+    } else {
+      riscv_perf_codegen_program(ctx, &raw, output);
+    }
+  }
+  set_error_trap(outer);
+  arena_release(&raw_arena);
+  ir_module_free(&module);
+}
+
+void compile_source(CompileContext *ctx, CodegenTarget target,
+                    const char *input, Emitter *output) {
+#ifdef DEBUG_LOG
+  printf("=== Input ===\n");
+  printf("%s\n", input);
+#endif
+  AstCompUnit *comp_unit = parse(ctx, input);
+#ifdef DEBUG_LOG
+  printf("=== AST dump ===\n");
+  comp_unit->base.dump((AstBase *)comp_unit, 0);
+#endif
+  if (ctx->native_ir) {
+    compile_native(ctx, target, comp_unit, output);
+    return;
+  }
+  // IR 只保存在内存中，直接交给后端，不再写文件读回来
+  StringBuffer ir;
+  string_buffer_init(&ir);
+  // 服务模式下出错时先释放 IR ，再跳回外层设置的位置
+  // 没有设置 trap 时出错直接退出进程，不用释放
+  jmp_buf trap;
+  jmp_buf *outer = set_error_trap(NULL);
+  if (outer != NULL) {
+    set_error_trap(&trap);
+    if (setjmp(trap) != 0) {
+      string_buffer_free(&ir);
+      set_error_trap(outer);
+      compile_error_exit();
+    }
+  }
+  koopa_ir_codegen(ctx, comp_unit, &ir);
+#ifdef DEBUG_LOG
+  printf("=== Koopa IR codegen result ===\n");
+  printf("%s\n", ir.data);
+#endif
+  switch (target) {
+  case CODEGEN_TARGET_RISCV:
+    riscv_codegen(ir.data, output);
+    break;
+  case CODEGEN_TARGET_PERF:
+    riscv_perf_codegen(ctx, ir.data, output);
+    break;
+  case CODEGEN_TARGET_KOOPA:
+    emit_bytes(output, ir.data, ir.size);
+    break;
+  default:
+    fprintf(stderr, "未指定目标\n");
+    exit(1);
+  }
+  set_error_trap(outer);
+  string_buffer_free(&ir);
+}
@@ -0,0 +1,18 @@
+#ifndef SRC_COMPILE_H_
+#define SRC_COMPILE_H_
+
+#include "context.h"
+#include "emit.h"
+
+typedef enum {
+  CODEGEN_TARGET_RISCV,
+  CODEGEN_TARGET_KOOPA,
+  CODEGEN_TARGET_PERF,
+} CodegenTarget;
+
+// 把源码 input 编译成 target 对应的 Koopa IR 或者汇编，写到 output 中
+// AST 节点和标识符全部分配在 ctx 中，由调用方释放
+void compile_source(CompileContext *ctx, CodegenTarget target,
+                    const char *input, Emitter *output);
+
+#endif // SRC_COMPILE_H_
@@ -0,0 +1,28 @@
+#include "context.h"
+
+#include "time_report.h"
+
+void compile_context_init(CompileContext *ctx) {
+  arena_init(&ctx->ast_arena);
+  intern_pool_init(&ctx->intern_pool);
+  ctx->threads = 1;
+  ctx->cache = NULL;
+  ctx->native_ir = false;
+  ctx->verify_ir = false;
+  ctx->input_file = NULL;
+  ctx->input_index = 0;
+}
+
+void compile_context_set_cache(CompileContext *ctx, Cache *cache) {
+  ctx->cache = cache;
+  cache_key_map_init(&ctx->function_keys);
+}
+
+void compile_context_free(CompileContext *ctx) {
+  time_report_arena(&ctx->ast_arena);
+  arena_release(&ctx->ast_arena);
+  intern_pool_free(&ctx->intern_pool);
+  if (ctx->cache != NULL) {
+    cache_key_map_free(&ctx->function_keys);
+  }
+}
@@ -0,0 +1,64 @@
+#ifndef SRC_CONTEXT_H_
+#define SRC_CONTEXT_H_
+
+#include <stdbool.h>
+
+#include "arena.h"
+#include "cache.h"
+#include "intern.h"
+
+/**
+ * @struct CompileContext
+ * @brief 一次编译（一个输入文件）用到的全部内存
+ *
+ * parse 、koopa_ir_codegen 和后端都通过它拿到 AST 与驻留字符串，
+ * 各个 pass 剩下的工作状态放在自己的结构体中（ KoopaGen 、RiscvGen 等），
+ * 由入口函数创建并显式传给每个函数，返回或出错跳出时释放。
+ * 所以不同线程各用一个 CompileContext 就可以同时编译不同的文件，
+ * 同一个线程也可以依次编译多个文件。
+ *
+ * @var CompileContext::ast_arena
+ * 所有 AST 节点都分配在这里
+ *
+ * @var CompileContext::intern_pool
+ * 标识符的驻留池，Symbol::name 等也指向这里
+ *
+ * @var CompileContext::threads
+ * 编译这个文件时最多使用的线程数，默认为 1
+ *
+ * @var CompileContext::cache
+ * 按函数缓存编译结果，NULL 表示不使用缓存，可以由多个 CompileContext 共享
+ *
+ * @var CompileContext::function_keys
+ * 设置了 cache 时，IR 生成记录每个函数的键，后端用它查找汇编
+ *
+ * @var CompileContext::native_ir
+ * 为 true 时使用 ir.h 中的 IR ，不生成 Koopa IR 文本，也不使用缓存
+ *
+ * @var CompileContext::verify_ir
+ * native_ir 时在生成 IR 和每个 pass 之后验证 IR
+ *
+ * @var CompileContext::input_file
+ * 输入文件名，-stats 用它区分不同文件的函数，没有文件名（服务模式）时为 NULL
+ *
+ * @var CompileContext::input_index
+ * 输入文件在命令行中的位置，-stats 按它排列不同文件的函数
+ */
+typedef struct CompileContext {
+  Arena ast_arena;
+  InternPool intern_pool;
+  int threads;
+  Cache *cache;
+  CacheKeyMap function_keys;
+  bool native_ir;
+  bool verify_ir;
+  const char *input_file;
+  int input_index;
+} CompileContext;
+
+void compile_context_init(CompileContext *ctx);
+void compile_context_set_cache(CompileContext *ctx, Cache *cache);
+// 释放之后 AST 和驻留字符串全部失效
+void compile_context_free(CompileContext *ctx);
+
+#endif // SRC_CONTEXT_H_
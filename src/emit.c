@@ -0,0 +1,228 @@
+#include "emit.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "source.h"
+#include "utils.h"
+
+// 缓冲区超过这个大小就写到文件
+#define EMIT_FLUSH_SIZE (1 << 20)
+
+void emitter_init(Emitter *emitter, StringBuffer *buffer) {
+  emitter->buffer = buffer;
+  emitter->file = NULL;
+}
+
+void emitter_open(Emitter *emitter, const char *filename) {
+  if (is_stdio_filename(filename)) {
+    emitter->file = stdout;
+  } else {
+    emitter->file = fopen(filename, "w");
+  }
+  if (emitter->file == NULL) {
+    fprintf(stderr, "无法打开文件 %s\n", filename);
+    compile_error_exit();
+  }
+  string_buffer_init(&emitter->file_buffer);
+  string_buffer_reserve(&emitter->file_buffer, EMIT_FLUSH_SIZE);
+  emitter->buffer = &emitter->file_buffer;
+}
+
+static void emitter_flush(Emitter *emitter) {
+  StringBuffer *buffer = emitter->buffer;
+  if (buffer->size == 0) {
+    return;
+  }
+  if (fwrite(buffer->data, 1, buffer->size, emitter->file) != buffer->size) {
+    fprintf(stderr, "写入文件失败\n");
+    compile_error_exit();
+  }
+  buffer->size = 0;
+  buffer->data[0] = '\0';
+}
+
+// 每次 emit 结束时检查，缓冲区足够大时整块写出
+static inline void emitter_maybe_flush(Emitter *emitter) {
+  if (emitter->file != NULL && emitter->buffer->size >= EMIT_FLUSH_SIZE) {
+    emitter_flush(emitter);
+  }
+}
+
+void emitter_close(Emitter *emitter) {
+  if (emitter->file == NULL) {
+    return;
+  }
+  emitter_flush(emitter);
+  if (emitter->file == stdout) {
+    fflush(stdout);
+  } else {
+    fclose(emitter->file);
+  }
+  emitter->file = NULL;
+  string_buffer_free(&emitter->file_buffer);
+  emitter->buffer = NULL;
+}
+
+// #region 直接写缓冲区，调用方负责结尾的 '\0'
+
+static inline void ensure(StringBuffer *buffer, size_t extra) {
+  if (buffer->size + extra >= buffer->capacity) {
+    string_buffer_reserve(buffer, extra);
+  }
+}
+
+static inline void put_bytes(StringBuffer *buffer, const char *str,
+                             size_t len) {
+  ensure(buffer, len);
+  memcpy(buffer->data + buffer->size, str, len);
+  buffer->size += len;
+}
+
+static inline void put_char(StringBuffer *buffer, char c) {
+  ensure(buffer, 1);
+  buffer->data[buffer->size++] = c;
+}
+
+static void put_unsigned(StringBuffer *buffer, unsigned long long value) {
+  char digits[24];
+  int n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+  ensure(buffer, n);
+  char *p = buffer->data + buffer->size;
+  for (int i = 0; i < n; i++) {
+    p[i] = digits[n - 1 - i];
+  }
+  buffer->size += n;
+}
+
+static void put_signed(StringBuffer *buffer, long long value) {
+  if (value < 0) {
+    put_char(buffer, '-');
+    // 先转成 unsigned 再取负，避免 LLONG_MIN 溢出
+    put_unsigned(buffer, -(unsigned long long)value);
+  } else {
+    put_unsigned(buffer, value);
+  }
+}
+
+static void put_pointer(StringBuffer *buffer, const void *ptr) {
+  // 和 glibc printf 的 %p 保持一致
+  if (ptr == NULL) {
+    put_bytes(buffer, "(nil)", 5);
+    return;
+  }
+  static const char hex[] = "0123456789abcdef";
+  uintptr_t value = (uintptr_t)ptr;
+  char digits[2 * sizeof(uintptr_t)];
+  int n = 0;
+  while (value != 0) {
+    digits[n++] = hex[value & 0xf];
+    value >>= 4;
+  }
+  put_bytes(buffer, "0x", 2);
+  ensure(buffer, n);
+  for (int i = 0; i < n; i++) {
+    buffer->data[buffer->size++] = digits[n - 1 - i];
+  }
+}
+
+static inline void put_end(StringBuffer *buffer) {
+  buffer->data[buffer->size] = '\0';
+}
+
+// #endregion
+
+void emit_char(Emitter *emitter, char c) {
+  put_char(emitter->buffer, c);
+  put_end(emitter->buffer);
+  emitter_maybe_flush(emitter);
+}
+
+void emit_str(Emitter *emitter, const char *str) {
+  put_bytes(emitter->buffer, str, strlen(str));
+  put_end(emitter->buffer);
+  emitter_maybe_flush(emitter);
+}
+
+void emit_bytes(Emitter *emitter, const char *data, size_t length) {
+  if (length == 0) {
+    return;
+  }
+  if (emitter->file != NULL && length >= EMIT_FLUSH_SIZE) {
+    // 大块内容不再拷贝到缓冲区，直接写到文件
+    emitter_flush(emitter);
+    if (fwrite(data, 1, length, emitter->file) != length) {
+      fprintf(stderr, "写入文件失败\n");
+      compile_error_exit();
+    }
+    return;
+  }
+  put_bytes(emitter->buffer, data, length);
+  put_end(emitter->buffer);
+  emitter_maybe_flush(emitter);
+}
+
+void emit_int(Emitter *emitter, long long value) {
+  put_signed(emitter->buffer, value);
+  put_end(emitter->buffer);
+  emitter_maybe_flush(emitter);
+}
+
+void emitter_vemitf(Emitter *emitter, const char *fmt, va_list args) {
+  StringBuffer *buffer = emitter->buffer;
+  const char *p = fmt;
+  while (*p) {
+    // 普通字符整段复制
+    const char *percent = strchr(p, '%');
+    if (percent == NULL) {
+      put_bytes(buffer, p, strlen(p));
+      break;
+    }
+    put_bytes(buffer, p, percent - p);
+    p = percent + 1;
+    switch (*p) {
+    case 'd':
+      put_signed(buffer, va_arg(args, int));
+      break;
+    case 's': {
+      const char *s = va_arg(args, const char *);
+      put_bytes(buffer, s, strlen(s));
+      break;
+    }
+    case 'c':
+      put_char(buffer, (char)va_arg(args, int));
+      break;
+    case 'p':
+      put_pointer(buffer, va_arg(args, void *));
+      break;
+    case '%':
+      put_char(buffer, '%');
+      break;
+    case 'z':
+      if (p[1] == 'u') {
+        p++;
+        put_unsigned(buffer, va_arg(args, size_t));
+        break;
+      }
+      fatalf("emitf 不支持的格式 %%z%c\n", p[1]);
+      break;
+    default:
+      fatalf("emitf 不支持的格式 %%%c\n", *p);
+    }
+    p++;
+  }
+  put_end(buffer);
+  emitter_maybe_flush(emitter);
+}
+
+void emitf(Emitter *emitter, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  emitter_vemitf(emitter, fmt, args);
+  va_end(args);
+}
@@ -0,0 +1,49 @@
+#ifndef SRC_EMIT_H_
+#define SRC_EMIT_H_
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "utils.h"
+
+/**
+ * @struct Emitter
+ * @brief 带缓冲区的文本输出
+ *
+ * 所有输出先追加到内存缓冲区，输出到文件时缓冲区超过阈值才整块写出，
+ * 避免每一行都调用一次 vfprintf 。
+ * 格式化由 emitf 自己实现，只支持代码生成用到的 %d %zu %s %c %p %% ，
+ * 不需要 printf 那套完整的格式解析。
+ *
+ * @var Emitter::buffer
+ * 输出缓冲区
+ *
+ * @var Emitter::file_buffer
+ * 输出到文件时使用的缓冲区，buffer 指向它
+ *
+ * @var Emitter::file
+ * 输出文件，NULL 表示所有内容保留在 buffer 中
+ */
+typedef struct Emitter {
+  StringBuffer *buffer;
+  StringBuffer file_buffer;
+  FILE *file;
+} Emitter;
+
+// 输出追加到 buffer 中，不写文件
+void emitter_init(Emitter *emitter, StringBuffer *buffer);
+// 输出写到 filename 文件中，filename 为 "-" 时写到标准输出
+void emitter_open(Emitter *emitter, const char *filename);
+// 写出缓冲区中剩余的内容，关闭文件
+void emitter_close(Emitter *emitter);
+
+void emit_char(Emitter *emitter, char c);
+void emit_str(Emitter *emitter, const char *str);
+// 输出 data 的前 length 个字节，例如另一个 Emitter 累积的内容
+void emit_bytes(Emitter *emitter, const char *data, size_t length);
+void emit_int(Emitter *emitter, long long value);
+void emitf(Emitter *emitter, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+void emitter_vemitf(Emitter *emitter, const char *fmt, va_list args);
+
+#endif // SRC_EMIT_H_
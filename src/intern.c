@@ -0,0 +1,132 @@
+#include "intern.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "utils.h"
+
+// 驻留字符串在内存中的布局，返回给调用方的是 data
+typedef struct InternString {
+  uint32_t hash;
+  int length;
+  char data[];
+} InternString;
+
+static uint32_t hash_string(const char *str, int length) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < length; i++) {
+    hash ^= (unsigned char)str[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static InternString *to_intern_string(const char *interned) {
+  return (InternString *)(interned - offsetof(InternString, data));
+}
+
+static void grow_pool(InternPool *pool) {
+  if (pool->slots == NULL) {
+    arena_init(&pool->arena);
+    pool->capacity = 1024;
+    pool->count = 0;
+    pool->slots = calloc(pool->capacity, sizeof(InternString *));
+    if (pool->slots == NULL) {
+      fatalf("无法分配内存\n");
+    }
+    return;
+  }
+  if ((pool->count + 1) * 4 <= pool->capacity * 3) {
+    return;
+  }
+  InternString **old_slots = pool->slots;
+  int old_capacity = pool->capacity;
+  pool->capacity *= 2;
+  pool->slots = calloc(pool->capacity, sizeof(InternString *));
+  if (pool->slots == NULL) {
+    fatalf("无法分配内存\n");
+  }
+  uint32_t mask = pool->capacity - 1;
+  for (int i = 0; i < old_capacity; i++) {
+    if (old_slots[i] == NULL) {
+      continue;
+    }
+    uint32_t j = old_slots[i]->hash & mask;
+    while (pool->slots[j] != NULL) {
+      j = (j + 1) & mask;
+    }
+    pool->slots[j] = old_slots[i];
+  }
+  free(old_slots);
+}
+
+void intern_pool_init(InternPool *pool) {
+  pool->slots = NULL;
+  pool->capacity = 0;
+  pool->count = 0;
+}
+
+// 返回 str 所在的槽位，不存在时返回应该插入的空槽位
+static InternString **find_slot(InternPool *pool, const char *str, int length,
+                                uint32_t hash) {
+  uint32_t mask = pool->capacity - 1;
+  uint32_t i = hash & mask;
+  while (pool->slots[i] != NULL) {
+    InternString *s = pool->slots[i];
+    if (s->hash == hash && s->length == length &&
+        memcmp(s->data, str, length) == 0) {
+      break;
+    }
+    i = (i + 1) & mask;
+  }
+  return &pool->slots[i];
+}
+
+const char *intern(InternPool *pool, const char *str, int length) {
+  grow_pool(pool);
+  uint32_t hash = hash_string(str, length);
+  InternString **slot = find_slot(pool, str, length, hash);
+  if (*slot != NULL) {
+    return (*slot)->data;
+  }
+  InternString *s =
+      arena_alloc(&pool->arena, sizeof(InternString) + length + 1);
+  s->hash = hash;
+  s->length = length;
+  memcpy(s->data, str, length);
+  s->data[length] = '\0';
+  *slot = s;
+  pool->count++;
+  return s->data;
+}
+
+const char *intern_find(InternPool *pool, const char *str, int length) {
+  if (pool->slots == NULL) {
+    return NULL;
+  }
+  InternString **slot =
+      find_slot(pool, str, length, hash_string(str, length));
+  return *slot == NULL ? NULL : (*slot)->data;
+}
+
+const char *intern_cstr(InternPool *pool, const char *str) {
+  return intern(pool, str, strlen(str));
+}
+
+uint32_t intern_hash(const char *interned) {
+  return to_intern_string(interned)->hash;
+}
+
+void intern_pool_free(InternPool *pool) {
+  if (pool->slots == NULL) {
+    return;
+  }
+  free(pool->slots);
+  pool->slots = NULL;
+  pool->capacity = 0;
+  pool->count = 0;
+  arena_release(&pool->arena);
+}
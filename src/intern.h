@@ -0,0 +1,35 @@
+#ifndef SRC_INTERN_H_
+#define SRC_INTERN_H_
+
+#include <stdint.h>
+
+#include "arena.h"
+
+/*
+ * 字符串驻留池
+ * 相同内容的字符串只保存一份，所以驻留字符串可以直接用指针比较是否相等
+ * 每个驻留字符串前面保存了预先计算好的哈希值，查哈希表时不需要重新计算
+ * 每个编译任务使用自己的驻留池，不同线程之间不共享
+ */
+
+typedef struct InternString InternString;
+
+typedef struct InternPool {
+  Arena arena;          // 字符串的存储空间
+  InternString **slots; // 开放寻址哈希表
+  int capacity;         // 总是 2 的幂
+  int count;
+} InternPool;
+
+void intern_pool_init(InternPool *pool);
+// 返回 str 前 length 个字符对应的驻留字符串（以 '\0' 结尾）
+const char *intern(InternPool *pool, const char *str, int length);
+const char *intern_cstr(InternPool *pool, const char *str);
+// 只查找不插入，str 还没有驻留时返回 NULL
+const char *intern_find(InternPool *pool, const char *str, int length);
+// 驻留字符串的哈希值，参数必须是 intern 返回的指针
+uint32_t intern_hash(const char *interned);
+// 释放驻留池，之前返回的指针全部失效
+void intern_pool_free(InternPool *pool);
+
+#endif // SRC_INTERN_H_
@@ -0,0 +1,578 @@
+#include "ir.h"
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+static IrType *new_type(IrModule *module, IrTypeTag tag) {
+  IrType *type = arena_calloc(&module->arena, 1, sizeof(IrType));
+  type->tag = tag;
+  return type;
+}
+
+void ir_module_init(IrModule *module) {
+  memset(module, 0, sizeof(IrModule));
+  arena_init(&module->arena);
+  module->i32 = new_type(module, IR_TYPE_I32);
+  module->unit = new_type(module, IR_TYPE_UNIT);
+}
+
+void ir_module_free(IrModule *module) {
+  free(module->globals);
+  free(module->funcs);
+  arena_release(&module->arena);
+  memset(module, 0, sizeof(IrModule));
+}
+
+const char *ir_strdup(IrModule *module, const char *str) {
+  return arena_strndup(&module->arena, str, strlen(str));
+}
+
+const char *ir_strf(IrModule *module, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int length = vsnprintf(NULL, 0, fmt, args);
+  va_end(args);
+  char *str = arena_alloc(&module->arena, length + 1);
+  va_start(args, fmt);
+  vsnprintf(str, length + 1, fmt, args);
+  va_end(args);
+  return str;
+}
+
+// 数组按 2 倍扩容
+static void *grow_array(void *data, int count, int *capacity, size_t size) {
+  if (count < *capacity) {
+    return data;
+  }
+  *capacity = *capacity == 0 ? 16 : *capacity * 2;
+  data = realloc(data, size * *capacity);
+  if (data == NULL) {
+    fatalf("无法分配内存\n");
+  }
+  return data;
+}
+
+// #region 类型
+
+IrType *ir_type_array(IrModule *module, IrType *base, int len) {
+  IrType *type = new_type(module, IR_TYPE_ARRAY);
+  type->base = base;
+  type->len = len;
+  return type;
+}
+
+IrType *ir_type_pointer(IrModule *module, IrType *base) {
+  if (base->pointer == NULL) {
+    base->pointer = new_type(module, IR_TYPE_POINTER);
+    base->pointer->base = base;
+  }
+  return base->pointer;
+}
+
+IrType *ir_type_function(IrModule *module, IrType **params, int param_count,
+                         IrType *ret) {
+  IrType *type = new_type(module, IR_TYPE_FUNCTION);
+  type->base = ret;
+  type->param_count = param_count;
+  type->params = arena_alloc(&module->arena, sizeof(IrType *) * param_count);
+  memcpy(type->params, params, sizeof(IrType *) * param_count);
+  return type;
+}
+
+bool ir_type_equal(const IrType *a, const IrType *b) {
+  if (a == b) {
+    return true;
+  }
+  if (a->tag != b->tag) {
+    return false;
+  }
+  switch (a->tag) {
+  case IR_TYPE_I32:
+  case IR_TYPE_UNIT:
+    return true;
+  case IR_TYPE_ARRAY:
+    return a->len == b->len && ir_type_equal(a->base, b->base);
+  case IR_TYPE_POINTER:
+    return ir_type_equal(a->base, b->base);
+  case IR_TYPE_FUNCTION:
+    if (a->param_count != b->param_count || !ir_type_equal(a->base, b->base)) {
+      return false;
+    }
+    for (int i = 0; i < a->param_count; i++) {
+      if (!ir_type_equal(a->params[i], b->params[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+int ir_type_size(const IrType *type) {
+  switch (type->tag) {
+  case IR_TYPE_I32:
+  case IR_TYPE_POINTER:
+    return 4;
+  case IR_TYPE_ARRAY:
+    return type->len * ir_type_size(type->base);
+  default:
+    fatalf("ir_type_size unknown type: %d\n", type->tag);
+    return -1;
+  }
+}
+
+// #endregion
+
+// #region 值
+
+static IrValue *new_value(IrModule *module, IrValueKind kind, IrType *type,
+                          int operand_count) {
+  IrValue *value = arena_calloc(&module->arena, 1, sizeof(IrValue));
+  value->kind = kind;
+  value->type = type;
+  value->operand_count = operand_count;
+  if (operand_count > 0) {
+    value->operands =
+        arena_calloc(&module->arena, operand_count, sizeof(IrUse));
+    for (int i = 0; i < operand_count; i++) {
+      value->operands[i].user = value;
+    }
+  }
+  return value;
+}
+
+void ir_use_set(IrUse *use, IrValue *value) {
+  if (use->value != NULL) {
+    if (use->prev != NULL) {
+      use->prev->next = use->next;
+    } else {
+      use->value->uses = use->next;
+    }
+    if (use->next != NULL) {
+      use->next->prev = use->prev;
+    }
+  }
+  use->value = value;
+  use->prev = NULL;
+  use->next = NULL;
+  if (value != NULL) {
+    use->next = value->uses;
+    if (value->uses != NULL) {
+      value->uses->prev = use;
+    }
+    value->uses = use;
+  }
+}
+
+IrValue *ir_integer(IrModule *module, int value) {
+  IrValue *integer = new_value(module, IR_INTEGER, module->i32, 0);
+  integer->data.integer = value;
+  return integer;
+}
+
+IrValue *ir_zero_init(IrModule *module, IrType *type) {
+  return new_value(module, IR_ZERO_INIT, type, 0);
+}
+
+IrValue *ir_undef(IrModule *module, IrType *type) {
+  return new_value(module, IR_UNDEF, type, 0);
+}
+
+IrValue *ir_aggregate(IrModule *module, IrType *type, IrValue **elems,
+                      int count) {
+  IrValue *aggregate = new_value(module, IR_AGGREGATE, type, count);
+  for (int i = 0; i < count; i++) {
+    ir_use_set(&aggregate->operands[i], elems[i]);
+  }
+  return aggregate;
+}
+
+IrValue *ir_global_alloc(IrModule *module, const char *name, IrType *type,
+                         IrValue *init) {
+  IrValue *global = new_value(module, IR_GLOBAL_ALLOC,
+                              ir_type_pointer(module, type), 1);
+  global->name = name;
+  ir_use_set(&global->operands[0], init);
+  module->globals = grow_array(module->globals, module->global_count,
+                               &module->global_capacity, sizeof(IrValue *));
+  module->globals[module->global_count++] = global;
+  return global;
+}
+
+// #endregion
+
+// #region 函数和基本块
+
+IrFunction *ir_function_new(IrModule *module, const char *name, IrType *type,
+                            const char **param_names) {
+  assert(type->tag == IR_TYPE_FUNCTION);
+  IrFunction *func = arena_calloc(&module->arena, 1, sizeof(IrFunction));
+  func->name = name;
+  func->type = type;
+  func->module = module;
+  func->param_count = type->param_count;
+  func->params =
+      arena_calloc(&module->arena, type->param_count, sizeof(IrValue *));
+  for (int i = 0; i < type->param_count; i++) {
+    IrValue *param = new_value(module, IR_FUNC_ARG, type->params[i], 0);
+    param->data.index = i;
+    param->name = param_names != NULL ? param_names[i] : NULL;
+    func->params[i] = param;
+  }
+  module->funcs = grow_array(module->funcs, module->func_count,
+                             &module->func_capacity, sizeof(IrFunction *));
+  module->funcs[module->func_count++] = func;
+  return func;
+}
+
+bool ir_function_is_decl(const IrFunction *func) { return func->first == NULL; }
+
+IrBlock *ir_block_new(IrFunction *func, const char *name) {
+  IrBlock *block = arena_calloc(&func->module->arena, 1, sizeof(IrBlock));
+  block->name = name;
+  block->func = func;
+  block->rpo = -1;
+  return block;
+}
+
+void ir_block_append(IrBlock *block) {
+  IrFunction *func = block->func;
+  block->prev = func->last;
+  block->next = NULL;
+  if (func->last != NULL) {
+    func->last->next = block;
+  } else {
+    func->first = block;
+  }
+  func->last = block;
+}
+
+IrValue *ir_block_add_param(IrBlock *block, IrType *type, const char *name) {
+  IrModule *module = block->func->module;
+  IrValue *param = new_value(module, IR_BLOCK_ARG, type, 0);
+  param->name = name;
+  param->block = block;
+  param->data.index = block->param_count;
+  if (block->param_count == block->param_capacity) {
+    // 参数数组分配在 arena 中，扩容时复制到新的位置
+    int capacity = block->param_capacity == 0 ? 4 : block->param_capacity * 2;
+    IrValue **params =
+        arena_alloc(&module->arena, sizeof(IrValue *) * capacity);
+    memcpy(params, block->params, sizeof(IrValue *) * block->param_count);
+    block->params = params;
+    block->param_capacity = capacity;
+  }
+  block->params[block->param_count++] = param;
+  return param;
+}
+
+void ir_block_remove_params(IrBlock *block, const bool *removed) {
+  int count = 0;
+  for (int i = 0; i < block->param_count; i++) {
+    IrValue *param = block->params[i];
+    if (removed[i]) {
+      assert(!ir_has_uses(param));
+      param->block = NULL;
+      continue;
+    }
+    param->data.index = count;
+    block->params[count++] = param;
+  }
+  block->param_count = count;
+}
+
+void ir_block_remove(IrBlock *block) {
+  while (block->last != NULL) {
+    ir_inst_remove(block->last);
+  }
+  for (int i = 0; i < block->param_count; i++) {
+    assert(!ir_has_uses(block->params[i]));
+  }
+  IrFunction *func = block->func;
+  if (block->prev != NULL) {
+    block->prev->next = block->next;
+  } else {
+    func->first = block->next;
+  }
+  if (block->next != NULL) {
+    block->next->prev = block->prev;
+  } else {
+    func->last = block->prev;
+  }
+  block->prev = NULL;
+  block->next = NULL;
+}
+
+bool ir_is_terminator(const IrValue *value) {
+  return value->kind == IR_BRANCH || value->kind == IR_JUMP ||
+         value->kind == IR_RETURN;
+}
+
+IrValue *ir_block_terminator(const IrBlock *block) {
+  if (block->last != NULL && ir_is_terminator(block->last)) {
+    return block->last;
+  }
+  return NULL;
+}
+
+int ir_successors(const IrValue *terminator, IrBlock *succs[2]) {
+  switch (terminator->kind) {
+  case IR_BRANCH:
+    succs[0] = terminator->data.branch.true_block;
+    succs[1] = terminator->data.branch.false_block;
+    return 2;
+  case IR_JUMP:
+    succs[0] = terminator->data.target;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+// #endregion
+
+// #region 指令
+
+static IrValue *append(IrBuilder *builder, IrValue *inst) {
+  IrBlock *block = builder->block;
+  assert(block != NULL && ir_block_terminator(block) == NULL);
+  inst->block = block;
+  inst->prev = block->last;
+  if (block->last != NULL) {
+    block->last->next = inst;
+  } else {
+    block->first = inst;
+  }
+  block->last = inst;
+  return inst;
+}
+
+IrValue *ir_alloc(IrBuilder *builder, IrType *type, const char *name) {
+  IrModule *module = builder->module;
+  IrValue *inst =
+      new_value(module, IR_ALLOC, ir_type_pointer(module, type), 0);
+  inst->name = name;
+  return append(builder, inst);
+}
+
+IrValue *ir_load(IrBuilder *builder, IrValue *src) {
+  assert(src->type->tag == IR_TYPE_POINTER);
+  IrValue *inst = new_value(builder->module, IR_LOAD, src->type->base, 1);
+  ir_use_set(&inst->operands[0], src);
+  return append(builder, inst);
+}
+
+IrValue *ir_store(IrBuilder *builder, IrValue *value, IrValue *dest) {
+  IrModule *module = builder->module;
+  IrValue *inst = new_value(module, IR_STORE, module->unit, 2);
+  ir_use_set(&inst->operands[0], value);
+  ir_use_set(&inst->operands[1], dest);
+  return append(builder, inst);
+}
+
+IrValue *ir_get_ptr(IrBuilder *builder, IrValue *src, IrValue *index) {
+  assert(src->type->tag == IR_TYPE_POINTER);
+  IrValue *inst = new_value(builder->module, IR_GET_PTR, src->type, 2);
+  ir_use_set(&inst->operands[0], src);
+  ir_use_set(&inst->operands[1], index);
+  return append(builder, inst);
+}
+
+IrValue *ir_get_elem_ptr(IrBuilder *builder, IrValue *src, IrValue *index) {
+  assert(src->type->tag == IR_TYPE_POINTER &&
+         src->type->base->tag == IR_TYPE_ARRAY);
+  IrModule *module = builder->module;
+  IrType *type = ir_type_pointer(module, src->type->base->base);
+  IrValue *inst = new_value(module, IR_GET_ELEM_PTR, type, 2);
+  ir_use_set(&inst->operands[0], src);
+  ir_use_set(&inst->operands[1], index);
+  return append(builder, inst);
+}
+
+IrValue *ir_binary(IrBuilder *builder, IrBinaryOp op, IrValue *lhs,
+                   IrValue *rhs) {
+  IrModule *module = builder->module;
+  IrValue *inst = new_value(module, IR_BINARY, module->i32, 2);
+  inst->data.op = op;
+  ir_use_set(&inst->operands[0], lhs);
+  ir_use_set(&inst->operands[1], rhs);
+  return append(builder, inst);
+}
+
+IrValue *ir_branch(IrBuilder *builder, IrValue *cond, IrBlock *true_block,
+                   IrBlock *false_block) {
+  IrModule *module = builder->module;
+  IrValue *inst = new_value(module, IR_BRANCH, module->unit, 1);
+  inst->data.branch.true_block = true_block;
+  inst->data.branch.false_block = false_block;
+  inst->data.branch.true_arg_count = 0;
+  ir_use_set(&inst->operands[0], cond);
+  return append(builder, inst);
+}
+
+IrValue *ir_jump(IrBuilder *builder, IrBlock *target) {
+  IrValue *inst = new_value(builder->module, IR_JUMP, builder->module->unit, 0);
+  inst->data.target = target;
+  return append(builder, inst);
+}
+
+IrValue *ir_call(IrBuilder *builder, IrFunction *callee, IrValue **args,
+                 int arg_count) {
+  IrValue *inst =
+      new_value(builder->module, IR_CALL, callee->type->base, arg_count);
+  inst->data.callee = callee;
+  for (int i = 0; i < arg_count; i++) {
+    ir_use_set(&inst->operands[i], args[i]);
+  }
+  return append(builder, inst);
+}
+
+IrValue *ir_return(IrBuilder *builder, IrValue *value) {
+  IrValue *inst = new_value(builder->module, IR_RETURN, builder->module->unit,
+                            value != NULL ? 1 : 0);
+  if (value != NULL) {
+    ir_use_set(&inst->operands[0], value);
+  }
+  return append(builder, inst);
+}
+
+// #endregion
+
+// #region 修改
+
+bool ir_has_side_effect(const IrValue *value) {
+  switch (value->kind) {
+  case IR_STORE:
+  case IR_CALL:
+  case IR_BRANCH:
+  case IR_JUMP:
+  case IR_RETURN:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool ir_has_uses(const IrValue *value) { return value->uses != NULL; }
+
+void ir_replace_all_uses(IrValue *value, IrValue *replacement) {
+  assert(value != replacement);
+  while (value->uses != NULL) {
+    ir_use_set(value->uses, replacement);
+  }
+}
+
+void ir_inst_remove(IrValue *inst) {
+  assert(!ir_has_uses(inst));
+  for (int i = 0; i < inst->operand_count; i++) {
+    ir_use_set(&inst->operands[i], NULL);
+  }
+  IrBlock *block = inst->block;
+  if (inst->prev != NULL) {
+    inst->prev->next = inst->next;
+  } else {
+    block->first = inst->next;
+  }
+  if (inst->next != NULL) {
+    inst->next->prev = inst->prev;
+  } else {
+    block->last = inst->prev;
+  }
+  inst->prev = NULL;
+  inst->next = NULL;
+  inst->block = NULL;
+}
+
+// 把操作数换成 values 中的 count 个值，旧的操作数不再使用
+static void reset_operands(IrValue *inst, IrValue **values, int count) {
+  for (int i = 0; i < inst->operand_count; i++) {
+    ir_use_set(&inst->operands[i], NULL);
+  }
+  IrModule *module = inst->block->func->module;
+  inst->operands = arena_calloc(&module->arena, count, sizeof(IrUse));
+  inst->operand_count = count;
+  for (int i = 0; i < count; i++) {
+    inst->operands[i].user = inst;
+    ir_use_set(&inst->operands[i], values[i]);
+  }
+}
+
+void ir_add_branch_args(IrValue *terminator, IrBlock *target,
+                        IrValue **args, int arg_count) {
+  int count = terminator->operand_count;
+  IrValue **values = malloc(sizeof(IrValue *) * (count + arg_count * 2));
+  int n = 0;
+  if (terminator->kind == IR_JUMP) {
+    assert(terminator->data.target == target);
+    for (int i = 0; i < count; i++) {
+      values[n++] = terminator->operands[i].value;
+    }
+    for (int i = 0; i < arg_count; i++) {
+      values[n++] = args[i];
+    }
+  } else {
+    assert(terminator->kind == IR_BRANCH);
+    int true_end = 1 + terminator->data.branch.true_arg_count;
+    for (int i = 0; i < true_end; i++) {
+      values[n++] = terminator->operands[i].value;
+    }
+    // 两个目标可能是同一个块，两条边都要加上实参
+    if (terminator->data.branch.true_block == target) {
+      for (int i = 0; i < arg_count; i++) {
+        values[n++] = args[i];
+      }
+      terminator->data.branch.true_arg_count += arg_count;
+    }
+    for (int i = true_end; i < count; i++) {
+      values[n++] = terminator->operands[i].value;
+    }
+    if (terminator->data.branch.false_block == target) {
+      for (int i = 0; i < arg_count; i++) {
+        values[n++] = args[i];
+      }
+    }
+  }
+  assert(n >= count);
+  reset_operands(terminator, values, n);
+  free(values);
+}
+
+void ir_remove_branch_args(IrValue *terminator, IrBlock *target,
+                           const bool *removed) {
+  int count = terminator->operand_count;
+  IrValue **values = malloc(sizeof(IrValue *) * (count + 1));
+  int n = 0;
+  if (terminator->kind == IR_JUMP) {
+    assert(terminator->data.target == target);
+    for (int i = 0; i < count; i++) {
+      if (!removed[i]) {
+        values[n++] = terminator->operands[i].value;
+      }
+    }
+  } else {
+    assert(terminator->kind == IR_BRANCH);
+    int true_end = 1 + terminator->data.branch.true_arg_count;
+    values[n++] = terminator->operands[0].value;
+    for (int i = 1; i < true_end; i++) {
+      if (terminator->data.branch.true_block != target || !removed[i - 1]) {
+        values[n++] = terminator->operands[i].value;
+      }
+    }
+    terminator->data.branch.true_arg_count = n - 1;
+    for (int i = true_end; i < count; i++) {
+      if (terminator->data.branch.false_block != target ||
+          !removed[i - true_end]) {
+        values[n++] = terminator->operands[i].value;
+      }
+    }
+  }
+  reset_operands(terminator, values, n);
+  free(values);
+}
+
+// #endregion
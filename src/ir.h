@@ -0,0 +1,303 @@
+#ifndef SRC_IR_H_
+#define SRC_IR_H_
+
+#include <stdbool.h>
+
+#include "arena.h"
+#include "emit.h"
+
+/*
+ * 编译器自己的 SSA IR ，指令和 Koopa IR 一一对应，但是可以修改
+ *
+ * ir_gen 直接从 AST 生成，经过 pass.h 中的分析和变换之后，
+ * ir_print 输出成 Koopa IR 文本（-koopa），或者由 ir_lower 转换成
+ * koopa_raw_program_t 交给 RISC-V 后端，不需要经过文本和 libkoopa 的解析。
+ *
+ * 每个值都记录了使用它的地方（IrUse 组成的链表），
+ * 替换一个值的所有使用、删除没有使用的指令都只需要常数时间。
+ * 基本块可以有参数（块参数），跳转到这个块的 jump 和 br 给出对应的实参，
+ * 相当于其他 SSA IR 中的 phi 。
+ * 类型、值、基本块和函数都分配在 IrModule::arena 中，和模块一起释放。
+ */
+
+typedef enum {
+  IR_TYPE_I32,
+  IR_TYPE_UNIT,
+  IR_TYPE_ARRAY,
+  IR_TYPE_POINTER,
+  IR_TYPE_FUNCTION,
+} IrTypeTag;
+
+typedef struct IrType IrType;
+struct IrType {
+  IrTypeTag tag;
+  IrType *base;    // 数组的元素类型、指针指向的类型、函数的返回类型
+  int len;         // 数组的长度
+  IrType **params; // 函数的参数类型
+  int param_count;
+  IrType *pointer; // 指向这个类型的指针类型，第一次用到时创建
+};
+
+// 和 koopa_raw_value_tag_t 的顺序相同
+typedef enum {
+  IR_INTEGER,
+  IR_ZERO_INIT,
+  IR_UNDEF,
+  IR_AGGREGATE,
+  IR_FUNC_ARG,
+  IR_BLOCK_ARG,
+  IR_ALLOC,
+  IR_GLOBAL_ALLOC,
+  IR_LOAD,
+  IR_STORE,
+  IR_GET_PTR,
+  IR_GET_ELEM_PTR,
+  IR_BINARY,
+  IR_BRANCH,
+  IR_JUMP,
+  IR_CALL,
+  IR_RETURN,
+} IrValueKind;
+
+typedef enum {
+  IR_OP_NE,
+  IR_OP_EQ,
+  IR_OP_GT,
+  IR_OP_LT,
+  IR_OP_GE,
+  IR_OP_LE,
+  IR_OP_ADD,
+  IR_OP_SUB,
+  IR_OP_MUL,
+  IR_OP_DIV,
+  IR_OP_MOD,
+  IR_OP_AND,
+  IR_OP_OR,
+  IR_OP_XOR,
+  IR_OP_SHL,
+  IR_OP_SHR,
+  IR_OP_SAR,
+} IrBinaryOp;
+
+typedef struct IrValue IrValue;
+typedef struct IrUse IrUse;
+typedef struct IrBlock IrBlock;
+typedef struct IrFunction IrFunction;
+typedef struct IrModule IrModule;
+
+// user 的一个操作数，同时是 value 的使用链表中的一项
+struct IrUse {
+  IrValue *value;
+  IrValue *user;
+  IrUse *prev;
+  IrUse *next;
+};
+
+/**
+ * @struct IrValue
+ * @brief 常量、参数、全局变量或者指令
+ *
+ * 操作数按固定的顺序排列：
+ *  - store: 值, 地址
+ *  - load: 地址
+ *  - get_ptr get_elem_ptr: 地址, 下标
+ *  - binary: lhs, rhs
+ *  - branch: 条件, 真分支的实参..., 假分支的实参...
+ *  - jump call: 实参...
+ *  - return: 返回值（没有返回值时没有操作数）
+ *  - aggregate: 元素...
+ *  - global_alloc: 初始值
+ *
+ * @var IrValue::name
+ * @x 或者 %x ，没有名字的值为 NULL ，打印时按顺序编号
+ *
+ * @var IrValue::uses
+ * 使用这个值的地方
+ *
+ * @var IrValue::block
+ * 指令和块参数所在的基本块，其他值为 NULL
+ *
+ * @var IrValue::id
+ * 分析和打印时使用的临时编号
+ */
+struct IrValue {
+  IrValueKind kind;
+  IrType *type;
+  const char *name;
+  IrUse *uses;
+  IrUse *operands;
+  int operand_count;
+  IrBlock *block;
+  IrValue *prev; // 基本块中的前一条指令
+  IrValue *next;
+  union {
+    int integer;
+    int index; // 函数参数和块参数的序号
+    IrBinaryOp op;
+    struct {
+      IrBlock *true_block;
+      IrBlock *false_block;
+      int true_arg_count;
+    } branch;
+    IrBlock *target; // jump
+    IrFunction *callee;
+  } data;
+  int id;
+};
+
+/**
+ * @struct IrBlock
+ * @brief 基本块，最后一条指令是 branch jump 或者 return
+ *
+ * preds 之后的字段是分析的结果，由 pass.h 中的分析计算，
+ * IrFunction::valid_analyses 记录它们当前是否有效。
+ */
+struct IrBlock {
+  const char *name; // %entry
+  IrFunction *func;
+  IrValue **params;
+  int param_count;
+  int param_capacity;
+  IrValue *first;
+  IrValue *last;
+  IrBlock *prev;
+  IrBlock *next;
+  int id; // ir_lower 使用的临时编号
+
+  IrBlock **preds; // 前驱，同一个前驱只出现一次
+  int pred_count;
+  int rpo;       // 逆后序中的编号，不可达的块为 -1
+  IrBlock *idom; // 直接支配者，入口块和不可达的块为 NULL
+  IrBlock **dom_children;
+  int dom_child_count;
+  int dom_pre; // 支配树先序和后序遍历的编号，用来 O(1) 判断支配关系
+  int dom_post;
+};
+
+struct IrFunction {
+  const char *name; // @main
+  IrType *type;
+  IrValue **params;
+  int param_count;
+  IrBlock *first; // 没有基本块的是函数声明
+  IrBlock *last;
+  IrModule *module;
+  unsigned valid_analyses; // IrAnalysis 的组合
+  // 可达的基本块按逆后序排列，CFG 分析的结果
+  IrBlock **rpo_blocks;
+  int rpo_count;
+};
+
+struct IrModule {
+  Arena arena;
+  IrValue **globals;
+  int global_count;
+  int global_capacity;
+  IrFunction **funcs;
+  int func_count;
+  int func_capacity;
+  IrType *i32;
+  IrType *unit;
+};
+
+// 新指令追加到 block 的末尾
+typedef struct IrBuilder {
+  IrModule *module;
+  IrBlock *block;
+} IrBuilder;
+
+void ir_module_init(IrModule *module);
+void ir_module_free(IrModule *module);
+// 名字复制到模块的 arena 中
+const char *ir_strdup(IrModule *module, const char *str);
+const char *ir_strf(IrModule *module, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// #region 类型
+IrType *ir_type_array(IrModule *module, IrType *base, int len);
+IrType *ir_type_pointer(IrModule *module, IrType *base);
+IrType *ir_type_function(IrModule *module, IrType **params, int param_count,
+                         IrType *ret);
+bool ir_type_equal(const IrType *a, const IrType *b);
+// 占用的字节数
+int ir_type_size(const IrType *type);
+// #endregion
+
+// #region 常量和全局变量
+IrValue *ir_integer(IrModule *module, int value);
+IrValue *ir_zero_init(IrModule *module, IrType *type);
+IrValue *ir_undef(IrModule *module, IrType *type);
+IrValue *ir_aggregate(IrModule *module, IrType *type, IrValue **elems,
+                      int count);
+// type 是变量的类型，返回值的类型是指向它的指针
+IrValue *ir_global_alloc(IrModule *module, const char *name, IrType *type,
+                         IrValue *init);
+// #endregion
+
+// #region 函数和基本块
+// param_names 为 NULL 时是函数声明
+IrFunction *ir_function_new(IrModule *module, const char *name, IrType *type,
+                            const char **param_names);
+bool ir_function_is_decl(const IrFunction *func);
+// 创建的基本块还不在函数中，由 ir_block_append 加到函数末尾
+IrBlock *ir_block_new(IrFunction *func, const char *name);
+void ir_block_append(IrBlock *block);
+IrValue *ir_block_add_param(IrBlock *block, IrType *type, const char *name);
+// 删除 removed[i] 为 true 的参数，它们不能再有使用，剩下的参数重新编号
+void ir_block_remove_params(IrBlock *block, const bool *removed);
+// 删除基本块和其中的指令，块参数和指令的结果都不能再有使用
+void ir_block_remove(IrBlock *block);
+// 最后一条指令是 branch jump return 时返回它，否则返回 NULL
+IrValue *ir_block_terminator(const IrBlock *block);
+// 跳转的目标，最多两个，返回个数
+int ir_successors(const IrValue *terminator, IrBlock *succs[2]);
+// #endregion
+
+// #region 指令
+IrValue *ir_alloc(IrBuilder *builder, IrType *type, const char *name);
+IrValue *ir_load(IrBuilder *builder, IrValue *src);
+IrValue *ir_store(IrBuilder *builder, IrValue *value, IrValue *dest);
+IrValue *ir_get_ptr(IrBuilder *builder, IrValue *src, IrValue *index);
+IrValue *ir_get_elem_ptr(IrBuilder *builder, IrValue *src, IrValue *index);
+IrValue *ir_binary(IrBuilder *builder, IrBinaryOp op, IrValue *lhs,
+                   IrValue *rhs);
+IrValue *ir_branch(IrBuilder *builder, IrValue *cond, IrBlock *true_block,
+                   IrBlock *false_block);
+IrValue *ir_jump(IrBuilder *builder, IrBlock *target);
+IrValue *ir_call(IrBuilder *builder, IrFunction *callee, IrValue **args,
+                 int arg_count);
+// value 为 NULL 时没有返回值
+IrValue *ir_return(IrBuilder *builder, IrValue *value);
+// #endregion
+
+// #region 修改
+bool ir_is_terminator(const IrValue *value);
+// 有副作用的指令即使结果没有使用也不能删除
+bool ir_has_side_effect(const IrValue *value);
+bool ir_has_uses(const IrValue *value);
+void ir_use_set(IrUse *use, IrValue *value);
+void ir_replace_all_uses(IrValue *value, IrValue *replacement);
+// 从基本块中删除指令，指令的结果不能再有使用
+void ir_inst_remove(IrValue *inst);
+// 在 terminator 中跳转到 target 的每条边的末尾加上 args 中的实参
+void ir_add_branch_args(IrValue *terminator, IrBlock *target,
+                        IrValue **args, int arg_count);
+// 删除 terminator 中跳转到 target 的边上 removed[i] 为 true 的第 i 个实参
+void ir_remove_branch_args(IrValue *terminator, IrBlock *target,
+                           const bool *removed);
+// #endregion
+
+// 输出 Koopa IR 文本
+void ir_print_module(IrModule *module, Emitter *output);
+
+/*
+ * 检查模块的结构，发现错误时用 fatalf 报告，pass 出错时可以尽早发现：
+ *  - 基本块以且只以一条 branch jump return 结束，链表的前后指针一致
+ *  - 每个操作数都在它的值的使用链表中，反之亦然
+ *  - 指令的操作数类型正确，实参和块参数、函数参数一一对应
+ *  - 指令的结果在使用它的地方可用（定义支配使用）
+ */
+void ir_verify_module(IrModule *module);
+void ir_verify_function(IrFunction *func);
+
+#endif // SRC_IR_H_
@@ -0,0 +1,986 @@
+#include "ir_gen.h"
+
+#include <assert.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "context.h"
+#include "ir.h"
+#include "optimize.h"
+#include "symbol.h"
+#include "time_report.h"
+#include "utils.h"
+#include "value_map.h"
+
+/*
+ * 符号到 IR 的对应关系：变量的 alloc 或者 global_alloc ，函数的 IrFunction
+ * 局部符号随函数一起释放，地址可能被下一个函数的符号复用，所以分开保存，
+ * 每个函数开始时清空。
+ */
+typedef struct {
+  ValueMap indexes; // Symbol * -> items 中的下标
+  void **items;
+  int count;
+  int capacity;
+} Bindings;
+
+// 生成 IR 的状态，ir_gen 在栈上准备一个，传给下面所有的函数
+typedef struct {
+  CompileContext *context;
+  IrModule *module;
+  SymbolTable symbols;
+  // 新指令追加到 builder.block 的末尾
+  IrBuilder builder;
+  Bindings globals;
+  Bindings locals;
+  // 和 koopa_ir.c 中相同的标签计数，每个函数都从 0 开始
+  int if_index;
+  int while_index;
+  // 整个函数共用一个计数，嵌套的循环里 break continue 之后的块名字也不会重复
+  int while_body_index;
+  int logic_index;
+  int zero_fill_index;
+  // return 之后的语句已经在优化时移除了，这里只是兜底
+  int unreachable_index;
+  // 当前所在的循环，break continue 跳转的目标
+  IrBlock *loop_entry;
+  IrBlock *loop_end;
+  int loop_index;
+  AstFuncDef *current_func_def;
+  bool has_main;
+} IrGen;
+
+// #region 符号
+
+static void bindings_free(Bindings *bindings) {
+  value_map_free(&bindings->indexes);
+  free(bindings->items);
+  memset(bindings, 0, sizeof(Bindings));
+}
+
+static void bindings_clear(Bindings *bindings) {
+  value_map_clear(&bindings->indexes);
+  bindings->count = 0;
+}
+
+static void bind_symbol(IrGen *gen, Symbol *symbol, void *item) {
+  Bindings *bindings = symbol->level > 0 ? &gen->locals : &gen->globals;
+  if (bindings->count == bindings->capacity) {
+    bindings->capacity = bindings->capacity == 0 ? 16 : bindings->capacity * 2;
+    bindings->items =
+        realloc(bindings->items, sizeof(void *) * bindings->capacity);
+  }
+  value_map_put(&bindings->indexes, symbol, bindings->count);
+  bindings->items[bindings->count++] = item;
+}
+
+static void *symbol_item(IrGen *gen, Symbol *symbol) {
+  Bindings *bindings = symbol->level > 0 ? &gen->locals : &gen->globals;
+  int index;
+  if (!value_map_get(&bindings->indexes, symbol, &index)) {
+    fatalf("符号 %s 没有对应的 IR\n", symbol->name);
+  }
+  return bindings->items[index];
+}
+
+// 变量在 IR 中的名字，局部符号的名字随函数释放，复制到模块中
+static const char *variable_name(IrGen *gen, Symbol *symbol) {
+  return ir_strdup(gen->module, symbol_unique_name(&gen->symbols, symbol));
+}
+
+// #endregion
+
+// #region 类型
+
+// dimensions 是 [2, 3] 时返回 [[i32, 3], 2]
+static IrType *array_type(IrGen *gen, const int *dimensions,
+                          int dimension_count) {
+  IrType *type = gen->module->i32;
+  for (int i = dimension_count - 1; i >= 0; i--) {
+    type = ir_type_array(gen->module, type, dimensions[i]);
+  }
+  return type;
+}
+
+static IrType *param_type(IrGen *gen, FuncParam *param) {
+  switch (param->type) {
+  case BType_INT:
+    return gen->module->i32;
+  case BType_POINTER:
+    return ir_type_pointer(gen->module, gen->module->i32);
+  case BType_ARRAY_POINTER: {
+    assert(param->dimensions.count > 0);
+    int dimensions[param->dimensions.count];
+    read_dimensions(&param->dimensions, dimensions);
+    IrType *type = array_type(gen, dimensions, param->dimensions.count);
+    return ir_type_pointer(gen->module, type);
+  }
+  default:
+    fatalf("未知的参数类型\n");
+    return NULL;
+  }
+}
+
+static IrType *return_type(IrGen *gen, BType type) {
+  return type == BType_VOID ? gen->module->unit : gen->module->i32;
+}
+
+// #endregion
+
+// #region 基本块
+
+static IrBlock *new_block(IrGen *gen, const char *fmt, int index) {
+  return ir_block_new(gen->builder.block->func,
+                      ir_strf(gen->module, fmt, index));
+}
+
+// 前一个块必须已经结束
+static void start_block(IrGen *gen, IrBlock *block) {
+  assert(gen->builder.block == NULL ||
+         ir_block_terminator(gen->builder.block) != NULL);
+  ir_block_append(block);
+  gen->builder.block = block;
+}
+
+static bool block_terminated(IrGen *gen) {
+  return ir_block_terminator(gen->builder.block) != NULL;
+}
+
+// 追加指令的位置，当前块已经结束时新开一个不可达的块
+static IrBuilder *b(IrGen *gen) {
+  if (block_terminated(gen)) {
+    gen->unreachable_index++;
+    start_block(gen,
+                new_block(gen, "%%unreachable_%d", gen->unreachable_index));
+  }
+  return &gen->builder;
+}
+
+// #endregion
+
+// #region 生成 IR
+static IrValue *codegen_exp(IrGen *gen, AstExp *exp);
+static void codegen_block(IrGen *gen, AstBlock *block);
+static void codegen_stmt(IrGen *gen, AstStmt *stmt);
+
+static IrValue *integer(IrGen *gen,
+                        int value) { return ir_integer(gen->module, value); }
+
+static IrValue *codegen_identifier(IrGen *gen, AstIdentifier *ident) {
+  Symbol *symbol = find_symbol(&gen->symbols, ident->name);
+  if (symbol == NULL) {
+    fatalf("访问未定义的符号 %s\n", ident->name);
+  }
+  IrValue *var;
+  switch (symbol->type) {
+  case SymbolType_int:
+  case SymbolType_pointer:
+  case SymbolType_array_pointer:
+    var = symbol_item(gen, symbol);
+    return ir_load(b(gen), var);
+  case SymbolType_array:
+    // 数组的第一个元素的地址
+    var = symbol_item(gen, symbol);
+    return ir_get_elem_ptr(b(gen), var, integer(gen, 0));
+  default:
+    fatalf("未知的符号类型\n");
+    return NULL;
+  }
+}
+
+/*
+ * a && b 和 a || b 短路求值，结果放在中间变量 %result_n 中
+ * a && b: result = 0; if (a != 0) { result = b != 0; }
+ * a || b: result = 1; if (a == 0) { result = b != 0; }
+ */
+static IrValue *codegen_logic_exp(IrGen *gen, AstBinaryExp *exp) {
+  bool is_and = exp->op == BinaryOpType_AND;
+  gen->logic_index++;
+  int current = gen->logic_index;
+  IrValue *result = ir_alloc(b(gen), gen->module->i32,
+                              ir_strf(gen->module, "%%result_%d", current));
+  ir_store(b(gen), integer(gen, is_and ? 0 : 1), result);
+  IrValue *lhs = codegen_exp(gen, exp->lhs);
+  IrBlock *rhs_block =
+      new_block(gen, is_and ? "%%and_true_%d" : "%%or_false_%d", current);
+  IrBlock *end_block =
+      new_block(gen, is_and ? "%%and_end_%d" : "%%or_end_%d", current);
+  if (is_and) {
+    ir_branch(b(gen), lhs, rhs_block, end_block);
+  } else {
+    ir_branch(b(gen), lhs, end_block, rhs_block);
+  }
+  start_block(gen, rhs_block);
+  IrValue *rhs = codegen_exp(gen, exp->rhs);
+  ir_store(b(gen), ir_binary(b(gen), IR_OP_NE, rhs, integer(gen, 0)), result);
+  ir_jump(b(gen), end_block);
+  start_block(gen, end_block);
+  return ir_load(b(gen), result);
+}
+
+static IrValue *codegen_binary_exp(IrGen *gen, AstBinaryExp *exp) {
+  if (exp->op == BinaryOpType_AND || exp->op == BinaryOpType_OR) {
+    return codegen_logic_exp(gen, exp);
+  }
+  IrValue *lhs = codegen_exp(gen, exp->lhs);
+  IrValue *rhs = codegen_exp(gen, exp->rhs);
+  IrBinaryOp op;
+  switch (exp->op) {
+  case BinaryOpType_ADD:
+    op = IR_OP_ADD;
+    break;
+  case BinaryOpType_SUB:
+    op = IR_OP_SUB;
+    break;
+  case BinaryOpType_MUL:
+    op = IR_OP_MUL;
+    break;
+  case BinaryOpType_DIV:
+    op = IR_OP_DIV;
+    break;
+  case BinaryOpType_MOD:
+    op = IR_OP_MOD;
+    break;
+  case BinaryOpType_EQ:
+    op = IR_OP_EQ;
+    break;
+  case BinaryOpType_NE:
+    op = IR_OP_NE;
+    break;
+  case BinaryOpType_LT:
+    op = IR_OP_LT;
+    break;
+  case BinaryOpType_LE:
+    op = IR_OP_LE;
+    break;
+  case BinaryOpType_GT:
+    op = IR_OP_GT;
+    break;
+  case BinaryOpType_GE:
+    op = IR_OP_GE;
+    break;
+  default:
+    fatalf("未知的二元运算符 %c\n", exp->op);
+    return NULL;
+  }
+  return ir_binary(b(gen), op, lhs, rhs);
+}
+
+static IrValue *codegen_func_call(IrGen *gen, AstFuncCall *func_call) {
+  Symbol *symbol = find_symbol(&gen->symbols, func_call->ident->name);
+  if (symbol == NULL) {
+    fatalf("调用未定义的函数 %s\n", func_call->ident->name);
+  }
+  if (symbol->type != SymbolType_func) {
+    fatalf("调用非函数符号 %s\n", func_call->ident->name);
+  }
+  if (symbol->func_type.param_count != func_call->count) {
+    fatalf("调用函数 %s 参数个数不匹配\n", func_call->ident->name);
+  }
+  // 至少留一个位置，避免零长度数组
+  IrValue *args[func_call->count + 1];
+  for (int i = 0; i < func_call->count; i++) {
+    args[i] = codegen_exp(gen, func_call->args[i]);
+  }
+  return ir_call(b(gen), symbol_item(gen, symbol), args, func_call->count);
+}
+
+/*
+ * 数组元素的地址，indexes 中的下标都用上
+ * 数组 getelemptr 每一维；指针先 load 出指针，第一维 getptr ，之后 getelemptr
+ */
+static IrValue *codegen_element_ptr(IrGen *gen, Symbol *symbol,
+                                    IrValue **indexes, int count) {
+  IrValue *ptr = symbol_item(gen, symbol);
+  int start = 0;
+  if (symbol->type != SymbolType_array) {
+    ptr = ir_load(b(gen), ptr);
+    ptr = ir_get_ptr(b(gen), ptr, indexes[0]);
+    start = 1;
+  }
+  for (int i = start; i < count; i++) {
+    ptr = ir_get_elem_ptr(b(gen), ptr, indexes[i]);
+  }
+  return ptr;
+}
+
+// 数组变量的维数，指针参数比它指向的数组多一维
+static int access_dimension_count(Symbol *symbol) {
+  switch (symbol->type) {
+  case SymbolType_array:
+    return symbol->dimension_count;
+  case SymbolType_pointer:
+    return 1;
+  case SymbolType_array_pointer:
+    return symbol->dimension_count + 1;
+  default:
+    return -1;
+  }
+}
+
+static IrValue *codegen_array_access(IrGen *gen, AstArrayAccess *array_access) {
+  Symbol *symbol = find_symbol(&gen->symbols, array_access->name);
+  if (symbol == NULL) {
+    fatalf("访问未定义的数组变量 %s\n", array_access->name);
+  }
+  int dimension_count = access_dimension_count(symbol);
+  if (dimension_count < 0) {
+    fatalf("访问非数组变量 %s\n", array_access->name);
+  }
+  int count = array_access->indexes.count;
+  assert(count <= dimension_count);
+  if (symbol->type == SymbolType_pointer) {
+    assert(count == 1);
+  }
+  IrValue *indexes[count];
+  for (int i = 0; i < count; i++) {
+    indexes[i] = codegen_exp(gen, array_access->indexes.elements[i]);
+  }
+  IrValue *ptr = codegen_element_ptr(gen, symbol, indexes, count);
+  if (count == dimension_count) {
+    // 索引到最后一维，是取值，需要 load 一次
+    return ir_load(b(gen), ptr);
+  }
+  // 其他的需要返回数组第一个元素的指针
+  return ir_get_elem_ptr(b(gen), ptr, integer(gen, 0));
+}
+
+static IrValue *codegen_exp(IrGen *gen, AstExp *exp) {
+  switch (exp->type) {
+  case AST_UNARY_EXP: {
+    AstUnaryExp *unary_exp = (AstUnaryExp *)exp;
+    IrValue *operand = codegen_exp(gen, unary_exp->operand);
+    switch (unary_exp->op) {
+    case '-':
+      return ir_binary(b(gen), IR_OP_SUB, integer(gen, 0), operand);
+    case '!':
+      return ir_binary(b(gen), IR_OP_EQ, operand, integer(gen, 0));
+    default:
+      fatalf("不应该出现一元加法表达式\n");
+      return NULL;
+    }
+  }
+  case AST_BINARY_EXP:
+    return codegen_binary_exp(gen, (AstBinaryExp *)exp);
+  case AST_NUMBER:
+    return integer(gen, ((AstNumber *)exp)->number);
+  case AST_IDENTIFIER:
+    return codegen_identifier(gen, (AstIdentifier *)exp);
+  case AST_FUNC_CALL:
+    return codegen_func_call(gen, (AstFuncCall *)exp);
+  case AST_ARRAY_ACCESS:
+    return codegen_array_access(gen, (AstArrayAccess *)exp);
+  default:
+    fatalf("未知的表达式类型 %s\n", ast_type_to_string(exp->type));
+    return NULL;
+  }
+}
+
+static void codegen_return_stmt(IrGen *gen, AstReturnStmt *stmt) {
+  if (stmt->exp) {
+    if (gen->current_func_def->func_type == BType_VOID) {
+      fatalf("void 函数只能出现不带返回值的 return 语句\n");
+    }
+    ir_return(b(gen), codegen_exp(gen, stmt->exp));
+  } else {
+    if (gen->current_func_def->func_type != BType_VOID) {
+      fatalf("非 void 函数没有 return 返回值\n");
+    }
+    ir_return(b(gen), NULL);
+  }
+}
+
+static void codegen_assign_stmt(IrGen *gen, AstAssignStmt *stmt) {
+  if (stmt->lhs->type == AST_IDENTIFIER) {
+    AstIdentifier *ident = (AstIdentifier *)stmt->lhs;
+    Symbol *symbol = find_symbol(&gen->symbols, ident->name);
+    if (symbol == NULL) {
+      fatalf("赋值未定义的符号 %s\n", ident->name);
+    }
+    IrValue *value = codegen_exp(gen, stmt->exp);
+    ir_store(b(gen), value, symbol_item(gen, symbol));
+  } else if (stmt->lhs->type == AST_ARRAY_ACCESS) {
+    IrValue *value = codegen_exp(gen, stmt->exp);
+    AstArrayAccess *array_access = (AstArrayAccess *)stmt->lhs;
+    Symbol *symbol = find_symbol(&gen->symbols, array_access->name);
+    if (symbol == NULL) {
+      fatalf("赋值未定义的数组变量 %s\n", array_access->name);
+    }
+    if (symbol->is_const_value) {
+      fatalf("不能给常量赋值 %s\n", array_access->name);
+    }
+    int dimension_count = access_dimension_count(symbol);
+    if (dimension_count < 0) {
+      fatalf("赋值非数组变量 %s\n", symbol->name);
+    }
+    int count = array_access->indexes.count;
+    assert(count == dimension_count);
+    IrValue *indexes[count];
+    for (int i = 0; i < count; i++) {
+      indexes[i] = codegen_exp(gen, array_access->indexes.elements[i]);
+    }
+    ir_store(b(gen), value, codegen_element_ptr(gen, symbol, indexes, count));
+  } else {
+    fatalf("不支持的左值类型 %s\n", ast_type_to_string(stmt->lhs->type));
+  }
+}
+
+// 和 koopa_ir.c 相同：不超过这么多元素的局部数组直接逐个写入
+#define ZERO_FILL_UNROLL_LIMIT 16
+// 清零循环每次迭代最多写入的元素个数
+#define ZERO_FILL_MAX_STEP 8
+
+// 数组第一个元素的指针 *i32
+static IrValue *first_element_ptr(IrGen *gen, IrValue *array,
+                                  int dimension_count) {
+  IrValue *ptr = array;
+  for (int i = 0; i < dimension_count; i++) {
+    ptr = ir_get_elem_ptr(b(gen), ptr, integer(gen, 0));
+  }
+  return ptr;
+}
+
+// 用循环把数组清零，形状和 koopa_ir.c 中的 codegen_zero_fill 相同
+static void codegen_zero_fill(IrGen *gen, IrValue *array, int dimension_count,
+                              int count) {
+  gen->zero_fill_index++;
+  int current = gen->zero_fill_index;
+  int step = ZERO_FILL_MAX_STEP;
+  while (count % step != 0) {
+    step /= 2;
+  }
+  IrType *i32_ptr = ir_type_pointer(gen->module, gen->module->i32);
+  IrValue *zero_ptr =
+      ir_alloc(b(gen), i32_ptr, ir_strf(gen->module, "%%zero_ptr_%d", current));
+  ir_store(b(gen), first_element_ptr(gen, array, dimension_count), zero_ptr);
+  IrValue *zero_index =
+      ir_alloc(b(gen), gen->module->i32,
+               ir_strf(gen->module, "%%zero_index_%d", current));
+  ir_store(b(gen), integer(gen, 0), zero_index);
+  IrBlock *cond_block = new_block(gen, "%%zero_fill_%d", current);
+  IrBlock *body_block = new_block(gen, "%%zero_fill_body_%d", current);
+  IrBlock *end_block = new_block(gen, "%%zero_fill_end_%d", current);
+  ir_jump(b(gen), cond_block);
+
+  start_block(gen, cond_block);
+  IrValue *index = ir_load(b(gen), zero_index);
+  IrValue *cond = ir_binary(b(gen), IR_OP_LT, index,
+                            integer(gen, count / step));
+  ir_branch(b(gen), cond, body_block, end_block);
+
+  start_block(gen, body_block);
+  for (int i = 0; i < step; i++) {
+    IrValue *ptr = ir_load(b(gen), zero_ptr);
+    if (i > 0) {
+      ptr = ir_get_ptr(b(gen), ptr, integer(gen, i));
+    }
+    ir_store(b(gen), integer(gen, 0), ptr);
+  }
+  // 指针和计数都向后移动
+  IrValue *ptr = ir_load(b(gen), zero_ptr);
+  ir_store(b(gen), ir_get_ptr(b(gen), ptr, integer(gen, step)), zero_ptr);
+  index = ir_load(b(gen), zero_index);
+  ir_store(b(gen), ir_binary(b(gen), IR_OP_ADD, index, integer(gen, 1)),
+           zero_index);
+  ir_jump(b(gen), cond_block);
+
+  start_block(gen, end_block);
+}
+
+// 局部数组的初始化，和 koopa_ir.c 中的 codegen_local_array_init 相同
+static void codegen_local_array_init(IrGen *gen, IrValue *array,
+                                     const int *dimensions, int dimension_count,
+                                     const AstArrayInit *init) {
+  int steps[dimension_count];
+  steps[dimension_count - 1] = 1;
+  for (int i = dimension_count - 2; i >= 0; i--) {
+    steps[i] = steps[i + 1] * dimensions[i + 1];
+  }
+  assert(init->total_count == steps[0] * dimensions[0]);
+  bool unroll = init->total_count <= ZERO_FILL_UNROLL_LIMIT;
+  if (!unroll) {
+    codegen_zero_fill(gen, array, dimension_count, init->total_count);
+  }
+  int next = 0; // init->entries 中下一个元素
+  for (int i = 0; i < init->total_count; i++) {
+    IrValue *value;
+    if (next < init->count && init->entries[next].index == i) {
+      value = codegen_exp(gen, init->entries[next++].value);
+    } else if (!unroll) {
+      // 已经清零了，直接跳到下一个需要写入的元素
+      if (next == init->count) {
+        break;
+      }
+      i = init->entries[next].index - 1;
+      continue;
+    } else {
+      value = integer(gen, 0);
+    }
+    IrValue *ptr = array;
+    int remaining = i;
+    for (int j = 0; j < dimension_count; j++) {
+      ptr = ir_get_elem_ptr(b(gen), ptr, integer(gen, remaining / steps[j]));
+      remaining = remaining % steps[j];
+    }
+    ir_store(b(gen), value, ptr);
+  }
+}
+
+// 局部数组的 alloc 和初始化
+static void codegen_local_array(IrGen *gen, Symbol *symbol,
+                                AstArrayInit *init) {
+  IrType *type = array_type(gen, symbol->dimensions, symbol->dimension_count);
+  IrValue *array = ir_alloc(b(gen), type, variable_name(gen, symbol));
+  bind_symbol(gen, symbol, array);
+  if (init != NULL) {
+    codegen_local_array_init(gen, array, symbol->dimensions,
+                             symbol->dimension_count, init);
+  }
+}
+
+static void codegen_var_decl(IrGen *gen, AstVarDecl *decl) {
+  for (int i = 0; i < decl->defs.count; i++) {
+    AstVarDef *def = decl->defs.elements[i];
+    Symbol *symbol = new_symbol(&gen->symbols, def->name, SymbolType_int);
+    if (def->dimensions.count > 0) {
+      symbol->type = SymbolType_array;
+      symbol_set_dimensions(&gen->symbols, symbol, &def->dimensions);
+      assert(def->val == NULL || def->val->type == AST_ARRAY_INIT);
+      codegen_local_array(gen, symbol, (AstArrayInit *)def->val);
+    } else {
+      IrValue *var = ir_alloc(b(gen), gen->module->i32,
+                              variable_name(gen, symbol));
+      bind_symbol(gen, symbol, var);
+      if (def->val) {
+        ir_store(b(gen), codegen_exp(gen, def->val), var);
+      }
+    }
+  }
+}
+
+static void codegen_const_decl(IrGen *gen, AstConstDecl *decl) {
+  for (int i = 0; i < decl->defs.count; i++) {
+    AstVarDef *def = decl->defs.elements[i];
+    if (def->dimensions.count > 0) {
+      Symbol *symbol = new_symbol(&gen->symbols, def->name, SymbolType_array);
+      symbol->is_const_value = true;
+      symbol_set_dimensions(&gen->symbols, symbol, &def->dimensions);
+      if (def->val == NULL || def->val->type != AST_ARRAY_INIT) {
+        fatalf("常量数组的值必须是数组\n");
+      }
+      codegen_local_array(gen, symbol, (AstArrayInit *)def->val);
+    }
+  }
+}
+
+// 当前块没有结束时跳转到 target
+static void jump_if_open(IrGen *gen, IrBlock *target) {
+  if (!block_terminated(gen)) {
+    ir_jump(&gen->builder, target);
+  }
+}
+
+static void codegen_if_stmt(IrGen *gen, AstIfStmt *stmt) {
+  gen->if_index++;
+  int current = gen->if_index;
+  IrValue *cond = codegen_exp(gen, stmt->condition);
+  IrBlock *then_block = new_block(gen, "%%if_then_%d", current);
+  IrBlock *else_block = NULL;
+  IrBlock *end_block = new_block(gen, "%%if_end_%d", current);
+  if (stmt->else_) {
+    else_block = new_block(gen, "%%if_else_%d", current);
+    ir_branch(b(gen), cond, then_block, else_block);
+  } else {
+    ir_branch(b(gen), cond, then_block, end_block);
+  }
+  start_block(gen, then_block);
+  codegen_stmt(gen, stmt->then);
+  jump_if_open(gen, end_block);
+  if (stmt->else_) {
+    start_block(gen, else_block);
+    codegen_stmt(gen, stmt->else_);
+    jump_if_open(gen, end_block);
+  }
+  start_block(gen, end_block);
+}
+
+static void codegen_while_stmt(IrGen *gen, AstWhileStmt *stmt) {
+  gen->while_index++;
+  int current = gen->while_index;
+  IrBlock *saved_entry = gen->loop_entry;
+  IrBlock *saved_end = gen->loop_end;
+  int saved_index = gen->loop_index;
+  gen->loop_entry = new_block(gen, "%%while_entry_%d", current);
+  gen->loop_end = new_block(gen, "%%while_end_%d", current);
+  gen->loop_index = current;
+  IrBlock *body_block = new_block(gen, "%%while_body_%d", current);
+
+  ir_jump(b(gen), gen->loop_entry);
+  start_block(gen, gen->loop_entry);
+  IrValue *cond = codegen_exp(gen, stmt->condition);
+  ir_branch(b(gen), cond, body_block, gen->loop_end);
+  start_block(gen, body_block);
+  codegen_stmt(gen, stmt->body);
+  jump_if_open(gen, gen->loop_entry);
+  start_block(gen, gen->loop_end);
+
+  gen->loop_entry = saved_entry;
+  gen->loop_end = saved_end;
+  gen->loop_index = saved_index;
+}
+
+// break continue 结束了当前的块，之后的语句放到新的块里
+static void codegen_loop_jump(IrGen *gen, IrBlock *target) {
+  ir_jump(b(gen), target);
+  gen->while_body_index++;
+  IrBlock *block = ir_block_new(gen->builder.block->func,
+                                ir_strf(gen->module, "%%while_body_%d_%d",
+                                        gen->loop_index,
+                                        gen->while_body_index));
+  start_block(gen, block);
+}
+
+static void codegen_stmt(IrGen *gen, AstStmt *stmt) {
+  switch (stmt->type) {
+  case AST_BREAK_STMT:
+    if (gen->loop_end == NULL) {
+      fatalf("break 只能出现在循环内\n");
+    }
+    codegen_loop_jump(gen, gen->loop_end);
+    break;
+  case AST_CONTINUE_STMT:
+    if (gen->loop_entry == NULL) {
+      fatalf("continue 只能出现在循环内\n");
+    }
+    codegen_loop_jump(gen, gen->loop_entry);
+    break;
+  case AST_WHILE_STMT:
+    codegen_while_stmt(gen, (AstWhileStmt *)stmt);
+    break;
+  case AST_IF_STMT:
+    codegen_if_stmt(gen, (AstIfStmt *)stmt);
+    break;
+  case AST_RETURN_STMT:
+    codegen_return_stmt(gen, (AstReturnStmt *)stmt);
+    break;
+  case AST_ASSIGN_STMT:
+    codegen_assign_stmt(gen, (AstAssignStmt *)stmt);
+    break;
+  case AST_CONST_DECL:
+    codegen_const_decl(gen, (AstConstDecl *)stmt);
+    break;
+  case AST_VAR_DECL:
+    codegen_var_decl(gen, (AstVarDecl *)stmt);
+    break;
+  case AST_BLOCK:
+    codegen_block(gen, (AstBlock *)stmt);
+    break;
+  case AST_EXP_STMT:
+    codegen_exp(gen, ((AstExpStmt *)stmt)->exp);
+    break;
+  case AST_EMPTY_STMT:
+    // nothing to do
+    break;
+  default:
+    fatalf("未知的语句类型 %s\n", ast_type_to_string(stmt->type));
+  }
+}
+
+static void codegen_block(IrGen *gen, AstBlock *block) {
+  AstStmt *stmt = block->stmt;
+  enter_scope(&gen->symbols);
+  while (stmt) {
+    codegen_stmt(gen, stmt);
+    stmt = stmt->next;
+  }
+  leave_scope(&gen->symbols);
+}
+
+/**
+ * 下标 [start, start + 这一维的元素总数) 这一部分的初始值
+ * 整个部分都是 0 时返回 zeroinit
+ * @param next init->entries 中第一个下标不小于 start 的元素，返回后更新
+ */
+static IrValue *array_init_value(IrGen *gen, IrType *type,
+                                 const AstArrayInit *init, int start,
+                                 int *next) {
+  assert(type->tag == IR_TYPE_ARRAY);
+  int size = ir_type_size(type) / ir_type_size(gen->module->i32);
+  if (*next == init->count || init->entries[*next].index >= start + size) {
+    return ir_zero_init(gen->module, type);
+  }
+  int step = size / type->len;
+  // 一维可以有几百万个元素，不能放在栈上
+  IrValue **elems = malloc(sizeof(IrValue *) * type->len);
+  // 这一维中连续的 0 都使用同一个常量
+  IrValue *zero = NULL;
+  for (int i = 0; i < type->len; i++) {
+    if (type->base->tag == IR_TYPE_ARRAY) {
+      elems[i] = array_init_value(gen, type->base, init, start + i * step,
+                                  next);
+    } else if (*next < init->count &&
+               init->entries[*next].index == start + i) {
+      AstExp *value = init->entries[(*next)++].value;
+      assert(value->type == AST_NUMBER);
+      elems[i] = integer(gen, ((AstNumber *)value)->number);
+    } else {
+      if (zero == NULL) {
+        zero = integer(gen, 0);
+      }
+      elems[i] = zero;
+    }
+  }
+  IrValue *aggregate = ir_aggregate(gen->module, type, elems, type->len);
+  free(elems);
+  return aggregate;
+}
+
+static void codegen_global_array(IrGen *gen, Symbol *symbol, AstExp *val) {
+  IrType *type = array_type(gen, symbol->dimensions, symbol->dimension_count);
+  IrValue *init;
+  if (val) {
+    assert(val->type == AST_ARRAY_INIT);
+    int next = 0;
+    init = array_init_value(gen, type, (AstArrayInit *)val, 0, &next);
+  } else {
+    init = ir_zero_init(gen->module, type);
+  }
+  bind_symbol(gen, symbol,
+              ir_global_alloc(gen->module, variable_name(gen, symbol), type,
+                              init));
+}
+
+static void codegen_global_var_decl(IrGen *gen, AstVarDecl *decl) {
+  for (int i = 0; i < decl->defs.count; i++) {
+    AstVarDef *def = decl->defs.elements[i];
+    Symbol *symbol = new_symbol(&gen->symbols, def->name, SymbolType_int);
+    if (def->dimensions.count > 0) {
+      symbol->type = SymbolType_array;
+      symbol_set_dimensions(&gen->symbols, symbol, &def->dimensions);
+      codegen_global_array(gen, symbol, def->val);
+    } else {
+      IrValue *init;
+      if (def->val) {
+        assert(def->val->type == AST_NUMBER);
+        init = integer(gen, ((AstNumber *)def->val)->number);
+      } else {
+        init = ir_zero_init(gen->module, gen->module->i32);
+      }
+      bind_symbol(gen, symbol,
+                  ir_global_alloc(gen->module, variable_name(gen, symbol),
+                                  gen->module->i32, init));
+    }
+  }
+}
+
+static void codegen_global_const_decl(IrGen *gen, AstConstDecl *decl) {
+  for (int i = 0; i < decl->defs.count; i++) {
+    AstVarDef *def = decl->defs.elements[i];
+    if (def->dimensions.count > 0) {
+      // 常量数组在 optimize_const_decl 中已经加入了符号表
+      Symbol *symbol = find_symbol(&gen->symbols, def->name);
+      assert(symbol != NULL && symbol->level == 0 &&
+             symbol->type == SymbolType_array);
+      symbol_set_dimensions(&gen->symbols, symbol, &def->dimensions);
+      if (def->val == NULL || def->val->type != AST_ARRAY_INIT) {
+        fatalf("常量数组的值必须是数组\n");
+      }
+      codegen_global_array(gen, symbol, def->val);
+    }
+  }
+}
+
+// 参数先存到 alloc 中，之后和局部变量一样访问
+static void codegen_params(IrGen *gen, AstFuncDef *func_def, IrFunction *func) {
+  FuncParam *param = func_def->params;
+  for (int i = 0; param != NULL; i++, param = param->next) {
+    Symbol *symbol;
+    switch (param->type) {
+    case BType_INT:
+      symbol = new_symbol(&gen->symbols, param->ident->name, SymbolType_int);
+      break;
+    case BType_POINTER:
+      symbol = new_symbol(&gen->symbols, param->ident->name,
+                          SymbolType_pointer);
+      break;
+    case BType_ARRAY_POINTER:
+      symbol = new_symbol(&gen->symbols, param->ident->name,
+                          SymbolType_array_pointer);
+      symbol_set_dimensions(&gen->symbols, symbol, &param->dimensions);
+      break;
+    default:
+      fatalf("未知的参数类型\n");
+      return;
+    }
+    IrValue *arg = func->params[i];
+    IrValue *var = ir_alloc(b(gen), arg->type, variable_name(gen, symbol));
+    bind_symbol(gen, symbol, var);
+    ir_store(b(gen), arg, var);
+  }
+}
+
+static void codegen_func_def(IrGen *gen, AstFuncDef *func_def,
+                             IrFunction *func) {
+  // 标签只需要在函数内唯一，每个函数都从 0 开始计数
+  gen->if_index = 0;
+  gen->while_index = 0;
+  gen->while_body_index = 0;
+  gen->logic_index = 0;
+  gen->zero_fill_index = 0;
+  gen->unreachable_index = 0;
+  gen->loop_entry = NULL;
+  gen->loop_end = NULL;
+  gen->current_func_def = func_def;
+  bindings_clear(&gen->locals);
+
+  gen->builder.block = NULL;
+  start_block(gen, ir_block_new(func, "%entry"));
+  enter_scope(&gen->symbols);
+  codegen_params(gen, func_def, func);
+  codegen_block(gen, func_def->block);
+  if (!block_terminated(gen)) {
+    // 没有 return 的 int 函数返回 0
+    bool is_void = func_def->func_type == BType_VOID;
+    ir_return(&gen->builder, is_void ? NULL : integer(gen, 0));
+  }
+  leave_scope(&gen->symbols);
+  gen->builder.block = NULL;
+}
+
+static void codegen_function(IrGen *gen, AstFuncDef *func_def) {
+  Symbol *symbol = find_symbol(&gen->symbols, func_def->ident->name);
+  IrFunction *func = symbol_item(gen, symbol);
+  // 优化时加入的局部常量用完就丢，生成 IR 时局部符号重新从 0 开始编号
+  phase_begin(PHASE_OPTIMIZE);
+  int global_index = symbol_table_begin_function(&gen->symbols);
+  optimize_func_def(&gen->symbols, &gen->context->ast_arena, func_def);
+  symbol_table_end_function(&gen->symbols, global_index);
+  phase_end(PHASE_OPTIMIZE);
+  global_index = symbol_table_begin_function(&gen->symbols);
+  codegen_func_def(gen, func_def, func);
+  symbol_table_end_function(&gen->symbols, global_index);
+}
+
+// 登记函数的类型，创建还没有函数体的 IrFunction
+static void declare_function(IrGen *gen, AstFuncDef *func_def) {
+  Symbol *symbol = new_symbol(&gen->symbols, func_def->ident->name,
+                              SymbolType_func);
+  update_func_type(&gen->symbols, func_def, &symbol->func_type);
+  int param_count = func_def->param_count;
+  // 至少留一个位置，避免零长度数组
+  IrType *params[param_count + 1];
+  const char *names[param_count + 1];
+  FuncParam *param = func_def->params;
+  for (int i = 0; i < param_count; i++, param = param->next) {
+    params[i] = param_type(gen, param);
+    names[i] = ir_strf(gen->module, "@%s", param->ident->name);
+  }
+  IrType *type = ir_type_function(gen->module, params, param_count,
+                                  return_type(gen, func_def->func_type));
+  const char *name = ir_strf(gen->module, "@%s", func_def->ident->name);
+  bind_symbol(gen, symbol, ir_function_new(gen->module, name, type, names));
+  if (strcmp(func_def->ident->name, "main") == 0 && param_count == 0 &&
+      func_def->func_type == BType_INT) {
+    gen->has_main = true;
+  }
+}
+
+// 函数体之外的部分：优化并生成全局变量和常量，登记函数的类型
+static void codegen_global_def(IrGen *gen, AstBase *def) {
+  switch (def->type) {
+  case AST_FUNC_DEF:
+    declare_function(gen, (AstFuncDef *)def);
+    break;
+  case AST_VAR_DECL:
+    phase_begin(PHASE_OPTIMIZE);
+    optimize_global_var_decl(&gen->symbols, &gen->context->ast_arena,
+                             (AstVarDecl *)def);
+    phase_end(PHASE_OPTIMIZE);
+    codegen_global_var_decl(gen, (AstVarDecl *)def);
+    break;
+  case AST_CONST_DECL:
+    phase_begin(PHASE_OPTIMIZE);
+    optimize_const_decl(&gen->symbols, &gen->context->ast_arena,
+                        (AstConstDecl *)def);
+    phase_end(PHASE_OPTIMIZE);
+    codegen_global_const_decl(gen, (AstConstDecl *)def);
+    break;
+  default:
+    fatalf("未知的定义类型\n");
+  }
+}
+
+// SysY 运行时库的声明
+static void codegen_lib_decl(IrGen *gen) {
+  Symbol *symbols[LIB_FUNCTION_COUNT];
+  declare_lib_symbols(&gen->symbols, &gen->context->intern_pool, symbols);
+  for (int i = 0; i < LIB_FUNCTION_COUNT; i++) {
+    FunctionType *func_type = &symbols[i]->func_type;
+    IrType *params[func_type->param_count + 1];
+    for (int j = 0; j < func_type->param_count; j++) {
+      params[j] = func_type->param_types[j] == BType_POINTER
+                      ? ir_type_pointer(gen->module, gen->module->i32)
+                      : gen->module->i32;
+    }
+    IrType *type = ir_type_function(gen->module, params, func_type->param_count,
+                                    return_type(gen, func_type->return_type));
+    const char *name = ir_strf(gen->module, "@%s", symbols[i]->name);
+    bind_symbol(gen, symbols[i],
+                ir_function_new(gen->module, name, type, NULL));
+  }
+}
+
+// #endregion
+
+static void init(IrGen *gen, CompileContext *ctx, IrModule *module) {
+  memset(gen, 0, sizeof(IrGen));
+  gen->context = ctx;
+  gen->module = module;
+  gen->builder = (IrBuilder){module, NULL};
+  symbol_table_init(&gen->symbols);
+  value_map_init(&gen->globals.indexes);
+  value_map_init(&gen->locals.indexes);
+}
+
+static void finish(IrGen *gen) {
+  bindings_free(&gen->globals);
+  bindings_free(&gen->locals);
+  symbol_table_free(&gen->symbols);
+}
+
+void ir_gen(CompileContext *ctx, AstCompUnit *comp_unit, IrModule *module) {
+  phase_begin(PHASE_IR_EMIT);
+  IrGen gen;
+  init(&gen, ctx, module);
+  // 服务模式下出错时先释放状态，再跳回外层设置的位置
+  jmp_buf trap;
+  jmp_buf *outer = set_error_trap(NULL);
+  if (outer != NULL) {
+    set_error_trap(&trap);
+    if (setjmp(trap) != 0) {
+      finish(&gen);
+      set_error_trap(outer);
+      compile_error_exit();
+    }
+  }
+  codegen_lib_decl(&gen);
+  // 先处理全部的全局定义，函数可以调用在它后面定义的函数
+  for (int i = 0; i < comp_unit->count; i++) {
+    codegen_global_def(&gen, comp_unit->defs[i]);
+  }
+  // 在该 CompUnit 中, 必须存在且仅存在一个标识为 main, 无参数,
+  // 返回类型为 int 的 FuncDef (函数定义). main 函数是程序的入口点.
+  if (!gen.has_main) {
+    fatalf("入口函数 main 不存在\n");
+  }
+  for (int i = 0; i < comp_unit->count; i++) {
+    if (comp_unit->defs[i]->type == AST_FUNC_DEF) {
+      codegen_function(&gen, (AstFuncDef *)comp_unit->defs[i]);
+    }
+  }
+  set_error_trap(outer);
+  finish(&gen);
+  phase_end(PHASE_IR_EMIT);
+}
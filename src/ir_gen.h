@@ -0,0 +1,22 @@
+#ifndef SRC_IR_GEN_H_
+#define SRC_IR_GEN_H_
+
+#include "ast.h"
+#include "context.h"
+#include "ir.h"
+
+/*
+ * 从 AST 直接生成 ir.h 中的 IR ，写到已经初始化的 module 中
+ * 指令的形状和 koopa_ir_codegen 生成的文本一致（同样先优化 AST ，
+ * 基本块和 alloc 的名字也相同），所以后端对临时值的假设仍然成立。
+ * 和 koopa_ir_codegen 不同，只在当前线程中生成。
+ * 出错时 module 中可能留下生成了一半的内容，由调用方释放。
+ *
+ * 现在 koopa_ir.c 和这里各有一份从 AST 生成 IR 的代码，改生成方式时两边都要改。
+ * 打算让 koopa_ir.c 退役：ir_print 已经能输出相同的文本，
+ * 先把按函数生成（并行、-stream 、-lowmem 和缓存用到）移到 ir_gen 上，
+ * 文本路径改成 ir_gen 加 ir_print ，之后删掉 koopa_ir.c 中的生成代码。
+ */
+void ir_gen(CompileContext *ctx, AstCompUnit *comp_unit, IrModule *module);
+
+#endif // SRC_IR_GEN_H_
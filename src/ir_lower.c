@@ -0,0 +1,335 @@
+#include "ir_lower.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "utils.h"
+#include "value_map.h"
+
+_Static_assert((int)IR_RETURN == (int)KOOPA_RVT_RETURN,
+               "IrValueKind 和 koopa_raw_value_tag_t 的顺序不同");
+_Static_assert((int)IR_OP_SAR == (int)KOOPA_RBO_SAR,
+               "IrBinaryOp 和 koopa_raw_binary_op_t 的顺序不同");
+
+// 转换的状态，只在 ir_lower 执行期间有效
+typedef struct {
+  Arena *arena;
+  /*
+   * 全局变量、参数、块参数和指令按 IrValue::id 编号，
+   * 基本块按 IrBlock::id 编号，函数按在模块中的顺序编号，
+   * 它们的 raw 结构预先一次分配好，引用时直接按编号取，
+   * 值的使用出现在定义之前（比如跳回循环开头的实参）也没有关系。
+   * 常量不在任何基本块里，每次使用都转换一份。
+   */
+  koopa_raw_value_data_t *raw_values;
+  koopa_raw_basic_block_data_t *raw_blocks;
+  koopa_raw_function_data_t *raw_funcs;
+  // IrFunction * -> raw_funcs 中的下标
+  ValueMap func_indexes;
+  // 类型的数量很少，用哈希表缓存
+  ValueMap type_indexes;
+  koopa_raw_type_kind_t **raw_types;
+  int type_count;
+  int type_capacity;
+} Lowering;
+
+static koopa_raw_slice_t new_slice(Lowering *lowering,
+                                   koopa_raw_slice_item_kind_t kind, int len) {
+  koopa_raw_slice_t slice;
+  slice.buffer = arena_calloc(lowering->arena, len + 1, sizeof(void *));
+  slice.len = len;
+  slice.kind = kind;
+  return slice;
+}
+
+static koopa_raw_type_t lower_type(Lowering *lowering, const IrType *type) {
+  int index;
+  if (value_map_get(&lowering->type_indexes, type, &index)) {
+    return lowering->raw_types[index];
+  }
+  koopa_raw_type_kind_t *raw =
+      arena_calloc(lowering->arena, 1, sizeof(koopa_raw_type_kind_t));
+  if (lowering->type_count == lowering->type_capacity) {
+    lowering->type_capacity =
+        lowering->type_capacity == 0 ? 16 : lowering->type_capacity * 2;
+    lowering->raw_types = realloc(lowering->raw_types,
+                                  sizeof(void *) * lowering->type_capacity);
+  }
+  value_map_put(&lowering->type_indexes, type, lowering->type_count);
+  lowering->raw_types[lowering->type_count++] = raw;
+  switch (type->tag) {
+  case IR_TYPE_I32:
+    raw->tag = KOOPA_RTT_INT32;
+    break;
+  case IR_TYPE_UNIT:
+    raw->tag = KOOPA_RTT_UNIT;
+    break;
+  case IR_TYPE_ARRAY:
+    raw->tag = KOOPA_RTT_ARRAY;
+    raw->data.array.base = lower_type(lowering, type->base);
+    raw->data.array.len = type->len;
+    break;
+  case IR_TYPE_POINTER:
+    raw->tag = KOOPA_RTT_POINTER;
+    raw->data.pointer.base = lower_type(lowering, type->base);
+    break;
+  case IR_TYPE_FUNCTION:
+    raw->tag = KOOPA_RTT_FUNCTION;
+    raw->data.function.params =
+        new_slice(lowering, KOOPA_RSIK_TYPE, type->param_count);
+    for (int i = 0; i < type->param_count; i++) {
+      raw->data.function.params.buffer[i] = lower_type(lowering,
+                                                       type->params[i]);
+    }
+    raw->data.function.ret = lower_type(lowering, type->base);
+    break;
+  }
+  return raw;
+}
+
+static koopa_raw_function_data_t *function_ref(Lowering *lowering,
+                                               const IrFunction *func) {
+  int index;
+  bool found = value_map_get(&lowering->func_indexes, func, &index);
+  assert(found);
+  (void)found;
+  return &lowering->raw_funcs[index];
+}
+
+static bool is_constant(const IrValue *value) {
+  switch (value->kind) {
+  case IR_INTEGER:
+  case IR_ZERO_INIT:
+  case IR_UNDEF:
+  case IR_AGGREGATE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static koopa_raw_value_data_t *lower_value(Lowering *lowering,
+                                           const IrValue *value);
+
+static koopa_raw_value_t operand(Lowering *lowering, const IrUse *use) {
+  const IrValue *value = use->value;
+  if (is_constant(value)) {
+    return lower_value(lowering, value);
+  }
+  return &lowering->raw_values[value->id];
+}
+
+// 从 operands[start] 开始的 count 个操作数
+static koopa_raw_slice_t operand_slice(Lowering *lowering, const IrValue *value,
+                                       int start, int count) {
+  koopa_raw_slice_t slice = new_slice(lowering, KOOPA_RSIK_VALUE, count);
+  for (int i = 0; i < count; i++) {
+    slice.buffer[i] = operand(lowering, &value->operands[start + i]);
+  }
+  return slice;
+}
+
+// 使用这个值的指令，后端不依赖它，只是保持和 libkoopa 的结果一致
+static koopa_raw_slice_t used_by(Lowering *lowering, const IrValue *value) {
+  int count = 0;
+  for (IrUse *use = value->uses; use != NULL; use = use->next) {
+    count++;
+  }
+  koopa_raw_slice_t slice = new_slice(lowering, KOOPA_RSIK_VALUE, count);
+  int i = 0;
+  for (IrUse *use = value->uses; use != NULL; use = use->next) {
+    // 常量的使用者只有全局变量的初始值和 aggregate ，不需要记录
+    slice.buffer[i++] =
+        is_constant(use->user) ? NULL : &lowering->raw_values[use->user->id];
+  }
+  return slice;
+}
+
+// 填写 value 对应的 raw 结构，常量每次都返回新的结构
+static koopa_raw_value_data_t *lower_value(Lowering *lowering,
+                                           const IrValue *value) {
+  koopa_raw_value_data_t *raw;
+  if (is_constant(value)) {
+    raw = arena_calloc(lowering->arena, 1, sizeof(koopa_raw_value_data_t));
+    raw->used_by = new_slice(lowering, KOOPA_RSIK_VALUE, 0);
+  } else {
+    raw = &lowering->raw_values[value->id];
+    raw->used_by = used_by(lowering, value);
+  }
+  raw->ty = lower_type(lowering, value->type);
+  raw->name = value->name;
+  koopa_raw_value_kind_t *kind = &raw->kind;
+  kind->tag = (koopa_raw_value_tag_t)value->kind;
+  const IrUse *ops = value->operands;
+  switch (value->kind) {
+  case IR_INTEGER:
+    kind->data.integer.value = value->data.integer;
+    break;
+  case IR_ZERO_INIT:
+  case IR_UNDEF:
+  case IR_ALLOC:
+    break;
+  case IR_AGGREGATE:
+    kind->data.aggregate.elems =
+        operand_slice(lowering, value, 0, value->operand_count);
+    break;
+  case IR_FUNC_ARG:
+    kind->data.func_arg_ref.index = value->data.index;
+    break;
+  case IR_BLOCK_ARG:
+    kind->data.block_arg_ref.index = value->data.index;
+    break;
+  case IR_GLOBAL_ALLOC:
+    kind->data.global_alloc.init = operand(lowering, &ops[0]);
+    break;
+  case IR_LOAD:
+    kind->data.load.src = operand(lowering, &ops[0]);
+    break;
+  case IR_STORE:
+    kind->data.store.value = operand(lowering, &ops[0]);
+    kind->data.store.dest = operand(lowering, &ops[1]);
+    break;
+  case IR_GET_PTR:
+    kind->data.get_ptr.src = operand(lowering, &ops[0]);
+    kind->data.get_ptr.index = operand(lowering, &ops[1]);
+    break;
+  case IR_GET_ELEM_PTR:
+    kind->data.get_elem_ptr.src = operand(lowering, &ops[0]);
+    kind->data.get_elem_ptr.index = operand(lowering, &ops[1]);
+    break;
+  case IR_BINARY:
+    kind->data.binary.op = (koopa_raw_binary_op_t)value->data.op;
+    kind->data.binary.lhs = operand(lowering, &ops[0]);
+    kind->data.binary.rhs = operand(lowering, &ops[1]);
+    break;
+  case IR_BRANCH: {
+    int true_count = value->data.branch.true_arg_count;
+    koopa_raw_branch_t *branch = &kind->data.branch;
+    branch->cond = operand(lowering, &ops[0]);
+    branch->true_bb =
+        &lowering->raw_blocks[value->data.branch.true_block->id];
+    branch->false_bb =
+        &lowering->raw_blocks[value->data.branch.false_block->id];
+    branch->true_args = operand_slice(lowering, value, 1, true_count);
+    branch->false_args = operand_slice(lowering, value, 1 + true_count,
+                                       value->operand_count - 1 - true_count);
+    break;
+  }
+  case IR_JUMP:
+    kind->data.jump.target = &lowering->raw_blocks[value->data.target->id];
+    kind->data.jump.args = operand_slice(lowering, value, 0,
+                                         value->operand_count);
+    break;
+  case IR_CALL:
+    kind->data.call.callee = function_ref(lowering, value->data.callee);
+    kind->data.call.args = operand_slice(lowering, value, 0,
+                                         value->operand_count);
+    break;
+  case IR_RETURN:
+    kind->data.ret.value =
+        value->operand_count > 0 ? operand(lowering, &ops[0]) : NULL;
+    break;
+  }
+  return raw;
+}
+
+static void lower_block(Lowering *lowering, const IrBlock *block) {
+  koopa_raw_basic_block_data_t *raw = &lowering->raw_blocks[block->id];
+  raw->name = block->name;
+  raw->params = new_slice(lowering, KOOPA_RSIK_VALUE, block->param_count);
+  for (int i = 0; i < block->param_count; i++) {
+    raw->params.buffer[i] = lower_value(lowering, block->params[i]);
+  }
+  // 后端不使用基本块的 used_by
+  raw->used_by = new_slice(lowering, KOOPA_RSIK_VALUE, 0);
+  int count = 0;
+  for (const IrValue *inst = block->first; inst != NULL; inst = inst->next) {
+    count++;
+  }
+  raw->insts = new_slice(lowering, KOOPA_RSIK_VALUE, count);
+  int i = 0;
+  for (const IrValue *inst = block->first; inst != NULL; inst = inst->next) {
+    raw->insts.buffer[i++] = lower_value(lowering, inst);
+  }
+}
+
+static void lower_function(Lowering *lowering, const IrFunction *func) {
+  koopa_raw_function_data_t *raw = function_ref(lowering, func);
+  raw->ty = lower_type(lowering, func->type);
+  raw->name = func->name;
+  raw->params = new_slice(lowering, KOOPA_RSIK_VALUE, func->param_count);
+  for (int i = 0; i < func->param_count; i++) {
+    raw->params.buffer[i] = lower_value(lowering, func->params[i]);
+  }
+  int count = 0;
+  for (const IrBlock *block = func->first; block != NULL;
+       block = block->next) {
+    count++;
+  }
+  raw->bbs = new_slice(lowering, KOOPA_RSIK_BASIC_BLOCK, count);
+  int i = 0;
+  for (const IrBlock *block = func->first; block != NULL;
+       block = block->next) {
+    raw->bbs.buffer[i++] = &lowering->raw_blocks[block->id];
+    lower_block(lowering, block);
+  }
+}
+
+// 给全局变量、参数、块参数、指令和基本块编号，返回值的个数
+static int number_module(IrModule *module, int *block_count) {
+  int value_count = 0;
+  *block_count = 0;
+  for (int i = 0; i < module->global_count; i++) {
+    module->globals[i]->id = value_count++;
+  }
+  for (int i = 0; i < module->func_count; i++) {
+    IrFunction *func = module->funcs[i];
+    for (int j = 0; j < func->param_count; j++) {
+      func->params[j]->id = value_count++;
+    }
+    for (IrBlock *block = func->first; block != NULL; block = block->next) {
+      block->id = (*block_count)++;
+      for (int j = 0; j < block->param_count; j++) {
+        block->params[j]->id = value_count++;
+      }
+      for (IrValue *inst = block->first; inst != NULL; inst = inst->next) {
+        inst->id = value_count++;
+      }
+    }
+  }
+  return value_count;
+}
+
+koopa_raw_program_t ir_lower(IrModule *module, Arena *arena) {
+  Lowering lowering = {0};
+  lowering.arena = arena;
+  int block_count;
+  int value_count = number_module(module, &block_count);
+  lowering.raw_values =
+      arena_calloc(arena, value_count + 1, sizeof(koopa_raw_value_data_t));
+  lowering.raw_blocks = arena_calloc(arena, block_count + 1,
+                                     sizeof(koopa_raw_basic_block_data_t));
+  lowering.raw_funcs = arena_calloc(arena, module->func_count + 1,
+                                    sizeof(koopa_raw_function_data_t));
+  value_map_init(&lowering.func_indexes);
+  value_map_init(&lowering.type_indexes);
+  for (int i = 0; i < module->func_count; i++) {
+    value_map_put(&lowering.func_indexes, module->funcs[i], i);
+  }
+
+  koopa_raw_program_t program;
+  program.values = new_slice(&lowering, KOOPA_RSIK_VALUE, module->global_count);
+  for (int i = 0; i < module->global_count; i++) {
+    program.values.buffer[i] = lower_value(&lowering, module->globals[i]);
+  }
+  program.funcs = new_slice(&lowering, KOOPA_RSIK_FUNCTION, module->func_count);
+  for (int i = 0; i < module->func_count; i++) {
+    lower_function(&lowering, module->funcs[i]);
+    program.funcs.buffer[i] = &lowering.raw_funcs[i];
+  }
+
+  value_map_free(&lowering.func_indexes);
+  value_map_free(&lowering.type_indexes);
+  free(lowering.raw_types);
+  return program;
+}
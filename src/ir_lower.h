@@ -0,0 +1,16 @@
+#ifndef SRC_IR_LOWER_H_
+#define SRC_IR_LOWER_H_
+
+#include "arena.h"
+#include "ir.h"
+#include "koopa.h"
+
+/*
+ * 把 IR 转换成 koopa_raw_program_t ，交给 RISC-V 后端
+ * 和 libkoopa 解析文本得到的结果结构相同，后端不需要区分来源。
+ * 结果中的内存都分配在 arena 中，名字指向 module 中的字符串，
+ * 所以 arena 和 module 都要在后端处理完之后才能释放。
+ */
+koopa_raw_program_t ir_lower(IrModule *module, Arena *arena);
+
+#endif // SRC_IR_LOWER_H_
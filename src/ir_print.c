@@ -0,0 +1,240 @@
+#include <assert.h>
+
+#include "emit.h"
+#include "ir.h"
+#include "utils.h"
+
+static const char *const binary_op_names[] = {
+    "ne",  "eq",  "gt",  "lt", "ge", "le",  "add", "sub", "mul",
+    "div", "mod", "and", "or", "xor", "shl", "shr", "sar",
+};
+
+static void print_type(Emitter *out, const IrType *type) {
+  switch (type->tag) {
+  case IR_TYPE_I32:
+    emit_str(out, "i32");
+    break;
+  case IR_TYPE_ARRAY:
+    emit_char(out, '[');
+    print_type(out, type->base);
+    emitf(out, ", %d]", type->len);
+    break;
+  case IR_TYPE_POINTER:
+    emit_char(out, '*');
+    print_type(out, type->base);
+    break;
+  default:
+    fatalf("print_type unknown type: %d\n", type->tag);
+  }
+}
+
+static void print_value(Emitter *out, const IrValue *value) {
+  switch (value->kind) {
+  case IR_INTEGER:
+    emit_int(out, value->data.integer);
+    break;
+  case IR_ZERO_INIT:
+    emit_str(out, "zeroinit");
+    break;
+  case IR_UNDEF:
+    emit_str(out, "undef");
+    break;
+  case IR_AGGREGATE:
+    emit_char(out, '{');
+    for (int i = 0; i < value->operand_count; i++) {
+      if (i > 0) {
+        emit_str(out, ", ");
+      }
+      print_value(out, value->operands[i].value);
+    }
+    emit_char(out, '}');
+    break;
+  default:
+    if (value->name != NULL) {
+      emit_str(out, value->name);
+    } else {
+      emit_char(out, '%');
+      emit_int(out, value->id);
+    }
+  }
+}
+
+// 从 operands[start] 开始的 count 个实参
+static void print_target(Emitter *out, const IrBlock *target,
+                         const IrValue *inst, int start, int count) {
+  emit_str(out, target->name);
+  if (count == 0) {
+    return;
+  }
+  emit_char(out, '(');
+  for (int i = 0; i < count; i++) {
+    if (i > 0) {
+      emit_str(out, ", ");
+    }
+    print_value(out, inst->operands[start + i].value);
+  }
+  emit_char(out, ')');
+}
+
+static void print_inst(Emitter *out, const IrValue *inst) {
+  emit_str(out, "  ");
+  if (inst->type->tag != IR_TYPE_UNIT) {
+    print_value(out, inst);
+    emit_str(out, " = ");
+  }
+  switch (inst->kind) {
+  case IR_ALLOC:
+    emit_str(out, "alloc ");
+    print_type(out, inst->type->base);
+    break;
+  case IR_LOAD:
+    emit_str(out, "load ");
+    print_value(out, inst->operands[0].value);
+    break;
+  case IR_STORE:
+    emit_str(out, "store ");
+    print_value(out, inst->operands[0].value);
+    emit_str(out, ", ");
+    print_value(out, inst->operands[1].value);
+    break;
+  case IR_GET_PTR:
+  case IR_GET_ELEM_PTR:
+    emit_str(out, inst->kind == IR_GET_PTR ? "getptr " : "getelemptr ");
+    print_value(out, inst->operands[0].value);
+    emit_str(out, ", ");
+    print_value(out, inst->operands[1].value);
+    break;
+  case IR_BINARY:
+    emit_str(out, binary_op_names[inst->data.op]);
+    emit_char(out, ' ');
+    print_value(out, inst->operands[0].value);
+    emit_str(out, ", ");
+    print_value(out, inst->operands[1].value);
+    break;
+  case IR_BRANCH: {
+    int true_count = inst->data.branch.true_arg_count;
+    emit_str(out, "br ");
+    print_value(out, inst->operands[0].value);
+    emit_str(out, ", ");
+    print_target(out, inst->data.branch.true_block, inst, 1, true_count);
+    emit_str(out, ", ");
+    print_target(out, inst->data.branch.false_block, inst, 1 + true_count,
+                 inst->operand_count - 1 - true_count);
+    break;
+  }
+  case IR_JUMP:
+    emit_str(out, "jump ");
+    print_target(out, inst->data.target, inst, 0, inst->operand_count);
+    break;
+  case IR_CALL:
+    emitf(out, "call %s(", inst->data.callee->name);
+    for (int i = 0; i < inst->operand_count; i++) {
+      if (i > 0) {
+        emit_str(out, ", ");
+      }
+      print_value(out, inst->operands[i].value);
+    }
+    emit_char(out, ')');
+    break;
+  case IR_RETURN:
+    emit_str(out, "ret");
+    if (inst->operand_count > 0) {
+      emit_char(out, ' ');
+      print_value(out, inst->operands[0].value);
+    }
+    break;
+  default:
+    fatalf("print_inst unknown kind: %d\n", inst->kind);
+  }
+  emit_char(out, '\n');
+}
+
+// 没有名字的块参数和指令结果按出现的顺序编号为 %0, %1, ...
+static void number_values(IrFunction *func) {
+  int id = 0;
+  for (IrBlock *block = func->first; block != NULL; block = block->next) {
+    for (int i = 0; i < block->param_count; i++) {
+      block->params[i]->id = id++;
+    }
+    for (IrValue *inst = block->first; inst != NULL; inst = inst->next) {
+      if (inst->type->tag != IR_TYPE_UNIT && inst->name == NULL) {
+        inst->id = id++;
+      }
+    }
+  }
+}
+
+static void print_block(Emitter *out, const IrBlock *block) {
+  emit_str(out, block->name);
+  if (block->param_count > 0) {
+    emit_char(out, '(');
+    for (int i = 0; i < block->param_count; i++) {
+      if (i > 0) {
+        emit_str(out, ", ");
+      }
+      print_value(out, block->params[i]);
+      emit_str(out, ": ");
+      print_type(out, block->params[i]->type);
+    }
+    emit_char(out, ')');
+  }
+  emit_str(out, ":\n");
+  for (const IrValue *inst = block->first; inst != NULL; inst = inst->next) {
+    print_inst(out, inst);
+  }
+}
+
+static void print_function(Emitter *out, IrFunction *func) {
+  bool decl = ir_function_is_decl(func);
+  emitf(out, "%s %s(", decl ? "decl" : "fun", func->name);
+  for (int i = 0; i < func->param_count; i++) {
+    if (i > 0) {
+      emit_str(out, ", ");
+    }
+    if (!decl) {
+      emitf(out, "%s: ", func->params[i]->name);
+    }
+    print_type(out, func->params[i]->type);
+  }
+  emit_char(out, ')');
+  if (func->type->base->tag != IR_TYPE_UNIT) {
+    emit_str(out, ": ");
+    print_type(out, func->type->base);
+  }
+  if (decl) {
+    emit_char(out, '\n');
+    return;
+  }
+  emit_str(out, " {\n");
+  number_values(func);
+  for (const IrBlock *block = func->first; block != NULL;
+       block = block->next) {
+    if (block != func->first) {
+      emit_char(out, '\n');
+    }
+    print_block(out, block);
+  }
+  emit_str(out, "}\n");
+}
+
+void ir_print_module(IrModule *module, Emitter *output) {
+  for (int i = 0; i < module->func_count; i++) {
+    if (ir_function_is_decl(module->funcs[i])) {
+      print_function(output, module->funcs[i]);
+    }
+  }
+  for (int i = 0; i < module->global_count; i++) {
+    IrValue *global = module->globals[i];
+    emitf(output, "\nglobal %s = alloc ", global->name);
+    print_type(output, global->type->base);
+    emit_str(output, ", ");
+    print_value(output, global->operands[0].value);
+    emit_char(output, '\n');
+  }
+  for (int i = 0; i < module->func_count; i++) {
+    if (!ir_function_is_decl(module->funcs[i])) {
+      emit_char(output, '\n');
+      print_function(output, module->funcs[i]);
+    }
+  }
+}
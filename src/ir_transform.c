@@ -0,0 +1,85 @@
+#include <stdlib.h>
+
+#include "ir.h"
+#include "pass.h"
+
+bool ir_remove_unreachable_blocks(IrFunction *func) {
+  bool changed = false;
+  // 不可达的块之间可能互相使用对方的值，先断开所有使用再删除
+  for (IrBlock *block = func->first; block != NULL; block = block->next) {
+    if (block->rpo >= 0) {
+      continue;
+    }
+    for (IrValue *inst = block->first; inst != NULL; inst = inst->next) {
+      for (int i = 0; i < inst->operand_count; i++) {
+        ir_use_set(&inst->operands[i], NULL);
+      }
+    }
+    changed = true;
+  }
+  if (!changed) {
+    return false;
+  }
+  IrBlock *block = func->first;
+  while (block != NULL) {
+    IrBlock *next = block->next;
+    if (block->rpo < 0) {
+      ir_block_remove(block);
+    }
+    block = next;
+  }
+  return true;
+}
+
+// 常量、全局变量和参数不在基本块里；块参数要和跳转的实参一起删除，这里不处理
+static bool is_dead(const IrValue *inst) {
+  return inst->block != NULL && inst->kind != IR_BLOCK_ARG &&
+         !ir_has_uses(inst) &&
+         !ir_has_side_effect(inst);
+}
+
+bool ir_eliminate_dead_code(IrFunction *func) {
+  int capacity = 64;
+  int count = 0;
+  IrValue **worklist = malloc(sizeof(IrValue *) * capacity);
+  for (IrBlock *block = func->first; block != NULL; block = block->next) {
+    for (IrValue *inst = block->first; inst != NULL; inst = inst->next) {
+      if (!is_dead(inst)) {
+        continue;
+      }
+      if (count == capacity) {
+        capacity *= 2;
+        worklist = realloc(worklist, sizeof(IrValue *) * capacity);
+      }
+      worklist[count++] = inst;
+    }
+  }
+  bool changed = false;
+  while (count > 0) {
+    IrValue *inst = worklist[--count];
+    // 同一条指令可能因为多个操作数被重复加入
+    if (!is_dead(inst)) {
+      continue;
+    }
+    // 删除之后操作数可能也没有使用了
+    int operand_count = inst->operand_count;
+    IrValue *operands[operand_count + 1];
+    for (int i = 0; i < operand_count; i++) {
+      operands[i] = inst->operands[i].value;
+    }
+    ir_inst_remove(inst);
+    changed = true;
+    for (int i = 0; i < operand_count; i++) {
+      if (!is_dead(operands[i])) {
+        continue;
+      }
+      if (count == capacity) {
+        capacity *= 2;
+        worklist = realloc(worklist, sizeof(IrValue *) * capacity);
+      }
+      worklist[count++] = operands[i];
+    }
+  }
+  free(worklist);
+  return changed;
+}
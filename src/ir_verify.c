@@ -0,0 +1,222 @@
+#include <stddef.h>
+
+#include "ir.h"
+#include "pass.h"
+#include "utils.h"
+
+// 在检查 func 的函数中使用，报错时输出函数名
+#define verify(cond, fmt, ...)                                                 \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fatalf("IR 验证失败 %s: " fmt "\n", func->name, ##__VA_ARGS__);          \
+    }                                                                          \
+  } while (0)
+
+static const char *block_name(const IrBlock *block) {
+  return block != NULL ? block->name : "(null)";
+}
+
+// 操作数在它的值的使用链表中
+static void verify_use(const IrFunction *func, const IrValue *inst,
+                       const IrUse *use) {
+  const IrValue *value = use->value;
+  verify(value != NULL, "%s 中的指令有空操作数", block_name(inst->block));
+  verify(use->user == inst, "%s 中操作数的 user 错误", inst->block->name);
+  if (use->prev != NULL) {
+    verify(use->prev->next == use, "%s 中使用链表断开", inst->block->name);
+  } else {
+    verify(value->uses == use, "%s 中操作数不在使用链表中",
+           inst->block->name);
+  }
+  if (use->next != NULL) {
+    verify(use->next->prev == use, "%s 中使用链表断开", inst->block->name);
+  }
+  verify(value->type->tag != IR_TYPE_UNIT, "%s 中使用了没有值的指令",
+         inst->block->name);
+}
+
+// 定义支配使用，块参数在块的开头定义
+static void verify_dominance(const IrFunction *func, const IrValue *inst,
+                             const IrValue *value) {
+  if (value->block == NULL) {
+    if (value->kind == IR_FUNC_ARG) {
+      verify(value->data.index < func->param_count &&
+                 func->params[value->data.index] == value,
+             "%s 中使用了其他函数的参数", inst->block->name);
+    }
+    return;
+  }
+  const IrBlock *def = value->block;
+  const IrBlock *use = inst->block;
+  verify(def->func == func, "%s 中使用了其他函数的值", use->name);
+  if (use->rpo < 0) {
+    // 不可达的块里什么都可以用，由删除不可达块的 pass 清理
+    return;
+  }
+  verify(def->rpo >= 0, "%s 中使用了不可达的块 %s 中的值", use->name,
+         def->name);
+  if (def != use || value->kind == IR_BLOCK_ARG) {
+    verify(ir_dominates(def, use), "%s 中的值在 %s 中使用，没有支配使用",
+           def->name, use->name);
+    return;
+  }
+  // 同一个块里定义在使用之前，id 是指令在块中的位置
+  verify(value->id < inst->id, "%s 中的值在定义之前使用", use->name);
+}
+
+static void verify_args(const IrFunction *func, const IrValue *inst,
+                        const IrBlock *target, int start, int count) {
+  verify(target != NULL && target->func == func,
+         "%s 跳转到其他函数的基本块", inst->block->name);
+  verify(target != func->first, "%s 跳转到入口块", inst->block->name);
+  verify(count == target->param_count, "%s 跳转到 %s 的实参个数错误",
+         inst->block->name, target->name);
+  for (int i = 0; i < count; i++) {
+    verify(ir_type_equal(inst->operands[start + i].value->type,
+                         target->params[i]->type),
+           "%s 跳转到 %s 的第 %d 个实参类型错误", inst->block->name,
+           target->name, i);
+  }
+}
+
+static bool is_i32(const IrValue *value) {
+  return value->type->tag == IR_TYPE_I32;
+}
+
+static bool is_pointer(const IrValue *value) {
+  return value->type->tag == IR_TYPE_POINTER;
+}
+
+static void verify_types(const IrFunction *func, const IrValue *inst) {
+  const char *name = inst->block->name;
+  const IrUse *ops = inst->operands;
+  switch (inst->kind) {
+  case IR_ALLOC:
+    verify(is_pointer(inst) && inst->operand_count == 0, "%s 中 alloc 错误",
+           name);
+    break;
+  case IR_LOAD:
+    verify(inst->operand_count == 1 && is_pointer(ops[0].value) &&
+               ir_type_equal(ops[0].value->type->base, inst->type),
+           "%s 中 load 类型错误", name);
+    break;
+  case IR_STORE:
+    verify(inst->operand_count == 2 && is_pointer(ops[1].value) &&
+               ir_type_equal(ops[1].value->type->base, ops[0].value->type),
+           "%s 中 store 类型错误", name);
+    break;
+  case IR_GET_PTR:
+  case IR_GET_ELEM_PTR:
+    verify(inst->operand_count == 2 && is_pointer(ops[0].value) &&
+               is_i32(ops[1].value) && is_pointer(inst),
+           "%s 中 getptr 类型错误", name);
+    if (inst->kind == IR_GET_ELEM_PTR) {
+      const IrType *base = ops[0].value->type->base;
+      verify(base->tag == IR_TYPE_ARRAY &&
+                 ir_type_equal(base->base, inst->type->base),
+             "%s 中 getelemptr 类型错误", name);
+    } else {
+      verify(ir_type_equal(ops[0].value->type, inst->type),
+             "%s 中 getptr 类型错误", name);
+    }
+    break;
+  case IR_BINARY:
+    verify(inst->operand_count == 2 && is_i32(ops[0].value) &&
+               is_i32(ops[1].value) && is_i32(inst),
+           "%s 中二元运算类型错误", name);
+    break;
+  case IR_BRANCH: {
+    int true_count = inst->data.branch.true_arg_count;
+    verify(inst->operand_count >= 1 + true_count && is_i32(ops[0].value),
+           "%s 中 br 的条件错误", name);
+    verify_args(func, inst, inst->data.branch.true_block, 1, true_count);
+    verify_args(func, inst, inst->data.branch.false_block, 1 + true_count,
+                inst->operand_count - 1 - true_count);
+    break;
+  }
+  case IR_JUMP:
+    verify_args(func, inst, inst->data.target, 0, inst->operand_count);
+    break;
+  case IR_CALL: {
+    const IrType *type = inst->data.callee->type;
+    verify(inst->operand_count == type->param_count, "%s 中调用 %s 参数个数错误",
+           name, inst->data.callee->name);
+    for (int i = 0; i < inst->operand_count; i++) {
+      verify(ir_type_equal(ops[i].value->type, type->params[i]),
+             "%s 中调用 %s 的第 %d 个参数类型错误", name,
+             inst->data.callee->name, i);
+    }
+    verify(ir_type_equal(inst->type, type->base), "%s 中调用 %s 返回类型错误",
+           name, inst->data.callee->name);
+    break;
+  }
+  case IR_RETURN: {
+    const IrType *ret = func->type->base;
+    if (ret->tag == IR_TYPE_UNIT) {
+      verify(inst->operand_count == 0, "%s 中 ret 不应该有返回值", name);
+    } else {
+      verify(inst->operand_count == 1 &&
+                 ir_type_equal(ops[0].value->type, ret),
+             "%s 中 ret 返回值类型错误", name);
+    }
+    break;
+  }
+  default:
+    verify(false, "%s 中有不是指令的值 %d", name, inst->kind);
+  }
+}
+
+static void verify_block(const IrFunction *func, const IrBlock *block) {
+  verify(block->func == func, "%s 不属于这个函数", block->name);
+  verify(block->name != NULL && block->name[0] == '%', "基本块名字错误");
+  verify(block->first != NULL, "%s 是空的基本块", block->name);
+  verify(ir_block_terminator(block) != NULL, "%s 没有以跳转或返回结束",
+         block->name);
+  for (int i = 0; i < block->param_count; i++) {
+    const IrValue *param = block->params[i];
+    verify(param->kind == IR_BLOCK_ARG && param->block == block &&
+               param->data.index == i,
+           "%s 的第 %d 个参数错误", block->name, i);
+  }
+  int position = 0;
+  const IrValue *prev = NULL;
+  for (IrValue *inst = block->first; inst != NULL; inst = inst->next) {
+    verify(inst->block == block && inst->prev == prev, "%s 中指令链表错误",
+           block->name);
+    verify(inst == block->last || !ir_is_terminator(inst),
+           "%s 中跳转或返回之后还有指令", block->name);
+    inst->id = position++;
+    prev = inst;
+  }
+  verify(prev == block->last, "%s 中指令链表错误", block->name);
+}
+
+void ir_verify_function(IrFunction *func) {
+  if (ir_function_is_decl(func)) {
+    return;
+  }
+  verify(func->first->param_count == 0, "入口块不能有参数");
+  ir_require_analyses(func, IR_ANALYSIS_DOMINATORS);
+  const IrBlock *prev = NULL;
+  for (IrBlock *block = func->first; block != NULL; block = block->next) {
+    verify(block->prev == prev, "%s 前后的基本块链表错误", block->name);
+    verify_block(func, block);
+    prev = block;
+  }
+  verify(prev == func->last, "基本块链表错误");
+  for (IrBlock *block = func->first; block != NULL; block = block->next) {
+    for (IrValue *inst = block->first; inst != NULL; inst = inst->next) {
+      for (int i = 0; i < inst->operand_count; i++) {
+        verify_use(func, inst, &inst->operands[i]);
+        verify_dominance(func, inst, inst->operands[i].value);
+      }
+      verify_types(func, inst);
+    }
+  }
+}
+
+void ir_verify_module(IrModule *module) {
+  for (int i = 0; i < module->func_count; i++) {
+    ir_verify_function(module->funcs[i]);
+  }
+}
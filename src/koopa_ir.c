@@ -1,738 +1,144 @@
 #include "koopa_ir.h"
 
 #include <assert.h>
+#include <setjmp.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "ast.h"
+#include "cache.h"
+#include "context.h"
+#include "emit.h"
+#include "intern.h"
+#include "optimize.h"
+#include "symbol.h"
+#include "thread_pool.h"
+#include "time_report.h"
 #include "utils.h"
 
-FILE *fp = NULL;
-// IR 里面 %0, %1, %2 等符号的索引计数
-int temp_sign_index = 0;
-// if 计数，用来生成唯一的标签
-int if_index = 0;
-// while 计数，用来生成唯一的标签
-int while_index = 0;
-/*
- * while body 计数，用来给 break continue 后的指令生成唯一标签
- * break continue 会中断当前指令的 basic block
- * 所以需要重新生成一个新的 basic block
- */
-int while_body_index = 0;
-// while 栈结构，用来辅助 break continue 生成
-IntStack while_stack;
-// 逻辑运算（ && || ）计数，用来生成唯一的标签
-int logic_index = 0;
-// 用来判断是否生成 ret 指令，没有需要在末尾补上
-bool output_ret_inst = false;
-// ptr 计数
-int ptr_index = 0;
-// codegen 当前正在处理的函数
-AstFuncDef *current_func_def = NULL;
-
-static bool starts_with(const char *str, const char *prefix) {
-  // 移除前面的空格
-  while (*str == ' ') {
-    str++;
-  }
-  return strncmp(str, prefix, strlen(prefix)) == 0;
-}
-
-static void outputf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
-static void outputf(const char *fmt, ...) {
-  output_ret_inst = starts_with(fmt, "ret");
+static void outputf(KoopaGen *gen, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+static void outputf(KoopaGen *gen, const char *fmt, ...) {
+  // 生成 ret 指令的地方会在输出之后重新设置
+  gen->output_ret_inst = false;
   va_list args;
   va_start(args, fmt);
-  vfprintf(fp, fmt, args);
+  emitter_vemitf(&gen->emitter, fmt, args);
   va_end(args);
 }
 
-typedef enum {
-  SymbolType_int,
-  SymbolType_func,
-  SymbolType_array,
-  SymbolType_pointer,
-  SymbolType_array_pointer,
-} SymbolType;
-
+// #region 生成 IR
+static void codegen_array_init_value(KoopaGen *gen, const int *dimensions,
+                                     int dimension_count,
+                                     const AstArrayInit *init, int start,
+                                     int *next);
+static void codegen_exp(KoopaGen *gen, AstExp *exp);
+static void codegen_block(KoopaGen *gen, AstBlock *block);
+static void codegen_stmt(KoopaGen *gen, AstStmt *stmt);
+
+// 表达式的结果，整数或者 %0, %1, %2 等临时值
 typedef struct {
-  BType return_type;
-  BType *param_types;
-  int param_count;
-} FunctionType;
-
-void update_func_type(AstFuncDef *func_def, FunctionType *func_type) {
-  func_type->return_type = func_def->func_type;
-  func_type->param_count = func_def->param_count;
-  func_type->param_types = malloc(sizeof(BType) * func_type->param_count);
-  FuncParam *param = func_def->params;
-  for (int i = 0; i < func_type->param_count; i++) {
-    func_type->param_types[i] = param->type;
-    param = param->next;
-  }
-}
-
-typedef struct Symbol Symbol;
-typedef struct Symbol {
-  const char *name;
-  bool is_const_value;
+  bool is_number;
   int value;
-  int level;    // 符号的作用域
-  int index;    // 符号的计数，用来生成唯一的符号名
-  Symbol *next; // 指向下一个符号
-
-  SymbolType type;
-  FunctionType func_type; // 函数的类型
-  int *dimensions;        // 数组的维度
-  int dimension_count;
-} Symbol;
-
-static Symbol symbol_table_head = {NULL, false, 0, 0, 0, NULL, SymbolType_int};
-
-static void reset_symbol_table() {
-  Symbol *symbol = symbol_table_head.next;
-  while (symbol) {
-    Symbol *next = symbol->next;
-    free(symbol);
-    symbol = next;
-  }
-  symbol_table_head.name = NULL;
-  symbol_table_head.is_const_value = false;
-  symbol_table_head.value = 0;
-  symbol_table_head.level = 0;
-  symbol_table_head.index = 0;
-  symbol_table_head.next = NULL;
-}
-
-static Symbol *find_symbol(const char *name) {
-  Symbol *symbol = symbol_table_head.next;
-  while (symbol) {
-    if (strcmp(symbol->name, name) == 0) {
-      return symbol;
-    }
-    symbol = symbol->next;
-  }
-  return NULL;
-}
-
-static Symbol *new_symbol(const char *name, SymbolType type) {
-  Symbol *found = find_symbol(name);
-  if (found != NULL && found->level == symbol_table_head.level) {
-    fprintf(stderr, "符号 %s 已经存在\n", name);
-    exit(1);
-  }
-  Symbol *symbol = calloc(1, sizeof(Symbol));
-  symbol->name = name;
-  symbol->is_const_value = false;
-  symbol->value = 0;
-  symbol->level = symbol_table_head.level;
-  symbol->next = symbol_table_head.next;
-  symbol->index = symbol_table_head.index++;
-  symbol->type = type;
-  symbol_table_head.next = symbol;
-  return symbol;
-}
-
-static const char *symbol_unique_name(Symbol *symbol) {
-  size_t size = strlen(symbol->name) + 32;
-  char *buf = malloc(size);
-  snprintf(buf, size, "@%s_%d_%d", symbol->name, symbol->level, symbol->index);
-  return buf;
-}
-
-static int eval_symbol(const char *name) {
-  Symbol *symbol = find_symbol(name);
-  if (symbol == NULL) {
-    fatalf("eval 未定义的符号 %s\n", name);
-  }
-  if (!symbol->is_const_value) {
-    fprintf(stderr, "符号 %s 不是常量\n", name);
-    exit(1);
-  }
-  return symbol->value;
-}
-
-static void enter_scope() { symbol_table_head.level++; }
-
-static void leave_scope() {
-  Symbol *symbol = symbol_table_head.next;
-  while (symbol) {
-    Symbol *next = symbol->next;
-    if (symbol->level == symbol_table_head.level) {
-      free(symbol);
-    } else {
-      break;
-    }
-    symbol = next;
-  }
-  symbol_table_head.next = symbol;
-  symbol_table_head.level--;
-}
-
-// #region 优化 AST
-
-int eval_const_exp(AstExp *exp);
-AstExp *optimize_exp(AstExp *exp);
-void optimize_block(AstBlock *block);
-void optimize_stmt(AstStmt *stmt);
-
-bool is_const_exp(AstExp *exp) {
-  switch (exp->type) {
-  case AST_NUMBER:
-    return true;
-  case AST_IDENTIFIER: {
-    AstIdentifier *ident = (AstIdentifier *)exp;
-    Symbol *symbol = find_symbol(ident->name);
-    return symbol != NULL && symbol->is_const_value;
-  }
-  case AST_UNARY_EXP: {
-    AstUnaryExp *unary_exp = (AstUnaryExp *)exp;
-    return is_const_exp(unary_exp->operand);
-  }
-  case AST_BINARY_EXP: {
-    AstBinaryExp *binary_exp = (AstBinaryExp *)exp;
-    return is_const_exp(binary_exp->lhs) && is_const_exp(binary_exp->rhs);
-  }
-  default:
-    return false;
-  }
-  return false;
-}
+} Operand;
 
-int eval_array_value(AstArrayValue *array_value) {
-  AstExp **elements = array_value->elements;
-  for (int i = 0; i < array_value->count; i++) {
-    if (elements[i]->type == AST_ARRAY_VALUE) {
-      eval_const_exp(elements[i]);
-    } else if (elements[i]->type == AST_NUMBER) {
-    } else {
-      int val = eval_const_exp(elements[i]);
-      AstNumber *number = new_ast_number();
-      number->number = val;
-      elements[i] = (AstExp *)number;
-    }
-  }
-  return -1;
-}
-
-int eval_const_exp(AstExp *exp) {
-  switch (exp->type) {
-  case AST_NUMBER:
-    return ((AstNumber *)exp)->number;
-  case AST_ARRAY_VALUE:
-    return eval_array_value((AstArrayValue *)exp);
-  case AST_IDENTIFIER: {
-    AstIdentifier *ident = (AstIdentifier *)exp;
-    return eval_symbol(ident->name);
-  }
-  case AST_UNARY_EXP: {
-    AstUnaryExp *unary_exp = (AstUnaryExp *)exp;
-    int operand = eval_const_exp(unary_exp->operand);
-    switch (unary_exp->op) {
-    case '-':
-      return -operand;
-    case '!':
-      return !operand;
-    case '+':
-      return operand;
-    default:
-      fprintf(stderr, "未知的一元运算符 %c\n", unary_exp->op);
-      exit(1);
-    }
-  }
-  case AST_BINARY_EXP: {
-    AstBinaryExp *binary_exp = (AstBinaryExp *)exp;
-    int lhs = eval_const_exp(binary_exp->lhs);
-    int rhs = eval_const_exp(binary_exp->rhs);
-    switch (binary_exp->op) {
-    case BinaryOpType_ADD:
-      return lhs + rhs;
-    case BinaryOpType_SUB:
-      return lhs - rhs;
-    case BinaryOpType_MUL:
-      return lhs * rhs;
-    case BinaryOpType_DIV:
-      return lhs / rhs;
-    case BinaryOpType_MOD:
-      return lhs % rhs;
-    case BinaryOpType_EQ:
-      return lhs == rhs;
-    case BinaryOpType_NE:
-      return lhs != rhs;
-    case BinaryOpType_LT:
-      return lhs < rhs;
-    case BinaryOpType_LE:
-      return lhs <= rhs;
-    case BinaryOpType_GT:
-      return lhs > rhs;
-    case BinaryOpType_GE:
-      return lhs >= rhs;
-    case BinaryOpType_AND:
-      return lhs && rhs;
-    case BinaryOpType_OR:
-      return lhs || rhs;
-    default:
-      fprintf(stderr, "未知的二元运算符\n");
-      exit(1);
-    }
-  }
-  default:
-    fprintf(stderr, "非常量表达式\n");
-    exit(1);
+// 返回表达式的结果，需要紧跟在 codegen_exp(gen, exp) 之后调用
+static Operand exp_operand(KoopaGen *gen, AstExp *exp) {
+  if (exp->type == AST_NUMBER) {
+    // 数字直接返回数字
+    return (Operand){true, ((AstNumber *)exp)->number};
   }
+  // 其他表达式的结果是最后一个临时值
+  return (Operand){false, gen->temp_sign_index - 1};
 }
 
-AstExp *optimize_unary_exp(AstUnaryExp *unary_exp) {
-  unary_exp->operand = optimize_exp(unary_exp->operand);
-  if (is_const_exp(unary_exp->operand)) {
-    int operand = eval_const_exp((AstExp *)unary_exp);
-    AstNumber *number = new_ast_number();
-    number->number = operand;
-    return (AstExp *)number;
-  }
-  if (unary_exp->op == '+') {
-    return unary_exp->operand;
+static void output_operand(KoopaGen *gen, Operand operand) {
+  if (!operand.is_number) {
+    emit_char(&gen->emitter, '%');
   }
-  return (AstExp *)unary_exp;
+  emit_int(&gen->emitter, operand.value);
 }
 
-AstExp *optimize_binary_exp(AstBinaryExp *binary_exp) {
-  binary_exp->lhs = optimize_exp(binary_exp->lhs);
-  binary_exp->rhs = optimize_exp(binary_exp->rhs);
-  if (is_const_exp((AstExp *)binary_exp)) {
-    AstNumber *number = new_ast_number();
-    number->number = eval_const_exp((AstExp *)binary_exp);
-    return (AstExp *)number;
-  }
-  return (AstExp *)binary_exp;
+// %n = op lhs, rhs
+static void output_binary(KoopaGen *gen, const char *op, Operand lhs,
+                          Operand rhs) {
+  outputf(gen, "  %%%d = %s ", gen->temp_sign_index, op);
+  output_operand(gen, lhs);
+  emit_str(&gen->emitter, ", ");
+  output_operand(gen, rhs);
+  emit_char(&gen->emitter, '\n');
+  gen->temp_sign_index++;
 }
 
-AstExp *optimize_exp(AstExp *exp) {
-  switch (exp->type) {
-  case AST_ARRAY_VALUE: {
-    AstArrayValue *array_value = (AstArrayValue *)exp;
-    for (int i = 0; i < array_value->count; i++) {
-      array_value->elements[i] = optimize_exp(array_value->elements[i]);
-    }
-    return exp;
-  }
-  case AST_ARRAY_ACCESS: {
-    AstArrayAccess *array_access = (AstArrayAccess *)exp;
-    for (int i = 0; i < array_access->indexes.count; i++) {
-      array_access->indexes.elements[i] =
-          optimize_exp(array_access->indexes.elements[i]);
-    }
-    return exp;
-  }
-  case AST_FUNC_CALL: {
-    AstFuncCall *func_call = (AstFuncCall *)exp;
-    for (int i = 0; i < func_call->count; i++) {
-      func_call->args[i] = optimize_exp(func_call->args[i]);
-    }
-    return exp;
-  }
-  case AST_UNARY_EXP: {
-    return optimize_unary_exp((AstUnaryExp *)exp);
-  }
-  case AST_BINARY_EXP: {
-    return optimize_binary_exp((AstBinaryExp *)exp);
-  }
-  case AST_IDENTIFIER: {
-    if (is_const_exp(exp)) {
-      int value = eval_const_exp(exp);
-      AstNumber *number = new_ast_number();
-      number->number = value;
-      return (AstExp *)number;
-    }
-    return exp;
-  }
-  case AST_NUMBER: {
-    return exp;
-  }
-  default:
-    fatalf("未知的表达式类型 %s\n", ast_type_to_string(exp->type));
-    return NULL;
-  }
+// store value, dest
+static void output_store(KoopaGen *gen, Operand value, const char *dest) {
+  outputf(gen, "  store ");
+  output_operand(gen, value);
+  outputf(gen, ", %s\n", dest);
 }
 
-void print_int_array(const char *prefix, int coordinates[], int n) {
-  printf("%s: (", prefix);
-  for (int i = 0; i < n; i++) {
-    printf("%d, ", coordinates[i]);
-  }
-  printf(")\n");
+// %n = inst src, index
+static void output_ptr_inst(KoopaGen *gen, const char *inst, const char *src,
+                            Operand index) {
+  outputf(gen, "  %%%d = %s %s, ", gen->temp_sign_index, inst, src);
+  output_operand(gen, index);
+  emit_char(&gen->emitter, '\n');
+  gen->temp_sign_index++;
 }
 
-/**
- * 将多维数组展开为一维数组
- * @param dimensions 数组的维度
- * @param count 维度的数量
- * @param val 数组的值
- * @param coordinates 当前的坐标
- * @param current 当前的维度
- * @param result 一维数组
-
-*/
-void do_flatten(int dimensions[], int dimension_count, AstArrayValue *val,
-                int coordinates[], int current, ExpArray *result) {
-  assert(current > 0);
-  for (int i = 0; i < val->count; i++) {
-    if (val->elements[i]->type == AST_ARRAY_VALUE) {
-      assert(coordinates[dimension_count - 1] == 0);
-      int origin = coordinates[dimension_count - current];
-      do_flatten(dimensions, dimension_count, (AstArrayValue *)val->elements[i],
-                 coordinates, current - 1, result);
-      // 碰到数组，对应维度进一，低维度需要全部置为 0
-      // 这里不直接加 1 的原因：
-      //    如果数组里面是全满的，就会发生进位，直接加 1 有问题；
-      //    所以使用原始值加 1
-      coordinates[dimension_count - current] = origin + 1;
-      for (int i = dimension_count - current + 1; i < dimension_count; i++) {
-        coordinates[i] = 0;
-      }
-    } else {
-      // 碰到非数组，维度降到最低，开始填充
-      current = 1;
-
-      int index = 0;
-      for (int i = 0; i < dimension_count; i++) {
-        int n = coordinates[i];
-        for (int j = i + 1; j < dimension_count; j++) {
-          n *= dimensions[j];
-        }
-        index += n;
-      }
-      result->elements[index] = val->elements[i];
-      coordinates[dimension_count - 1]++;
-
-      // 坐标进位，同时更新下一个括号的维度
-      for (int i = dimension_count - 1; i > 0; i--) {
-        if (coordinates[i] == dimensions[i]) {
-          coordinates[i] = 0;
-          coordinates[i - 1]++;
-          current = dimension_count - i + 1;
-        } else {
-          break;
-        }
-      }
-      assert(coordinates[0] <= dimensions[0]); // 进位不能超过最高的维度
-    }
-    // print_int_array("  ", coordinates, count);
-  }
+// %n = inst %(n-1), index
+static void output_ptr_inst_chain(KoopaGen *gen, const char *inst,
+                                  Operand index) {
+  outputf(gen, "  %%%d = %s %%%d, ", gen->temp_sign_index, inst,
+          gen->temp_sign_index - 1);
+  output_operand(gen, index);
+  emit_char(&gen->emitter, '\n');
+  gen->temp_sign_index++;
 }
 
-// 比如声明是 int a[1][2][3] ，dimensions 就是 [1, 2, 3]
-AstExp *flatten_multi_dimension_array(int dimensions[], int dimension_count,
-                                      AstExp *val) {
-  assert(val->type == AST_ARRAY_VALUE);
-  if (dimension_count == 1) {
-    AstArrayValue *array_value = (AstArrayValue *)val;
-    // 补全默认值
-    for (int i = array_value->count; i < dimensions[0]; i++) {
-      AstNumber *number = new_ast_number();
-      number->number = 0;
-      ast_array_value_add(array_value, (AstExp *)number);
-    }
-    return val;
-  }
-  int total_count = 1;
+// 输出数组类型，比如 dimensions 是 [2, 3] ，输出 [[i32, 3], 2]
+static void output_array_type(KoopaGen *gen, const int *dimensions,
+                              int dimension_count) {
   for (int i = 0; i < dimension_count; i++) {
-    total_count *= dimensions[i];
-  }
-  ExpArray result;
-  init_exp_array(&result);
-  result.count = total_count;
-  result.capacity = total_count;
-  result.elements = malloc(sizeof(AstExp *) * result.capacity);
-  for (int i = 0; i < total_count; i++) {
-    AstNumber *number = new_ast_number();
-    number->number = 0;
-    result.elements[i] = (AstExp *)number;
-  }
-
-  int *coordinates = malloc(sizeof(int) * total_count);
-  memset(coordinates, 0, sizeof(int) * total_count);
-  do_flatten(dimensions, dimension_count, (AstArrayValue *)val, coordinates,
-             dimension_count, &result);
-
-  AstArrayValue *array_value = new_ast_array_value();
-  array_value->count = total_count;
-  array_value->capacity = total_count;
-  array_value->elements = result.elements;
-  return (AstExp *)array_value;
-}
-
-void optimize_const_decl(AstConstDecl *decl) {
-  for (int i = 0; i < decl->defs.count; i++) {
-    AstVarDef *def = decl->defs.elements[i];
-    assert(def->val != NULL);
-    SymbolType symbol_type = SymbolType_int;
-    if (def->dimensions.count > 0) {
-      int dimensions[def->dimensions.count];
-      for (int i = 0; i < def->dimensions.count; i++) {
-        int n = eval_const_exp(def->dimensions.elements[i]);
-        assert(n > 0);
-        dimensions[i] = n;
-        AstNumber *number = new_ast_number();
-        number->number = n;
-        def->dimensions.elements[i] = (AstExp *)number;
-      }
-      symbol_type = SymbolType_array;
-      def->val = flatten_multi_dimension_array(dimensions,
-                                               def->dimensions.count, def->val);
-    }
-    int value = eval_const_exp(def->val);
-    Symbol *symbol = new_symbol(def->name, symbol_type);
-    symbol->is_const_value = true;
-    symbol->value = value;
-  }
-}
-
-void optimize_var_decl(AstVarDecl *decl) {
-  for (int i = 0; i < decl->defs.count; i++) {
-    AstVarDef *def = decl->defs.elements[i];
-    if (def->dimensions.count > 0) {
-      int dimensions[def->dimensions.count];
-      for (int i = 0; i < def->dimensions.count; i++) {
-        int n = eval_const_exp(def->dimensions.elements[i]);
-        assert(n > 0);
-        AstNumber *number = new_ast_number();
-        number->number = n;
-        def->dimensions.elements[i] = (AstExp *)number;
-        dimensions[i] = n;
-      }
-      if (def->val) {
-        optimize_exp(def->val);
-        def->val = flatten_multi_dimension_array(
-            dimensions, def->dimensions.count, def->val);
-      }
-    } else {
-      if (def->val) {
-        def->val = optimize_exp(def->val);
-      }
-    }
-  }
-}
-
-void optimize_global_var_decl(AstVarDecl *decl) {
-  for (int i = 0; i < decl->defs.count; i++) {
-    AstVarDef *def = decl->defs.elements[i];
-    if (def->dimensions.count > 0) {
-      int dimensions[def->dimensions.count];
-      for (int i = 0; i < def->dimensions.count; i++) {
-        int n = eval_const_exp(def->dimensions.elements[i]);
-        assert(n > 0);
-        AstNumber *number = new_ast_number();
-        number->number = n;
-        def->dimensions.elements[i] = (AstExp *)number;
-        dimensions[i] = n;
-      }
-      if (def->val) {
-        assert(def->val->type == AST_ARRAY_VALUE);
-        eval_const_exp(def->val);
-        def->val = flatten_multi_dimension_array(
-            dimensions, def->dimensions.count, def->val);
-      }
-    } else {
-      if (def->val) {
-        int value = eval_const_exp(def->val);
-        AstNumber *number = new_ast_number();
-        number->number = value;
-        def->val = (AstExp *)number;
-      }
-    }
+    emit_char(&gen->emitter, '[');
   }
-}
-
-void optimize_stmt(AstStmt *stmt) {
-  switch (stmt->type) {
-  case AST_RETURN_STMT: {
-    AstReturnStmt *return_stmt = (AstReturnStmt *)stmt;
-    if (return_stmt->exp) {
-      return_stmt->exp = optimize_exp(return_stmt->exp);
-    }
-    break;
-  }
-  case AST_EXP_STMT: {
-    AstExpStmt *exp_stmt = (AstExpStmt *)stmt;
-    exp_stmt->exp = optimize_exp(exp_stmt->exp);
-    break;
-  }
-  case AST_ASSIGN_STMT: {
-    AstAssignStmt *assign_stmt = (AstAssignStmt *)stmt;
-    assign_stmt->lhs = optimize_exp(assign_stmt->lhs);
-    assign_stmt->exp = optimize_exp(assign_stmt->exp);
-    break;
-  }
-  case AST_EMPTY_STMT:
-    // nothing to do
-    break;
-  case AST_BLOCK:
-    optimize_block((AstBlock *)stmt);
-    break;
-  case AST_IF_STMT: {
-    AstIfStmt *if_stmt = (AstIfStmt *)stmt;
-    if_stmt->condition = optimize_exp(if_stmt->condition);
-    optimize_stmt(if_stmt->then);
-    if (if_stmt->else_) {
-      optimize_stmt(if_stmt->else_);
-    }
-    break;
-  }
-  case AST_WHILE_STMT: {
-    AstWhileStmt *while_stmt = (AstWhileStmt *)stmt;
-    while_stmt->condition = optimize_exp(while_stmt->condition);
-    optimize_stmt(while_stmt->body);
-    break;
-  }
-  case AST_BREAK_STMT:
-  case AST_CONTINUE_STMT:
-    break;
-
-  default:
-    fatalf("未知的语句类型 %s\n", ast_type_to_string(stmt->type));
-  }
-}
-
-void optimize_block(AstBlock *block) {
-  AstStmt *stmt = block->stmt;
-  enter_scope();
-  while (stmt) {
-    switch (stmt->type) {
-    case AST_CONST_DECL: {
-      optimize_const_decl((AstConstDecl *)stmt);
-      break;
-    }
-    case AST_VAR_DECL: {
-      optimize_var_decl((AstVarDecl *)stmt);
-      break;
-    }
-    case AST_EMPTY_STMT:
-      // 移除空语句
-      break;
-    default:
-      optimize_stmt(stmt);
-      break;
-    }
-    if (stmt->type == AST_RETURN_STMT) {
-      // return 之后的语句不会执行到，直接移除
-      stmt->next = NULL;
-      break;
-    }
-    stmt = stmt->next;
+  emit_str(&gen->emitter, "i32");
+  for (int i = dimension_count - 1; i >= 0; i--) {
+    emit_str(&gen->emitter, ", ");
+    emit_int(&gen->emitter, dimensions[i]);
+    emit_char(&gen->emitter, ']');
   }
-  leave_scope();
 }
 
-void optimize_func_def(AstFuncDef *func_def) {
-  FuncParam *param = func_def->params;
-  while (param) {
-    if (param->dimensions.count > 0) {
-      for (int i = 0; i < param->dimensions.count; i++) {
-        int n = eval_const_exp(param->dimensions.elements[i]);
-        assert(n > 0);
-        AstNumber *number = new_ast_number();
-        number->number = n;
-        param->dimensions.elements[i] = (AstExp *)number;
-      }
-    }
-    param = param->next;
-  }
-  optimize_block(func_def->block);
-}
-
-// 优化 AST，工作包括：
-//  - 移除一元加法表达式
-//  - 数字计算，例如 1 + 2 -> 3
-//  - 常量替换，例如 const a = 1; const b = a + 2; -> const a = 1; const b = 3;
-//  - 多维数组初始化值展开
-//  - 数组参数第二维度及以上的维度计算
-//  - 移除 return 之后的语句
-//  - 补全数组默认值
-void optimize_comp_unit(AstCompUnit *comp_unit) {
-  for (int i = 0; i < comp_unit->count; i++) {
-    AstBase *def = comp_unit->defs[i];
-    switch (def->type) {
-
-    case AST_FUNC_DEF: {
-      optimize_func_def((AstFuncDef *)def);
-      break;
-    }
-    case AST_CONST_DECL: {
-      optimize_const_decl((AstConstDecl *)def);
-      break;
-    }
-    case AST_VAR_DECL: {
-      optimize_global_var_decl((AstVarDecl *)def);
-      break;
-    }
-    default: {
-      fatalf("未知的定义类型\n");
-    }
-    }
-  }
-  // 重置符号表
-  reset_symbol_table();
-
-  // printf("    === 优化后的 AST ===\n");
-  // comp_unit->base.dump((AstBase *)comp_unit, 4);
-  // printf("\n");
-}
-// #endregion
-
-// #region 生成 IR
-static void codegen_array_init_value(int *dimension, int dimension_count,
-                                     AstArrayValue *value);
-static void codegen_exp(AstExp *exp);
-static void codegen_block(AstBlock *block);
-static void codegen_stmt(AstStmt *stmt);
-
-// 返回符号，表示表达式的结果
-static char *exp_sign(AstExp *exp) {
-  size_t size = 32;
-  char *buf = malloc(size);
-  if (exp->type == AST_NUMBER) {
-    // 数字直接返回数字
-    snprintf(buf, size, "%d", ((AstNumber *)exp)->number);
-  } else {
-    // 其他表达式返回 %0, %1, %2 等符号
-    snprintf(buf, size, "%%%d", temp_sign_index - 1);
-  }
-  return buf;
-}
-
-static void codegen_identifier(AstIdentifier *ident) {
-  Symbol *symbol = find_symbol(ident->name);
+static void codegen_identifier(KoopaGen *gen, AstIdentifier *ident) {
+  Symbol *symbol = find_symbol(&gen->symbols, ident->name);
   if (symbol == NULL) {
     fatalf("访问未定义的符号 %s\n", ident->name);
   }
   if (symbol->type == SymbolType_int) {
-    const char *name = symbol_unique_name(symbol);
-    outputf("  %%%d = load %s\n", temp_sign_index, name);
-    free((void *)name);
-    temp_sign_index++;
+    const char *name = symbol_unique_name(&gen->symbols, symbol);
+    outputf(gen, "  %%%d = load %s\n", gen->temp_sign_index, name);
+    gen->temp_sign_index++;
   } else if (symbol->type == SymbolType_array) {
     // 数组的第一个元素的地址
-    const char *name = symbol_unique_name(symbol);
-    outputf("  %%%d = getelemptr %s, 0\n", temp_sign_index, name);
-    free((void *)name);
-    temp_sign_index++;
+    const char *name = symbol_unique_name(&gen->symbols, symbol);
+    outputf(gen, "  %%%d = getelemptr %s, 0\n", gen->temp_sign_index, name);
+    gen->temp_sign_index++;
   } else if (symbol->type == SymbolType_pointer ||
              symbol->type == SymbolType_array_pointer) {
-    const char *name = symbol_unique_name(symbol);
-    outputf("  %%%d = load %s\n", temp_sign_index, name);
-    free((void *)name);
-    temp_sign_index++;
+    const char *name = symbol_unique_name(&gen->symbols, symbol);
+    outputf(gen, "  %%%d = load %s\n", gen->temp_sign_index, name);
+    gen->temp_sign_index++;
   } else {
     fatalf("未知的符号类型\n");
   }
 }
 
-static void codegen_binary_exp(AstBinaryExp *exp) {
+static void codegen_binary_exp(KoopaGen *gen, AstBinaryExp *exp) {
   // 短路求值
   switch (exp->op) {
   case BinaryOpType_AND: {
@@ -743,34 +149,33 @@ static void codegen_binary_exp(AstBinaryExp *exp) {
         result = b != 0;
       }
     */
-    logic_index++;
-    int current_logic_index = logic_index;
+    gen->logic_index++;
+    int current_logic_index = gen->logic_index;
     // 引入中间变量 result
     // int result = 0
-    outputf("  %%result_%d = alloc i32\n", current_logic_index);
-    outputf("  store 0, %%result_%d\n", current_logic_index);
-    codegen_exp(exp->lhs);
-    char *lhs = exp_sign(exp->lhs);
+    outputf(gen, "  %%result_%d = alloc i32\n", current_logic_index);
+    outputf(gen, "  store 0, %%result_%d\n", current_logic_index);
+    codegen_exp(gen, exp->lhs);
+    Operand lhs = exp_operand(gen, exp->lhs);
     // if (a != 0) {
     //   result = b != 0;
     // }
-    outputf("  br %s, %%and_true_%d, %%and_end_%d\n", lhs, current_logic_index,
+    outputf(gen, "  br ");
+    output_operand(gen, lhs);
+    outputf(gen, ", %%and_true_%d, %%and_end_%d\n", current_logic_index,
             current_logic_index);
-    outputf("%%and_true_%d:\n", current_logic_index);
-    codegen_exp(exp->rhs);
-    char *rhs = exp_sign(exp->rhs);
-    outputf("  %%%d = ne %s, 0\n", temp_sign_index, rhs);
-    outputf("  store %%%d, %%result_%d\n", temp_sign_index,
+    outputf(gen, "%%and_true_%d:\n", current_logic_index);
+    codegen_exp(gen, exp->rhs);
+    Operand rhs = exp_operand(gen, exp->rhs);
+    output_binary(gen, "ne", rhs, (Operand){true, 0});
+    outputf(gen, "  store %%%d, %%result_%d\n", gen->temp_sign_index - 1,
             current_logic_index);
-    outputf("  jump %%and_end_%d\n", current_logic_index);
-    temp_sign_index++;
-    outputf("%%and_end_%d:\n", current_logic_index);
+    outputf(gen, "  jump %%and_end_%d\n", current_logic_index);
+    outputf(gen, "%%and_end_%d:\n", current_logic_index);
     // 按表达式的约定，把结果放到临时值
-    outputf("  %%%d = load %%result_%d\n", temp_sign_index,
+    outputf(gen, "  %%%d = load %%result_%d\n", gen->temp_sign_index,
             current_logic_index);
-    temp_sign_index++;
-    free(lhs);
-    free(rhs);
+    gen->temp_sign_index++;
     return;
   }
   case BinaryOpType_OR: {
@@ -781,135 +186,106 @@ static void codegen_binary_exp(AstBinaryExp *exp) {
         result = b != 0;
       }
     */
-    logic_index++;
-    int current_logic_index = logic_index;
+    gen->logic_index++;
+    int current_logic_index = gen->logic_index;
     // 引入中间变量 result
     // int result = 1
-    outputf("  %%result_%d = alloc i32\n", current_logic_index);
-    outputf("  store 1, %%result_%d\n", current_logic_index);
-    codegen_exp(exp->lhs);
-    char *lhs = exp_sign(exp->lhs);
+    outputf(gen, "  %%result_%d = alloc i32\n", current_logic_index);
+    outputf(gen, "  store 1, %%result_%d\n", current_logic_index);
+    codegen_exp(gen, exp->lhs);
+    Operand lhs = exp_operand(gen, exp->lhs);
     // if (a == 0) {
     //   result = b != 0;
     // }
-    outputf("  br %s, %%or_end_%d, %%or_false_%d\n", lhs, current_logic_index,
+    outputf(gen, "  br ");
+    output_operand(gen, lhs);
+    outputf(gen, ", %%or_end_%d, %%or_false_%d\n", current_logic_index,
             current_logic_index);
-    outputf("%%or_false_%d:\n", current_logic_index);
-    codegen_exp(exp->rhs);
-    char *rhs = exp_sign(exp->rhs);
-    outputf("  %%%d = ne %s, 0\n", temp_sign_index, rhs);
-    outputf("  store %%%d, %%result_%d\n", temp_sign_index,
+    outputf(gen, "%%or_false_%d:\n", current_logic_index);
+    codegen_exp(gen, exp->rhs);
+    Operand rhs = exp_operand(gen, exp->rhs);
+    output_binary(gen, "ne", rhs, (Operand){true, 0});
+    outputf(gen, "  store %%%d, %%result_%d\n", gen->temp_sign_index - 1,
             current_logic_index);
-    outputf("  jump %%or_end_%d\n", current_logic_index);
-    temp_sign_index++;
-    outputf("%%or_end_%d:\n", current_logic_index);
+    outputf(gen, "  jump %%or_end_%d\n", current_logic_index);
+    outputf(gen, "%%or_end_%d:\n", current_logic_index);
     // 按表达式的约定，把结果放到临时值
-    outputf("  %%%d = load %%result_%d\n", temp_sign_index,
+    outputf(gen, "  %%%d = load %%result_%d\n", gen->temp_sign_index,
             current_logic_index);
-    temp_sign_index++;
-    free(lhs);
-    free(rhs);
+    gen->temp_sign_index++;
     return;
   }
   default:
     break;
   }
 
-  codegen_exp(exp->lhs);
-  char *lhs = exp_sign(exp->lhs);
-  codegen_exp(exp->rhs);
-  char *rhs = exp_sign(exp->rhs);
+  codegen_exp(gen, exp->lhs);
+  Operand lhs = exp_operand(gen, exp->lhs);
+  codegen_exp(gen, exp->rhs);
+  Operand rhs = exp_operand(gen, exp->rhs);
   switch (exp->op) {
-  case BinaryOpType_ADD: {
-    outputf("  %%%d = add %s, %s\n", temp_sign_index, lhs, rhs);
-    temp_sign_index++;
+  case BinaryOpType_ADD:
+    output_binary(gen, "add", lhs, rhs);
     break;
-  }
-  case BinaryOpType_SUB: {
-    outputf("  %%%d = sub %s, %s\n", temp_sign_index, lhs, rhs);
-    temp_sign_index++;
+  case BinaryOpType_SUB:
+    output_binary(gen, "sub", lhs, rhs);
     break;
-  }
-  case BinaryOpType_MUL: {
-    outputf("  %%%d = mul %s, %s\n", temp_sign_index, lhs, rhs);
-    temp_sign_index++;
+  case BinaryOpType_MUL:
+    output_binary(gen, "mul", lhs, rhs);
     break;
-  }
-  case BinaryOpType_DIV: {
-    outputf("  %%%d = div %s, %s\n", temp_sign_index, lhs, rhs);
-    temp_sign_index++;
+  case BinaryOpType_DIV:
+    output_binary(gen, "div", lhs, rhs);
     break;
-  }
-  case BinaryOpType_MOD: {
-    outputf("  %%%d = mod %s, %s\n", temp_sign_index, lhs, rhs);
-    temp_sign_index++;
+  case BinaryOpType_MOD:
+    output_binary(gen, "mod", lhs, rhs);
     break;
-  }
-  case BinaryOpType_EQ: {
-    outputf("  %%%d = eq %s, %s\n", temp_sign_index, lhs, rhs);
-    temp_sign_index++;
+  case BinaryOpType_EQ:
+    output_binary(gen, "eq", lhs, rhs);
     break;
-  }
-  case BinaryOpType_NE: {
-    outputf("  %%%d = ne %s, %s\n", temp_sign_index, lhs, rhs);
-    temp_sign_index++;
+  case BinaryOpType_NE:
+    output_binary(gen, "ne", lhs, rhs);
     break;
-  }
-  case BinaryOpType_LT: {
-    outputf("  %%%d = lt %s, %s\n", temp_sign_index, lhs, rhs);
-    temp_sign_index++;
+  case BinaryOpType_LT:
+    output_binary(gen, "lt", lhs, rhs);
     break;
-  }
-  case BinaryOpType_LE: {
-    outputf("  %%%d = le %s, %s\n", temp_sign_index, lhs, rhs);
-    temp_sign_index++;
+  case BinaryOpType_LE:
+    output_binary(gen, "le", lhs, rhs);
     break;
-  }
-  case BinaryOpType_GT: {
-    outputf("  %%%d = gt %s, %s\n", temp_sign_index, lhs, rhs);
-    temp_sign_index++;
+  case BinaryOpType_GT:
+    output_binary(gen, "gt", lhs, rhs);
     break;
-  }
-  case BinaryOpType_GE: {
-    outputf("  %%%d = ge %s, %s\n", temp_sign_index, lhs, rhs);
-    temp_sign_index++;
+  case BinaryOpType_GE:
+    output_binary(gen, "ge", lhs, rhs);
     break;
-  }
   case BinaryOpType_AND: {
     // a && b
     // r1 = a != 0
     // r2 = b != 0
     // r3 = r1 & r2
-    outputf("  %%%d = ne %s, 0\n", temp_sign_index, lhs);
-    temp_sign_index++;
-    outputf("  %%%d = ne %s, 0\n", temp_sign_index, rhs);
-    temp_sign_index++;
-    outputf("  %%%d = and %%%d, %%%d\n", temp_sign_index, temp_sign_index - 2,
-            temp_sign_index - 1);
-    temp_sign_index++;
+    output_binary(gen, "ne", lhs, (Operand){true, 0});
+    output_binary(gen, "ne", rhs, (Operand){true, 0});
+    output_binary(gen, "and", (Operand){false, gen->temp_sign_index - 2},
+                  (Operand){false, gen->temp_sign_index - 1});
     break;
   }
   case BinaryOpType_OR: {
     // a || b
     // r1 = a | b
     // r2 = r1 != 0
-    outputf("  %%%d = or %s, %s\n", temp_sign_index, lhs, rhs);
-    temp_sign_index++;
-    outputf("  %%%d = ne %%%d, 0\n", temp_sign_index, temp_sign_index - 1);
-    temp_sign_index++;
+    output_binary(gen, "or", lhs, rhs);
+    output_binary(gen, "ne", (Operand){false, gen->temp_sign_index - 1},
+                  (Operand){true, 0});
     break;
   }
 
   default:
     fprintf(stderr, "未知的二元运算符 %c\n", exp->op);
-    exit(1);
+    compile_error_exit();
   }
-  free(lhs);
-  free(rhs);
 }
 
-static void codegen_func_call(AstFuncCall *func_call) {
-  Symbol *symbol = find_symbol(func_call->ident->name);
+static void codegen_func_call(KoopaGen *gen, AstFuncCall *func_call) {
+  Symbol *symbol = find_symbol(&gen->symbols, func_call->ident->name);
   if (symbol == NULL) {
     fatalf("调用未定义的函数 %s\n", func_call->ident->name);
   }
@@ -921,122 +297,113 @@ static void codegen_func_call(AstFuncCall *func_call) {
   }
 
   AstExp **args = func_call->args;
-  char **signs = malloc(sizeof(char *) * func_call->count);
+  // 至少留一个位置，避免零长度数组
+  Operand operands[func_call->count + 1];
   for (int i = 0; i < func_call->count; i++) {
-    codegen_exp(args[i]);
-    signs[i] = exp_sign(args[i]);
+    codegen_exp(gen, args[i]);
+    operands[i] = exp_operand(gen, args[i]);
   }
   if (symbol->func_type.return_type == BType_VOID) {
-    outputf("  call @%s(", symbol->name);
+    outputf(gen, "  call @%s(", symbol->name);
   } else {
-    outputf("  %%%d = call @%s(", temp_sign_index, symbol->name);
-    temp_sign_index++;
+    outputf(gen, "  %%%d = call @%s(", gen->temp_sign_index, symbol->name);
+    gen->temp_sign_index++;
   }
   for (int i = 0; i < func_call->count; i++) {
-    outputf("%s%s", signs[i], (i == func_call->count - 1) ? "" : ", ");
-  }
-  outputf(")\n");
-
-  for (int i = 0; i < func_call->count; i++) {
-    free(signs[i]);
+    output_operand(gen, operands[i]);
+    if (i != func_call->count - 1) {
+      emit_str(&gen->emitter, ", ");
+    }
   }
-  free(signs);
+  outputf(gen, ")\n");
 }
 
-static void codegen_array_access(AstArrayAccess *array_access) {
-  Symbol *symbol = find_symbol(array_access->name);
+static void codegen_array_access(KoopaGen *gen, AstArrayAccess *array_access) {
+  Symbol *symbol = find_symbol(&gen->symbols, array_access->name);
   if (symbol == NULL) {
     fatalf("访问未定义的数组变量 %s\n", array_access->name);
   }
   if (symbol->type == SymbolType_array) {
     assert(array_access->indexes.count <= symbol->dimension_count);
-    const char *name = symbol_unique_name(symbol);
-    char **index_signs = malloc(sizeof(char *) * array_access->indexes.count);
+    const char *name = symbol_unique_name(&gen->symbols, symbol);
+    Operand indexes[array_access->indexes.count];
     for (int i = 0; i < array_access->indexes.count; i++) {
-      codegen_exp(array_access->indexes.elements[i]);
-      index_signs[i] = exp_sign(array_access->indexes.elements[i]);
+      codegen_exp(gen, array_access->indexes.elements[i]);
+      indexes[i] = exp_operand(gen, array_access->indexes.elements[i]);
     }
     for (int i = 0; i < array_access->indexes.count; i++) {
       if (i == 0) {
-        outputf("  %%%d = getelemptr %s, %s\n", temp_sign_index, name,
-                index_signs[i]);
+        output_ptr_inst(gen, "getelemptr", name, indexes[i]);
       } else {
-        outputf("  %%%d = getelemptr %%%d, %s\n", temp_sign_index,
-                temp_sign_index - 1, index_signs[i]);
+        output_ptr_inst_chain(gen, "getelemptr", indexes[i]);
       }
-      temp_sign_index++;
     }
     if (array_access->indexes.count == symbol->dimension_count) {
       // 索引到最后一维，是取值，需要 load 一次
-      outputf("  %%%d = load %%%d\n", temp_sign_index, temp_sign_index - 1);
-      temp_sign_index++;
+      outputf(gen, "  %%%d = load %%%d\n", gen->temp_sign_index,
+              gen->temp_sign_index - 1);
+      gen->temp_sign_index++;
     } else {
-      outputf("  %%%d = getelemptr %%%d, 0\n", temp_sign_index,
-              temp_sign_index - 1);
-      temp_sign_index++;
+      outputf(gen, "  %%%d = getelemptr %%%d, 0\n", gen->temp_sign_index,
+              gen->temp_sign_index - 1);
+      gen->temp_sign_index++;
     }
   } else if (symbol->type == SymbolType_pointer) {
     assert(array_access->indexes.count == 1);
-    codegen_exp(array_access->indexes.elements[0]);
-    const char *index_sign = exp_sign(array_access->indexes.elements[0]);
-    const char *name = symbol_unique_name(symbol);
-    outputf("  %%%d = load %s\n", temp_sign_index, name);
-    temp_sign_index++;
-    outputf("  %%%d = getptr %%%d, %s\n", temp_sign_index, temp_sign_index - 1,
-            index_sign);
-    temp_sign_index++;
-    outputf("  %%%d = load %%%d\n", temp_sign_index, temp_sign_index - 1);
-    temp_sign_index++;
+    codegen_exp(gen, array_access->indexes.elements[0]);
+    Operand index = exp_operand(gen, array_access->indexes.elements[0]);
+    const char *name = symbol_unique_name(&gen->symbols, symbol);
+    outputf(gen, "  %%%d = load %s\n", gen->temp_sign_index, name);
+    gen->temp_sign_index++;
+    output_ptr_inst_chain(gen, "getptr", index);
+    outputf(gen, "  %%%d = load %%%d\n", gen->temp_sign_index,
+            gen->temp_sign_index - 1);
+    gen->temp_sign_index++;
   } else if (symbol->type == SymbolType_array_pointer) {
     assert(array_access->indexes.count <= symbol->dimension_count + 1);
-    const char *name = symbol_unique_name(symbol);
-    char **index_signs = malloc(sizeof(char *) * array_access->indexes.count);
+    const char *name = symbol_unique_name(&gen->symbols, symbol);
+    Operand indexes[array_access->indexes.count];
     for (int i = 0; i < array_access->indexes.count; i++) {
-      codegen_exp(array_access->indexes.elements[i]);
-      index_signs[i] = exp_sign(array_access->indexes.elements[i]);
+      codegen_exp(gen, array_access->indexes.elements[i]);
+      indexes[i] = exp_operand(gen, array_access->indexes.elements[i]);
     }
     // name 是 array** ，load 一次得到 array*
-    outputf("  %%%d = load %s\n", temp_sign_index, name);
-    temp_sign_index++;
-    outputf("  %%%d = getptr %%%d, %s\n", temp_sign_index, temp_sign_index - 1,
-            index_signs[0]);
-    temp_sign_index++;
+    outputf(gen, "  %%%d = load %s\n", gen->temp_sign_index, name);
+    gen->temp_sign_index++;
+    output_ptr_inst_chain(gen, "getptr", indexes[0]);
     for (int i = 1; i < array_access->indexes.count; i++) {
-      outputf("  %%%d = getelemptr %%%d, %s\n", temp_sign_index,
-              temp_sign_index - 1, index_signs[i]);
-      temp_sign_index++;
+      output_ptr_inst_chain(gen, "getelemptr", indexes[i]);
     }
     if (array_access->indexes.count == symbol->dimension_count + 1) {
       // 索引到最后一维，是取值，需要 load 一次
-      outputf("  %%%d = load %%%d\n", temp_sign_index, temp_sign_index - 1);
-      temp_sign_index++;
+      outputf(gen, "  %%%d = load %%%d\n", gen->temp_sign_index,
+              gen->temp_sign_index - 1);
+      gen->temp_sign_index++;
     } else {
       // 其他的需要返回数组第一个元素的指针
-      outputf("  %%%d = getelemptr %%%d, 0\n", temp_sign_index,
-              temp_sign_index - 1);
-      temp_sign_index++;
+      outputf(gen, "  %%%d = getelemptr %%%d, 0\n", gen->temp_sign_index,
+              gen->temp_sign_index - 1);
+      gen->temp_sign_index++;
     }
   } else {
     fatalf("访问非数组变量 %s\n", array_access->name);
   }
 }
 
-static void codegen_exp(AstExp *exp) {
+static void codegen_exp(KoopaGen *gen, AstExp *exp) {
   switch (exp->type) {
   case AST_UNARY_EXP: {
     AstUnaryExp *unary_exp = (AstUnaryExp *)exp;
-    codegen_exp(unary_exp->operand);
+    codegen_exp(gen, unary_exp->operand);
     switch (unary_exp->op) {
     case '-': {
-      outputf("  %%%d = sub 0, %s\n", temp_sign_index,
-              exp_sign(unary_exp->operand));
-      temp_sign_index++;
+      output_binary(gen, "sub", (Operand){true, 0},
+                    exp_operand(gen, unary_exp->operand));
       break;
     }
     case '!': {
-      outputf("  %%%d = eq %s, 0\n", temp_sign_index,
-              exp_sign(unary_exp->operand));
-      temp_sign_index++;
+      output_binary(gen, "eq", exp_operand(gen, unary_exp->operand),
+                    (Operand){true, 0});
       break;
     }
     case '+':
@@ -1047,7 +414,7 @@ static void codegen_exp(AstExp *exp) {
     break;
   }
   case AST_BINARY_EXP: {
-    codegen_binary_exp((AstBinaryExp *)exp);
+    codegen_binary_exp(gen, (AstBinaryExp *)exp);
     break;
   }
 
@@ -1055,51 +422,53 @@ static void codegen_exp(AstExp *exp) {
     // nothing to do
     break;
   case AST_IDENTIFIER:
-    codegen_identifier((AstIdentifier *)exp);
+    codegen_identifier(gen, (AstIdentifier *)exp);
     break;
   case AST_FUNC_CALL:
-    codegen_func_call((AstFuncCall *)exp);
+    codegen_func_call(gen, (AstFuncCall *)exp);
     break;
   case AST_ARRAY_ACCESS:
-    codegen_array_access((AstArrayAccess *)exp);
+    codegen_array_access(gen, (AstArrayAccess *)exp);
     break;
   default:
     fprintf(stderr, "未知的表达式类型 %s\n", ast_type_to_string(exp->type));
-    exit(1);
+    compile_error_exit();
   }
 }
 
-static void codegen_return_stmt(AstReturnStmt *stmt) {
+static void codegen_return_stmt(KoopaGen *gen, AstReturnStmt *stmt) {
   if (stmt->exp) {
-    if (current_func_def->func_type == BType_VOID) {
+    if (gen->current_func_def->func_type == BType_VOID) {
       fatalf("void 函数只能出现不带返回值的 return 语句\n");
     }
-    codegen_exp(stmt->exp);
-    outputf("  ret %s\n", exp_sign(stmt->exp));
+    codegen_exp(gen, stmt->exp);
+    outputf(gen, "  ret ");
+    output_operand(gen, exp_operand(gen, stmt->exp));
+    outputf(gen, "\n");
   } else {
-    if (current_func_def->func_type != BType_VOID) {
+    if (gen->current_func_def->func_type != BType_VOID) {
       fatalf("非 void 函数没有 return 返回值\n");
     }
-    outputf("  ret\n");
+    outputf(gen, "  ret\n");
   }
+  gen->output_ret_inst = true;
 }
 
-static void codegen_assign_stmt(AstAssignStmt *stmt) {
+static void codegen_assign_stmt(KoopaGen *gen, AstAssignStmt *stmt) {
   if (stmt->lhs->type == AST_IDENTIFIER) {
     AstIdentifier *ident = (AstIdentifier *)stmt->lhs;
-    Symbol *symbol = find_symbol(ident->name);
+    Symbol *symbol = find_symbol(&gen->symbols, ident->name);
     if (symbol == NULL) {
       fatalf("赋值未定义的符号 %s\n", ident->name);
     }
-    codegen_exp(stmt->exp);
-    const char *name = symbol_unique_name(symbol);
-    outputf("  store %s, %s\n", exp_sign(stmt->exp), name);
-    free((void *)name);
+    codegen_exp(gen, stmt->exp);
+    output_store(gen, exp_operand(gen, stmt->exp),
+                 symbol_unique_name(&gen->symbols, symbol));
   } else if (stmt->lhs->type == AST_ARRAY_ACCESS) {
-    codegen_exp(stmt->exp);
-    const char *value_sign = exp_sign(stmt->exp);
+    codegen_exp(gen, stmt->exp);
+    Operand value = exp_operand(gen, stmt->exp);
     AstArrayAccess *array_access = (AstArrayAccess *)stmt->lhs;
-    Symbol *symbol = find_symbol(array_access->name);
+    Symbol *symbol = find_symbol(&gen->symbols, array_access->name);
     if (symbol == NULL) {
       fatalf("赋值未定义的数组变量 %s\n", array_access->name);
     }
@@ -1108,55 +477,52 @@ static void codegen_assign_stmt(AstAssignStmt *stmt) {
     }
     if (symbol->type == SymbolType_array) {
       assert(array_access->indexes.count == symbol->dimension_count);
-      const char *name = symbol_unique_name(symbol);
-      char **index_signs = malloc(sizeof(char *) * array_access->indexes.count);
+      const char *name = symbol_unique_name(&gen->symbols, symbol);
+      Operand indexes[array_access->indexes.count];
       for (int i = 0; i < array_access->indexes.count; i++) {
-        codegen_exp(array_access->indexes.elements[i]);
-        index_signs[i] = exp_sign(array_access->indexes.elements[i]);
+        codegen_exp(gen, array_access->indexes.elements[i]);
+        indexes[i] = exp_operand(gen, array_access->indexes.elements[i]);
       }
 
       for (int i = 0; i < array_access->indexes.count; i++) {
         if (i == 0) {
-          outputf("  %%%d = getelemptr %s, %s\n", temp_sign_index, name,
-                  index_signs[i]);
+          output_ptr_inst(gen, "getelemptr", name, indexes[i]);
         } else {
-          outputf("  %%%d = getelemptr %%%d, %s\n", temp_sign_index,
-                  temp_sign_index - 1, index_signs[i]);
+          output_ptr_inst_chain(gen, "getelemptr", indexes[i]);
         }
-        temp_sign_index++;
       }
-      outputf("  store %s, %%%d\n", value_sign, temp_sign_index - 1);
+      outputf(gen, "  store ");
+      output_operand(gen, value);
+      outputf(gen, ", %%%d\n", gen->temp_sign_index - 1);
     } else if (symbol->type == SymbolType_pointer) {
       assert(array_access->indexes.count == 1);
-      codegen_exp(array_access->indexes.elements[0]);
-      const char *index_sign = exp_sign(array_access->indexes.elements[0]);
-      const char *name = symbol_unique_name(symbol);
-      outputf("  %%%d = load %s\n", temp_sign_index, name);
-      temp_sign_index++;
-      outputf("  %%%d = getptr %%%d, %s\n", temp_sign_index,
-              temp_sign_index - 1, index_sign);
-      temp_sign_index++;
-      outputf("  store %s, %%%d\n", value_sign, temp_sign_index - 1);
+      codegen_exp(gen, array_access->indexes.elements[0]);
+      Operand index = exp_operand(gen, array_access->indexes.elements[0]);
+      const char *name = symbol_unique_name(&gen->symbols, symbol);
+      outputf(gen, "  %%%d = load %s\n", gen->temp_sign_index, name);
+      gen->temp_sign_index++;
+      output_ptr_inst_chain(gen, "getptr", index);
+      outputf(gen, "  store ");
+      output_operand(gen, value);
+      outputf(gen, ", %%%d\n", gen->temp_sign_index - 1);
     } else if (symbol->type == SymbolType_array_pointer) {
       assert(array_access->indexes.count == symbol->dimension_count + 1);
-      const char *name = symbol_unique_name(symbol);
-      char **index_signs = malloc(sizeof(char *) * array_access->indexes.count);
+      const char *name = symbol_unique_name(&gen->symbols, symbol);
+      Operand indexes[array_access->indexes.count];
       for (int i = 0; i < array_access->indexes.count; i++) {
-        codegen_exp(array_access->indexes.elements[i]);
-        index_signs[i] = exp_sign(array_access->indexes.elements[i]);
+        codegen_exp(gen, array_access->indexes.elements[i]);
+        indexes[i] = exp_operand(gen, array_access->indexes.elements[i]);
       }
 
-      outputf("  %%%d = load %s\n", temp_sign_index, name);
-      temp_sign_index++;
-      outputf("  %%%d = getptr %%%d, %s\n", temp_sign_index,
-              temp_sign_index - 1, index_signs[0]);
-      temp_sign_index++;
+      outputf(gen, "  %%%d = load %s\n", gen->temp_sign_index, name);
+      gen->temp_sign_index++;
+      output_ptr_inst_chain(gen, "getptr", indexes[0]);
       for (int i = 1; i < array_access->indexes.count; i++) {
-        outputf("  %%%d = getelemptr %%%d, %s\n", temp_sign_index,
-                temp_sign_index - 1, index_signs[i]);
-        temp_sign_index++;
+        output_ptr_inst_chain(gen, "getelemptr", indexes[i]);
       }
-      outputf("  store %s, %%%d\n", value_sign, temp_sign_index - 1);
+      outputf(gen, "  store ");
+      output_operand(gen, value);
+      outputf(gen, ", %%%d\n", gen->temp_sign_index - 1);
     } else {
       stmt->base.dump((AstBase *)stmt, 0);
       printf("\n");
@@ -1165,243 +531,300 @@ static void codegen_assign_stmt(AstAssignStmt *stmt) {
   } else {
     fatalf("不支持的左值类型 %s\n", ast_type_to_string(stmt->lhs->type));
   }
-  outputf("\n");
+  outputf(gen, "\n");
 }
 
-static void codegen_var_decl(AstVarDecl *decl) {
+// 不超过这么多元素的局部数组直接逐个写入，更大的先用循环整体清零
+#define ZERO_FILL_UNROLL_LIMIT 16
+// 清零循环每次迭代最多写入的元素个数
+#define ZERO_FILL_MAX_STEP 8
+
+// %ptr_n = getelemptr name, 0 ... 一直到第一个元素的指针 *i32
+static void output_first_element_ptr(KoopaGen *gen, const char *name,
+                                     int dimension_count) {
+  outputf(gen, "  %%ptr_%d = getelemptr %s, 0\n", gen->ptr_index, name);
+  gen->ptr_index++;
+  for (int i = 1; i < dimension_count; i++) {
+    outputf(gen, "  %%ptr_%d = getelemptr %%ptr_%d, 0\n", gen->ptr_index,
+            gen->ptr_index - 1);
+    gen->ptr_index++;
+  }
+}
+
+/**
+ * 用循环把数组清零
+ * 后端要求每个临时值只使用一次，所以当前的指针放在 %zero_ptr_n 中，
+ * 每次使用时重新 load 。
+ * 每次迭代写入能整除元素个数的最多 ZERO_FILL_MAX_STEP 个元素，减少循环的开销。
+ */
+static void codegen_zero_fill(KoopaGen *gen, const char *name,
+                              int dimension_count, int count) {
+  gen->zero_fill_index++;
+  int current = gen->zero_fill_index;
+  int step = ZERO_FILL_MAX_STEP;
+  while (count % step != 0) {
+    step /= 2;
+  }
+  outputf(gen, "  %%zero_ptr_%d = alloc *i32\n", current);
+  output_first_element_ptr(gen, name, dimension_count);
+  outputf(gen, "  store %%ptr_%d, %%zero_ptr_%d\n", gen->ptr_index - 1,
+          current);
+  outputf(gen, "  %%zero_index_%d = alloc i32\n", current);
+  outputf(gen, "  store 0, %%zero_index_%d\n", current);
+  outputf(gen, "  jump %%zero_fill_%d\n", current);
+  outputf(gen, "\n%%zero_fill_%d:\n", current);
+  outputf(gen, "  %%%d = load %%zero_index_%d\n", gen->temp_sign_index,
+          current);
+  gen->temp_sign_index++;
+  output_binary(gen, "lt", (Operand){false, gen->temp_sign_index - 1},
+                (Operand){true, count / step});
+  outputf(gen, "  br %%%d, %%zero_fill_body_%d, %%zero_fill_end_%d\n",
+          gen->temp_sign_index - 1, current, current);
+  outputf(gen, "\n%%zero_fill_body_%d:\n", current);
+  for (int i = 0; i < step; i++) {
+    outputf(gen, "  %%ptr_%d = load %%zero_ptr_%d\n", gen->ptr_index, current);
+    gen->ptr_index++;
+    if (i > 0) {
+      outputf(gen, "  %%ptr_%d = getptr %%ptr_%d, %d\n", gen->ptr_index,
+              gen->ptr_index - 1, i);
+      gen->ptr_index++;
+    }
+    outputf(gen, "  store 0, %%ptr_%d\n", gen->ptr_index - 1);
+  }
+  // 指针和计数都向后移动
+  outputf(gen, "  %%ptr_%d = load %%zero_ptr_%d\n", gen->ptr_index, current);
+  gen->ptr_index++;
+  outputf(gen, "  %%ptr_%d = getptr %%ptr_%d, %d\n", gen->ptr_index,
+          gen->ptr_index - 1, step);
+  gen->ptr_index++;
+  outputf(gen, "  store %%ptr_%d, %%zero_ptr_%d\n", gen->ptr_index - 1,
+          current);
+  outputf(gen, "  %%%d = load %%zero_index_%d\n", gen->temp_sign_index,
+          current);
+  gen->temp_sign_index++;
+  output_binary(gen, "add", (Operand){false, gen->temp_sign_index - 1},
+                (Operand){true, 1});
+  outputf(gen, "  store %%%d, %%zero_index_%d\n", gen->temp_sign_index - 1,
+          current);
+  outputf(gen, "  jump %%zero_fill_%d\n", current);
+  outputf(gen, "\n%%zero_fill_end_%d:\n", current);
+}
+
+/**
+ * 局部数组的初始化
+ * 小数组逐个元素写入，没有记录在 init 中的元素写 0 ；
+ * 大数组先用循环清零，再只写入 init 中的元素。
+ */
+static void codegen_local_array_init(KoopaGen *gen, const char *name,
+                                     const int *dimensions, int dimension_count,
+                                     const AstArrayInit *init) {
+  int steps[dimension_count];
+  steps[dimension_count - 1] = 1;
+  for (int i = dimension_count - 2; i >= 0; i--) {
+    steps[i] = steps[i + 1] * dimensions[i + 1];
+  }
+  assert(init->total_count == steps[0] * dimensions[0]);
+  bool unroll = init->total_count <= ZERO_FILL_UNROLL_LIMIT;
+  if (!unroll) {
+    codegen_zero_fill(gen, name, dimension_count, init->total_count);
+  }
+  int next = 0; // init->entries 中下一个元素
+  for (int i = 0; i < init->total_count; i++) {
+    Operand value = {true, 0};
+    if (next < init->count && init->entries[next].index == i) {
+      AstExp *v = init->entries[next++].value;
+      codegen_exp(gen, v);
+      value = exp_operand(gen, v);
+    } else if (!unroll) {
+      // 已经清零了，直接跳到下一个需要写入的元素
+      if (next == init->count) {
+        break;
+      }
+      i = init->entries[next].index - 1;
+      continue;
+    }
+    int remaining = i;
+    for (int j = 0; j < dimension_count; j++) {
+      int offset = remaining / steps[j];
+      remaining = remaining % steps[j];
+      if (j == 0) {
+        outputf(gen, "  %%ptr_%d = getelemptr %s, %d\n", gen->ptr_index, name,
+                offset);
+      } else {
+        outputf(gen, "  %%ptr_%d = getelemptr %%ptr_%d, %d\n", gen->ptr_index,
+                gen->ptr_index - 1, offset);
+      }
+      gen->ptr_index++;
+    }
+    outputf(gen, "  store ");
+    output_operand(gen, value);
+    outputf(gen, ", %%ptr_%d\n", gen->ptr_index - 1);
+  }
+}
+
+static void codegen_var_decl(KoopaGen *gen, AstVarDecl *decl) {
   for (int i = 0; i < decl->defs.count; i++) {
     AstVarDef *def = decl->defs.elements[i];
-    char *type = malloc(def->dimensions.count * 32 * sizeof(char));
-    char *temp_type = malloc(def->dimensions.count * sizeof(char));
-    Symbol *symbol = new_symbol(def->name, SymbolType_int);
-    const char *name = symbol_unique_name(symbol);
+    Symbol *symbol = new_symbol(&gen->symbols, def->name, SymbolType_int);
+    const char *name = symbol_unique_name(&gen->symbols, symbol);
     if (def->dimensions.count > 0) {
-      int dimension_count = def->dimensions.count;
-      int *dimensions = malloc(sizeof(int) * dimension_count);
-      strcpy(type, "i32");
-      int total_count = 1;
-      for (int i = dimension_count - 1; i > -1; i--) {
-        assert(def->dimensions.elements[i]->type == AST_NUMBER);
-        int n = ((AstNumber *)def->dimensions.elements[i])->number;
-        assert(n > 0);
-        dimensions[i] = n;
-        sprintf(temp_type, "[%s, %d]", type, n);
-        strcpy(type, temp_type);
-        total_count *= n;
-      }
       symbol->type = SymbolType_array;
-      symbol->dimensions = dimensions;
-      symbol->dimension_count = dimension_count;
-      outputf("  %s = alloc %s\n", name, type);
+      symbol_set_dimensions(&gen->symbols, symbol, &def->dimensions);
+      int dimension_count = symbol->dimension_count;
+      int *dimensions = symbol->dimensions;
+      outputf(gen, "  %s = alloc ", name);
+      output_array_type(gen, dimensions, dimension_count);
+      outputf(gen, "\n");
 
       if (def->val) {
-        assert(def->val->type == AST_ARRAY_VALUE);
-        int *steps = malloc(dimension_count * sizeof(int));
-        steps[dimension_count - 1] = 1;
-        for (int i = dimension_count - 2; i >= 0; i--) {
-          steps[i] = steps[i + 1] * dimensions[i + 1];
-        }
-        AstArrayValue *array_value = (AstArrayValue *)def->val;
-        assert(array_value->count == total_count);
-        for (int i = 0; i < array_value->count; i++) {
-          AstExp *v = array_value->elements[i];
-          codegen_exp(v);
-          const char *v_sign = exp_sign(v);
-          int remaining = i;
-          for (int j = 0; j < dimension_count; j++) {
-            int offset = remaining / steps[j];
-            remaining = remaining % steps[j];
-            if (j == 0) {
-              outputf("  %%ptr_%d = getelemptr %s, %d\n", ptr_index, name,
-                      offset);
-            } else {
-              outputf("  %%ptr_%d = getelemptr %%ptr_%d, %d\n", ptr_index,
-                      ptr_index - 1, offset);
-            }
-            ptr_index++;
-          }
-          outputf("  store %s, %%ptr_%d\n", v_sign, ptr_index - 1);
-        }
+        assert(def->val->type == AST_ARRAY_INIT);
+        codegen_local_array_init(gen, name, dimensions, dimension_count,
+                                 (AstArrayInit *)def->val);
       }
     } else {
-      outputf("  %s = alloc i32\n", name);
+      outputf(gen, "  %s = alloc i32\n", name);
       if (def->val) {
-        codegen_exp(def->val);
-        outputf("  store %s, %s\n", exp_sign(def->val), name);
+        codegen_exp(gen, def->val);
+        output_store(gen, exp_operand(gen, def->val), name);
       }
     }
-    free((void *)name);
-    free(type);
-    free(temp_type);
   }
 }
 
-static void codegen_const_decl(AstConstDecl *decl) {
+static void codegen_const_decl(KoopaGen *gen, AstConstDecl *decl) {
   for (int i = 0; i < decl->defs.count; i++) {
     AstVarDef *def = decl->defs.elements[i];
     if (def->dimensions.count > 0) {
-      char *type = malloc(def->dimensions.count * 32 * sizeof(char));
-      char *temp_type = malloc(def->dimensions.count * 32 * sizeof(char));
-      int dimension_count = def->dimensions.count;
-      int *dimensions = malloc(sizeof(int) * dimension_count);
-      strcpy(type, "i32");
-      int total_count = 1;
-      for (int i = dimension_count - 1; i > -1; i--) {
-        assert(def->dimensions.elements[i]->type == AST_NUMBER);
-        int n = ((AstNumber *)def->dimensions.elements[i])->number;
-        assert(n > 0);
-        dimensions[i] = n;
-        sprintf(temp_type, "[%s, %d]", type, n);
-        strcpy(type, temp_type);
-        total_count *= n;
-      }
-      Symbol *symbol = new_symbol(def->name, SymbolType_array);
+      Symbol *symbol = new_symbol(&gen->symbols, def->name, SymbolType_array);
       symbol->is_const_value = true;
-      symbol->dimensions = dimensions;
-      symbol->dimension_count = dimension_count;
-      const char *name = symbol_unique_name(symbol);
-      outputf("  %s = alloc %s\n", name, type);
-      if (def->val == NULL || def->val->type != AST_ARRAY_VALUE) {
+      symbol_set_dimensions(&gen->symbols, symbol, &def->dimensions);
+      int dimension_count = symbol->dimension_count;
+      int *dimensions = symbol->dimensions;
+      const char *name = symbol_unique_name(&gen->symbols, symbol);
+      outputf(gen, "  %s = alloc ", name);
+      output_array_type(gen, dimensions, dimension_count);
+      outputf(gen, "\n");
+      if (def->val == NULL || def->val->type != AST_ARRAY_INIT) {
         fatalf("常量数组的值必须是数组\n");
       }
-      int *steps = malloc(dimension_count * sizeof(int));
-      steps[dimension_count - 1] = 1;
-      for (int i = dimension_count - 2; i >= 0; i--) {
-        steps[i] = steps[i + 1] * dimensions[i + 1];
-      }
-      AstArrayValue *array_value = (AstArrayValue *)def->val;
-      assert(array_value->count == total_count);
-      for (int i = 0; i < array_value->count; i++) {
-        int remaining = i;
-        for (int j = 0; j < dimension_count; j++) {
-          int offset = remaining / steps[j];
-          remaining = remaining % steps[j];
-          if (j == 0) {
-            outputf("  %%ptr_%d = getelemptr %s, %d\n", ptr_index, name,
-                    offset);
-          } else {
-            outputf("  %%ptr_%d = getelemptr %%ptr_%d, %d\n", ptr_index,
-                    ptr_index - 1, offset);
-          }
-          ptr_index++;
-        }
-        assert(array_value->elements[i]->type == AST_NUMBER);
-        int n = ((AstNumber *)array_value->elements[i])->number;
-        outputf("  store %d, %%ptr_%d\n", n, ptr_index - 1);
-      }
-      free((void *)name);
-      free(type);
-      free(temp_type);
+      codegen_local_array_init(gen, name, dimensions, dimension_count,
+                               (AstArrayInit *)def->val);
     }
   }
 }
 
-static void codegen_exp_stmt(AstExpStmt *stmt) { codegen_exp(stmt->exp); }
+static void codegen_exp_stmt(KoopaGen *gen, AstExpStmt *stmt) {
+  codegen_exp(gen, stmt->exp);
+}
 
-static void codegen_if_stmt(AstIfStmt *stmt) {
-  if_index++;
-  int current_if_index = if_index;
-  codegen_exp(stmt->condition);
+static void codegen_if_stmt(KoopaGen *gen, AstIfStmt *stmt) {
+  gen->if_index++;
+  int current_if_index = gen->if_index;
+  codegen_exp(gen, stmt->condition);
+  outputf(gen, "  br ");
+  output_operand(gen, exp_operand(gen, stmt->condition));
   if (stmt->else_) {
-    outputf("  br %s, %%if_then_%d, %%if_else_%d\n", exp_sign(stmt->condition),
-            current_if_index, current_if_index);
+    outputf(gen, ", %%if_then_%d, %%if_else_%d\n", current_if_index,
+            current_if_index);
   } else {
-    outputf("  br %s, %%if_then_%d, %%if_end_%d\n", exp_sign(stmt->condition),
-            current_if_index, current_if_index);
+    outputf(gen, ", %%if_then_%d, %%if_end_%d\n", current_if_index,
+            current_if_index);
   }
-  outputf("%%if_then_%d:\n", current_if_index);
-  codegen_stmt(stmt->then);
-  if (!output_ret_inst) {
+  outputf(gen, "%%if_then_%d:\n", current_if_index);
+  codegen_stmt(gen, stmt->then);
+  if (!gen->output_ret_inst) {
     // basic block 结尾后面如果是 ret 指令，就不需要 jump
-    outputf("  jump %%if_end_%d\n", current_if_index);
+    outputf(gen, "  jump %%if_end_%d\n", current_if_index);
   }
   if (stmt->else_) {
-    outputf("%%if_else_%d:\n", current_if_index);
-    codegen_stmt(stmt->else_);
-    if (!output_ret_inst) {
+    outputf(gen, "%%if_else_%d:\n", current_if_index);
+    codegen_stmt(gen, stmt->else_);
+    if (!gen->output_ret_inst) {
       // basic block 结尾后面如果是 ret 指令，就不需要 jump
-      outputf("  jump %%if_end_%d\n", current_if_index);
+      outputf(gen, "  jump %%if_end_%d\n", current_if_index);
     }
   }
-  outputf("%%if_end_%d:\n", current_if_index);
+  outputf(gen, "%%if_end_%d:\n", current_if_index);
 }
 
-static void codegen_while_stmt(AstWhileStmt *stmt) {
-  while_index++;
-  int current_index = while_index;
-  while_body_index = 0;
-  int_stack_push(&while_stack, current_index);
-
-  outputf("  jump %%while_entry_%d\n", current_index);
-  outputf("\n%%while_entry_%d:\n", current_index);
-  codegen_exp(stmt->condition);
-  outputf("  br %s, %%while_body_%d, %%while_end_%d\n",
-          exp_sign(stmt->condition), current_index, current_index);
-  outputf("\n%%while_body_%d:\n", current_index);
-  codegen_stmt(stmt->body);
-  if (!output_ret_inst) {
-    outputf("  jump %%while_entry_%d\n", current_index);
-  }
-  outputf("\n%%while_end_%d:\n", current_index);
-
-  int_stack_pop(&while_stack);
+static void codegen_while_stmt(KoopaGen *gen, AstWhileStmt *stmt) {
+  gen->while_index++;
+  int current_index = gen->while_index;
+  gen->while_body_index = 0;
+  int_stack_push(&gen->while_stack, current_index);
+
+  outputf(gen, "  jump %%while_entry_%d\n", current_index);
+  outputf(gen, "\n%%while_entry_%d:\n", current_index);
+  codegen_exp(gen, stmt->condition);
+  outputf(gen, "  br ");
+  output_operand(gen, exp_operand(gen, stmt->condition));
+  outputf(gen, ", %%while_body_%d, %%while_end_%d\n", current_index,
+          current_index);
+  outputf(gen, "\n%%while_body_%d:\n", current_index);
+  codegen_stmt(gen, stmt->body);
+  if (!gen->output_ret_inst) {
+    outputf(gen, "  jump %%while_entry_%d\n", current_index);
+  }
+  outputf(gen, "\n%%while_end_%d:\n", current_index);
+
+  int_stack_pop(&gen->while_stack);
 }
 
-static void codegen_break_stmt(AstBreakStmt *stmt) {
-  if (int_stack_empty(&while_stack)) {
+static void codegen_break_stmt(KoopaGen *gen, AstBreakStmt *stmt) {
+  if (int_stack_empty(&gen->while_stack)) {
     fatalf("break 只能出现在循环内\n");
   }
-  outputf("  jump %%while_end_%d\n", int_stack_top(&while_stack));
-  while_body_index++;
-  int current_index = while_body_index;
+  outputf(gen, "  jump %%while_end_%d\n", int_stack_top(&gen->while_stack));
+  gen->while_body_index++;
+  int current_index = gen->while_body_index;
   // jump 指令结束了前一个 basic block ，需要新起一个 basic block
-  outputf("\n%%while_body_%d_%d:\n", int_stack_top(&while_stack),
+  outputf(gen, "\n%%while_body_%d_%d:\n", int_stack_top(&gen->while_stack),
           current_index);
 }
 
-static void codegen_continue_stmt(AstContinueStmt *stmt) {
-  if (int_stack_empty(&while_stack)) {
+static void codegen_continue_stmt(KoopaGen *gen, AstContinueStmt *stmt) {
+  if (int_stack_empty(&gen->while_stack)) {
     fatalf("continue 只能出现在循环内\n");
   }
-  outputf("  jump %%while_entry_%d\n", int_stack_top(&while_stack));
-  while_body_index++;
-  int current_index = while_body_index;
+  outputf(gen, "  jump %%while_entry_%d\n", int_stack_top(&gen->while_stack));
+  gen->while_body_index++;
+  int current_index = gen->while_body_index;
   // jump 指令结束了前一个 basic block ，需要新起一个 basic block
-  outputf("\n%%while_body_%d_%d:\n", int_stack_top(&while_stack),
+  outputf(gen, "\n%%while_body_%d_%d:\n", int_stack_top(&gen->while_stack),
           current_index);
 }
 
-static void codegen_stmt(AstStmt *stmt) {
+static void codegen_stmt(KoopaGen *gen, AstStmt *stmt) {
   switch (stmt->type) {
   case AST_BREAK_STMT:
-    codegen_break_stmt((AstBreakStmt *)stmt);
+    codegen_break_stmt(gen, (AstBreakStmt *)stmt);
     break;
   case AST_CONTINUE_STMT:
-    codegen_continue_stmt((AstContinueStmt *)stmt);
+    codegen_continue_stmt(gen, (AstContinueStmt *)stmt);
     break;
   case AST_WHILE_STMT:
-    codegen_while_stmt((AstWhileStmt *)stmt);
+    codegen_while_stmt(gen, (AstWhileStmt *)stmt);
     break;
   case AST_IF_STMT:
-    codegen_if_stmt((AstIfStmt *)stmt);
+    codegen_if_stmt(gen, (AstIfStmt *)stmt);
     break;
   case AST_RETURN_STMT:
-    codegen_return_stmt((AstReturnStmt *)stmt);
+    codegen_return_stmt(gen, (AstReturnStmt *)stmt);
     break;
   case AST_ASSIGN_STMT:
-    codegen_assign_stmt((AstAssignStmt *)stmt);
+    codegen_assign_stmt(gen, (AstAssignStmt *)stmt);
     break;
   case AST_CONST_DECL:
-    codegen_const_decl((AstConstDecl *)stmt);
+    codegen_const_decl(gen, (AstConstDecl *)stmt);
     break;
   case AST_VAR_DECL:
-    codegen_var_decl((AstVarDecl *)stmt);
+    codegen_var_decl(gen, (AstVarDecl *)stmt);
     break;
   case AST_BLOCK:
-    codegen_block((AstBlock *)stmt);
+    codegen_block(gen, (AstBlock *)stmt);
     break;
   case AST_EXP_STMT:
-    codegen_exp_stmt((AstExpStmt *)stmt);
+    codegen_exp_stmt(gen, (AstExpStmt *)stmt);
     break;
   case AST_EMPTY_STMT:
     // nothing to do
@@ -1411,177 +834,137 @@ static void codegen_stmt(AstStmt *stmt) {
   }
 }
 
-static void codegen_block(AstBlock *block) {
+static void codegen_block(KoopaGen *gen, AstBlock *block) {
   AstStmt *stmt = block->stmt;
-  enter_scope();
+  enter_scope(&gen->symbols);
   while (stmt) {
-    codegen_stmt(stmt);
+    codegen_stmt(gen, stmt);
     stmt = stmt->next;
   }
-  leave_scope();
+  leave_scope(&gen->symbols);
 }
 
-static void codegen_array_init_value(int *dimension, int dimension_count,
-                                     AstArrayValue *value) {
+/**
+ * 输出下标 [start, start + 这一维的元素总数) 这一部分的初始值
+ * 整个部分都是 0 时只输出一个 zeroinit
+ * @param next init->entries 中第一个下标不小于 start 的元素，输出后更新
+ */
+static void codegen_array_init_value(KoopaGen *gen, const int *dimensions,
+                                     int dimension_count,
+                                     const AstArrayInit *init, int start,
+                                     int *next) {
   assert(dimension_count > 0);
-  if (dimension_count == 1) {
-    int count = dimension[0];
-    outputf("{");
-    for (int i = 0; i < value->count; i++) {
-      assert(value->elements[i]->type == AST_NUMBER);
-      outputf("%d", ((AstNumber *)value->elements[i])->number);
-      if (i != count - 1) {
-        outputf(", ");
-      }
-    }
-    for (int i = value->count; i < count; i++) {
-      outputf("0");
-      if (i != count - 1) {
-        outputf(", ");
-      }
-    }
-    outputf("}");
-    return;
+  int size = 1;
+  for (int i = 0; i < dimension_count; i++) {
+    size *= dimensions[i];
   }
-  int *steps = malloc(sizeof(int) * dimension_count - 1);
-  steps[dimension_count - 1] = dimension[dimension_count - 1];
-  for (int i = dimension_count - 2; i >= 0; i--) {
-    steps[i] = steps[i + 1] * dimension[i];
+  if (*next == init->count || init->entries[*next].index >= start + size) {
+    outputf(gen, "zeroinit");
+    return;
   }
-  for (int i = 0; i < value->count; i++) {
-    assert(value->elements[i]->type == AST_NUMBER);
-    bool left_brace = false;
-    for (int j = 0; j < dimension_count; j++) {
-      if ((i % steps[j]) == 0) {
-        left_brace = true;
-        outputf("{");
-      }
-    }
-    if (!left_brace) {
-      outputf(", ");
+  int step = size / dimensions[0];
+  outputf(gen, "{");
+  for (int i = 0; i < dimensions[0]; i++) {
+    if (i > 0) {
+      outputf(gen, ", ");
     }
-    outputf("%d", ((AstNumber *)value->elements[i])->number);
-    bool right_brace = false;
-    for (int j = 0; j < dimension_count; j++) {
-      if (((i + 1) % steps[j]) == 0) {
-        right_brace = true;
-        outputf("}");
-      }
-    }
-    if (right_brace && i != value->count - 1) {
-      outputf(", ");
+    if (dimension_count > 1) {
+      codegen_array_init_value(gen, dimensions + 1, dimension_count - 1, init,
+                               start + i * step, next);
+    } else if (*next < init->count && init->entries[*next].index == start + i) {
+      AstExp *value = init->entries[(*next)++].value;
+      assert(value->type == AST_NUMBER);
+      outputf(gen, "%d", ((AstNumber *)value)->number);
+    } else {
+      outputf(gen, "0");
     }
   }
+  outputf(gen, "}");
 }
 
-static void codegen_global_var_decl(AstVarDecl *decl) {
+static void codegen_global_var_decl(KoopaGen *gen, AstVarDecl *decl) {
   for (int i = 0; i < decl->defs.count; i++) {
     AstVarDef *def = decl->defs.elements[i];
-    Symbol *symbol = new_symbol(def->name, SymbolType_int);
-    const char *name = symbol_unique_name(symbol);
+    Symbol *symbol = new_symbol(&gen->symbols, def->name, SymbolType_int);
+    const char *name = symbol_unique_name(&gen->symbols, symbol);
     if (def->dimensions.count > 0) {
-      char *type = malloc(def->dimensions.count * 32 * sizeof(char));
-      char *temp_type = malloc(def->dimensions.count * 32 * sizeof(char));
-      int *dimensions = malloc(sizeof(int) * def->dimensions.count);
-      strcpy(type, "i32");
-      for (int i = def->dimensions.count - 1; i > -1; i--) {
-        assert(def->dimensions.elements[i]->type == AST_NUMBER);
-        int n = ((AstNumber *)def->dimensions.elements[i])->number;
-        assert(n > 0);
-        dimensions[i] = n;
-        sprintf(temp_type, "[%s, %d]", type, n);
-        strcpy(type, temp_type);
-      }
       symbol->type = SymbolType_array;
-      symbol->dimensions = dimensions;
-      symbol->dimension_count = def->dimensions.count;
-      outputf("global %s = alloc %s, ", name, type);
+      symbol_set_dimensions(&gen->symbols, symbol, &def->dimensions);
+      outputf(gen, "global %s = alloc ", name);
+      output_array_type(gen, symbol->dimensions, symbol->dimension_count);
+      outputf(gen, ", ");
       if (def->val) {
-        assert(def->val->type == AST_ARRAY_VALUE);
-        codegen_array_init_value(dimensions, def->dimensions.count,
-                                 (AstArrayValue *)def->val);
-        outputf("\n");
+        assert(def->val->type == AST_ARRAY_INIT);
+        int next = 0;
+        codegen_array_init_value(gen, symbol->dimensions,
+                                 symbol->dimension_count,
+                                 (AstArrayInit *)def->val, 0, &next);
+        outputf(gen, "\n");
       } else {
-        outputf("zeroinit\n");
+        outputf(gen, "zeroinit\n");
       }
-      free(type);
-      free(temp_type);
     } else {
-      outputf("global %s = alloc i32, ", name);
+      outputf(gen, "global %s = alloc i32, ", name);
       if (def->val) {
         assert(def->val->type == AST_NUMBER);
-        outputf("%d\n", ((AstNumber *)def->val)->number);
+        outputf(gen, "%d\n", ((AstNumber *)def->val)->number);
       } else {
-        outputf("zeroinit\n");
+        outputf(gen, "zeroinit\n");
       }
     }
-    free((void *)name);
   }
 }
 
-static void codegen_global_const_decl(AstConstDecl *decl) {
+static void codegen_global_const_decl(KoopaGen *gen, AstConstDecl *decl) {
   for (int i = 0; i < decl->defs.count; i++) {
     AstVarDef *def = decl->defs.elements[i];
     if (def->dimensions.count > 0) {
-      char *type = malloc(def->dimensions.count * 32 * sizeof(char));
-      char *temp_type = malloc(def->dimensions.count * 32 * sizeof(char));
-      int *dimensions = malloc(sizeof(int) * def->dimensions.count);
-      strcpy(type, "i32");
-      for (int i = def->dimensions.count - 1; i > -1; i--) {
-        assert(def->dimensions.elements[i]->type == AST_NUMBER);
-        int n = ((AstNumber *)def->dimensions.elements[i])->number;
-        assert(n > 0);
-        dimensions[i] = n;
-        sprintf(temp_type, "[%s, %d]", type, n);
-        strcpy(type, temp_type);
-      }
-      Symbol *symbol = new_symbol(def->name, SymbolType_array);
-      symbol->is_const_value = true;
-      symbol->dimensions = dimensions;
-      symbol->dimension_count = def->dimensions.count;
-      const char *name = symbol_unique_name(symbol);
-      outputf("global %s = alloc %s, ", name, type);
-      if (def->val == NULL || def->val->type != AST_ARRAY_VALUE) {
+      // 常量数组在 optimize_const_decl 中已经加入了符号表
+      Symbol *symbol = find_symbol(&gen->symbols, def->name);
+      assert(symbol != NULL && symbol->level == 0 &&
+             symbol->type == SymbolType_array);
+      symbol_set_dimensions(&gen->symbols, symbol, &def->dimensions);
+      const char *name = symbol_unique_name(&gen->symbols, symbol);
+      outputf(gen, "global %s = alloc ", name);
+      output_array_type(gen, symbol->dimensions, symbol->dimension_count);
+      outputf(gen, ", ");
+      if (def->val == NULL || def->val->type != AST_ARRAY_INIT) {
         fatalf("常量数组的值必须是数组\n");
       }
-      codegen_array_init_value(dimensions, def->dimensions.count,
-                               (AstArrayValue *)def->val);
-      outputf("\n");
-      free((void *)name);
-      free(type);
-      free(temp_type);
+      int next = 0;
+      codegen_array_init_value(gen, symbol->dimensions, symbol->dimension_count,
+                               (AstArrayInit *)def->val, 0, &next);
+      outputf(gen, "\n");
     }
   }
 }
 
-static void codegen_func_def(AstFuncDef *func_def) {
-  temp_sign_index = 0;
-  current_func_def = func_def;
-  outputf("fun @%s(", func_def->ident->name);
+static void codegen_func_def(KoopaGen *gen, AstFuncDef *func_def) {
+  // 临时符号和标签只需要在函数内唯一，每个函数都从 0 开始计数
+  gen->temp_sign_index = 0;
+  gen->if_index = 0;
+  gen->while_index = 0;
+  gen->while_body_index = 0;
+  gen->logic_index = 0;
+  gen->ptr_index = 0;
+  gen->zero_fill_index = 0;
+  gen->current_func_def = func_def;
+  outputf(gen, "fun @%s(", func_def->ident->name);
   FuncParam *param = func_def->params;
   while (param) {
     switch (param->type) {
     case BType_INT:
-      outputf("@%s: i32", param->ident->name);
+      outputf(gen, "@%s: i32", param->ident->name);
       break;
     case BType_POINTER:
-      outputf("@%s: *i32", param->ident->name);
+      outputf(gen, "@%s: *i32", param->ident->name);
       break;
     case BType_ARRAY_POINTER: {
       assert(param->dimensions.count > 0);
-      char *type = malloc(param->dimensions.count * 32 * sizeof(char));
-      char *temp_type = malloc(param->dimensions.count * 32 * sizeof(char));
-      strcpy(type, "i32");
-      for (int i = param->dimensions.count - 1; i > -1; i--) {
-        assert(param->dimensions.elements[i]->type == AST_NUMBER);
-        int n = ((AstNumber *)param->dimensions.elements[i])->number;
-        assert(n > 0);
-        sprintf(temp_type, "[%s, %d]", type, n);
-        strcpy(type, temp_type);
-      }
-      outputf("@%s: *%s", param->ident->name, type);
-      free(type);
-      free(temp_type);
+      int dimensions[param->dimensions.count];
+      read_dimensions(&param->dimensions, dimensions);
+      outputf(gen, "@%s: *", param->ident->name);
+      output_array_type(gen, dimensions, param->dimensions.count);
       break;
     }
     default:
@@ -1589,59 +972,47 @@ static void codegen_func_def(AstFuncDef *func_def) {
     }
     param = param->next;
     if (param) {
-      outputf(", ");
+      outputf(gen, ", ");
     }
   }
-  outputf(") ");
+  outputf(gen, ") ");
   if (func_def->func_type != BType_VOID) {
-    outputf(": i32 ");
+    outputf(gen, ": i32 ");
   }
-  outputf("{\n");
+  outputf(gen, "{\n");
 
-  outputf("%%entry:\n");
+  outputf(gen, "%%entry:\n");
 
-  enter_scope();
+  enter_scope(&gen->symbols);
   param = func_def->params;
   while (param) {
     switch (param->type) {
     case BType_INT: {
-      Symbol *symbol = new_symbol(param->ident->name, SymbolType_int);
-      const char *name = symbol_unique_name(symbol);
-      outputf("  %s = alloc i32\n", name);
-      outputf("  store @%s, %s\n", param->ident->name, name);
-      free((void *)name);
+      Symbol *symbol = new_symbol(&gen->symbols, param->ident->name,
+                                  SymbolType_int);
+      const char *name = symbol_unique_name(&gen->symbols, symbol);
+      outputf(gen, "  %s = alloc i32\n", name);
+      outputf(gen, "  store @%s, %s\n", param->ident->name, name);
       break;
     }
     case BType_POINTER: {
-      Symbol *symbol = new_symbol(param->ident->name, SymbolType_pointer);
-      const char *name = symbol_unique_name(symbol);
-      outputf("  %s = alloc *i32\n", name);
-      outputf("  store @%s, %s\n", param->ident->name, name);
-      free((void *)name);
+      Symbol *symbol = new_symbol(&gen->symbols, param->ident->name,
+                                  SymbolType_pointer);
+      const char *name = symbol_unique_name(&gen->symbols, symbol);
+      outputf(gen, "  %s = alloc *i32\n", name);
+      outputf(gen, "  store @%s, %s\n", param->ident->name, name);
       break;
     }
     case BType_ARRAY_POINTER: {
       assert(param->dimensions.count > 0);
-      Symbol *symbol = new_symbol(param->ident->name, SymbolType_array_pointer);
-      symbol->dimension_count = param->dimensions.count;
-      symbol->dimensions = malloc(sizeof(int) * param->dimensions.count);
-      const char *name = symbol_unique_name(symbol);
-      char *type = malloc(param->dimensions.count * 32 * sizeof(char));
-      char *temp_type = malloc(param->dimensions.count * 32 * sizeof(char));
-      strcpy(type, "i32");
-      for (int i = param->dimensions.count - 1; i > -1; i--) {
-        assert(param->dimensions.elements[i]->type == AST_NUMBER);
-        int n = ((AstNumber *)param->dimensions.elements[i])->number;
-        assert(n > 0);
-        sprintf(temp_type, "[%s, %d]", type, n);
-        strcpy(type, temp_type);
-        symbol->dimensions[i] = n;
-      }
-      outputf("  %s = alloc *%s\n", name, type);
-      outputf("  store @%s, %s\n", param->ident->name, name);
-      free(type);
-      free(temp_type);
-      free((void *)name);
+      Symbol *symbol = new_symbol(&gen->symbols, param->ident->name,
+                                  SymbolType_array_pointer);
+      symbol_set_dimensions(&gen->symbols, symbol, &param->dimensions);
+      const char *name = symbol_unique_name(&gen->symbols, symbol);
+      outputf(gen, "  %s = alloc *", name);
+      output_array_type(gen, symbol->dimensions, symbol->dimension_count);
+      outputf(gen, "\n");
+      outputf(gen, "  store @%s, %s\n", param->ident->name, name);
       break;
     }
     default:
@@ -1650,123 +1021,356 @@ static void codegen_func_def(AstFuncDef *func_def) {
     param = param->next;
   }
 
-  codegen_block(func_def->block);
-  if (!output_ret_inst) {
-    outputf("  ret\n");
+  codegen_block(gen, func_def->block);
+  if (!gen->output_ret_inst) {
+    outputf(gen, "  ret\n");
   }
-  outputf("}\n");
-  leave_scope();
+  outputf(gen, "}\n");
+  leave_scope(&gen->symbols);
 }
 
-static void codegen_comp_unit(AstCompUnit *comp_unit) {
-  bool has_main = false;
-  for (int i = 0; i < comp_unit->count; i++) {
-    if (comp_unit->defs[i]->type == AST_FUNC_DEF) {
-      AstFuncDef *func_def = (AstFuncDef *)comp_unit->defs[i];
-      Symbol *symbol = new_symbol(func_def->ident->name, SymbolType_func);
-      update_func_type(func_def, &symbol->func_type);
-      codegen_func_def(func_def);
-      if (strcmp(func_def->ident->name, "main") == 0 &&
-          func_def->param_count == 0 && func_def->func_type == BType_INT) {
-        has_main = true;
-      }
-    } else if (comp_unit->defs[i]->type == AST_VAR_DECL) {
-      codegen_global_var_decl((AstVarDecl *)comp_unit->defs[i]);
-    } else if (comp_unit->defs[i]->type == AST_CONST_DECL) {
-      codegen_global_const_decl((AstConstDecl *)comp_unit->defs[i]);
+// 优化并生成一个函数，只依赖全局符号，可以在任意线程中执行
+// 局部符号的编号也从 0 开始，生成结果和其他函数、执行的线程都无关
+/*
+ * 函数在缓存中的键：函数的 token 序列，加上函数里出现的标识符对应的全局符号
+ * 生成函数的 IR 只会用到这些外部信息，它们都不变时 IR 也不变。
+ * 被局部符号遮蔽的全局符号也算进来，只是让缓存偏保守。
+ */
+static CacheKey function_cache_key(KoopaGen *gen, AstFuncDef *func_def) {
+  CacheKey key = func_def->token_key;
+  for (int i = 0; i < func_def->ident_count; i++) {
+    Symbol *symbol = find_symbol(&gen->symbols, func_def->idents[i]);
+    if (symbol == NULL) {
+      cache_key_update_int(&key, -1);
+      continue;
+    }
+    // 函数在 IR 中直接用原来的名字，常量直接替换成值，
+    // 只有变量的名字里带有它在全局符号中的序号
+    if (symbol->type == SymbolType_func || symbol->is_const_value) {
+      cache_key_update_str(&key, symbol->name);
     } else {
-      fatalf("未知的定义类型\n");
+      cache_key_update_str(&key, symbol_unique_name(&gen->symbols, symbol));
+    }
+    cache_key_update_int(&key, symbol->type);
+    cache_key_update_int(&key, symbol->is_const_value);
+    cache_key_update_int(&key, symbol->value);
+    cache_key_update_int(&key, symbol->dimension_count);
+    cache_key_update(&key, symbol->dimensions,
+                     sizeof(int) * symbol->dimension_count);
+    if (symbol->type == SymbolType_func) {
+      FunctionType *func_type = &symbol->func_type;
+      cache_key_update_int(&key, func_type->return_type);
+      cache_key_update_int(&key, func_type->param_count);
+      cache_key_update(&key, func_type->param_types,
+                       sizeof(BType) * func_type->param_count);
+    }
+  }
+  return key;
+}
+
+static void codegen_function(KoopaGen *gen, AstFuncDef *func_def) {
+  // 输出一定在内存中，函数的 IR 就是 start 之后追加的部分
+  StringBuffer *output = gen->emitter.buffer;
+  size_t start = output->size;
+  CacheKey key = {0, 0};
+  if (gen->context->cache != NULL) {
+    key = function_cache_key(gen, func_def);
+    cache_key_map_put(&gen->context->function_keys, func_def->ident->name, key);
+    if (cache_load(gen->context->cache, key, CACHE_KOOPA, output)) {
+      return;
+    }
+  }
+
+  // 优化时加入的局部常量用完就丢，生成 IR 时局部符号重新从 0 开始编号
+  phase_begin(PHASE_OPTIMIZE);
+  int global_index = symbol_table_begin_function(&gen->symbols);
+  optimize_func_def(&gen->symbols, gen->arena, func_def);
+  symbol_table_end_function(&gen->symbols, global_index);
+  phase_end(PHASE_OPTIMIZE);
+  global_index = symbol_table_begin_function(&gen->symbols);
+  codegen_func_def(gen, func_def);
+  symbol_table_end_function(&gen->symbols, global_index);
+  if (gen->context->cache != NULL) {
+    cache_store(gen->context->cache, key, CACHE_KOOPA, output->data + start,
+                output->size - start);
+  }
+}
+
+// 函数体之外的部分：优化并生成全局变量和常量，登记函数的类型
+static void codegen_global_def(KoopaGen *gen, AstBase *def) {
+  switch (def->type) {
+  case AST_FUNC_DEF: {
+    AstFuncDef *func_def = (AstFuncDef *)def;
+    Symbol *symbol = new_symbol(&gen->symbols, func_def->ident->name,
+                                SymbolType_func);
+    update_func_type(&gen->symbols, func_def, &symbol->func_type);
+    if (strcmp(func_def->ident->name, "main") == 0 &&
+        func_def->param_count == 0 && func_def->func_type == BType_INT) {
+      gen->has_main = true;
     }
+    break;
+  }
+  case AST_VAR_DECL: {
+    phase_begin(PHASE_OPTIMIZE);
+    optimize_global_var_decl(&gen->symbols, gen->arena, (AstVarDecl *)def);
+    phase_end(PHASE_OPTIMIZE);
+    codegen_global_var_decl(gen, (AstVarDecl *)def);
+    break;
+  }
+  case AST_CONST_DECL: {
+    phase_begin(PHASE_OPTIMIZE);
+    optimize_const_decl(&gen->symbols, gen->arena, (AstConstDecl *)def);
+    phase_end(PHASE_OPTIMIZE);
+    codegen_global_const_decl(gen, (AstConstDecl *)def);
+    break;
+  }
+  default: {
+    fatalf("未知的定义类型\n");
   }
+  }
+}
+
+static void check_main(KoopaGen *gen) {
   // 在该 CompUnit 中, 必须存在且仅存在一个标识为 main, 无参数, 返回类型为 int
   // 的 FuncDef (函数定义). main 函数是程序的入口点.
-  if (!has_main) {
+  if (!gen->has_main) {
     fatalf("入口函数 main 不存在\n");
   }
 }
 
-// 生成 SysY 运行时库的声明
-static void codegen_lib_decl(void) {
-  Symbol *symbol = NULL;
-  outputf("decl @getint(): i32\n");
-  symbol = new_symbol("getint", SymbolType_func);
-  symbol->func_type.return_type = BType_INT;
-  symbol->func_type.param_count = 0;
-  symbol->func_type.param_types = NULL;
-
-  outputf("decl @getch(): i32\n");
-  symbol = new_symbol("getch", SymbolType_func);
-  symbol->func_type.return_type = BType_INT;
-  symbol->func_type.param_count = 0;
-  symbol->func_type.param_types = NULL;
-
-  outputf("decl @getarray(*i32): i32\n");
-  symbol = new_symbol("getarray", SymbolType_func);
-  symbol->func_type.return_type = BType_INT;
-  symbol->func_type.param_count = 1;
-  symbol->func_type.param_types = malloc(sizeof(BType));
-  symbol->func_type.param_types[0] = BType_POINTER;
-
-  outputf("decl @putint(i32)\n");
-  symbol = new_symbol("putint", SymbolType_func);
-  symbol->func_type.return_type = BType_VOID;
-  symbol->func_type.param_count = 1;
-  symbol->func_type.param_types = malloc(sizeof(BType));
-  symbol->func_type.param_types[0] = BType_INT;
-
-  outputf("decl @putch(i32)\n");
-  symbol = new_symbol("putch", SymbolType_func);
-  symbol->func_type.return_type = BType_VOID;
-  symbol->func_type.param_count = 1;
-  symbol->func_type.param_types = malloc(sizeof(BType));
-  symbol->func_type.param_types[0] = BType_INT;
-
-  outputf("decl @putarray(i32, *i32)\n");
-  symbol = new_symbol("putarray", SymbolType_func);
-  symbol->func_type.return_type = BType_VOID;
-  symbol->func_type.param_count = 2;
-  symbol->func_type.param_types = malloc(sizeof(BType) * 2);
-  symbol->func_type.param_types[0] = BType_INT;
-  symbol->func_type.param_types[1] = BType_POINTER;
-
-  outputf("decl @starttime()\n");
-  symbol = new_symbol("starttime", SymbolType_func);
-  symbol->func_type.return_type = BType_VOID;
-  symbol->func_type.param_count = 0;
-  symbol->func_type.param_types = NULL;
-
-  outputf("decl @stoptime()\n");
-  symbol = new_symbol("stoptime", SymbolType_func);
-  symbol->func_type.return_type = BType_VOID;
-  symbol->func_type.param_count = 0;
-  symbol->func_type.param_types = NULL;
+/*
+ * 第一阶段，按源码顺序处理全局定义：
+ * 优化并生成全局变量和常量（IR 写到 outputs 中对应的位置），登记函数的类型。
+ * 函数体在第二阶段处理，所以函数可以看到全部的全局符号。
+ */
+static void codegen_global_defs(KoopaGen *gen, AstCompUnit *comp_unit,
+                                StringBuffer *outputs) {
+  for (int i = 0; i < comp_unit->count; i++) {
+    emitter_init(&gen->emitter, &outputs[i]);
+    codegen_global_def(gen, comp_unit->defs[i]);
+  }
+  check_main(gen);
+}
+
+// 准备一份新的状态，优化 AST 时新建的节点分配在 arena 中
+static void init(KoopaGen *gen, CompileContext *ctx, Arena *arena) {
+  gen->context = ctx;
+  symbol_table_init(&gen->symbols);
+  gen->arena = arena;
+  gen->temp_sign_index = 0;
+  gen->if_index = 0;
+  gen->while_index = 0;
+  gen->while_body_index = 0;
+  int_stack_init(&gen->while_stack);
+  gen->logic_index = 0;
+  gen->output_ret_inst = false;
+  gen->ptr_index = 0;
+  gen->zero_fill_index = 0;
+  gen->current_func_def = NULL;
+  gen->has_main = false;
+  gen->def_outputs = NULL;
+  gen->def_output_count = 0;
+}
+
+static void finish(KoopaGen *gen) {
+  for (int i = 0; i < gen->def_output_count; i++) {
+    string_buffer_free(&gen->def_outputs[i]);
+  }
+  free(gen->def_outputs);
+  gen->def_outputs = NULL;
+  gen->def_output_count = 0;
+  symbol_table_free(&gen->symbols);
+  free(gen->while_stack.data);
+  gen->while_stack.data = NULL;
+}
+
+// #region 并行生成函数
+
+typedef struct {
+  AstFuncDef **funcs;
+  StringBuffer **outputs; // funcs[i] 的 IR 写到 outputs[i]
+  // 第一阶段结束时的全局符号，工作线程用它们建立自己的符号表
+  Symbol **globals;
+  int global_count;
+  // 当前线程（worker 0）的状态，工作线程从它复制上下文
+  KoopaGen *gen;
+  // 工作线程各自的状态和优化 AST 时使用的 arena ，都按 worker 编号，
+  // 下标 0 不使用。arena 结束后并入 ctx->ast_arena
+  KoopaGen *workers;
+  Arena *arenas;
+} FunctionJobs;
+
+static void function_thread_init(void *arg, int worker) {
+  FunctionJobs *jobs = arg;
+  KoopaGen *gen = &jobs->workers[worker];
+  init(gen, jobs->gen->context, &jobs->arenas[worker]);
+  import_symbols(&gen->symbols, jobs->globals, jobs->global_count);
+}
+
+static void function_thread_exit(void *arg, int worker) {
+  FunctionJobs *jobs = arg;
+  finish(&jobs->workers[worker]);
+}
+
+static void function_task(void *arg, int worker, int index) {
+  FunctionJobs *jobs = arg;
+  KoopaGen *gen = worker == 0 ? jobs->gen : &jobs->workers[worker];
+  // 工作线程自己统计，当前线程执行时嵌套在 koopa_ir_codegen 的阶段里
+  phase_begin(PHASE_IR_EMIT);
+  emitter_init(&gen->emitter, jobs->outputs[index]);
+  codegen_function(gen, jobs->funcs[index]);
+  phase_end(PHASE_IR_EMIT);
+}
+
+// 第二阶段，threads 个线程同时生成函数，每个函数写到自己的缓冲区
+static void codegen_functions_parallel(KoopaGen *gen, AstCompUnit *comp_unit,
+                                       StringBuffer *outputs, int threads) {
+  FunctionJobs jobs;
+  jobs.funcs = malloc(sizeof(AstFuncDef *) * comp_unit->count);
+  jobs.outputs = malloc(sizeof(StringBuffer *) * comp_unit->count);
+  int func_count = 0;
+  for (int i = 0; i < comp_unit->count; i++) {
+    if (comp_unit->defs[i]->type == AST_FUNC_DEF) {
+      jobs.funcs[func_count] = (AstFuncDef *)comp_unit->defs[i];
+      jobs.outputs[func_count] = &outputs[i];
+      func_count++;
+    }
+  }
+  // 当前线程之后还会在符号表里加入局部符号，log 可能被 realloc ，所以复制一份
+  // 全局符号的名字提前生成好，之后其他线程只读不写
+  Symbol **globals = symbol_table_symbols(&gen->symbols, &jobs.global_count);
+  jobs.globals = malloc(sizeof(Symbol *) * (jobs.global_count + 1));
+  for (int i = 0; i < jobs.global_count; i++) {
+    jobs.globals[i] = globals[i];
+    symbol_unique_name(&gen->symbols, jobs.globals[i]);
+  }
+  jobs.gen = gen;
+  jobs.workers = malloc(sizeof(KoopaGen) * threads);
+  jobs.arenas = malloc(sizeof(Arena) * threads);
+  for (int i = 0; i < threads; i++) {
+    arena_init(&jobs.arenas[i]);
+  }
+
+  thread_pool_run_with_hooks(threads, func_count, function_task,
+                             function_thread_init, function_thread_exit,
+                             &jobs);
+
+  for (int i = 1; i < threads; i++) {
+    arena_absorb(&gen->context->ast_arena, &jobs.arenas[i]);
+  }
+  free(jobs.workers);
+  free(jobs.arenas);
+  free(jobs.globals);
+  free(jobs.outputs);
+  free(jobs.funcs);
 }
 
 // #endregion
 
-static void init(void) {
-  temp_sign_index = 0;
-  if_index = 0;
-  while_index = 0;
-  while_body_index = 0;
-  int_stack_init(&while_stack);
-  logic_index = 0;
-  output_ret_inst = false;
+static void output_param_type(KoopaGen *gen, BType type) {
+  switch (type) {
+  case BType_INT:
+    outputf(gen, "i32");
+    break;
+  case BType_POINTER:
+    outputf(gen, "*i32");
+    break;
+  default:
+    fatalf("未知的参数类型\n");
+  }
 }
 
-void koopa_ir_codegen(AstCompUnit *comp_unit, const char *output_file) {
-  init();
+// 生成 SysY 运行时库的声明
+static void codegen_lib_decl(KoopaGen *gen) {
+  Symbol *symbols[LIB_FUNCTION_COUNT];
+  declare_lib_symbols(&gen->symbols, &gen->context->intern_pool, symbols);
+  for (int i = 0; i < LIB_FUNCTION_COUNT; i++) {
+    FunctionType *func_type = &symbols[i]->func_type;
+    outputf(gen, "decl @%s(", symbols[i]->name);
+    for (int j = 0; j < func_type->param_count; j++) {
+      if (j > 0) {
+        outputf(gen, ", ");
+      }
+      output_param_type(gen, func_type->param_types[j]);
+    }
+    outputf(gen, ")");
+    if (func_type->return_type != BType_VOID) {
+      outputf(gen, ": i32");
+    }
+    outputf(gen, "\n");
+  }
+}
+
+// #endregion
 
-  fp = fopen(output_file, "w");
-  if (fp == NULL) {
-    fprintf(stderr, "无法打开文件 %s\n", output_file);
-    exit(1);
+void koopa_ir_codegen(CompileContext *ctx, AstCompUnit *comp_unit,
+                      StringBuffer *output) {
+  phase_begin(PHASE_IR_EMIT);
+  KoopaGen gen;
+  // 优化 AST 时会创建新的节点，和其他节点一起放在 ctx 中
+  init(&gen, ctx, &ctx->ast_arena);
+  // 服务模式下出错时先释放状态，再跳回外层设置的位置
+  jmp_buf trap;
+  jmp_buf *outer = set_error_trap(NULL);
+  if (outer != NULL) {
+    set_error_trap(&trap);
+    if (setjmp(trap) != 0) {
+      finish(&gen);
+      set_error_trap(outer);
+      compile_error_exit();
+    }
+  }
+  emitter_init(&gen.emitter, output);
+  codegen_lib_decl(&gen);
+
+  // 每个全局定义的 IR ，最后按源码顺序拼接
+  // 全零的缓冲区第一次写入时才分配内存
+  StringBuffer *outputs = calloc(comp_unit->count + 1, sizeof(StringBuffer));
+  gen.def_outputs = outputs;
+  gen.def_output_count = comp_unit->count;
+  codegen_global_defs(&gen, comp_unit, outputs);
+  bool parallel = ctx->threads > 1;
+  if (parallel) {
+    codegen_functions_parallel(&gen, comp_unit, outputs, ctx->threads);
   }
 
-  // 优化 AST
-  optimize_comp_unit(comp_unit);
-  // 生成 IR
-  codegen_lib_decl();
-  codegen_comp_unit(comp_unit);
-  fclose(fp);
-}
\ No newline at end of file
+  emitter_init(&gen.emitter, output);
+  for (int i = 0; i < comp_unit->count; i++) {
+    AstBase *def = comp_unit->defs[i];
+    if (def->type == AST_FUNC_DEF && !parallel) {
+      // 串行时直接写到 output ，不经过缓冲区
+      codegen_function(&gen, (AstFuncDef *)def);
+    } else {
+      emit_bytes(&gen.emitter, outputs[i].data, outputs[i].size);
+    }
+    string_buffer_free(&outputs[i]);
+  }
+  set_error_trap(outer);
+  finish(&gen);
+  phase_end(PHASE_IR_EMIT);
+}
+
+void koopa_ir_stream_begin(KoopaGen *gen, CompileContext *ctx,
+                           StringBuffer *output) {
+  init(gen, ctx, NULL);
+  emitter_init(&gen->emitter, output);
+  codegen_lib_decl(gen);
+}
+
+void koopa_ir_stream_def(KoopaGen *gen, AstBase *def, Arena *arena,
+                         StringBuffer *output) {
+  phase_begin(PHASE_IR_EMIT);
+  gen->arena = arena;
+  emitter_init(&gen->emitter, output);
+  codegen_global_def(gen, def);
+  if (def->type == AST_FUNC_DEF) {
+    codegen_function(gen, (AstFuncDef *)def);
+  }
+  gen->arena = NULL;
+  phase_end(PHASE_IR_EMIT);
+}
+
+void koopa_ir_stream_end(KoopaGen *gen) {
+  check_main(gen);
+  finish(gen);
+}
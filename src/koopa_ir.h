@@ -1,8 +1,76 @@
 #ifndef SRC_CODEGEN_H_
 #define SRC_CODEGEN_H_
 
+#include <stdbool.h>
+
+#include "arena.h"
 #include "ast.h"
+#include "context.h"
+#include "emit.h"
+#include "symbol.h"
+#include "utils.h"
+
+/*
+ * 生成 Koopa IR 的状态
+ * koopa_ir_codegen 在栈上准备一个，并行生成函数时每个工作线程再各用一个；
+ * 流式生成时由调用方持有，在 begin 、def 和 end 之间传递。
+ */
+typedef struct {
+  // 当前编译任务的上下文，驻留字符串从这里分配
+  CompileContext *context;
+  // IR 输出，写到调用方提供的缓冲区
+  Emitter emitter;
+  SymbolTable symbols;
+  // 优化 AST 时新建的节点分配在这里
+  Arena *arena;
+  // IR 里面 %0, %1, %2 等符号的索引计数
+  int temp_sign_index;
+  // if 计数，用来生成唯一的标签
+  int if_index;
+  // while 计数，用来生成唯一的标签
+  int while_index;
+  /*
+   * while body 计数，用来给 break continue 后的指令生成唯一标签
+   * break continue 会中断当前指令的 basic block
+   * 所以需要重新生成一个新的 basic block
+   */
+  int while_body_index;
+  // while 栈结构，用来辅助 break continue 生成
+  IntStack while_stack;
+  // 逻辑运算（ && || ）计数，用来生成唯一的标签
+  int logic_index;
+  // 最后输出的指令是否是 ret ，不是的话需要在末尾补上 ret 或者 jump
+  bool output_ret_inst;
+  // ptr 计数
+  int ptr_index;
+  // 局部数组清零循环的计数，用来生成唯一的标签
+  int zero_fill_index;
+  // codegen 当前正在处理的函数
+  AstFuncDef *current_func_def;
+  // 是否已经定义了 main 函数
+  bool has_main;
+  // koopa_ir_codegen 中每个全局定义的 IR ，出错跳出时一起释放
+  StringBuffer *def_outputs;
+  int def_output_count;
+} KoopaGen;
+
+// 生成 Koopa IR 文本，追加到 output 中
+void koopa_ir_codegen(CompileContext *ctx, AstCompUnit *comp_unit,
+                      StringBuffer *output);
 
-void koopa_ir_codegen(AstCompUnit *comp_unit, const char *output_file);
+/*
+ * 流式生成，全局定义按源码顺序逐个传入，每个定义的 IR 单独输出
+ * 和 koopa_ir_codegen 的结果相同，只是函数只能看到它前面的全局符号
+ * begin 输出运行时库的声明，它会使用 ctx 的驻留池，
+ * 所以要在其他线程开始解析（同样使用驻留池）之前调用。
+ * 优化 def 时新建的节点分配在 arena 中，
+ * def 的节点可以在 koopa_ir_stream_def 返回后释放。
+ */
+void koopa_ir_stream_begin(KoopaGen *gen, CompileContext *ctx,
+                           StringBuffer *output);
+void koopa_ir_stream_def(KoopaGen *gen, AstBase *def, Arena *arena,
+                         StringBuffer *output);
+// 检查 main 函数，释放生成过程中的状态
+void koopa_ir_stream_end(KoopaGen *gen);
 
 #endif // SRC_CODEGEN_H_
\ No newline at end of file
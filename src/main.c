@@ -1,25 +1,60 @@
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include "koopa_ir.h"
-#include "parse.h"
-#include "riscv.h"
-#include "riscv_perf.h"
+#include "cache.h"
+#include "compile.h"
+#include "context.h"
+#include "emit.h"
+#include "pipeline.h"
+#include "riscv_stats.h"
+#include "server.h"
+#include "source.h"
+#include "thread_pool.h"
+#include "time_report.h"
+#include "utils.h"
 
 // #define DEBUG_LOG
 
-typedef enum {
-  CODEGEN_TARGET_RISCV,
-  CODEGEN_TARGET_KOOPA,
-  CODEGEN_TARGET_PERF,
-} CodegenTarget;
-
+// 所有输入文件使用同一个目标
 static CodegenTarget target;
+// 所有输入文件共享同一个缓存，NULL 表示不使用缓存
+static Cache *cache = NULL;
+// -ir ：从 AST 生成 ir.h 中的 IR ，运行 pass 后直接交给后端
+static bool native_ir = false;
+// -verify-ir ：每个 pass 之后验证 IR
+static bool verify_ir = false;
+
+typedef struct {
+  char **input_files;
+  int input_count;
+  char *output_file;
+  int jobs;        // 同时编译的文件数
+  bool stream;     // 流式编译，解析、生成 IR 和输出在不同线程中同时进行
+  bool low_memory; // 逐个定义编译，处理完一个函数再解析下一个
+  char *cache_dir; // 按函数缓存 IR 和汇编的目录
+  char *server;    // 编译服务的 socket 路径，- 表示标准输入输出
+  bool time_report;      // 结束时输出每个阶段的耗时和内存
+  bool time_report_json; // 以 JSON 格式输出
+  bool stats;            // 结束时输出 perf 后端每个函数的代码统计
+} Options;
 
 // handle cli arguments like "-koopa 输入文件 -o 输出文件"
-void handle_cli_arguments(int argc, char *argv[], char **input_file,
-                          char **output_file) {
+// 多个输入文件时 -o 指定输出目录，-j N 指定并行编译的线程数
+// 只有一个输入文件时 -j N 指定生成这个文件使用的线程数
+void handle_cli_arguments(int argc, char *argv[], Options *options) {
+  options->input_files = malloc(sizeof(char *) * argc);
+  options->input_count = 0;
+  options->output_file = NULL;
+  options->jobs = 1;
+  options->stream = false;
+  options->low_memory = false;
+  options->cache_dir = NULL;
+  options->server = NULL;
+  options->time_report = false;
+  options->time_report_json = false;
+  options->stats = false;
   for (int i = 1; i < argc; i++) {
     if (strcmp(argv[i], "-koopa") == 0) {
       target = CODEGEN_TARGET_KOOPA;
@@ -27,115 +62,280 @@ void handle_cli_arguments(int argc, char *argv[], char **input_file,
       target = CODEGEN_TARGET_RISCV;
     } else if (strcmp(argv[i], "-perf") == 0) {
       target = CODEGEN_TARGET_PERF;
+    } else if (strcmp(argv[i], "-stream") == 0) {
+      options->stream = true;
+    } else if (strcmp(argv[i], "-lowmem") == 0) {
+      options->low_memory = true;
+    } else if (strcmp(argv[i], "-cache") == 0 && i + 1 < argc) {
+      options->cache_dir = argv[i + 1];
+      i++;
+    } else if (strcmp(argv[i], "-time-report") == 0) {
+      options->time_report = true;
+    } else if (strcmp(argv[i], "-time-report=json") == 0) {
+      options->time_report = true;
+      options->time_report_json = true;
+    } else if (strcmp(argv[i], "-stats") == 0) {
+      options->stats = true;
+    } else if (strcmp(argv[i], "-ir") == 0) {
+      native_ir = true;
+    } else if (strcmp(argv[i], "-verify-ir") == 0) {
+      native_ir = true;
+      verify_ir = true;
+    } else if (strcmp(argv[i], "-server") == 0 && i + 1 < argc) {
+      options->server = argv[i + 1];
+      i++;
     } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
-      *output_file = argv[i + 1];
+      options->output_file = argv[i + 1];
+      i++;
+    } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      options->jobs = atoi(argv[i + 1]);
+      if (options->jobs < 1) {
+        fprintf(stderr, "-j 的参数必须是正整数: %s\n", argv[i + 1]);
+        exit(1);
+      }
       i++;
     } else {
-      *input_file = argv[i];
+      options->input_files[options->input_count++] = argv[i];
     }
   }
 }
 
-static char *read_from_file(const char *filename) {
-  FILE *file = fopen(filename, "r");
-  if (file == NULL) {
-    fprintf(stderr, "无法打开文件 %s\n", filename);
+// 编译一个文件，所有状态都在 ctx 和各个 pass 的局部结构体中，可以在多个线程中同时调用
+// threads 是编译这个文件内部可以使用的线程数，index 是它在命令行输入文件中的位置
+// 设置了错误陷阱时，出错后删除不完整的输出文件，释放资源再跳回陷阱
+static void compile_file(const char *input_file, const char *output_file,
+                         int threads, int index) {
+  SourceFile source;
+  source_file_open(&source, input_file);
+  // AST 节点和标识符全部分配在 ctx 中，编译结束后一次性释放
+  CompileContext ctx;
+  compile_context_init(&ctx);
+  if (cache != NULL) {
+    compile_context_set_cache(&ctx, cache);
+  }
+  ctx.threads = threads;
+  ctx.native_ir = native_ir;
+  ctx.verify_ir = verify_ir;
+  ctx.input_file = input_file;
+  ctx.input_index = index;
+  Emitter output = {0};
+  jmp_buf trap;
+  jmp_buf *outer = set_error_trap(NULL);
+  if (outer != NULL) {
+    set_error_trap(&trap);
+    if (setjmp(trap) != 0) {
+      set_error_trap(outer);
+      compile_context_free(&ctx);
+      source_file_close(&source);
+      if (output.file != NULL) {
+        emitter_close(&output);
+        if (!is_stdio_filename(output_file)) {
+          remove(output_file);
+        }
+      }
+      compile_error_exit();
+    }
+  }
+  emitter_open(&output, output_file);
+  compile_source(&ctx, target, source.data, &output);
+  emitter_close(&output);
+  set_error_trap(outer);
+#ifdef DEBUG_LOG
+  if (target != CODEGEN_TARGET_KOOPA && !is_stdio_filename(output_file)) {
+    SourceFile riscv;
+    source_file_open(&riscv, output_file);
+    printf("=== RISC-V codegen result ===\n");
+    printf("%s\n", riscv.data);
+    source_file_close(&riscv);
+  }
+#endif
+  compile_context_free(&ctx);
+  source_file_close(&source);
+}
+
+// 流式编译一个文件，只支持 -koopa 和 -perf
+// pipelined 为 true 时三个阶段在不同线程中同时进行，否则在当前线程逐个定义处理
+static void compile_file_stream(const char *input_file,
+                                const char *output_file, bool pipelined) {
+  if (target != CODEGEN_TARGET_KOOPA && target != CODEGEN_TARGET_PERF) {
+    fprintf(stderr, "-stream 和 -lowmem 只支持 -koopa 和 -perf\n");
     exit(1);
   }
+  SourceFile source;
+  source_file_open(&source, input_file);
+  CompileContext ctx;
+  compile_context_init(&ctx);
+  if (cache != NULL) {
+    compile_context_set_cache(&ctx, cache);
+  }
+  ctx.input_file = input_file;
+  bool riscv = target == CODEGEN_TARGET_PERF;
+  if (pipelined) {
+    compile_stream(&ctx, source.data, output_file, riscv);
+  } else {
+    compile_function_at_a_time(&ctx, source.data, output_file, riscv);
+  }
+  compile_context_free(&ctx);
+  source_file_close(&source);
+}
 
-  fseek(file, 0, SEEK_END);
-  long length = ftell(file);
-  fseek(file, 0, SEEK_SET);
+// #region 批量编译
 
-  char *buffer = malloc(length + 1);
-  if (buffer == NULL) {
-    fprintf(stderr, "无法分配内存\n");
-    exit(1);
+typedef struct {
+  char **input_files;
+  char **output_files;
+  bool *failed; // 每个文件是否编译失败
+} Batch;
+
+// 一个文件出错只让这个文件失败，报告后继续编译其他文件
+static void compile_batch_task(void *arg, int worker, int index) {
+  (void)worker;
+  Batch *batch = arg;
+  jmp_buf trap;
+  int phase_depth = time_report_depth();
+  if (setjmp(trap) == 0) {
+    set_error_trap(&trap);
+    // 线程已经分给了不同的文件，单个文件内部不再并行
+    compile_file(batch->input_files[index], batch->output_files[index], 1,
+                 index);
+  } else {
+    time_report_unwind(phase_depth);
+    fprintf(stderr, "%s: 编译失败\n", batch->input_files[index]);
+    batch->failed[index] = true;
   }
+  set_error_trap(NULL);
+}
 
-  fread(buffer, 1, length, file);
-  buffer[length] = '\0';
+// 输出文件为 output_dir/<去掉目录和扩展名的输入文件名>.koopa 或 .S
+static char *batch_output_file(const char *output_dir, const char *input_file) {
+  const char *name = strrchr(input_file, '/');
+  name = name == NULL ? input_file : name + 1;
+  const char *dot = strrchr(name, '.');
+  int name_length = dot == NULL || dot == name ? (int)strlen(name)
+                                               : (int)(dot - name);
+  const char *extension = target == CODEGEN_TARGET_KOOPA ? "koopa" : "S";
+  size_t size = strlen(output_dir) + name_length + strlen(extension) + 3;
+  char *output_file = malloc(size);
+  if (output_file == NULL) {
+    fatalf("无法分配内存\n");
+  }
+  snprintf(output_file, size, "%s/%.*s.%s", output_dir, name_length, name,
+           extension);
+  return output_file;
+}
 
-  fclose(file);
-  return buffer;
+// 多个输入文件分给 jobs 个线程编译，每个文件有独立的 CompileContext
+// 返回是否所有文件都编译成功
+static bool compile_batch(Options *options) {
+  Batch batch;
+  batch.input_files = options->input_files;
+  batch.output_files = malloc(sizeof(char *) * options->input_count);
+  batch.failed = calloc(options->input_count, sizeof(bool));
+  if (batch.output_files == NULL || batch.failed == NULL) {
+    fatalf("无法分配内存\n");
+  }
+  for (int i = 0; i < options->input_count; i++) {
+    if (is_stdio_filename(options->input_files[i])) {
+      fprintf(stderr, "批量编译时不能从标准输入读取\n");
+      exit(1);
+    }
+    batch.output_files[i] =
+        batch_output_file(options->output_file, options->input_files[i]);
+  }
+  thread_pool_run(options->jobs, options->input_count, compile_batch_task,
+                  &batch);
+  bool ok = true;
+  for (int i = 0; i < options->input_count; i++) {
+    ok = ok && !batch.failed[i];
+    free(batch.output_files[i]);
+  }
+  free(batch.output_files);
+  free(batch.failed);
+  return ok;
 }
 
+// #endregion
+
 int main(int argc, char *argv[]) {
   // if program crashes, buffer will not be flushed. So disable buffering.
   setvbuf(stdout, NULL, _IONBF, 0);
   setvbuf(stderr, NULL, _IONBF, 0);
 
-  char *input_file = NULL;
-  char *output_file = NULL;
-
-  handle_cli_arguments(argc, argv, &input_file, &output_file);
+  Options options;
+  handle_cli_arguments(argc, argv, &options);
 
-  if (input_file == NULL || output_file == NULL) {
+  if (options.server == NULL &&
+      (options.input_count == 0 || options.output_file == NULL)) {
     printf("Usage: %s -koopa <input_file> -o <output_file>\n", argv[0]);
+    printf("       %s -koopa [-j N] <input_file>... -o <output_dir>\n",
+           argv[0]);
+    printf("       %s -koopa|-perf -stream|-lowmem <input_file> -o "
+           "<output_file>\n",
+           argv[0]);
+    printf("       input_file 或 output_file 为 - 时使用标准输入或标准输出\n");
+    printf("       -cache <dir> 按函数缓存 IR 和 -perf 的汇编，结束时输出命中情况\n");
+    printf("       %s [-cache <dir>] -server <socket>|- 作为编译服务运行，"
+           "协议见 server.h\n",
+           argv[0]);
+    printf("       -time-report[=json] 结束时在标准错误输出每个阶段的耗时、"
+           "堆内存增长和峰值 RSS\n");
+    printf("       -stats 结束时在标准错误输出 -perf 生成的每个函数的指令分类、"
+           "溢出和栈帧大小\n");
+    printf("       -ir 从 AST 生成内存中的 SSA IR ，运行 pass 后直接交给后端，"
+           "不经过 Koopa IR 文本\n");
+    printf("       -verify-ir 同 -ir ，并且每个 pass 之后验证 IR\n");
     exit(1);
   }
 
-  const char *input = read_from_file(input_file);
-#ifdef DEBUG_LOG
-  printf("=== Input ===\n");
-  printf("%s\n", input);
-#endif
-  AstCompUnit *comp_unit = parse(input);
-  switch (target) {
-  case CODEGEN_TARGET_RISCV: {
-    koopa_ir_codegen(comp_unit, output_file);
-    const char *ir = read_from_file(output_file);
-#ifdef DEBUG_LOG
-    printf("=== Koopa IR codegen result ===\n");
-    printf("%s\n", ir);
-#endif
-    riscv_codegen(ir, output_file);
-    free((void *)ir);
-#ifdef DEBUG_LOG
-    const char *riscv = read_from_file(output_file);
-    printf("=== RISC-V codegen result ===\n");
-    printf("%s\n", riscv);
-    free((void *)riscv);
-#endif
-    break;
+  if (options.input_count > 1 && (options.stream || options.low_memory)) {
+    fprintf(stderr, "-stream 和 -lowmem 只支持一个输入文件\n");
+    exit(1);
   }
-  case CODEGEN_TARGET_PERF: {
-    koopa_ir_codegen(comp_unit, output_file);
-    const char *ir = read_from_file(output_file);
-#ifdef DEBUG_LOG
-    printf("=== Koopa IR codegen result ===\n");
-    printf("%s\n", ir);
-#endif
-    riscv_perf_codegen(ir, output_file);
-    free((void *)ir);
-#ifdef DEBUG_LOG
-    const char *riscv = read_from_file(output_file);
-    printf("=== RISC-V perf codegen result ===\n");
-    printf("%s\n", riscv);
-    free((void *)riscv);
-#endif
-    break;
+  if (native_ir &&
+      (options.stream || options.low_memory || options.server != NULL)) {
+    fprintf(stderr, "-ir 不支持 -stream 、-lowmem 和 -server\n");
+    exit(1);
   }
-  case CODEGEN_TARGET_KOOPA: {
-#ifdef DEBUG_LOG
-    printf("=== AST dump ===\n");
-    comp_unit->base.dump((AstBase *)comp_unit, 0);
-#endif
-    koopa_ir_codegen(comp_unit, output_file);
-#ifdef DEBUG_LOG
-    const char *ir = read_from_file(output_file);
-    printf("=== Koopa IR codegen result ===\n");
-    printf("%s\n", ir);
-    free((void *)ir);
-#endif
-    break;
+  if (options.time_report) {
+    time_report_enable();
   }
-  default: {
-    fprintf(stderr, "未指定目标\n");
-    exit(1);
-    break;
+  if (options.stats) {
+    if (target != CODEGEN_TARGET_PERF) {
+      fprintf(stderr, "-stats 只支持 -perf\n");
+      exit(1);
+    }
+    riscv_stats_enable();
+  }
+  bool ok = true;
+  Cache shared_cache;
+  if (options.cache_dir != NULL) {
+    cache_init(&shared_cache, options.cache_dir);
+    cache = &shared_cache;
+  }
+  if (options.server != NULL) {
+    serve(options.server, cache);
+  } else if (options.input_count == 1 &&
+             (options.stream || options.low_memory)) {
+    compile_file_stream(options.input_files[0], options.output_file,
+                        options.stream);
+  } else if (options.input_count == 1) {
+    compile_file(options.input_files[0], options.output_file, options.jobs,
+                 0);
+  } else {
+    ok = compile_batch(&options);
   }
+  if (cache != NULL) {
+    cache_report(cache, stderr);
+    cache_free(cache);
+    cache = NULL;
   }
+  if (options.stats) {
+    riscv_stats_print(stderr);
+  }
+  if (options.time_report) {
+    time_report_print(stderr, options.time_report_json);
+  }
+  free(options.input_files);
   fflush(stdout);
-  return 0;
-}
\ No newline at end of file
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,467 @@
+#include <stdlib.h>
+
+#include "ir.h"
+#include "pass.h"
+
+/*
+ * mem2reg：把只通过 load/store 访问的标量局部变量提升成 SSA 值
+ *
+ * ir_gen 给每个局部变量、函数参数和 && || 的结果都生成一个 alloc ，
+ * 读写都经过内存。地址只作为 load 的来源和 store 的目标使用（没有逃逸）的
+ * i32 和指针变量可以直接用值代替：
+ *  1. 在 store 所在块的迭代支配边界上加块参数，相当于放置 phi 。
+ *     只处理在某个块中先读后写、跨块活跃的变量（semi-pruned SSA），
+ *     只在一个块里使用的临时变量不需要参数
+ *  2. 先序遍历支配树，每个变量维护一个值栈：
+ *     load 替换成栈顶的值，store 把值压栈，
+ *     跳转时把栈顶的值作为后继块新参数的实参
+ *  3. 删除没有用到的块参数，包括只在循环中互相传递、最终没有使用的
+ * 在 store 之前读取的变量没有初始化，用 0 代替。
+ */
+
+typedef struct {
+  IrBlock **items;
+  int count;
+  int capacity;
+} BlockList;
+
+typedef struct {
+  IrValue *alloc;
+  IrType *type;
+  bool live_across; // 在某个块中先读后写，需要块参数
+  BlockList defs;   // 有 store 的块，每个块只出现一次
+  // 重命名时的值栈
+  IrValue **values;
+  int value_count;
+  int value_capacity;
+} Variable;
+
+static void block_list_push(BlockList *list, IrBlock *block) {
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity == 0 ? 4 : list->capacity * 2;
+    list->items = realloc(list->items, sizeof(IrBlock *) * list->capacity);
+  }
+  list->items[list->count++] = block;
+}
+
+static void variable_push(Variable *var, IrValue *value) {
+  if (var->value_count == var->value_capacity) {
+    var->value_capacity =
+        var->value_capacity == 0 ? 4 : var->value_capacity * 2;
+    var->values =
+        realloc(var->values, sizeof(IrValue *) * var->value_capacity);
+  }
+  var->values[var->value_count++] = value;
+}
+
+// 变量当前的值，还没有 store 过时是 0
+static IrValue *variable_top(IrModule *module, const Variable *var) {
+  if (var->value_count > 0) {
+    return var->values[var->value_count - 1];
+  }
+  if (var->type->tag == IR_TYPE_I32) {
+    return ir_integer(module, 0);
+  }
+  return ir_undef(module, var->type);
+}
+
+// 地址只作为 load 的来源和 store 的目标使用
+static bool is_promotable(const IrValue *alloc) {
+  IrTypeTag tag = alloc->type->base->tag;
+  if (tag != IR_TYPE_I32 && tag != IR_TYPE_POINTER) {
+    return false;
+  }
+  for (IrUse *use = alloc->uses; use != NULL; use = use->next) {
+    IrValue *user = use->user;
+    if (user->kind != IR_LOAD &&
+        (user->kind != IR_STORE || use != &user->operands[1])) {
+      return false;
+    }
+    // 不可达的块不会被重命名，那里的访问无法替换
+    if (user->block->rpo < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// load 和 store 访问的变量编号，不是提升的变量时返回 -1
+static int accessed_variable(const IrValue *inst) {
+  const IrValue *ptr;
+  if (inst->kind == IR_LOAD) {
+    ptr = inst->operands[0].value;
+  } else if (inst->kind == IR_STORE) {
+    ptr = inst->operands[1].value;
+  } else {
+    return -1;
+  }
+  return ptr->kind == IR_ALLOC ? ptr->id : -1;
+}
+
+// #region 支配边界
+
+/*
+ * Cooper, Harvey, Kennedy 中的算法：
+ * 有多个前驱的块 b ，从每个前驱沿支配树向上走到 b 的直接支配者为止，
+ * 经过的块的支配边界都包含 b
+ */
+static BlockList *compute_frontiers(IrFunction *func) {
+  BlockList *frontiers = calloc(func->rpo_count + 1, sizeof(BlockList));
+  for (int i = 0; i < func->rpo_count; i++) {
+    IrBlock *block = func->rpo_blocks[i];
+    if (block->pred_count < 2) {
+      continue;
+    }
+    for (int j = 0; j < block->pred_count; j++) {
+      IrBlock *runner = block->preds[j];
+      if (runner->rpo < 0) {
+        continue;
+      }
+      while (runner != block->idom) {
+        BlockList *frontier = &frontiers[runner->rpo];
+        // 同一个块的边界在处理 b 时连续加入，只需要和最后一个比较
+        if (frontier->count == 0 ||
+            frontier->items[frontier->count - 1] != block) {
+          block_list_push(frontier, block);
+        }
+        runner = runner->idom;
+      }
+    }
+  }
+  return frontiers;
+}
+
+// #endregion
+
+// 在迭代支配边界上给变量加块参数，参数的 id 是变量的编号
+static void place_params(IrFunction *func, Variable *vars, int var_count,
+                         const BlockList *frontiers) {
+  int *has_param = malloc(sizeof(int) * (func->rpo_count + 1));
+  int *queued = malloc(sizeof(int) * (func->rpo_count + 1));
+  for (int i = 0; i < func->rpo_count; i++) {
+    has_param[i] = -1;
+    queued[i] = -1;
+  }
+  BlockList worklist = {NULL, 0, 0};
+  for (int v = 0; v < var_count; v++) {
+    Variable *var = &vars[v];
+    if (!var->live_across) {
+      continue;
+    }
+    worklist.count = 0;
+    for (int i = 0; i < var->defs.count; i++) {
+      queued[var->defs.items[i]->rpo] = v;
+      block_list_push(&worklist, var->defs.items[i]);
+    }
+    while (worklist.count > 0) {
+      IrBlock *block = worklist.items[--worklist.count];
+      const BlockList *frontier = &frontiers[block->rpo];
+      for (int i = 0; i < frontier->count; i++) {
+        IrBlock *join = frontier->items[i];
+        if (has_param[join->rpo] == v) {
+          continue;
+        }
+        has_param[join->rpo] = v;
+        IrValue *param = ir_block_add_param(join, var->type, NULL);
+        param->id = v;
+        if (queued[join->rpo] != v) {
+          queued[join->rpo] = v;
+          block_list_push(&worklist, join);
+        }
+      }
+    }
+  }
+  free(worklist.items);
+  free(queued);
+  free(has_param);
+}
+
+// #region 重命名
+
+typedef struct {
+  IrModule *module;
+  Variable *vars;
+  const int *first_params; // 每个块（按逆后序编号）加参数之前的参数个数
+  // 压栈的变量编号，离开一个块时弹出它压入的值
+  int *log;
+  int log_count;
+  int log_capacity;
+  IrValue **args; // 一条边上的实参
+} Renamer;
+
+typedef struct {
+  IrBlock *block;
+  int next_child;
+  int log_mark; // 进入这个块时 log 的长度
+} RenameFrame;
+
+static void renamer_push(Renamer *renamer, int v, IrValue *value) {
+  variable_push(&renamer->vars[v], value);
+  if (renamer->log_count == renamer->log_capacity) {
+    renamer->log_capacity *= 2;
+    renamer->log =
+        realloc(renamer->log, sizeof(int) * renamer->log_capacity);
+  }
+  renamer->log[renamer->log_count++] = v;
+}
+
+// 把 block 中的 load store 换成值，给跳转到后继块的边加上实参
+static void rename_block(Renamer *renamer, IrBlock *block) {
+  Variable *vars = renamer->vars;
+  const int *first_params = renamer->first_params;
+  for (int i = first_params[block->rpo]; i < block->param_count; i++) {
+    IrValue *param = block->params[i];
+    renamer_push(renamer, param->id, param);
+  }
+  IrValue *inst = block->first;
+  while (inst != NULL) {
+    IrValue *next = inst->next;
+    int v = accessed_variable(inst);
+    if (v >= 0 && inst->kind == IR_LOAD) {
+      ir_replace_all_uses(inst, variable_top(renamer->module, &vars[v]));
+      ir_inst_remove(inst);
+    } else if (v >= 0) {
+      renamer_push(renamer, v, inst->operands[0].value);
+      ir_inst_remove(inst);
+    }
+    inst = next;
+  }
+  IrValue *terminator = ir_block_terminator(block);
+  IrBlock *succs[2];
+  int succ_count = ir_successors(terminator, succs);
+  if (succ_count == 2 && succs[0] == succs[1]) {
+    // ir_add_branch_args 会同时给两条边加上实参
+    succ_count = 1;
+  }
+  for (int i = 0; i < succ_count; i++) {
+    IrBlock *succ = succs[i];
+    int count = 0;
+    for (int j = first_params[succ->rpo]; j < succ->param_count; j++) {
+      IrValue *param = succ->params[j];
+      renamer->args[count++] =
+          variable_top(renamer->module, &vars[param->id]);
+    }
+    if (count > 0) {
+      ir_add_branch_args(terminator, succ, renamer->args, count);
+    }
+  }
+}
+
+static void rename_variables(IrFunction *func, Variable *vars,
+                             const int *first_params) {
+  int max_params = 0;
+  for (int i = 0; i < func->rpo_count; i++) {
+    IrBlock *block = func->rpo_blocks[i];
+    int count = block->param_count - first_params[i];
+    if (count > max_params) {
+      max_params = count;
+    }
+  }
+  Renamer renamer = {func->module, vars, first_params,
+                     malloc(sizeof(int) * 64), 0, 64,
+                     malloc(sizeof(IrValue *) * (max_params + 1))};
+  RenameFrame *stack = malloc(sizeof(RenameFrame) * (func->rpo_count + 1));
+  int depth = 0;
+  stack[depth++] = (RenameFrame){func->first, 0, 0};
+  rename_block(&renamer, func->first);
+  while (depth > 0) {
+    RenameFrame *frame = &stack[depth - 1];
+    if (frame->next_child < frame->block->dom_child_count) {
+      IrBlock *child = frame->block->dom_children[frame->next_child++];
+      stack[depth++] = (RenameFrame){child, 0, renamer.log_count};
+      rename_block(&renamer, child);
+      continue;
+    }
+    while (renamer.log_count > frame->log_mark) {
+      vars[renamer.log[--renamer.log_count]].value_count--;
+    }
+    depth--;
+  }
+  free(stack);
+  free(renamer.log);
+  free(renamer.args);
+}
+
+// #endregion
+
+// #region 删除没有用到的块参数
+
+// 这次加上的块参数
+static bool is_new_param(const IrValue *value, const int *first_params) {
+  return value->kind == IR_BLOCK_ARG &&
+         value->data.index >= first_params[value->block->rpo];
+}
+
+// use 是跳转的实参时返回它对应的块参数，否则返回 NULL
+static IrValue *argument_param(const IrUse *use) {
+  IrValue *user = use->user;
+  int index = (int)(use - user->operands);
+  if (user->kind == IR_JUMP) {
+    return user->data.target->params[index];
+  }
+  if (user->kind != IR_BRANCH || index == 0) {
+    return NULL;
+  }
+  int true_count = user->data.branch.true_arg_count;
+  if (index <= true_count) {
+    return user->data.branch.true_block->params[index - 1];
+  }
+  return user->data.branch.false_block->params[index - 1 - true_count];
+}
+
+/*
+ * 参数只作为新参数的实参使用时可能是死的，比如循环中没有读过的变量
+ * 从有其他使用的参数开始，沿实参反向标记活跃的参数，剩下的全部删除
+ */
+static void remove_dead_params(IrFunction *func, const int *first_params) {
+  int param_count = 0;
+  for (int i = 0; i < func->rpo_count; i++) {
+    IrBlock *block = func->rpo_blocks[i];
+    for (int j = first_params[i]; j < block->param_count; j++) {
+      block->params[j]->id = param_count++;
+    }
+  }
+  if (param_count == 0) {
+    return;
+  }
+  bool *live = calloc(param_count, sizeof(bool));
+  IrValue **worklist = malloc(sizeof(IrValue *) * param_count);
+  int count = 0;
+  for (int i = 0; i < func->rpo_count; i++) {
+    IrBlock *block = func->rpo_blocks[i];
+    for (int j = first_params[i]; j < block->param_count; j++) {
+      IrValue *param = block->params[j];
+      for (IrUse *use = param->uses; use != NULL; use = use->next) {
+        IrValue *target = argument_param(use);
+        if (target == NULL || !is_new_param(target, first_params)) {
+          live[param->id] = true;
+          worklist[count++] = param;
+          break;
+        }
+      }
+    }
+  }
+  while (count > 0) {
+    IrValue *param = worklist[--count];
+    IrBlock *block = param->block;
+    for (int i = 0; i < block->pred_count; i++) {
+      IrValue *terminator = ir_block_terminator(block->preds[i]);
+      for (int j = 0; j < terminator->operand_count; j++) {
+        IrValue *arg = terminator->operands[j].value;
+        if (argument_param(&terminator->operands[j]) != param ||
+            !is_new_param(arg, first_params) || live[arg->id]) {
+          continue;
+        }
+        live[arg->id] = true;
+        worklist[count++] = arg;
+      }
+    }
+  }
+
+  // 先删除所有实参，死参数之间的使用也随之消失，然后才能删除参数
+  bool **removed = calloc(func->rpo_count + 1, sizeof(bool *));
+  for (int i = 0; i < func->rpo_count; i++) {
+    IrBlock *block = func->rpo_blocks[i];
+    for (int j = first_params[i]; j < block->param_count; j++) {
+      if (live[block->params[j]->id]) {
+        continue;
+      }
+      if (removed[i] == NULL) {
+        removed[i] = calloc(block->param_count, sizeof(bool));
+      }
+      removed[i][j] = true;
+    }
+    if (removed[i] == NULL) {
+      continue;
+    }
+    for (int j = 0; j < block->pred_count; j++) {
+      ir_remove_branch_args(ir_block_terminator(block->preds[j]), block,
+                            removed[i]);
+    }
+  }
+  for (int i = 0; i < func->rpo_count; i++) {
+    if (removed[i] != NULL) {
+      ir_block_remove_params(func->rpo_blocks[i], removed[i]);
+      free(removed[i]);
+    }
+  }
+  free(removed);
+  free(worklist);
+  free(live);
+}
+
+// #endregion
+
+bool ir_promote_memory_to_registers(IrFunction *func) {
+  int var_count = 0;
+  int var_capacity = 0;
+  Variable *vars = NULL;
+  for (IrBlock *block = func->first; block != NULL; block = block->next) {
+    for (IrValue *inst = block->first; inst != NULL; inst = inst->next) {
+      if (inst->kind != IR_ALLOC) {
+        continue;
+      }
+      inst->id = -1;
+      if (!is_promotable(inst)) {
+        continue;
+      }
+      if (var_count == var_capacity) {
+        var_capacity = var_capacity == 0 ? 16 : var_capacity * 2;
+        vars = realloc(vars, sizeof(Variable) * var_capacity);
+      }
+      inst->id = var_count;
+      vars[var_count++] = (Variable){inst, inst->type->base};
+    }
+  }
+  if (var_count == 0) {
+    return false;
+  }
+
+  // 记录每个变量的定义块，以及它是否在某个块中先读后写
+  int *killed = malloc(sizeof(int) * var_count);
+  for (int v = 0; v < var_count; v++) {
+    killed[v] = -1;
+  }
+  int *first_params = malloc(sizeof(int) * (func->rpo_count + 1));
+  for (int i = 0; i < func->rpo_count; i++) {
+    IrBlock *block = func->rpo_blocks[i];
+    first_params[i] = block->param_count;
+    for (IrValue *inst = block->first; inst != NULL; inst = inst->next) {
+      int v = accessed_variable(inst);
+      if (v < 0) {
+        continue;
+      }
+      Variable *var = &vars[v];
+      if (inst->kind == IR_LOAD) {
+        if (killed[v] != i) {
+          var->live_across = true;
+        }
+        continue;
+      }
+      killed[v] = i;
+      if (var->defs.count == 0 ||
+          var->defs.items[var->defs.count - 1] != block) {
+        block_list_push(&var->defs, block);
+      }
+    }
+  }
+  free(killed);
+
+  BlockList *frontiers = compute_frontiers(func);
+  place_params(func, vars, var_count, frontiers);
+  rename_variables(func, vars, first_params);
+  remove_dead_params(func, first_params);
+
+  for (int v = 0; v < var_count; v++) {
+    ir_inst_remove(vars[v].alloc);
+    free(vars[v].defs.items);
+    free(vars[v].values);
+  }
+  for (int i = 0; i < func->rpo_count; i++) {
+    free(frontiers[i].items);
+  }
+  free(frontiers);
+  free(first_params);
+  free(vars);
+  return true;
+}
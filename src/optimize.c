@@ -0,0 +1,485 @@
+#include "optimize.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "symbol.h"
+#include "utils.h"
+
+static int eval_const_exp(SymbolTable *table, Arena *arena, AstExp *exp);
+static AstExp *optimize_exp(SymbolTable *table, Arena *arena, AstExp *exp);
+static void optimize_block(SymbolTable *table, Arena *arena, AstBlock *block);
+static void optimize_stmt(SymbolTable *table, Arena *arena, AstStmt *stmt);
+
+static bool is_const_exp(SymbolTable *table, Arena *arena, AstExp *exp) {
+  switch (exp->type) {
+  case AST_NUMBER:
+    return true;
+  case AST_IDENTIFIER: {
+    AstIdentifier *ident = (AstIdentifier *)exp;
+    Symbol *symbol = find_symbol(table, ident->name);
+    return symbol != NULL && symbol->is_const_value;
+  }
+  case AST_UNARY_EXP: {
+    AstUnaryExp *unary_exp = (AstUnaryExp *)exp;
+    return is_const_exp(table, arena, unary_exp->operand);
+  }
+  case AST_BINARY_EXP: {
+    AstBinaryExp *binary_exp = (AstBinaryExp *)exp;
+    return is_const_exp(table, arena, binary_exp->lhs) &&
+           is_const_exp(table, arena, binary_exp->rhs);
+  }
+  default:
+    return false;
+  }
+  return false;
+}
+
+static int eval_array_value(SymbolTable *table, Arena *arena,
+                            AstArrayValue *array_value) {
+  AstExp **elements = array_value->elements;
+  for (int i = 0; i < array_value->count; i++) {
+    if (elements[i]->type == AST_ARRAY_VALUE) {
+      eval_const_exp(table, arena, elements[i]);
+    } else if (elements[i]->type == AST_NUMBER) {
+    } else {
+      int val = eval_const_exp(table, arena, elements[i]);
+      AstNumber *number = new_ast_number(arena);
+      number->number = val;
+      elements[i] = (AstExp *)number;
+    }
+  }
+  return -1;
+}
+
+static int eval_array_init(SymbolTable *table, Arena *arena,
+                           AstArrayInit *init) {
+  for (int i = 0; i < init->count; i++) {
+    AstExp *value = init->entries[i].value;
+    if (value->type != AST_NUMBER) {
+      AstNumber *number = new_ast_number(arena);
+      number->number = eval_const_exp(table, arena, value);
+      init->entries[i].value = (AstExp *)number;
+    }
+  }
+  return -1;
+}
+
+static int eval_const_exp(SymbolTable *table, Arena *arena, AstExp *exp) {
+  switch (exp->type) {
+  case AST_NUMBER:
+    return ((AstNumber *)exp)->number;
+  case AST_ARRAY_VALUE:
+    return eval_array_value(table, arena, (AstArrayValue *)exp);
+  case AST_ARRAY_INIT:
+    return eval_array_init(table, arena, (AstArrayInit *)exp);
+  case AST_IDENTIFIER: {
+    AstIdentifier *ident = (AstIdentifier *)exp;
+    return eval_symbol(table, ident->name);
+  }
+  case AST_UNARY_EXP: {
+    AstUnaryExp *unary_exp = (AstUnaryExp *)exp;
+    int operand = eval_const_exp(table, arena, unary_exp->operand);
+    switch (unary_exp->op) {
+    case '-':
+      return -operand;
+    case '!':
+      return !operand;
+    case '+':
+      return operand;
+    default:
+      fprintf(stderr, "未知的一元运算符 %c\n", unary_exp->op);
+      compile_error_exit();
+    }
+  }
+  case AST_BINARY_EXP: {
+    AstBinaryExp *binary_exp = (AstBinaryExp *)exp;
+    int lhs = eval_const_exp(table, arena, binary_exp->lhs);
+    int rhs = eval_const_exp(table, arena, binary_exp->rhs);
+    switch (binary_exp->op) {
+    case BinaryOpType_ADD:
+      return lhs + rhs;
+    case BinaryOpType_SUB:
+      return lhs - rhs;
+    case BinaryOpType_MUL:
+      return lhs * rhs;
+    case BinaryOpType_DIV:
+      return lhs / rhs;
+    case BinaryOpType_MOD:
+      return lhs % rhs;
+    case BinaryOpType_EQ:
+      return lhs == rhs;
+    case BinaryOpType_NE:
+      return lhs != rhs;
+    case BinaryOpType_LT:
+      return lhs < rhs;
+    case BinaryOpType_LE:
+      return lhs <= rhs;
+    case BinaryOpType_GT:
+      return lhs > rhs;
+    case BinaryOpType_GE:
+      return lhs >= rhs;
+    case BinaryOpType_AND:
+      return lhs && rhs;
+    case BinaryOpType_OR:
+      return lhs || rhs;
+    default:
+      fprintf(stderr, "未知的二元运算符\n");
+      compile_error_exit();
+    }
+  }
+  default:
+    fprintf(stderr, "非常量表达式\n");
+    compile_error_exit();
+  }
+}
+
+static AstExp *optimize_unary_exp(SymbolTable *table, Arena *arena,
+                                  AstUnaryExp *unary_exp) {
+  unary_exp->operand = optimize_exp(table, arena, unary_exp->operand);
+  if (is_const_exp(table, arena, unary_exp->operand)) {
+    int operand = eval_const_exp(table, arena, (AstExp *)unary_exp);
+    AstNumber *number = new_ast_number(arena);
+    number->number = operand;
+    return (AstExp *)number;
+  }
+  if (unary_exp->op == '+') {
+    return unary_exp->operand;
+  }
+  return (AstExp *)unary_exp;
+}
+
+static AstExp *optimize_binary_exp(SymbolTable *table, Arena *arena,
+                                   AstBinaryExp *binary_exp) {
+  binary_exp->lhs = optimize_exp(table, arena, binary_exp->lhs);
+  binary_exp->rhs = optimize_exp(table, arena, binary_exp->rhs);
+  if (is_const_exp(table, arena, (AstExp *)binary_exp)) {
+    AstNumber *number = new_ast_number(arena);
+    number->number = eval_const_exp(table, arena, (AstExp *)binary_exp);
+    return (AstExp *)number;
+  }
+  return (AstExp *)binary_exp;
+}
+
+static AstExp *optimize_exp(SymbolTable *table, Arena *arena, AstExp *exp) {
+  switch (exp->type) {
+  case AST_ARRAY_VALUE: {
+    AstArrayValue *array_value = (AstArrayValue *)exp;
+    for (int i = 0; i < array_value->count; i++) {
+      array_value->elements[i] = optimize_exp(table, arena,
+                                              array_value->elements[i]);
+    }
+    return exp;
+  }
+  case AST_ARRAY_ACCESS: {
+    AstArrayAccess *array_access = (AstArrayAccess *)exp;
+    for (int i = 0; i < array_access->indexes.count; i++) {
+      array_access->indexes.elements[i] =
+          optimize_exp(table, arena, array_access->indexes.elements[i]);
+    }
+    return exp;
+  }
+  case AST_FUNC_CALL: {
+    AstFuncCall *func_call = (AstFuncCall *)exp;
+    for (int i = 0; i < func_call->count; i++) {
+      func_call->args[i] = optimize_exp(table, arena, func_call->args[i]);
+    }
+    return exp;
+  }
+  case AST_UNARY_EXP: {
+    return optimize_unary_exp(table, arena, (AstUnaryExp *)exp);
+  }
+  case AST_BINARY_EXP: {
+    return optimize_binary_exp(table, arena, (AstBinaryExp *)exp);
+  }
+  case AST_IDENTIFIER: {
+    if (is_const_exp(table, arena, exp)) {
+      int value = eval_const_exp(table, arena, exp);
+      AstNumber *number = new_ast_number(arena);
+      number->number = value;
+      return (AstExp *)number;
+    }
+    return exp;
+  }
+  case AST_NUMBER: {
+    return exp;
+  }
+  default:
+    fatalf("未知的表达式类型 %s\n", ast_type_to_string(exp->type));
+    return NULL;
+  }
+}
+
+// 常量 0 不需要记录
+static bool is_zero_number(AstExp *exp) {
+  return exp->type == AST_NUMBER && ((AstNumber *)exp)->number == 0;
+}
+
+/**
+ * 将多维数组展开为一维数组
+ * @param dimensions 数组的维度
+ * @param count 维度的数量
+ * @param val 数组的值
+ * @param coordinates 当前的坐标
+ * @param current 当前的维度
+ * @param result 展开的结果，只加入不是 0 的元素
+
+*/
+static void do_flatten(SymbolTable *table, Arena *arena, int dimensions[],
+                       int dimension_count, AstArrayValue *val,
+                       int coordinates[], int current, AstArrayInit *result) {
+  assert(current > 0);
+  for (int i = 0; i < val->count; i++) {
+    if (val->elements[i]->type == AST_ARRAY_VALUE) {
+      assert(coordinates[dimension_count - 1] == 0);
+      int origin = coordinates[dimension_count - current];
+      do_flatten(table, arena, dimensions, dimension_count,
+                 (AstArrayValue *)val->elements[i], coordinates, current - 1,
+                 result);
+      // 碰到数组，对应维度进一，低维度需要全部置为 0
+      // 这里不直接加 1 的原因：
+      //    如果数组里面是全满的，就会发生进位，直接加 1 有问题；
+      //    所以使用原始值加 1
+      coordinates[dimension_count - current] = origin + 1;
+      for (int i = dimension_count - current + 1; i < dimension_count; i++) {
+        coordinates[i] = 0;
+      }
+    } else {
+      // 碰到非数组，维度降到最低，开始填充
+      current = 1;
+
+      int index = 0;
+      for (int i = 0; i < dimension_count; i++) {
+        int n = coordinates[i];
+        for (int j = i + 1; j < dimension_count; j++) {
+          n *= dimensions[j];
+        }
+        index += n;
+      }
+      if (index >= result->total_count) {
+        fatalf("数组的初始值超出了数组的大小\n");
+      }
+      if (!is_zero_number(val->elements[i])) {
+        ast_array_init_add(arena, result, index, val->elements[i]);
+      }
+      coordinates[dimension_count - 1]++;
+
+      // 坐标进位，同时更新下一个括号的维度
+      for (int i = dimension_count - 1; i > 0; i--) {
+        if (coordinates[i] == dimensions[i]) {
+          coordinates[i] = 0;
+          coordinates[i - 1]++;
+          current = dimension_count - i + 1;
+        } else {
+          break;
+        }
+      }
+      assert(coordinates[0] <= dimensions[0]); // 进位不能超过最高的维度
+    }
+  }
+}
+
+// 比如声明是 int a[1][2][3] ，dimensions 就是 [1, 2, 3]
+// 结果只包含不是 0 的元素，大小和数组的元素总数无关
+static AstExp *flatten_multi_dimension_array(SymbolTable *table, Arena *arena,
+                                             int dimensions[],
+                                             int dimension_count, AstExp *val) {
+  assert(val->type == AST_ARRAY_VALUE);
+  int total_count = 1;
+  for (int i = 0; i < dimension_count; i++) {
+    total_count *= dimensions[i];
+  }
+  AstArrayInit *result = new_ast_array_init(arena, total_count);
+  int coordinates[dimension_count];
+  memset(coordinates, 0, sizeof(coordinates));
+  do_flatten(table, arena, dimensions, dimension_count, (AstArrayValue *)val,
+             coordinates, dimension_count, result);
+  return (AstExp *)result;
+}
+
+void optimize_const_decl(SymbolTable *table, Arena *arena, AstConstDecl *decl) {
+  for (int i = 0; i < decl->defs.count; i++) {
+    AstVarDef *def = decl->defs.elements[i];
+    assert(def->val != NULL);
+    SymbolType symbol_type = SymbolType_int;
+    if (def->dimensions.count > 0) {
+      int dimensions[def->dimensions.count];
+      for (int i = 0; i < def->dimensions.count; i++) {
+        int n = eval_const_exp(table, arena, def->dimensions.elements[i]);
+        assert(n > 0);
+        dimensions[i] = n;
+        AstNumber *number = new_ast_number(arena);
+        number->number = n;
+        def->dimensions.elements[i] = (AstExp *)number;
+      }
+      symbol_type = SymbolType_array;
+      // 先算出所有元素的值，展开时才能去掉值为 0 的元素
+      eval_const_exp(table, arena, def->val);
+      def->val = flatten_multi_dimension_array(table, arena, dimensions,
+                                               def->dimensions.count, def->val);
+    }
+    int value = eval_const_exp(table, arena, def->val);
+    Symbol *symbol = new_symbol(table, def->name, symbol_type);
+    symbol->is_const_value = true;
+    symbol->value = value;
+  }
+}
+
+static void optimize_var_decl(SymbolTable *table, Arena *arena,
+                              AstVarDecl *decl) {
+  for (int i = 0; i < decl->defs.count; i++) {
+    AstVarDef *def = decl->defs.elements[i];
+    if (def->dimensions.count > 0) {
+      int dimensions[def->dimensions.count];
+      for (int i = 0; i < def->dimensions.count; i++) {
+        int n = eval_const_exp(table, arena, def->dimensions.elements[i]);
+        assert(n > 0);
+        AstNumber *number = new_ast_number(arena);
+        number->number = n;
+        def->dimensions.elements[i] = (AstExp *)number;
+        dimensions[i] = n;
+      }
+      if (def->val) {
+        optimize_exp(table, arena, def->val);
+        def->val = flatten_multi_dimension_array(table, arena, dimensions,
+                                                 def->dimensions.count,
+                                                 def->val);
+      }
+    } else {
+      if (def->val) {
+        def->val = optimize_exp(table, arena, def->val);
+      }
+    }
+  }
+}
+
+void optimize_global_var_decl(SymbolTable *table, Arena *arena,
+                              AstVarDecl *decl) {
+  for (int i = 0; i < decl->defs.count; i++) {
+    AstVarDef *def = decl->defs.elements[i];
+    if (def->dimensions.count > 0) {
+      int dimensions[def->dimensions.count];
+      for (int i = 0; i < def->dimensions.count; i++) {
+        int n = eval_const_exp(table, arena, def->dimensions.elements[i]);
+        assert(n > 0);
+        AstNumber *number = new_ast_number(arena);
+        number->number = n;
+        def->dimensions.elements[i] = (AstExp *)number;
+        dimensions[i] = n;
+      }
+      if (def->val) {
+        assert(def->val->type == AST_ARRAY_VALUE);
+        eval_const_exp(table, arena, def->val);
+        def->val = flatten_multi_dimension_array(table, arena, dimensions,
+                                                 def->dimensions.count,
+                                                 def->val);
+      }
+    } else {
+      if (def->val) {
+        int value = eval_const_exp(table, arena, def->val);
+        AstNumber *number = new_ast_number(arena);
+        number->number = value;
+        def->val = (AstExp *)number;
+      }
+    }
+  }
+}
+
+static void optimize_stmt(SymbolTable *table, Arena *arena, AstStmt *stmt) {
+  switch (stmt->type) {
+  case AST_RETURN_STMT: {
+    AstReturnStmt *return_stmt = (AstReturnStmt *)stmt;
+    if (return_stmt->exp) {
+      return_stmt->exp = optimize_exp(table, arena, return_stmt->exp);
+    }
+    break;
+  }
+  case AST_EXP_STMT: {
+    AstExpStmt *exp_stmt = (AstExpStmt *)stmt;
+    exp_stmt->exp = optimize_exp(table, arena, exp_stmt->exp);
+    break;
+  }
+  case AST_ASSIGN_STMT: {
+    AstAssignStmt *assign_stmt = (AstAssignStmt *)stmt;
+    assign_stmt->lhs = optimize_exp(table, arena, assign_stmt->lhs);
+    assign_stmt->exp = optimize_exp(table, arena, assign_stmt->exp);
+    break;
+  }
+  case AST_EMPTY_STMT:
+    // nothing to do
+    break;
+  case AST_BLOCK:
+    optimize_block(table, arena, (AstBlock *)stmt);
+    break;
+  case AST_IF_STMT: {
+    AstIfStmt *if_stmt = (AstIfStmt *)stmt;
+    if_stmt->condition = optimize_exp(table, arena, if_stmt->condition);
+    optimize_stmt(table, arena, if_stmt->then);
+    if (if_stmt->else_) {
+      optimize_stmt(table, arena, if_stmt->else_);
+    }
+    break;
+  }
+  case AST_WHILE_STMT: {
+    AstWhileStmt *while_stmt = (AstWhileStmt *)stmt;
+    while_stmt->condition = optimize_exp(table, arena, while_stmt->condition);
+    optimize_stmt(table, arena, while_stmt->body);
+    break;
+  }
+  case AST_BREAK_STMT:
+  case AST_CONTINUE_STMT:
+    break;
+
+  default:
+    fatalf("未知的语句类型 %s\n", ast_type_to_string(stmt->type));
+  }
+}
+
+static void optimize_block(SymbolTable *table, Arena *arena, AstBlock *block) {
+  AstStmt *stmt = block->stmt;
+  enter_scope(table);
+  while (stmt) {
+    switch (stmt->type) {
+    case AST_CONST_DECL: {
+      optimize_const_decl(table, arena, (AstConstDecl *)stmt);
+      break;
+    }
+    case AST_VAR_DECL: {
+      optimize_var_decl(table, arena, (AstVarDecl *)stmt);
+      break;
+    }
+    case AST_EMPTY_STMT:
+      // 移除空语句
+      break;
+    default:
+      optimize_stmt(table, arena, stmt);
+      break;
+    }
+    if (stmt->type == AST_RETURN_STMT) {
+      // return 之后的语句不会执行到，直接移除
+      stmt->next = NULL;
+      break;
+    }
+    stmt = stmt->next;
+  }
+  leave_scope(table);
+}
+
+void optimize_func_def(SymbolTable *table, Arena *arena, AstFuncDef *func_def) {
+  FuncParam *param = func_def->params;
+  while (param) {
+    if (param->dimensions.count > 0) {
+      for (int i = 0; i < param->dimensions.count; i++) {
+        int n = eval_const_exp(table, arena, param->dimensions.elements[i]);
+        assert(n > 0);
+        AstNumber *number = new_ast_number(arena);
+        number->number = n;
+        param->dimensions.elements[i] = (AstExp *)number;
+      }
+    }
+    param = param->next;
+  }
+  optimize_block(table, arena, func_def->block);
+}
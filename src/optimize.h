@@ -0,0 +1,29 @@
+#ifndef SRC_OPTIMIZE_H_
+#define SRC_OPTIMIZE_H_
+
+#include "arena.h"
+#include "ast.h"
+#include "symbol.h"
+
+/*
+ * 优化 AST ，生成 IR 之前调用，koopa_ir.c 和 ir_gen.c 共用
+ * 常量会加入 table ，所以要传入生成 IR 时使用的同一个符号表
+ * 新的 AST 节点（折叠出来的数字、展开的数组初始值）分配在 arena 中
+ * 优化的工作包括：
+ *  - 移除一元加法表达式
+ *  - 数字计算，例如 1 + 2 -> 3
+ *  - 常量替换，例如 const a = 1; const b = a + 2; -> const a = 1; const b = 3;
+ *  - 多维数组初始化值展开
+ *  - 数组参数第二维度及以上的维度计算
+ *  - 移除 return 之后的语句
+ *  - 补全数组默认值
+ */
+
+// 全局常量加入符号表，数组的初始值展开成 AstArrayInit
+void optimize_const_decl(SymbolTable *table, Arena *arena, AstConstDecl *decl);
+void optimize_global_var_decl(SymbolTable *table, Arena *arena,
+                              AstVarDecl *decl);
+// 函数体里的常量只在优化期间加入符号表，离开作用域时撤销
+void optimize_func_def(SymbolTable *table, Arena *arena, AstFuncDef *func_def);
+
+#endif // SRC_OPTIMIZE_H_
@@ -1,5 +1,6 @@
 #include "parse.h"
 
+#include <setjmp.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -7,91 +8,128 @@
 #include <string.h>
 
 #include "ast.h"
-#include "tokenize.h"
+#include "time_report.h"
 #include "utils.h"
 
-typedef struct {
-  Token current;
-  Token next;
-  Token next2;
-} Parser;
-
-static Parser parser;
-
-static AstExp *parse_exp(void);
-static AstExp *parse_lval(void);
-static AstExp *parse_primary_exp(void);
-static AstNumber *parse_number(void);
-static AstIdentifier *parse_identifier(void);
-static AstExp *parse_unary_exp(void);
-static AstExp *parse_call_exp(void);
-static AstExp *parse_add_exp(void);
-static AstExp *parse_mul_exp(void);
-static AstExp *parse_lor_exp(void);
-static AstExp *parse_land_exp(void);
-static AstExp *parse_eq_exp(void);
-static AstExp *parse_rel_exp(void);
-static AstStmt *parse_stmt(void);
-static AstBlock *parse_block(void);
-
-static void advance(void) {
-  parser.current = parser.next;
-  parser.next = parser.next2;
-  parser.next2 = next_token();
-}
-
-static void consume(TokenType type) {
-  if (parser.current.type == type) {
-    advance();
+static AstExp *parse_exp(Parser *parser);
+static AstExp *parse_lval(Parser *parser);
+static AstExp *parse_primary_exp(Parser *parser);
+static AstNumber *parse_number(Parser *parser);
+static AstIdentifier *parse_identifier(Parser *parser);
+static AstExp *parse_unary_exp(Parser *parser);
+static AstExp *parse_call_exp(Parser *parser);
+static AstExp *parse_add_exp(Parser *parser);
+static AstExp *parse_mul_exp(Parser *parser);
+static AstExp *parse_lor_exp(Parser *parser);
+static AstExp *parse_land_exp(Parser *parser);
+static AstExp *parse_eq_exp(Parser *parser);
+static AstExp *parse_rel_exp(Parser *parser);
+static AstStmt *parse_stmt(Parser *parser);
+static AstBlock *parse_block(Parser *parser);
+
+// token 的类型和原文，以及第一次出现的标识符
+static void hash_token(Parser *parser, const Token *token) {
+  cache_key_update_int(&parser->key, token->type);
+  cache_key_update_int(&parser->key, token->length);
+  cache_key_update(&parser->key, token->start, token->length);
+  int index;
+  if (token->ident == NULL ||
+      value_map_get(&parser->seen_idents, token->ident, &index)) {
+    return;
+  }
+  if (parser->ident_count == parser->ident_capacity) {
+    parser->ident_capacity *= 2;
+    parser->idents = realloc(parser->idents,
+                            sizeof(const char *) * parser->ident_capacity);
+  }
+  value_map_put(&parser->seen_idents, token->ident, parser->ident_count);
+  parser->idents[parser->ident_count++] = token->ident;
+}
+
+// 取出下一批 token ，遇到 TOKEN_EOF 时提前结束，之后每批只有一个 TOKEN_EOF
+static void fill_tokens(Parser *parser) {
+  phase_begin(PHASE_TOKENIZE);
+  int count = 0;
+  do {
+    parser->tokens[count] = next_token(&parser->tokenizer);
+  } while (parser->tokens[count++].type != TOKEN_EOF &&
+           count < PARSER_TOKEN_BATCH);
+  parser->token_count = count;
+  parser->token_index = 0;
+  phase_end(PHASE_TOKENIZE);
+}
+
+static void advance(Parser *parser) {
+  if (parser->hashing) {
+    hash_token(parser, &parser->current);
+  }
+  parser->current = parser->next;
+  parser->next = parser->next2;
+  if (parser->token_index == parser->token_count) {
+    fill_tokens(parser);
+  }
+  parser->next2 = parser->tokens[parser->token_index++];
+}
+
+static void consume(Parser *parser, TokenType type) {
+  if (parser->current.type == type) {
+    advance(parser);
   } else {
     fatalf("Syntax error: expected %s, got %s(%.*s) at line %d\n",
            token_type_to_string(type),
-           token_type_to_string(parser.current.type), parser.current.length,
-           parser.current.start, parser.current.line);
+           token_type_to_string(parser->current.type), parser->current.length,
+           parser->current.start, parser->current.line);
   }
 }
 
-static bool try_consume(TokenType type) {
-  if (parser.current.type == type) {
-    advance();
+static bool try_consume(Parser *parser, TokenType type) {
+  if (parser->current.type == type) {
+    advance(parser);
     return true;
   }
   return false;
 }
 
-static void match(const char *expected) {
-  if (strlen(expected) == parser.current.length &&
-      strncmp(parser.current.start, expected, parser.current.length) == 0) {
-    advance();
+static void match(Parser *parser, const char *expected) {
+  if (strlen(expected) == parser->current.length &&
+      strncmp(parser->current.start, expected, parser->current.length) == 0) {
+    advance(parser);
   } else {
     fatalf("Syntax error: expected %s, got %.*s at line %d\n", expected,
-           parser.current.length, parser.current.start, parser.current.line);
+           parser->current.length, parser->current.start, parser->current.line);
   }
 }
 
-__attribute__((unused)) static bool try_match(const char *expected) {
-  if (strncmp(parser.current.start, expected, parser.current.length) == 0) {
-    advance();
+__attribute__((unused)) static bool try_match(Parser *parser,
+                                              const char *expected) {
+  if (strncmp(parser->current.start, expected, parser->current.length) == 0) {
+    advance(parser);
     return true;
   }
   return false;
 }
 
-static bool current_is(TokenType type) { return parser.current.type == type; }
-static bool current_eq(const char *s) {
-  return strlen(s) == parser.current.length &&
-         strncmp(parser.current.start, s, parser.current.length) == 0;
+static bool current_is(Parser *parser, TokenType type) {
+  return parser->current.type == type;
+}
+static bool current_eq(Parser *parser, const char *s) {
+  return strlen(s) == parser->current.length &&
+         strncmp(parser->current.start, s, parser->current.length) == 0;
 }
 
-static bool peek_is(TokenType type) { return parser.next.type == type; }
-__attribute__((unused)) static bool peek_eq(const char *s) {
-  return strlen(s) == parser.next.length &&
-         strncmp(parser.next.start, s, parser.next.length) == 0;
+static bool peek_is(Parser *parser, TokenType type) {
+  return parser->next.type == type;
+}
+__attribute__((unused)) static bool peek_eq(Parser *parser, const char *s) {
+  return strlen(s) == parser->next.length &&
+         strncmp(parser->next.start, s, parser->next.length) == 0;
 }
 
-static bool peek2_is(TokenType type) { return parser.next2.type == type; }
+static bool peek2_is(Parser *parser, TokenType type) {
+  return parser->next2.type == type;
+}
 
-BinaryOpType token_type_to_binary_op_type(TokenType type) {
+BinaryOpType token_type_to_binary_op_type(Parser *parser, TokenType type) {
   switch (type) {
   case TOKEN_PLUS:
     return BinaryOpType_ADD;
@@ -121,360 +159,362 @@ BinaryOpType token_type_to_binary_op_type(TokenType type) {
     return BinaryOpType_OR;
   default:
     fprintf(stderr, "Invalid binary operator: %d at line %d\n", type,
-            parser.current.line);
-    exit(1);
+            parser->current.line);
+    compile_error_exit();
   }
 }
 
 // Number    ::= INT_CONST;
-static AstNumber *parse_number(void) {
-  AstNumber *number = new_ast_number();
+static AstNumber *parse_number(Parser *parser) {
+  AstNumber *number = new_ast_number(parser->arena);
   int base = 10;
-  const char *start = parser.current.start;
-  if (parser.current.start[0] == '0' && parser.current.length > 1) {
+  const char *start = parser->current.start;
+  if (parser->current.start[0] == '0' && parser->current.length > 1) {
     base = 8;
-    if (parser.current.length > 2 &&
-        (parser.current.start[1] == 'x' || parser.current.start[1] == 'X')) {
+    if (parser->current.length > 2 &&
+        (parser->current.start[1] == 'x' || parser->current.start[1] == 'X')) {
       base = 16;
     }
   }
-  char *number_str = strndup(start, parser.current.length);
+  // 整数 token 后面紧跟的字符不可能是数字或字母，直接在源码上解析，
+  // 通过 endptr 判断是否整个 token 都被解析了
   char *endptr;
-  long long n = strtoll(number_str, &endptr, base);
-  if (*endptr != '\0') {
-    fprintf(stderr, "无效数字: %.*s at line %d\n", parser.current.length,
-            parser.current.start, parser.current.line);
-    exit(1);
+  long long n = strtoll(start, &endptr, base);
+  if (endptr != start + parser->current.length) {
+    fprintf(stderr, "无效数字: %.*s at line %d\n", parser->current.length,
+            parser->current.start, parser->current.line);
+    compile_error_exit();
   }
   // i32 number range check
   if (n > INT32_MAX || n < INT32_MIN) {
     fprintf(stderr, "数字超出 i32 范围: %lld (base %d) at line %d\n", n, base,
-            parser.current.line);
-    exit(1);
+            parser->current.line);
+    compile_error_exit();
   }
-  free(number_str);
   number->number = n;
-  consume(TOKEN_INTEGER);
+  consume(parser, TOKEN_INTEGER);
   return number;
 }
 
 // ArrayVal  ::= "{" ( Exp ("," Exp)* )? "}";
-static AstArrayValue *parse_array_value(void) {
-  AstArrayValue *array_value = new_ast_array_value();
-  consume(TOKEN_LBRACE);
-  if (!try_consume(TOKEN_RBRACE)) {
+static AstArrayValue *parse_array_value(Parser *parser) {
+  AstArrayValue *array_value = new_ast_array_value(parser->arena);
+  consume(parser, TOKEN_LBRACE);
+  if (!try_consume(parser, TOKEN_RBRACE)) {
     do {
-      AstExp *exp = parse_exp();
-      ast_array_value_add(array_value, exp);
-    } while (try_consume(TOKEN_COMMA));
-    consume(TOKEN_RBRACE);
+      AstExp *exp = parse_exp(parser);
+      ast_array_value_add(parser->arena, array_value, exp);
+    } while (try_consume(parser, TOKEN_COMMA));
+    consume(parser, TOKEN_RBRACE);
   }
   return array_value;
 }
 
 // PrimaryExp  ::= "(" Exp ")" | LVal | Number | ArrayVal;
-static AstExp *parse_primary_exp(void) {
-  switch (parser.current.type) {
+static AstExp *parse_primary_exp(Parser *parser) {
+  switch (parser->current.type) {
   case TOKEN_IDENTIFIER:
-    return parse_lval();
+    return parse_lval(parser);
   case TOKEN_INTEGER:
-    return (AstExp *)parse_number();
+    return (AstExp *)parse_number(parser);
   case TOKEN_LPAREN:
-    advance();
-    AstExp *exp = parse_exp();
-    consume(TOKEN_RPAREN);
+    advance(parser);
+    AstExp *exp = parse_exp(parser);
+    consume(parser, TOKEN_RPAREN);
     return exp;
   case TOKEN_LBRACE:
-    return (AstExp *)parse_array_value();
+    return (AstExp *)parse_array_value(parser);
   default:
     fprintf(stderr, "Syntax error: unexpected token %s(%d) at line %d\n",
-            token_type_to_string(parser.current.type), parser.current.type,
-            parser.current.line);
-    exit(1);
+            token_type_to_string(parser->current.type), parser->current.type,
+            parser->current.line);
+    compile_error_exit();
   }
 }
 
 // CallExp     ::= IDENT "(" [Exp {"," Exp}] ")";
-static AstExp *parse_call_exp(void) {
-  AstFuncCall *func_call = new_ast_func_call();
-  func_call->ident = parse_identifier();
-  consume(TOKEN_LPAREN);
-  if (!try_consume(TOKEN_RPAREN)) {
+static AstExp *parse_call_exp(Parser *parser) {
+  AstFuncCall *func_call = new_ast_func_call(parser->arena);
+  func_call->ident = parse_identifier(parser);
+  consume(parser, TOKEN_LPAREN);
+  if (!try_consume(parser, TOKEN_RPAREN)) {
     do {
-      AstExp *exp = parse_exp();
-      ast_func_call_add(func_call, exp);
-    } while (try_consume(TOKEN_COMMA));
-    consume(TOKEN_RPAREN);
+      AstExp *exp = parse_exp(parser);
+      ast_func_call_add(parser->arena, func_call, exp);
+    } while (try_consume(parser, TOKEN_COMMA));
+    consume(parser, TOKEN_RPAREN);
   }
   return (AstExp *)func_call;
 }
 
 // UnaryExp   ::= PrimaryExp | CallExp | ("+" | "-" | "!") UnaryExp;
-static AstExp *parse_unary_exp(void) {
-  if (parser.current.type == TOKEN_PLUS || parser.current.type == TOKEN_MINUS ||
-      parser.current.type == TOKEN_BANG) {
-    AstUnaryExp *unary_exp = new_ast_unary_exp();
-    unary_exp->op = *parser.current.start;
-    advance();
-    unary_exp->operand = parse_unary_exp();
+static AstExp *parse_unary_exp(Parser *parser) {
+  if (parser->current.type == TOKEN_PLUS ||
+      parser->current.type == TOKEN_MINUS ||
+      parser->current.type == TOKEN_BANG) {
+    AstUnaryExp *unary_exp = new_ast_unary_exp(parser->arena);
+    unary_exp->op = *parser->current.start;
+    advance(parser);
+    unary_exp->operand = parse_unary_exp(parser);
     return (AstExp *)unary_exp;
-  } else if (parser.current.type == TOKEN_IDENTIFIER && peek_is(TOKEN_LPAREN)) {
-    return parse_call_exp();
+  } else if (parser->current.type == TOKEN_IDENTIFIER &&
+             peek_is(parser, TOKEN_LPAREN)) {
+    return parse_call_exp(parser);
   }
 
-  return parse_primary_exp();
+  return parse_primary_exp(parser);
 }
 
 // MulExp      ::= UnaryExp (("*" | "/" | "%") UnaryExp)*;
-static AstExp *parse_mul_exp(void) {
-  AstExp *exp = parse_unary_exp();
-  while (parser.current.type == TOKEN_ASTERISK ||
-         parser.current.type == TOKEN_SLASH ||
-         parser.current.type == TOKEN_PERCENT) {
-    AstBinaryExp *binary_exp = new_ast_binary_exp();
+static AstExp *parse_mul_exp(Parser *parser) {
+  AstExp *exp = parse_unary_exp(parser);
+  while (parser->current.type == TOKEN_ASTERISK ||
+         parser->current.type == TOKEN_SLASH ||
+         parser->current.type == TOKEN_PERCENT) {
+    AstBinaryExp *binary_exp = new_ast_binary_exp(parser->arena);
     binary_exp->lhs = exp;
-    binary_exp->op = token_type_to_binary_op_type(parser.current.type);
-    advance();
-    binary_exp->rhs = parse_unary_exp();
+    binary_exp->op = token_type_to_binary_op_type(parser, parser->current.type);
+    advance(parser);
+    binary_exp->rhs = parse_unary_exp(parser);
     exp = (AstExp *)binary_exp;
   }
   return exp;
 }
 
 // AddExp      ::= MulExp (("+" | "-") MulExp)*;
-static AstExp *parse_add_exp(void) {
-  AstExp *exp = parse_mul_exp();
-  while (parser.current.type == TOKEN_PLUS ||
-         parser.current.type == TOKEN_MINUS) {
-    AstBinaryExp *binary_exp = new_ast_binary_exp();
+static AstExp *parse_add_exp(Parser *parser) {
+  AstExp *exp = parse_mul_exp(parser);
+  while (parser->current.type == TOKEN_PLUS ||
+         parser->current.type == TOKEN_MINUS) {
+    AstBinaryExp *binary_exp = new_ast_binary_exp(parser->arena);
     binary_exp->lhs = exp;
-    binary_exp->op = token_type_to_binary_op_type(parser.current.type);
-    advance();
-    binary_exp->rhs = parse_mul_exp();
+    binary_exp->op = token_type_to_binary_op_type(parser, parser->current.type);
+    advance(parser);
+    binary_exp->rhs = parse_mul_exp(parser);
     exp = (AstExp *)binary_exp;
   }
   return exp;
 }
 
 // RelExp      ::= AddExp (("<" | "<=" | ">" | ">=") AddExp)*;
-static AstExp *parse_rel_exp(void) {
-  AstExp *exp = parse_add_exp();
-  while (parser.current.type == TOKEN_LESS ||
-         parser.current.type == TOKEN_LESS_EQUAL ||
-         parser.current.type == TOKEN_GREATER ||
-         parser.current.type == TOKEN_GREATER_EQUAL) {
-    AstBinaryExp *binary_exp = new_ast_binary_exp();
+static AstExp *parse_rel_exp(Parser *parser) {
+  AstExp *exp = parse_add_exp(parser);
+  while (parser->current.type == TOKEN_LESS ||
+         parser->current.type == TOKEN_LESS_EQUAL ||
+         parser->current.type == TOKEN_GREATER ||
+         parser->current.type == TOKEN_GREATER_EQUAL) {
+    AstBinaryExp *binary_exp = new_ast_binary_exp(parser->arena);
     binary_exp->lhs = exp;
-    binary_exp->op = token_type_to_binary_op_type(parser.current.type);
-    advance();
-    binary_exp->rhs = parse_add_exp();
+    binary_exp->op = token_type_to_binary_op_type(parser, parser->current.type);
+    advance(parser);
+    binary_exp->rhs = parse_add_exp(parser);
     exp = (AstExp *)binary_exp;
   }
   return exp;
 }
 
 // EqExp       ::= RelExp (("==" | "!=") RelExp)*;
-static AstExp *parse_eq_exp(void) {
-  AstExp *exp = parse_rel_exp();
-  while (parser.current.type == TOKEN_EQUAL ||
-         parser.current.type == TOKEN_NOT_EQUAL) {
-    AstBinaryExp *binary_exp = new_ast_binary_exp();
+static AstExp *parse_eq_exp(Parser *parser) {
+  AstExp *exp = parse_rel_exp(parser);
+  while (parser->current.type == TOKEN_EQUAL ||
+         parser->current.type == TOKEN_NOT_EQUAL) {
+    AstBinaryExp *binary_exp = new_ast_binary_exp(parser->arena);
     binary_exp->lhs = exp;
-    binary_exp->op = token_type_to_binary_op_type(parser.current.type);
-    advance();
-    binary_exp->rhs = parse_rel_exp();
+    binary_exp->op = token_type_to_binary_op_type(parser, parser->current.type);
+    advance(parser);
+    binary_exp->rhs = parse_rel_exp(parser);
     exp = (AstExp *)binary_exp;
   }
   return exp;
 }
 
 // LAndExp     ::= EqExp ("&&" EqExp)*;
-static AstExp *parse_land_exp(void) {
-  AstExp *exp = parse_eq_exp();
-  while (parser.current.type == TOKEN_AND) {
-    AstBinaryExp *binary_exp = new_ast_binary_exp();
+static AstExp *parse_land_exp(Parser *parser) {
+  AstExp *exp = parse_eq_exp(parser);
+  while (parser->current.type == TOKEN_AND) {
+    AstBinaryExp *binary_exp = new_ast_binary_exp(parser->arena);
     binary_exp->lhs = exp;
-    binary_exp->op = token_type_to_binary_op_type(parser.current.type);
-    advance();
-    binary_exp->rhs = parse_eq_exp();
+    binary_exp->op = token_type_to_binary_op_type(parser, parser->current.type);
+    advance(parser);
+    binary_exp->rhs = parse_eq_exp(parser);
     exp = (AstExp *)binary_exp;
   }
   return exp;
 }
 
 // LOrExp      ::= LAndExp ("||" LAndExp)*;
-static AstExp *parse_lor_exp(void) {
-  AstExp *exp = parse_land_exp();
-  while (parser.current.type == TOKEN_OR) {
-    AstBinaryExp *binary_exp = new_ast_binary_exp();
+static AstExp *parse_lor_exp(Parser *parser) {
+  AstExp *exp = parse_land_exp(parser);
+  while (parser->current.type == TOKEN_OR) {
+    AstBinaryExp *binary_exp = new_ast_binary_exp(parser->arena);
     binary_exp->lhs = exp;
-    binary_exp->op = token_type_to_binary_op_type(parser.current.type);
-    advance();
-    binary_exp->rhs = parse_land_exp();
+    binary_exp->op = token_type_to_binary_op_type(parser, parser->current.type);
+    advance(parser);
+    binary_exp->rhs = parse_land_exp(parser);
     exp = (AstExp *)binary_exp;
   }
   return exp;
 }
 
 // Exp         ::= LOrExp;
-static AstExp *parse_exp(void) { return parse_lor_exp(); }
+static AstExp *parse_exp(Parser *parser) { return parse_lor_exp(parser); }
 
 // ReturnStmt        ::= "return" [Exp] ";";
-static AstStmt *parse_return_stmt(void) {
-  AstReturnStmt *stmt = new_ast_return_stmt();
-  match("return");
-  if (!current_is(TOKEN_SEMICOLON)) {
-    stmt->exp = parse_exp();
+static AstStmt *parse_return_stmt(Parser *parser) {
+  AstReturnStmt *stmt = new_ast_return_stmt(parser->arena);
+  match(parser, "return");
+  if (!current_is(parser, TOKEN_SEMICOLON)) {
+    stmt->exp = parse_exp(parser);
   }
-  consume(TOKEN_SEMICOLON);
+  consume(parser, TOKEN_SEMICOLON);
   return (AstStmt *)stmt;
 }
 
 // LVal              ::= IDENT ("[" Exp "]")*;
-static AstExp *parse_lval(void) {
-  if (peek_is(TOKEN_LBRACKET)) {
-    AstArrayAccess *array_access = new_ast_array_access();
-    array_access->name = strndup(parser.current.start, parser.current.length);
-    consume(TOKEN_IDENTIFIER);
-    while (current_is(TOKEN_LBRACKET)) {
-      advance();
-      AstExp *exp = parse_exp();
-      exp_array_add(&array_access->indexes, exp);
-      consume(TOKEN_RBRACKET);
+static AstExp *parse_lval(Parser *parser) {
+  if (peek_is(parser, TOKEN_LBRACKET)) {
+    AstArrayAccess *array_access = new_ast_array_access(parser->arena);
+    array_access->name = parser->current.ident;
+    consume(parser, TOKEN_IDENTIFIER);
+    while (current_is(parser, TOKEN_LBRACKET)) {
+      advance(parser);
+      AstExp *exp = parse_exp(parser);
+      exp_array_add(parser->arena, &array_access->indexes, exp);
+      consume(parser, TOKEN_RBRACKET);
     }
     return (AstExp *)array_access;
   }
-  return (AstExp *)parse_identifier();
+  return (AstExp *)parse_identifier(parser);
 };
 
 // FuncType  ::= "int";
-static BType parse_func_type(void) {
-  if (try_match("void")) {
+static BType parse_func_type(Parser *parser) {
+  if (try_match(parser, "void")) {
     return BType_VOID;
   } else {
-    match("int");
+    match(parser, "int");
     return BType_INT;
   }
 }
 
 // IDENT;
-static AstIdentifier *parse_identifier(void) {
-  AstIdentifier *ident = new_ast_identifier();
-  ident->name = strndup(parser.current.start, parser.current.length);
-  consume(TOKEN_IDENTIFIER);
+static AstIdentifier *parse_identifier(Parser *parser) {
+  AstIdentifier *ident = new_ast_identifier(parser->arena);
+  ident->name = parser->current.ident;
+  consume(parser, TOKEN_IDENTIFIER);
   return ident;
 }
 
 // ConstDef    ::= IDENT ("[" ConstExp "]")* "=" ConstInitVal;
 // ConstInitVal::= ConstExp | ArrayVal;
 // ConstExp    ::= Exp;
-static AstVarDef *parse_const_def(void) {
-  AstVarDef *def = new_ast_var_def();
-  def->name = strndup(parser.current.start, parser.current.length);
-  consume(TOKEN_IDENTIFIER);
-  while (current_is(TOKEN_LBRACKET)) {
-    advance();
-    AstExp *exp = parse_exp();
-    exp_array_add(&def->dimensions, exp);
-    consume(TOKEN_RBRACKET);
-  }
-  match("=");
-  if (current_is(TOKEN_LBRACE)) {
-    def->val = (AstExp *)parse_array_value();
+static AstVarDef *parse_const_def(Parser *parser) {
+  AstVarDef *def = new_ast_var_def(parser->arena);
+  def->name = parser->current.ident;
+  consume(parser, TOKEN_IDENTIFIER);
+  while (current_is(parser, TOKEN_LBRACKET)) {
+    advance(parser);
+    AstExp *exp = parse_exp(parser);
+    exp_array_add(parser->arena, &def->dimensions, exp);
+    consume(parser, TOKEN_RBRACKET);
+  }
+  match(parser, "=");
+  if (current_is(parser, TOKEN_LBRACE)) {
+    def->val = (AstExp *)parse_array_value(parser);
   } else {
-    def->val = parse_exp();
+    def->val = parse_exp(parser);
   }
   return def;
 }
 
 // ConstDecl   ::= "const" "int" ConstDef ("," ConstDef)* ";";
-static AstConstDecl *parse_const_decl(void) {
-  AstConstDecl *const_decl = new_ast_const_decl();
-  match("const");
-  match("int");
+static AstConstDecl *parse_const_decl(Parser *parser) {
+  AstConstDecl *const_decl = new_ast_const_decl(parser->arena);
+  match(parser, "const");
+  match(parser, "int");
   const_decl->type = BType_INT;
   do {
-    AstVarDef *def = parse_const_def();
-    var_def_array_add(&const_decl->defs, def);
-  } while (try_consume(TOKEN_COMMA));
-  consume(TOKEN_SEMICOLON);
+    AstVarDef *def = parse_const_def(parser);
+    var_def_array_add(parser->arena, &const_decl->defs, def);
+  } while (try_consume(parser, TOKEN_COMMA));
+  consume(parser, TOKEN_SEMICOLON);
   return const_decl;
 }
 
 // VarDef        ::= IDENT ("[" ConstExp "]")*
 //                 | IDENT ("[" ConstExp "]")* "=" InitVal;
 // InitVal       ::= Exp | "{" (Exp ("," Exp)*)? "}";
-static AstVarDef *parse_var_def(void) {
-  AstVarDef *def = new_ast_var_def();
-  def->name = strndup(parser.current.start, parser.current.length);
-  consume(TOKEN_IDENTIFIER);
-  while (current_is(TOKEN_LBRACKET)) {
-    advance();
-    AstExp *exp = parse_exp();
-    exp_array_add(&def->dimensions, exp);
-    consume(TOKEN_RBRACKET);
-  }
-  if (try_consume(TOKEN_ASSIGN)) {
-    if (current_is(TOKEN_LBRACE)) {
-      def->val = (AstExp *)parse_array_value();
+static AstVarDef *parse_var_def(Parser *parser) {
+  AstVarDef *def = new_ast_var_def(parser->arena);
+  def->name = parser->current.ident;
+  consume(parser, TOKEN_IDENTIFIER);
+  while (current_is(parser, TOKEN_LBRACKET)) {
+    advance(parser);
+    AstExp *exp = parse_exp(parser);
+    exp_array_add(parser->arena, &def->dimensions, exp);
+    consume(parser, TOKEN_RBRACKET);
+  }
+  if (try_consume(parser, TOKEN_ASSIGN)) {
+    if (current_is(parser, TOKEN_LBRACE)) {
+      def->val = (AstExp *)parse_array_value(parser);
     } else {
-      def->val = parse_exp();
+      def->val = parse_exp(parser);
     }
   }
   return def;
 }
 
 // VarDecl       ::= "int" VarDef ("," VarDef)* ";";
-static AstVarDecl *parse_var_decl(void) {
-  AstVarDecl *var_decl = new_ast_var_decl();
-  match("int");
+static AstVarDecl *parse_var_decl(Parser *parser) {
+  AstVarDecl *var_decl = new_ast_var_decl(parser->arena);
+  match(parser, "int");
   var_decl->type = BType_INT;
   do {
-    AstVarDef *def = parse_var_def();
-    var_def_array_add(&var_decl->defs, def);
-  } while (try_consume(TOKEN_COMMA));
-  consume(TOKEN_SEMICOLON);
+    AstVarDef *def = parse_var_def(parser);
+    var_def_array_add(parser->arena, &var_decl->defs, def);
+  } while (try_consume(parser, TOKEN_COMMA));
+  consume(parser, TOKEN_SEMICOLON);
   return var_decl;
 }
 
 // IfStmt       ::= "if" "(" Exp ")" Stmt ("else" Stmt)?;
-static AstIfStmt *parse_if_stmt(void) {
-  AstIfStmt *stmt = new_ast_if_stmt();
-  match("if");
-  consume(TOKEN_LPAREN);
-  stmt->condition = parse_exp();
-  consume(TOKEN_RPAREN);
-  stmt->then = parse_stmt();
-  if (try_match("else")) {
-    stmt->else_ = parse_stmt();
+static AstIfStmt *parse_if_stmt(Parser *parser) {
+  AstIfStmt *stmt = new_ast_if_stmt(parser->arena);
+  match(parser, "if");
+  consume(parser, TOKEN_LPAREN);
+  stmt->condition = parse_exp(parser);
+  consume(parser, TOKEN_RPAREN);
+  stmt->then = parse_stmt(parser);
+  if (try_match(parser, "else")) {
+    stmt->else_ = parse_stmt(parser);
   }
   return stmt;
 }
 
 // WhileStmt     ::= "while" "(" Exp ")" Stmt;
-static AstWhileStmt *parse_while_stmt(void) {
-  AstWhileStmt *stmt = new_ast_while_stmt();
-  match("while");
-  consume(TOKEN_LPAREN);
-  stmt->condition = parse_exp();
-  consume(TOKEN_RPAREN);
-  stmt->body = parse_stmt();
+static AstWhileStmt *parse_while_stmt(Parser *parser) {
+  AstWhileStmt *stmt = new_ast_while_stmt(parser->arena);
+  match(parser, "while");
+  consume(parser, TOKEN_LPAREN);
+  stmt->condition = parse_exp(parser);
+  consume(parser, TOKEN_RPAREN);
+  stmt->body = parse_stmt(parser);
   return stmt;
 }
 
 // BreakStmt     ::= "break" ";" ;
-static AstBreakStmt *parse_break_stmt(void) {
-  AstBreakStmt *stmt = new_ast_break_stmt();
-  match("break");
-  consume(TOKEN_SEMICOLON);
+static AstBreakStmt *parse_break_stmt(Parser *parser) {
+  AstBreakStmt *stmt = new_ast_break_stmt(parser->arena);
+  match(parser, "break");
+  consume(parser, TOKEN_SEMICOLON);
   return stmt;
 }
 
 // ContinueStmt  ::= "continue" ";" ;
-static AstContinueStmt *parse_continue_stmt(void) {
-  AstContinueStmt *stmt = new_ast_continue_stmt();
-  match("continue");
-  consume(TOKEN_SEMICOLON);
+static AstContinueStmt *parse_continue_stmt(Parser *parser) {
+  AstContinueStmt *stmt = new_ast_continue_stmt(parser->arena);
+  match(parser, "continue");
+  consume(parser, TOKEN_SEMICOLON);
   return stmt;
 }
 
@@ -489,105 +529,104 @@ static AstContinueStmt *parse_continue_stmt(void) {
 //                 | ReturnStmt;
 // ExpStmt       ::= Exp ";";
 // AssignStmt    ::= LVal "=" Exp ";";
-static AstStmt *parse_stmt(void) {
-  if (current_eq("return")) {
-    return parse_return_stmt();
-  } else if (current_is(TOKEN_LBRACE)) {
-    return (AstStmt *)parse_block();
-  } else if (current_is(TOKEN_SEMICOLON)) {
-    advance();
-    return (AstStmt *)new_ast_empty_stmt();
-  } else if (current_eq("if")) {
-    return (AstStmt *)parse_if_stmt();
-  } else if (current_eq("while")) {
-    return (AstStmt *)parse_while_stmt();
-  } else if (current_eq("continue")) {
-    return (AstStmt *)parse_continue_stmt();
-  } else if (current_eq("break")) {
-    return (AstStmt *)parse_break_stmt();
+static AstStmt *parse_stmt(Parser *parser) {
+  if (current_eq(parser, "return")) {
+    return parse_return_stmt(parser);
+  } else if (current_is(parser, TOKEN_LBRACE)) {
+    return (AstStmt *)parse_block(parser);
+  } else if (current_is(parser, TOKEN_SEMICOLON)) {
+    advance(parser);
+    return (AstStmt *)new_ast_empty_stmt(parser->arena);
+  } else if (current_eq(parser, "if")) {
+    return (AstStmt *)parse_if_stmt(parser);
+  } else if (current_eq(parser, "while")) {
+    return (AstStmt *)parse_while_stmt(parser);
+  } else if (current_eq(parser, "continue")) {
+    return (AstStmt *)parse_continue_stmt(parser);
+  } else if (current_eq(parser, "break")) {
+    return (AstStmt *)parse_break_stmt(parser);
   } else {
-    AstExp *exp = parse_exp();
-    if (current_is(TOKEN_ASSIGN)) {
-      AstAssignStmt *stmt = new_ast_assign_stmt();
+    AstExp *exp = parse_exp(parser);
+    if (current_is(parser, TOKEN_ASSIGN)) {
+      AstAssignStmt *stmt = new_ast_assign_stmt(parser->arena);
       stmt->lhs = exp;
-      consume(TOKEN_ASSIGN);
-      stmt->exp = parse_exp();
-      consume(TOKEN_SEMICOLON);
+      consume(parser, TOKEN_ASSIGN);
+      stmt->exp = parse_exp(parser);
+      consume(parser, TOKEN_SEMICOLON);
       return (AstStmt *)stmt;
     } else {
-      AstExpStmt *stmt = new_ast_exp_stmt();
+      AstExpStmt *stmt = new_ast_exp_stmt(parser->arena);
       stmt->exp = exp;
-      consume(TOKEN_SEMICOLON);
+      consume(parser, TOKEN_SEMICOLON);
       return (AstStmt *)stmt;
     }
   }
 }
 
 // Decl          ::= ConstDecl | VarDecl;
-static AstStmt *parse_decl(void) {
-  if (current_eq("const")) {
-    return (AstStmt *)parse_const_decl();
-  } else if (current_eq("int")) {
-    return (AstStmt *)parse_var_decl();
+static AstStmt *parse_decl(Parser *parser) {
+  if (current_eq(parser, "const")) {
+    return (AstStmt *)parse_const_decl(parser);
+  } else if (current_eq(parser, "int")) {
+    return (AstStmt *)parse_var_decl(parser);
   } else {
     fatalf("Syntax error: expected const or int, got %.*s at line %d\n",
-           parser.current.length, parser.current.start, parser.current.line);
+           parser->current.length, parser->current.start, parser->current.line);
     return NULL;
   }
 }
 
 // BlockItem     :: = Decl | Stmt;
-static AstStmt *parse_block_item(void) {
-  if (current_eq("const") || current_eq("int")) {
-    return parse_decl();
+static AstStmt *parse_block_item(Parser *parser) {
+  if (current_eq(parser, "const") || current_eq(parser, "int")) {
+    return parse_decl(parser);
   } else {
-    return parse_stmt();
+    return parse_stmt(parser);
   }
 }
 
 // Block         ::= "{" {BlockItem} "}";
-static AstBlock *parse_block(void) {
-  consume(TOKEN_LBRACE);
-  AstBlock *block = new_ast_block();
+static AstBlock *parse_block(Parser *parser) {
+  consume(parser, TOKEN_LBRACE);
+  AstBlock *block = new_ast_block(parser->arena);
   AstStmt head;
   head.next = NULL;
   AstStmt *tail = &head;
-  while (!current_is(TOKEN_RBRACE)) {
-    AstStmt *stmt = parse_block_item();
+  while (!current_is(parser, TOKEN_RBRACE)) {
+    AstStmt *stmt = parse_block_item(parser);
     tail->next = stmt;
     tail = stmt;
   }
   block->stmt = head.next;
-  consume(TOKEN_RBRACE);
+  consume(parser, TOKEN_RBRACE);
   return block;
 }
 
 // FuncDef   ::= FuncType IDENT "(" [FuncFParams] ")" Block;
 // FuncFParams ::= FuncFParam ("," FuncFParam)*;
 // FuncFParam  ::= "int" IDENT ("[" "]" ("[" ConstExp "]")* )?;
-static AstFuncDef *parse_func_def(void) {
-  AstFuncDef *func_def = new_ast_func_def();
-  func_def->func_type = parse_func_type();
-  func_def->ident = parse_identifier();
-  consume(TOKEN_LPAREN);
-  if (!try_consume(TOKEN_RPAREN)) {
+static AstFuncDef *parse_func_def(Parser *parser) {
+  AstFuncDef *func_def = new_ast_func_def(parser->arena);
+  func_def->func_type = parse_func_type(parser);
+  func_def->ident = parse_identifier(parser);
+  consume(parser, TOKEN_LPAREN);
+  if (!try_consume(parser, TOKEN_RPAREN)) {
     FuncParam head;
     head.next = NULL;
     FuncParam *tail = &head;
     do {
-      FuncParam *param = calloc(1, sizeof(FuncParam));
-      param->type = parse_func_type();
-      param->ident = parse_identifier();
-      init_exp_array(&param->dimensions);
-      if (current_is(TOKEN_LBRACKET)) {
+      FuncParam *param = new_func_param(parser->arena);
+      param->type = parse_func_type(parser);
+      param->ident = parse_identifier(parser);
+      if (current_is(parser, TOKEN_LBRACKET)) {
         param->type = BType_POINTER;
-        advance();
-        consume(TOKEN_RBRACKET);
-        while (current_is(TOKEN_LBRACKET)) {
-          advance();
-          AstExp *exp = parse_exp();
-          exp_array_add(&param->dimensions, exp);
-          consume(TOKEN_RBRACKET);
+        advance(parser);
+        consume(parser, TOKEN_RBRACKET);
+        while (current_is(parser, TOKEN_LBRACKET)) {
+          advance(parser);
+          AstExp *exp = parse_exp(parser);
+          exp_array_add(parser->arena, &param->dimensions, exp);
+          consume(parser, TOKEN_RBRACKET);
         }
         if (param->dimensions.count > 0) {
           param->type = BType_ARRAY_POINTER;
@@ -596,40 +635,110 @@ static AstFuncDef *parse_func_def(void) {
       tail->next = param;
       tail = param;
       func_def->param_count++;
-    } while (try_consume(TOKEN_COMMA));
+    } while (try_consume(parser, TOKEN_COMMA));
     func_def->params = head.next;
-    consume(TOKEN_RPAREN);
+    consume(parser, TOKEN_RPAREN);
   }
-  func_def->block = parse_block();
+  func_def->block = parse_block(parser);
+  return func_def;
+}
+
+// 解析函数定义，同时计算缓存用的键
+static AstFuncDef *parse_func_def_cached(Parser *parser) {
+  cache_key_init(&parser->key);
+  value_map_clear(&parser->seen_idents);
+  parser->ident_count = 0;
+  parser->hashing = true;
+  AstFuncDef *func_def = parse_func_def(parser);
+  parser->hashing = false;
+  func_def->token_key = parser->key;
+  ast_func_def_set_idents(parser->arena, func_def, parser->idents,
+                          parser->ident_count);
   return func_def;
 }
 
+// 一个全局定义 Decl | FuncDef
+static AstBase *parse_global_def(Parser *parser) {
+  if (current_eq(parser, "const") ||
+      (current_eq(parser, "int") && peek_is(parser, TOKEN_IDENTIFIER) &&
+       !peek2_is(parser, TOKEN_LPAREN))) {
+    return (AstBase *)parse_decl(parser);
+  }
+  if (parser->cache_enabled) {
+    return (AstBase *)parse_func_def_cached(parser);
+  }
+  return (AstBase *)parse_func_def(parser);
+}
+
 // CompUnit  ::= (Decl | FuncDef)+;
-static AstCompUnit *parse_comp_unit(void) {
-  AstCompUnit *comp_unit = new_ast_comp_unit();
-  while (!current_is(TOKEN_EOF)) {
-    if (current_eq("const") ||
-        (current_eq("int") && peek_is(TOKEN_IDENTIFIER) &&
-         !peek2_is(TOKEN_LPAREN))) {
-      AstStmt *decl = parse_decl();
-      ast_comp_unit_add(comp_unit, (AstBase *)decl);
-    } else {
-      AstFuncDef *func_def = parse_func_def();
-      ast_comp_unit_add(comp_unit, (AstBase *)func_def);
+static AstCompUnit *parse_comp_unit(Parser *parser) {
+  AstCompUnit *comp_unit = new_ast_comp_unit(parser->arena);
+  while (!current_is(parser, TOKEN_EOF)) {
+    ast_comp_unit_add(parser->arena, comp_unit, parse_global_def(parser));
+  }
+  consume(parser, TOKEN_EOF);
+  return comp_unit;
+}
+
+static void init_parser(Parser *parser, CompileContext *ctx,
+                        const char *input) {
+  memset(parser, 0, sizeof(Parser));
+  init_tokenizer(&parser->tokenizer, input, &ctx->intern_pool);
+  parser->token_count = 0;
+  parser->token_index = 0;
+  parser->hashing = false;
+  parser->cache_enabled = ctx->cache != NULL;
+  if (parser->cache_enabled) {
+    value_map_init(&parser->seen_idents);
+    parser->ident_capacity = 64;
+    parser->idents = malloc(sizeof(const char *) * parser->ident_capacity);
+  }
+  advance(parser);
+  advance(parser);
+  advance(parser);
+}
+
+void parse_end(Parser *parser) {
+  value_map_free(&parser->seen_idents);
+  free(parser->idents);
+  parser->idents = NULL;
+}
+
+AstCompUnit *parse(CompileContext *ctx, const char *input) {
+  phase_begin(PHASE_PARSE);
+  Parser parser;
+  init_parser(&parser, ctx, input);
+  parser.arena = &ctx->ast_arena;
+  // 出错时先释放 parser ，再跳回外层设置的位置
+  jmp_buf trap;
+  jmp_buf *outer = set_error_trap(NULL);
+  if (outer != NULL) {
+    set_error_trap(&trap);
+    if (setjmp(trap) != 0) {
+      parse_end(&parser);
+      set_error_trap(outer);
+      compile_error_exit();
     }
   }
-  consume(TOKEN_EOF);
+  AstCompUnit *comp_unit = parse_comp_unit(&parser);
+  set_error_trap(outer);
+  parse_end(&parser);
+  phase_end(PHASE_PARSE);
   return comp_unit;
 }
 
-static void init_parser(void) {
-  advance();
-  advance();
-  advance();
+void parse_begin(Parser *parser, CompileContext *ctx, const char *input) {
+  init_parser(parser, ctx, input);
 }
 
-AstCompUnit *parse(const char *input) {
-  init_tokenizer(input);
-  init_parser();
-  return parse_comp_unit();
-}
\ No newline at end of file
+AstBase *parse_next_def(Parser *parser, Arena *arena) {
+  if (current_is(parser, TOKEN_EOF)) {
+    parse_end(parser);
+    return NULL;
+  }
+  parser->arena = arena;
+  phase_begin(PHASE_PARSE);
+  AstBase *def = parse_global_def(parser);
+  phase_end(PHASE_PARSE);
+  return def;
+}
@@ -1,8 +1,45 @@
 #ifndef SRC_PARSE_H_
 #define SRC_PARSE_H_
 
+#include "arena.h"
 #include "ast.h"
+#include "context.h"
+#include "tokenize.h"
+#include "value_map.h"
 
-AstCompUnit *parse(const char *input);
+#define PARSER_TOKEN_BATCH 1024
+
+// 解析一个文件的全部状态，由调用方持有，多个线程可以各用一个同时解析不同的文件
+typedef struct {
+  Tokenizer tokenizer;
+  Token current;
+  Token next;
+  Token next2;
+  // 开启缓存时，解析函数定义的同时计算 token 序列的键，记录出现过的标识符
+  bool cache_enabled;
+  bool hashing;
+  CacheKey key;
+  ValueMap seen_idents; // 标识符 -> idents 中的下标，用来去重
+  const char **idents;
+  int ident_count;
+  int ident_capacity;
+  // 词法分析每次取出一批 token ，解析时从这里依次取，取完了再取下一批
+  // -time-report 按批统计词法分析，和不开启时走的是同一条路径
+  Token tokens[PARSER_TOKEN_BATCH];
+  int token_count;
+  int token_index;
+  // 新的 AST 节点分配在这里
+  Arena *arena;
+} Parser;
+
+// AST 节点和标识符分配在 ctx 中
+AstCompUnit *parse(CompileContext *ctx, const char *input);
+
+// 逐个解析全局定义，用于流式编译
+// parse_begin 初始化 parser ，之后每次返回下一个全局定义，节点分配在 arena 中
+// 没有更多定义时返回 NULL ，同时释放 parser ；中途停止时调用 parse_end 释放
+void parse_begin(Parser *parser, CompileContext *ctx, const char *input);
+AstBase *parse_next_def(Parser *parser, Arena *arena);
+void parse_end(Parser *parser);
 
 #endif // SRC_PARSE_H_
\ No newline at end of file
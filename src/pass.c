@@ -0,0 +1,241 @@
+#include "pass.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "time_report.h"
+#include "utils.h"
+
+// #region CFG
+
+// 每个块的前驱，一条 br 的两个目标相同时只算一次
+static void compute_preds(IrFunction *func) {
+  Arena *arena = &func->module->arena;
+  for (IrBlock *block = func->first; block != NULL; block = block->next) {
+    block->pred_count = 0;
+  }
+  for (IrBlock *block = func->first; block != NULL; block = block->next) {
+    IrBlock *succs[2];
+    int count = ir_successors(ir_block_terminator(block), succs);
+    for (int i = 0; i < count; i++) {
+      succs[i]->pred_count++;
+    }
+  }
+  for (IrBlock *block = func->first; block != NULL; block = block->next) {
+    block->preds = arena_alloc(arena, sizeof(IrBlock *) * block->pred_count);
+    block->pred_count = 0;
+  }
+  for (IrBlock *block = func->first; block != NULL; block = block->next) {
+    IrBlock *succs[2];
+    int count = ir_successors(ir_block_terminator(block), succs);
+    for (int i = 0; i < count; i++) {
+      IrBlock *succ = succs[i];
+      if (succ->pred_count > 0 && succ->preds[succ->pred_count - 1] == block) {
+        continue;
+      }
+      succ->preds[succ->pred_count++] = block;
+    }
+  }
+}
+
+// 从入口开始深度优先遍历，后序的逆序就是逆后序
+static void compute_rpo(IrFunction *func) {
+  int block_count = 0;
+  for (IrBlock *block = func->first; block != NULL; block = block->next) {
+    block->rpo = -1;
+    block_count++;
+  }
+  IrBlock **postorder = malloc(sizeof(IrBlock *) * (block_count + 1));
+  IrBlock **stack = malloc(sizeof(IrBlock *) * (block_count + 1));
+  int *next_succ = malloc(sizeof(int) * (block_count + 1));
+  int count = 0;
+  int depth = 0;
+  // 入栈时先用 rpo = 0 标记访问过，出栈时才知道真正的编号
+  func->first->rpo = 0;
+  stack[depth] = func->first;
+  next_succ[depth++] = 0;
+  while (depth > 0) {
+    IrBlock *block = stack[depth - 1];
+    IrBlock *succs[2];
+    int succ_count = ir_successors(ir_block_terminator(block), succs);
+    int i = next_succ[depth - 1]++;
+    if (i < succ_count) {
+      if (succs[i]->rpo < 0) {
+        succs[i]->rpo = 0;
+        stack[depth] = succs[i];
+        next_succ[depth++] = 0;
+      }
+      continue;
+    }
+    postorder[count++] = block;
+    depth--;
+  }
+  func->rpo_blocks = arena_alloc(&func->module->arena,
+                                 sizeof(IrBlock *) * (count + 1));
+  func->rpo_count = count;
+  for (int i = 0; i < count; i++) {
+    IrBlock *block = postorder[count - 1 - i];
+    block->rpo = i;
+    func->rpo_blocks[i] = block;
+  }
+  free(next_succ);
+  free(stack);
+  free(postorder);
+}
+
+static void compute_cfg(IrFunction *func) {
+  compute_preds(func);
+  compute_rpo(func);
+}
+
+// #endregion
+
+// #region 支配树
+
+static IrBlock *intersect(IrBlock *a, IrBlock *b) {
+  while (a != b) {
+    while (a->rpo > b->rpo) {
+      a = a->idom;
+    }
+    while (b->rpo > a->rpo) {
+      b = b->idom;
+    }
+  }
+  return a;
+}
+
+// 先序和后序编号，a 支配 b 当且仅当 b 的区间在 a 的区间里面
+static void number_dom_tree(IrFunction *func) {
+  IrBlock **stack = malloc(sizeof(IrBlock *) * (func->rpo_count + 1));
+  int *next_child = malloc(sizeof(int) * (func->rpo_count + 1));
+  int depth = 0;
+  int counter = 0;
+  stack[depth] = func->first;
+  next_child[depth++] = 0;
+  func->first->dom_pre = counter++;
+  while (depth > 0) {
+    IrBlock *block = stack[depth - 1];
+    int i = next_child[depth - 1]++;
+    if (i < block->dom_child_count) {
+      IrBlock *child = block->dom_children[i];
+      child->dom_pre = counter++;
+      stack[depth] = child;
+      next_child[depth++] = 0;
+      continue;
+    }
+    block->dom_post = counter++;
+    depth--;
+  }
+  free(next_child);
+  free(stack);
+}
+
+/*
+ * Cooper, Harvey, Kennedy: A Simple, Fast Dominance Algorithm
+ * 按逆后序反复用已经处理过的前驱求交，直到不再变化
+ */
+static void compute_dominators(IrFunction *func) {
+  for (IrBlock *block = func->first; block != NULL; block = block->next) {
+    block->idom = NULL;
+    block->dom_child_count = 0;
+  }
+  IrBlock *entry = func->first;
+  entry->idom = entry;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int i = 1; i < func->rpo_count; i++) {
+      IrBlock *block = func->rpo_blocks[i];
+      IrBlock *idom = NULL;
+      for (int j = 0; j < block->pred_count; j++) {
+        IrBlock *pred = block->preds[j];
+        if (pred->idom == NULL) {
+          continue;
+        }
+        idom = idom == NULL ? pred : intersect(pred, idom);
+      }
+      if (block->idom != idom) {
+        block->idom = idom;
+        changed = true;
+      }
+    }
+  }
+  entry->idom = NULL;
+
+  Arena *arena = &func->module->arena;
+  for (int i = 1; i < func->rpo_count; i++) {
+    func->rpo_blocks[i]->idom->dom_child_count++;
+  }
+  for (int i = 0; i < func->rpo_count; i++) {
+    IrBlock *block = func->rpo_blocks[i];
+    block->dom_children =
+        arena_alloc(arena, sizeof(IrBlock *) * block->dom_child_count);
+    block->dom_child_count = 0;
+  }
+  for (int i = 1; i < func->rpo_count; i++) {
+    IrBlock *block = func->rpo_blocks[i];
+    block->idom->dom_children[block->idom->dom_child_count++] = block;
+  }
+  number_dom_tree(func);
+}
+
+bool ir_dominates(const IrBlock *a, const IrBlock *b) {
+  assert(a->rpo >= 0 && b->rpo >= 0);
+  return a->dom_pre <= b->dom_pre && b->dom_post <= a->dom_post;
+}
+
+// #endregion
+
+void ir_require_analyses(IrFunction *func, unsigned analyses) {
+  assert(!ir_function_is_decl(func));
+  if (analyses & IR_ANALYSIS_DOMINATORS) {
+    analyses |= IR_ANALYSIS_CFG;
+  }
+  if ((analyses & IR_ANALYSIS_CFG) &&
+      !(func->valid_analyses & IR_ANALYSIS_CFG)) {
+    compute_cfg(func);
+    func->valid_analyses = IR_ANALYSIS_CFG;
+  }
+  if ((analyses & IR_ANALYSIS_DOMINATORS) &&
+      !(func->valid_analyses & IR_ANALYSIS_DOMINATORS)) {
+    compute_dominators(func);
+    func->valid_analyses |= IR_ANALYSIS_DOMINATORS;
+  }
+}
+
+// 默认的 pass 序列，按顺序运行
+static const IrPass default_passes[] = {
+    {"remove-unreachable-blocks", IR_ANALYSIS_CFG, 0,
+     ir_remove_unreachable_blocks},
+    {"mem2reg", IR_ANALYSIS_DOMINATORS,
+     IR_ANALYSIS_CFG | IR_ANALYSIS_DOMINATORS,
+     ir_promote_memory_to_registers},
+    {"dead-code-elimination", 0, IR_ANALYSIS_CFG | IR_ANALYSIS_DOMINATORS,
+     ir_eliminate_dead_code},
+};
+
+#define DEFAULT_PASS_COUNT (sizeof(default_passes) / sizeof(default_passes[0]))
+
+static void run_pass(const IrPass *pass, IrFunction *func, bool verify) {
+  ir_require_analyses(func, pass->requires);
+  if (pass->run(func)) {
+    func->valid_analyses &= pass->preserves;
+    if (verify) {
+      ir_verify_function(func);
+    }
+  }
+}
+
+void ir_run_passes(IrModule *module, bool verify_each) {
+  phase_begin(PHASE_IR_PASS);
+  for (int i = 0; i < module->func_count; i++) {
+    IrFunction *func = module->funcs[i];
+    if (ir_function_is_decl(func)) {
+      continue;
+    }
+    for (size_t j = 0; j < DEFAULT_PASS_COUNT; j++) {
+      run_pass(&default_passes[j], func, verify_each);
+    }
+  }
+  phase_end(PHASE_IR_PASS);
+}
@@ -0,0 +1,46 @@
+#ifndef SRC_PASS_H_
+#define SRC_PASS_H_
+
+#include <stdbool.h>
+
+#include "ir.h"
+
+/*
+ * IR 上的分析和变换
+ *
+ * 分析的结果保存在 IrBlock 和 IrFunction 上，
+ * IrFunction::valid_analyses 记录哪些结果当前有效。
+ * pass 管理器按固定的顺序对每个函数运行变换：
+ * 运行之前计算它需要的分析，修改了函数之后只保留它声明不受影响的分析。
+ * 分析的结果分配在模块的 arena 中，重新计算时旧的结果直接丢弃。
+ */
+
+typedef enum {
+  IR_ANALYSIS_CFG = 1 << 0,        // 前驱和逆后序
+  IR_ANALYSIS_DOMINATORS = 1 << 1, // 支配树，依赖 CFG
+} IrAnalysis;
+
+// 保证 analyses 中的分析有效，无效的（连同它依赖的）重新计算
+void ir_require_analyses(IrFunction *func, unsigned analyses);
+// a 支配 b ，需要支配树有效，两个块都可达
+bool ir_dominates(const IrBlock *a, const IrBlock *b);
+
+typedef struct {
+  const char *name;
+  unsigned requires;  // 运行之前需要的分析
+  unsigned preserves; // 修改了函数之后仍然有效的分析
+  // 返回是否修改了函数
+  bool (*run)(IrFunction *func);
+} IrPass;
+
+// 删除入口不可达的基本块
+bool ir_remove_unreachable_blocks(IrFunction *func);
+// 删除结果没有使用、也没有副作用的指令
+bool ir_eliminate_dead_code(IrFunction *func);
+// mem2reg：把地址没有逃逸的标量 alloc 换成 SSA 值和块参数
+bool ir_promote_memory_to_registers(IrFunction *func);
+
+// 对每个函数运行默认的 pass 序列，verify_each 为 true 时每个 pass 之后都验证
+void ir_run_passes(IrModule *module, bool verify_each);
+
+#endif // SRC_PASS_H_
@@ -0,0 +1,249 @@
+#include "pipeline.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "ast.h"
+#include "emit.h"
+#include "koopa_ir.h"
+#include "parse.h"
+#include "riscv_perf.h"
+#include "time_report.h"
+#include "utils.h"
+
+// 队列满时生产者等待，前端不会比后端领先太多
+#define QUEUE_CAPACITY 16
+
+// #region 有界队列
+
+typedef struct {
+  void *items[QUEUE_CAPACITY];
+  int head;
+  int count;
+  bool closed; // 生产者已经结束，不会再有新的元素
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+} BoundedQueue;
+
+static void queue_init(BoundedQueue *queue) {
+  queue->head = 0;
+  queue->count = 0;
+  queue->closed = false;
+  pthread_mutex_init(&queue->mutex, NULL);
+  pthread_cond_init(&queue->not_empty, NULL);
+  pthread_cond_init(&queue->not_full, NULL);
+}
+
+static void queue_destroy(BoundedQueue *queue) {
+  pthread_mutex_destroy(&queue->mutex);
+  pthread_cond_destroy(&queue->not_empty);
+  pthread_cond_destroy(&queue->not_full);
+}
+
+static void queue_push(BoundedQueue *queue, void *item) {
+  pthread_mutex_lock(&queue->mutex);
+  while (queue->count == QUEUE_CAPACITY) {
+    pthread_cond_wait(&queue->not_full, &queue->mutex);
+  }
+  queue->items[(queue->head + queue->count) % QUEUE_CAPACITY] = item;
+  queue->count++;
+  pthread_cond_signal(&queue->not_empty);
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+// 队列已经关闭并且取空时返回 NULL
+static void *queue_pop(BoundedQueue *queue) {
+  pthread_mutex_lock(&queue->mutex);
+  while (queue->count == 0 && !queue->closed) {
+    pthread_cond_wait(&queue->not_empty, &queue->mutex);
+  }
+  void *item = NULL;
+  if (queue->count > 0) {
+    item = queue->items[queue->head];
+    queue->head = (queue->head + 1) % QUEUE_CAPACITY;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+  }
+  pthread_mutex_unlock(&queue->mutex);
+  return item;
+}
+
+static void queue_close(BoundedQueue *queue) {
+  pthread_mutex_lock(&queue->mutex);
+  queue->closed = true;
+  pthread_cond_broadcast(&queue->not_empty);
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+// #endregion
+
+// 一个全局定义的 AST ，节点都分配在它自己的 arena 中
+typedef struct {
+  Arena arena;
+  AstBase *def;
+} ParsedDef;
+
+typedef struct {
+  CompileContext *ctx;
+  const char *input;
+  const char *output_file;
+  bool riscv;
+  BoundedQueue defs;   // 解析线程 -> IR 线程，ParsedDef
+  BoundedQueue chunks; // IR 线程 -> 输出线程，StringBuffer
+} Pipeline;
+
+static void *parse_stage(void *arg) {
+  Pipeline *pipeline = arg;
+  Parser parser;
+  parse_begin(&parser, pipeline->ctx, pipeline->input);
+  for (;;) {
+    ParsedDef *parsed = malloc(sizeof(ParsedDef));
+    if (parsed == NULL) {
+      fatalf("无法分配内存\n");
+    }
+    arena_init(&parsed->arena);
+    parsed->def = parse_next_def(&parser, &parsed->arena);
+    if (parsed->def == NULL) {
+      arena_release(&parsed->arena);
+      free(parsed);
+      break;
+    }
+    queue_push(&pipeline->defs, parsed);
+  }
+  queue_close(&pipeline->defs);
+  return NULL;
+}
+
+// #region 输出
+
+// -koopa 时片段直接写到文件，-perf 时交给 perf 后端生成汇编
+typedef struct {
+  bool riscv;
+  Emitter emitter;
+  PerfStream *stream;
+} Output;
+
+static void output_begin(Output *output, CompileContext *ctx,
+                         const char *output_file, bool riscv) {
+  output->riscv = riscv;
+  if (riscv) {
+    output->stream = riscv_perf_stream_begin(ctx, output_file);
+  } else {
+    emitter_open(&output->emitter, output_file);
+  }
+}
+
+static void output_chunk(Output *output, StringBuffer *chunk) {
+  if (chunk->size == 0) {
+    // 全局常量没有对应的 IR
+  } else if (output->riscv) {
+    riscv_perf_stream_chunk(output->stream, chunk->data);
+  } else {
+    emit_bytes(&output->emitter, chunk->data, chunk->size);
+  }
+}
+
+static void output_end(Output *output) {
+  if (output->riscv) {
+    riscv_perf_stream_end(output->stream);
+  } else {
+    emitter_close(&output->emitter);
+  }
+}
+
+// #endregion
+
+static void *output_stage(void *arg) {
+  Pipeline *pipeline = arg;
+  Output output;
+  output_begin(&output, pipeline->ctx, pipeline->output_file,
+               pipeline->riscv);
+  StringBuffer *chunk;
+  while ((chunk = queue_pop(&pipeline->chunks)) != NULL) {
+    output_chunk(&output, chunk);
+    string_buffer_free(chunk);
+    free(chunk);
+  }
+  output_end(&output);
+  return NULL;
+}
+
+static StringBuffer *new_chunk(void) {
+  StringBuffer *chunk = malloc(sizeof(StringBuffer));
+  if (chunk == NULL) {
+    fatalf("无法分配内存\n");
+  }
+  string_buffer_init(chunk);
+  return chunk;
+}
+
+void compile_stream(CompileContext *ctx, const char *input,
+                    const char *output_file, bool riscv) {
+  Pipeline pipeline = {ctx, input, output_file, riscv};
+  queue_init(&pipeline.defs);
+  queue_init(&pipeline.chunks);
+
+  // 运行时库的声明会驻留字符串，要在解析线程启动之前生成
+  KoopaGen gen;
+  StringBuffer *chunk = new_chunk();
+  koopa_ir_stream_begin(&gen, ctx, chunk);
+  queue_push(&pipeline.chunks, chunk);
+
+  pthread_t parser;
+  pthread_t writer;
+  if (pthread_create(&parser, NULL, parse_stage, &pipeline) != 0 ||
+      pthread_create(&writer, NULL, output_stage, &pipeline) != 0) {
+    fatalf("无法创建线程\n");
+  }
+
+  // 当前线程生成 IR
+  ParsedDef *parsed;
+  while ((parsed = queue_pop(&pipeline.defs)) != NULL) {
+    chunk = new_chunk();
+    // 常量折叠等会新建 AST 节点，和这个定义放在一起释放
+    koopa_ir_stream_def(&gen, parsed->def, &parsed->arena, chunk);
+    time_report_arena(&parsed->arena);
+    arena_release(&parsed->arena);
+    free(parsed);
+    queue_push(&pipeline.chunks, chunk);
+  }
+  koopa_ir_stream_end(&gen);
+  queue_close(&pipeline.chunks);
+
+  pthread_join(parser, NULL);
+  pthread_join(writer, NULL);
+  queue_destroy(&pipeline.defs);
+  queue_destroy(&pipeline.chunks);
+}
+
+void compile_function_at_a_time(CompileContext *ctx, const char *input,
+                                const char *output_file, bool riscv) {
+  Output output;
+  output_begin(&output, ctx, output_file, riscv);
+  KoopaGen gen;
+  StringBuffer chunk;
+  string_buffer_init(&chunk);
+  koopa_ir_stream_begin(&gen, ctx, &chunk);
+  output_chunk(&output, &chunk);
+
+  // 所有定义共用一个 arena ，每个定义处理完就清空，内存块留给下一个定义
+  Arena arena;
+  arena_init(&arena);
+  Parser parser;
+  parse_begin(&parser, ctx, input);
+  AstBase *def;
+  while ((def = parse_next_def(&parser, &arena)) != NULL) {
+    chunk.size = 0;
+    koopa_ir_stream_def(&gen, def, &arena, &chunk);
+    output_chunk(&output, &chunk);
+    arena_reset(&arena);
+  }
+  koopa_ir_stream_end(&gen);
+  time_report_arena(&arena);
+  arena_release(&arena);
+  string_buffer_free(&chunk);
+  output_end(&output);
+}
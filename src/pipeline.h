@@ -0,0 +1,26 @@
+#ifndef SRC_PIPELINE_H_
+#define SRC_PIPELINE_H_
+
+#include <stdbool.h>
+
+#include "context.h"
+
+/*
+ * 流式编译：解析、生成 IR 、生成汇编分别在三个线程中进行，
+ * 阶段之间通过有界队列逐个传递全局定义，
+ * 前端解析后面的函数时，后端已经在输出前面的函数。
+ * 每个定义的 AST 和 IR 用完就释放，内存占用只和单个定义的大小有关。
+ * riscv 为 false 时输出 Koopa IR ，为 true 时用 perf 后端输出汇编。
+ */
+void compile_stream(CompileContext *ctx, const char *input,
+                    const char *output_file, bool riscv);
+
+/*
+ * 和 compile_stream 的输出相同，但是全部在当前线程中进行：
+ * 解析一个全局定义，生成它的 IR 和汇编，释放它的 AST 之后再解析下一个。
+ * 同一时间只有一个定义留在内存里，峰值内存取决于最大的那个函数。
+ */
+void compile_function_at_a_time(CompileContext *ctx, const char *input,
+                                const char *output_file, bool riscv);
+
+#endif // SRC_PIPELINE_H_
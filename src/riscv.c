@@ -1,37 +1,22 @@
 #include "riscv.h"
 
 #include <assert.h>
+#include <setjmp.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "emit.h"
 #include "koopa.h"
+#include "riscv_slots.h"
+#include "time_report.h"
 #include "utils.h"
+#include "value_map.h"
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
-static FILE *fp;
-
-__attribute__((format(printf, 1, 2))) static void outputf(const char *fmt, ...);
-static void outputf(const char *fmt, ...) {
-  va_list args;
-  va_start(args, fmt);
-  // vprintf(fmt, args);
-  vfprintf(fp, fmt, args);
-  va_end(args);
-}
-
-// #region 辅助变量和函数
-
-// 函数返回时，需要恢复 sp ，所以需要记录栈的大小
-// 即生成 ret 指令时，需要将 sp 加上这个大小，恢复栈空间
-static size_t stack_size = 0;
-// 是否调用了其他函数，如果调用了，需要保存 ra
-// 寄存器； ret 指令时，需要恢复 ra 寄存器
-static bool has_call = false;
-
 typedef enum {
   VariableType_int,
   VariableType_array,
@@ -45,154 +30,194 @@ typedef struct Variable {
   int offset;
   int size; // 变量大小
   Variable *next;
-  int count; // 计数
+  int count;               // 计数
+  koopa_raw_value_t value; // 局部变量对应的 alloc 指令
 } Variable;
 
-static Variable globals = {NULL, VariableType_int, 0, 0, NULL, 0}; // 全局变量
-static Variable locals = {NULL, VariableType_int, 0, 0, NULL, 0}; // 局部变量
+typedef struct {
+  ValueMap depths; // 临时变量 -> 在表达式栈中的深度
+  int base_offset;
+  int max_depth;
+  int depth;
+} TempValueManager;
+
+// 生成汇编的状态，riscv_codegen_program 在栈上准备一个，传给下面所有的函数
+typedef struct {
+  Emitter *emitter;
+  // 函数返回时，需要恢复 sp ，所以需要记录栈的大小
+  // 即生成 ret 指令时，需要将 sp 加上这个大小，恢复栈空间
+  size_t stack_size;
+  // 是否调用了其他函数，如果调用了，需要保存 ra
+  // 寄存器； ret 指令时，需要恢复 ra 寄存器
+  bool has_call;
+  // 当前函数的名字（不含 @）
+  // Koopa IR 的基本块名只在函数内唯一，汇编里的标签要加上函数名作为前缀
+  const char *function_name;
+  // 当前基本块的名字，br 的两条边都有实参时用来生成中间的标签
+  const char *block_name;
+  // 全局变量
+  Variable globals;
+  // 局部变量
+  Variable locals;
+  // alloc 指令 -> 局部变量的栈偏移，偏移量全部确定之后由 locals_index 填充
+  ValueMap local_offsets;
+  TempValueManager tv_manager;
+  // SSA 形式的函数由 riscv_assign_value_slots 分配槽，
+  // 为 false 时是表达式栈分配的
+  bool has_value_slots;
+  ValueSlots value_slots;
+  ValueMap use_counts;
+} RiscvGen;
+
+__attribute__((format(printf, 2, 3))) static void
+outputf(RiscvGen *gen, const char *fmt, ...);
+static void outputf(RiscvGen *gen, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  emitter_vemitf(gen->emitter, fmt, args);
+  va_end(args);
+}
+
+// #region 辅助变量和函数
 
-static void new_global_variable(const char *name) {
+static void new_global_variable(RiscvGen *gen, const char *name) {
   assert(name != NULL);
   Variable *var = (Variable *)malloc(sizeof(Variable));
   var->name = name;
   var->offset = 0;
-  var->next = globals.next;
+  var->next = gen->globals.next;
   var->type = VariableType_int;
   var->size = 4;
-  globals.next = var;
-  globals.count++;
+  gen->globals.next = var;
+  gen->globals.count++;
 }
 
-static Variable *new_variable(const char *name) {
-  assert(name != NULL);
+static Variable *new_variable(RiscvGen *gen, koopa_raw_value_t value) {
+  assert(value->name != NULL);
   Variable *var = (Variable *)malloc(sizeof(Variable));
-  var->name = name;
-  var->offset =
-      locals.next == NULL ? 0 : locals.next->offset + locals.next->size;
-  var->next = locals.next;
+  var->name = value->name;
+  var->value = value;
+  Variable *last = gen->locals.next;
+  var->offset = last == NULL ? 0 : last->offset + last->size;
+  var->next = gen->locals.next;
   var->size = 4;
   var->type = VariableType_int;
-  locals.next = var;
-  locals.count++;
+  gen->locals.next = var;
+  gen->locals.count++;
   return var;
 }
 
 // 给所有局部变量的偏移量增加 offset
-static void locals_add_offset(int offset) {
-  Variable *var = locals.next;
+static void locals_add_offset(RiscvGen *gen, int offset) {
+  Variable *var = gen->locals.next;
   while (var != NULL) {
     var->offset += offset;
     var = var->next;
   }
 }
 
-static int get_offset(const char *name) {
-  Variable *var = locals.next;
-  while (var != NULL) {
-    if (strcmp(var->name, name) == 0) {
-      return var->offset;
-    }
-    var = var->next;
+static void locals_index(RiscvGen *gen) {
+  for (Variable *var = gen->locals.next; var != NULL; var = var->next) {
+    value_map_put(&gen->local_offsets, var->value, var->offset);
   }
-  fatalf("未找到变量 %s\n", name);
-  return -1;
 }
 
-static void locals_reset(void) {
-  Variable *var = locals.next;
+// alloc 是局部变量的 alloc 指令
+static int get_offset(RiscvGen *gen, koopa_raw_value_t alloc) {
+  int offset;
+  if (!value_map_get(&gen->local_offsets, alloc, &offset)) {
+    fatalf("未找到变量 %s\n", alloc->name);
+  }
+  return offset;
+}
+
+static void free_variables(Variable *head) {
+  Variable *var = head->next;
   while (var != NULL) {
     Variable *next = var->next;
     free(var);
     var = next;
   }
-  locals.next = NULL;
-  locals.count = 0;
+  head->next = NULL;
+  head->count = 0;
 }
 
-typedef struct {
-  koopa_raw_value_t value;
-  int depth;
-} TempValue;
-
-typedef struct {
-  TempValue *values;
-  size_t len;
-  size_t cap;
-  int base_offset;
-  int max_depth;
-  int depth;
-} TempValueManager;
-
-static TempValueManager tv_manager = {NULL, 0, 0, 0, 0, 0};
+static void locals_reset(RiscvGen *gen) {
+  free_variables(&gen->locals);
+  value_map_clear(&gen->local_offsets);
+}
 
-static void tv_manager_reinit(int base_offset) {
-  tv_manager.len = 0;
-  tv_manager.cap = 16;
-  tv_manager.max_depth = 0;
-  tv_manager.depth = 0;
-  tv_manager.base_offset = base_offset;
-  tv_manager.values = (TempValue *)realloc(tv_manager.values,
-                                           tv_manager.cap * sizeof(TempValue));
+static void tv_manager_reinit(RiscvGen *gen, int base_offset) {
+  value_map_clear(&gen->tv_manager.depths);
+  gen->tv_manager.max_depth = 0;
+  gen->tv_manager.depth = 0;
+  gen->tv_manager.base_offset = base_offset;
 }
 
-static void tv_manager_push(koopa_raw_value_t value) {
-  if (tv_manager.len >= tv_manager.cap) {
-    tv_manager.cap *= 2;
-    tv_manager.values = (TempValue *)realloc(
-        tv_manager.values, tv_manager.cap * sizeof(TempValue));
+static void tv_manager_push(RiscvGen *gen, koopa_raw_value_t value) {
+  int depth = gen->tv_manager.depth;
+  // 同一个值只记录第一次入栈的位置
+  int old_depth;
+  if (!value_map_get(&gen->tv_manager.depths, value, &old_depth)) {
+    value_map_put(&gen->tv_manager.depths, value, depth);
   }
-  int idx = tv_manager.len;
-  int depth = tv_manager.depth;
-  tv_manager.values[idx] = (TempValue){value, depth};
-  tv_manager.max_depth = MAX(tv_manager.max_depth, depth);
-  tv_manager.depth++;
-  tv_manager.len++;
+  gen->tv_manager.max_depth = MAX(gen->tv_manager.max_depth, depth);
+  gen->tv_manager.depth++;
 }
 
-static void tv_manager_pop(int n) {
-  tv_manager.depth -= n;
-  assert(tv_manager.depth >= 0);
+static void tv_manager_pop(RiscvGen *gen, int n) {
+  gen->tv_manager.depth -= n;
+  assert(gen->tv_manager.depth >= 0);
 }
 
-static int tv_manager_get_offset(koopa_raw_value_t value) {
-  for (size_t i = 0; i < tv_manager.len; i++) {
-    if (tv_manager.values[i].value == value) {
-      return tv_manager.base_offset + tv_manager.values[i].depth * 4;
-    }
+static int tv_manager_get_offset(RiscvGen *gen, koopa_raw_value_t value) {
+  int depth;
+  if (!value_map_get(&gen->tv_manager.depths, value, &depth)) {
+    return -1;
   }
-  return -1;
+  return gen->tv_manager.base_offset + depth * 4;
 }
 
-static int tv_manager_bget_offset(koopa_raw_value_t value) {
-  int offset = tv_manager_get_offset(value);
+static int tv_manager_bget_offset(RiscvGen *gen, koopa_raw_value_t value) {
+  int offset = tv_manager_get_offset(gen, value);
   assert(offset >= 0);
   return offset;
 }
 
-static int tv_manager_get_max_depth() { return tv_manager.max_depth; }
+static int tv_manager_get_max_depth(RiscvGen *gen) {
+  return gen->tv_manager.max_depth;
+}
+
+// 槽已经写在 tv_manager.depths 中，只需要设置基地址和大小
+static void tv_manager_use_slots(RiscvGen *gen, int base_offset,
+                                 int slot_count) {
+  gen->tv_manager.base_offset = base_offset;
+  gen->tv_manager.max_depth = slot_count;
+  gen->tv_manager.depth = 0;
+}
 
-static void store_to_stack(const char *src_register, int offset,
+static void store_to_stack(RiscvGen *gen, const char *src_register, int offset,
                            const char *temp_register) {
   if (offset < 0) {
     return;
   }
   if (offset >= 2048) {
-    outputf("  li %s, %d\n", temp_register, offset);
-    outputf("  add %s, sp, %s\n", temp_register, temp_register);
-    outputf("  sw %s, 0(%s)\n", src_register, temp_register);
+    outputf(gen, "  li %s, %d\n", temp_register, offset);
+    outputf(gen, "  add %s, sp, %s\n", temp_register, temp_register);
+    outputf(gen, "  sw %s, 0(%s)\n", src_register, temp_register);
   } else {
-    outputf("  sw %s, %d(sp)\n", src_register, offset);
+    outputf(gen, "  sw %s, %d(sp)\n", src_register, offset);
   }
 }
 
-static void load_from_stack(const char *dst_register, int offset,
+static void load_from_stack(RiscvGen *gen, const char *dst_register, int offset,
                             const char *temp_register) {
   if (offset >= 2048) {
-    outputf("  li %s, %d\n", temp_register, offset);
-    outputf("  add %s, sp, %s\n", temp_register, temp_register);
-    outputf("  lw %s, 0(%s)\n", dst_register, temp_register);
+    outputf(gen, "  li %s, %d\n", temp_register, offset);
+    outputf(gen, "  add %s, sp, %s\n", temp_register, temp_register);
+    outputf(gen, "  lw %s, 0(%s)\n", dst_register, temp_register);
   } else {
-    outputf("  lw %s, %d(sp)\n", dst_register, offset);
+    outputf(gen, "  lw %s, %d(sp)\n", dst_register, offset);
   }
 }
 
@@ -211,62 +236,75 @@ static int get_type_size(const koopa_raw_type_t ty) {
 // #endregion
 
 // #region visit IR 生成代码
-static void visit_koopa_raw_return(const koopa_raw_return_t ret);
-static void visit_koopa_raw_integer(const koopa_raw_integer_t n);
-static void visit_koopa_raw_value(const koopa_raw_value_t value);
-static void visit_koopa_raw_basic_block(const koopa_raw_basic_block_t block);
-static void visit_koopa_raw_function(const koopa_raw_function_t func);
-static void visit_koopa_raw_slice(const koopa_raw_slice_t slice);
-static void visit_koopa_raw_program(const koopa_raw_program_t program);
-static void visit_koopa_raw_binary(const koopa_raw_binary_t binary,
+static void visit_koopa_raw_return(RiscvGen *gen, const koopa_raw_return_t ret);
+static void visit_koopa_raw_integer(RiscvGen *gen, const koopa_raw_integer_t n);
+static void visit_koopa_raw_value(RiscvGen *gen, const koopa_raw_value_t value);
+static void visit_koopa_raw_basic_block(RiscvGen *gen,
+                                        const koopa_raw_basic_block_t block);
+static void visit_koopa_raw_function(RiscvGen *gen,
+                                     const koopa_raw_function_t func);
+static void visit_koopa_raw_slice(RiscvGen *gen, const koopa_raw_slice_t slice);
+static void visit_koopa_raw_program(RiscvGen *gen,
+                                    const koopa_raw_program_t program);
+static void visit_koopa_raw_binary(RiscvGen *gen,
+                                   const koopa_raw_binary_t binary,
                                    int tv_offset);
-static void visit_koopa_raw_branch(const koopa_raw_branch_t branch);
-static void visit_koopa_raw_jump(const koopa_raw_jump_t jump);
-static void visit_koopa_raw_call(const koopa_raw_call_t call, int tv_offset);
-static void visit_koopa_raw_global_alloc(const koopa_raw_global_alloc_t alloc,
+static void visit_koopa_raw_branch(RiscvGen *gen,
+                                   const koopa_raw_branch_t branch);
+static void visit_koopa_raw_jump(RiscvGen *gen, const koopa_raw_jump_t jump);
+static void visit_koopa_raw_call(RiscvGen *gen, const koopa_raw_call_t call,
+                                 int tv_offset);
+static void visit_koopa_raw_global_alloc(RiscvGen *gen,
+                                         const koopa_raw_global_alloc_t alloc,
                                          const char *name);
 static void
-visit_koopa_raw_get_elem_ptr(const koopa_raw_get_elem_ptr_t get_elem_ptr,
+visit_koopa_raw_get_elem_ptr(RiscvGen *gen,
+                             const koopa_raw_get_elem_ptr_t get_elem_ptr,
                              int tv_offset);
-static void visit_koopa_raw_get_ptr(const koopa_raw_get_ptr_t get_ptr,
+static void visit_koopa_raw_get_ptr(RiscvGen *gen,
+                                    const koopa_raw_get_ptr_t get_ptr,
                                     int tv_offset);
-static void visit_global_init(const koopa_raw_value_t init);
+static void visit_global_init(RiscvGen *gen, const koopa_raw_value_t init,
+                              int *zero_bytes);
 
-static void visit_koopa_raw_return(const koopa_raw_return_t ret) {
-  outputf("    # return\n");
+static void visit_koopa_raw_return(RiscvGen *gen,
+                                   const koopa_raw_return_t ret) {
+  outputf(gen, "    # return\n");
   if (ret.value) {
     if (ret.value->kind.tag == KOOPA_RVT_INTEGER) {
       // 如果返回值是常量，直接使用立即数
-      outputf("  li a0, %d\n", ret.value->kind.data.integer.value);
+      outputf(gen, "  li a0, %d\n", ret.value->kind.data.integer.value);
     } else {
       // 从栈中取出返回值
-      load_from_stack("a0", tv_manager_get_offset(ret.value), "t0");
+      load_from_stack(gen, "a0", tv_manager_get_offset(gen, ret.value), "t0");
     }
   }
-  if (has_call) {
+  if (gen->has_call) {
     // 如果调用了其他函数，需要恢复 ra 寄存器
-    int offset = stack_size - 4;
-    load_from_stack("ra", offset, "t0");
+    int offset = gen->stack_size - 4;
+    load_from_stack(gen, "ra", offset, "t0");
   }
 
   // 函数返回，恢复栈空间 epilogue
-  if (stack_size >= 2048) {
-    outputf("  li t0, %zu\n", stack_size);
-    outputf("  add sp, sp, t0\n");
+  if (gen->stack_size >= 2048) {
+    outputf(gen, "  li t0, %zu\n", gen->stack_size);
+    outputf(gen, "  add sp, sp, t0\n");
   } else {
-    outputf("  addi sp, sp, %zu\n", stack_size);
+    outputf(gen, "  addi sp, sp, %zu\n", gen->stack_size);
   }
-  outputf("  ret\n");
+  outputf(gen, "  ret\n");
 }
 
-static void visit_koopa_raw_integer(const koopa_raw_integer_t n) {
-  outputf("    # integer\n");
-  outputf("  li t0, %d\n", n.value);
+static void visit_koopa_raw_integer(RiscvGen *gen,
+                                    const koopa_raw_integer_t n) {
+  outputf(gen, "    # integer\n");
+  outputf(gen, "  li t0, %d\n", n.value);
 }
 
-static void visit_koopa_raw_binary(const koopa_raw_binary_t binary,
+static void visit_koopa_raw_binary(RiscvGen *gen,
+                                   const koopa_raw_binary_t binary,
                                    int tv_offset) {
-  outputf("    # binary %d ===\n", binary.op);
+  outputf(gen, "    # binary %d ===\n", binary.op);
   const char *lhs_register = "t0";
   if (binary.lhs->kind.tag == KOOPA_RVT_INTEGER) {
     if (binary.lhs->kind.data.integer.value == 0) {
@@ -274,11 +312,11 @@ static void visit_koopa_raw_binary(const koopa_raw_binary_t binary,
       lhs_register = "x0";
     } else {
       // 如果 lhs 是常量，直接使用立即数
-      outputf("  li t0, %d\n", binary.lhs->kind.data.integer.value);
+      outputf(gen, "  li t0, %d\n", binary.lhs->kind.data.integer.value);
     }
   } else {
     // 从栈中取出 lhs
-    load_from_stack("t0", tv_manager_get_offset(binary.lhs), "t0");
+    load_from_stack(gen, "t0", tv_manager_get_offset(gen, binary.lhs), "t0");
   }
 
   const char *rhs_register = "t1";
@@ -288,100 +326,115 @@ static void visit_koopa_raw_binary(const koopa_raw_binary_t binary,
       rhs_register = "x0";
     } else {
       // 如果 rhs 是常量，直接使用立即数
-      outputf("  li t1, %d\n", binary.rhs->kind.data.integer.value);
+      outputf(gen, "  li t1, %d\n", binary.rhs->kind.data.integer.value);
     }
   } else {
     // 从栈中取出 rhs
-    load_from_stack("t1", tv_manager_get_offset(binary.rhs), "t1");
+    load_from_stack(gen, "t1", tv_manager_get_offset(gen, binary.rhs), "t1");
   }
 
   // 目前所有变量都存储在栈上，所以这里可以直接使用 t0 作为结果寄存器
   const char *result_register = "t0";
   switch (binary.op) {
   case KOOPA_RBO_SUB:
-    outputf("  sub %s, %s, %s\n", result_register, lhs_register, rhs_register);
+    outputf(gen, "  sub %s, %s, %s\n", result_register, lhs_register,
+            rhs_register);
     break;
   case KOOPA_RBO_ADD:
-    outputf("  add %s, %s, %s\n", result_register, lhs_register, rhs_register);
+    outputf(gen, "  add %s, %s, %s\n", result_register, lhs_register,
+            rhs_register);
     break;
   case KOOPA_RBO_MUL:
-    outputf("  mul %s, %s, %s\n", result_register, lhs_register, rhs_register);
+    outputf(gen, "  mul %s, %s, %s\n", result_register, lhs_register,
+            rhs_register);
     break;
   case KOOPA_RBO_DIV:
-    outputf("  div %s, %s, %s\n", result_register, lhs_register, rhs_register);
+    outputf(gen, "  div %s, %s, %s\n", result_register, lhs_register,
+            rhs_register);
     break;
   case KOOPA_RBO_MOD:
-    outputf("  rem %s, %s, %s\n", result_register, lhs_register, rhs_register);
+    outputf(gen, "  rem %s, %s, %s\n", result_register, lhs_register,
+            rhs_register);
     break;
   case KOOPA_RBO_EQ: {
-    outputf("  xor %s, %s, %s\n", result_register, lhs_register, rhs_register);
-    outputf("  seqz %s, %s\n", result_register, result_register);
+    outputf(gen, "  xor %s, %s, %s\n", result_register, lhs_register,
+            rhs_register);
+    outputf(gen, "  seqz %s, %s\n", result_register, result_register);
     break;
   }
   case KOOPA_RBO_NOT_EQ: {
-    outputf("  xor %s, %s, %s\n", result_register, lhs_register, rhs_register);
-    outputf("  snez %s, %s\n", result_register, result_register);
+    outputf(gen, "  xor %s, %s, %s\n", result_register, lhs_register,
+            rhs_register);
+    outputf(gen, "  snez %s, %s\n", result_register, result_register);
     break;
   }
   case KOOPA_RBO_LT: {
-    outputf("  slt %s, %s, %s\n", result_register, lhs_register, rhs_register);
+    outputf(gen, "  slt %s, %s, %s\n", result_register, lhs_register,
+            rhs_register);
     break;
   }
   case KOOPA_RBO_LE: {
-    outputf("  slt %s, %s, %s\n", result_register, rhs_register, lhs_register);
-    outputf("  xori %s, %s, 1\n", result_register, result_register);
+    outputf(gen, "  slt %s, %s, %s\n", result_register, rhs_register,
+            lhs_register);
+    outputf(gen, "  xori %s, %s, 1\n", result_register, result_register);
     break;
   }
   case KOOPA_RBO_GT: {
-    outputf("  slt %s, %s, %s\n", result_register, rhs_register, lhs_register);
+    outputf(gen, "  slt %s, %s, %s\n", result_register, rhs_register,
+            lhs_register);
     break;
   }
   case KOOPA_RBO_GE: {
-    outputf("  slt %s, %s, %s\n", result_register, lhs_register, rhs_register);
-    outputf("  xori %s, %s, 1\n", result_register, result_register);
+    outputf(gen, "  slt %s, %s, %s\n", result_register, lhs_register,
+            rhs_register);
+    outputf(gen, "  xori %s, %s, 1\n", result_register, result_register);
     break;
   }
   case KOOPA_RBO_AND:
-    outputf("  and %s, %s, %s\n", result_register, lhs_register, rhs_register);
+    outputf(gen, "  and %s, %s, %s\n", result_register, lhs_register,
+            rhs_register);
     break;
   case KOOPA_RBO_OR:
-    outputf("  or %s, %s, %s\n", result_register, lhs_register, rhs_register);
+    outputf(gen, "  or %s, %s, %s\n", result_register, lhs_register,
+            rhs_register);
     break;
   default:
     fatalf("visit_koopa_raw_binary unknown op: %d\n", binary.op);
   }
   // 将结果存储到栈上
   if (tv_offset >= 0) {
-    store_to_stack(result_register, tv_offset, "t1");
+    store_to_stack(gen, result_register, tv_offset, "t1");
   }
 }
 
-static void visit_koopa_raw_load(const koopa_raw_load_t load, int tv_offset) {
+static void visit_koopa_raw_load(RiscvGen *gen, const koopa_raw_load_t load,
+                                 int tv_offset) {
   if (load.src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
-    outputf("    # load %s\n", load.src->name);
-    outputf("  la t0, %s\n", load.src->name + 1);
-    outputf("  lw t0, 0(t0)\n");
-    store_to_stack("t0", tv_offset, "t1");
+    outputf(gen, "    # load %s\n", load.src->name);
+    outputf(gen, "  la t0, %s\n", load.src->name + 1);
+    outputf(gen, "  lw t0, 0(t0)\n");
+    store_to_stack(gen, "t0", tv_offset, "t1");
   } else if (load.src->kind.tag == KOOPA_RVT_ALLOC) {
-    outputf("    # load %s\n", load.src->name);
-    int offset = get_offset(load.src->name);
-    load_from_stack("t0", offset, "t0");
-    store_to_stack("t0", tv_offset, "t1");
+    outputf(gen, "    # load %s\n", load.src->name);
+    int offset = get_offset(gen, load.src);
+    load_from_stack(gen, "t0", offset, "t0");
+    store_to_stack(gen, "t0", tv_offset, "t1");
   } else if (load.src->kind.tag == KOOPA_RVT_GET_ELEM_PTR ||
              load.src->kind.tag == KOOPA_RVT_GET_PTR) {
-    outputf("    # load %%xxx\n");
+    outputf(gen, "    # load %%xxx\n");
     // 将值加载到 t0
-    load_from_stack("t0", tv_manager_bget_offset(load.src), "t0");
+    load_from_stack(gen, "t0", tv_manager_bget_offset(gen, load.src), "t0");
     // t0 存的是地址，需要再取一次
-    outputf("  lw t0, 0(t0)\n");
-    store_to_stack("t0", tv_offset, "t1");
+    outputf(gen, "  lw t0, 0(t0)\n");
+    store_to_stack(gen, "t0", tv_offset, "t1");
   } else {
     fatalf("visit_koopa_raw_load unknown src kind: %d\n", load.src->kind.tag);
   }
 }
 
-static void visit_koopa_raw_store(const koopa_raw_store_t store) {
-  outputf("    # store\n");
+static void visit_koopa_raw_store(RiscvGen *gen,
+                                  const koopa_raw_store_t store) {
+  outputf(gen, "    # store\n");
   if (store.dest->kind.tag == KOOPA_RVT_ALLOC ||
       store.dest->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
     char src_reg[3] = {'t', '0', '\0'};
@@ -395,74 +448,138 @@ static void visit_koopa_raw_store(const koopa_raw_store_t store) {
         // 参数在栈上
         src_reg[0] = 't';
         src_reg[1] = '0';
-        int offset = (int)stack_size + (index - 8) * 4;
-        load_from_stack(src_reg, offset, src_reg);
+        int offset = (int)gen->stack_size + (index - 8) * 4;
+        load_from_stack(gen, src_reg, offset, src_reg);
       }
     } else {
       if (store.value->kind.tag == KOOPA_RVT_INTEGER) {
         // 如果保存的值是常量，直接使用立即数
-        outputf("  li %s, %d\n", src_reg, store.value->kind.data.integer.value);
+        outputf(gen, "  li %s, %d\n", src_reg,
+                store.value->kind.data.integer.value);
       } else {
         // 从栈中取出值到 t0
-        load_from_stack(src_reg, tv_manager_bget_offset(store.value), src_reg);
+        load_from_stack(gen, src_reg, tv_manager_bget_offset(gen, store.value),
+                        src_reg);
       }
     }
     if (store.dest->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
-      outputf("  la t1, %s\n", store.dest->name + 1);
-      outputf("  sw %s, 0(t1)\n", src_reg);
+      outputf(gen, "  la t1, %s\n", store.dest->name + 1);
+      outputf(gen, "  sw %s, 0(t1)\n", src_reg);
     } else {
-      int offset = get_offset(store.dest->name);
-      store_to_stack(src_reg, offset, "t1");
+      int offset = get_offset(gen, store.dest);
+      store_to_stack(gen, src_reg, offset, "t1");
     }
   } else if (store.dest->kind.tag == KOOPA_RVT_GET_ELEM_PTR ||
-             store.dest->kind.tag == KOOPA_RVT_GET_PTR) {
+             store.dest->kind.tag == KOOPA_RVT_GET_PTR ||
+             store.dest->kind.tag == KOOPA_RVT_LOAD ||
+             store.dest->kind.tag == KOOPA_RVT_BLOCK_ARG_REF ||
+             store.dest->kind.tag == KOOPA_RVT_FUNC_ARG_REF) {
+    // 地址是临时值，load 出来的是局部数组清零循环中的指针，
+    // mem2reg 之后这个指针是块参数
     if (store.value->kind.tag == KOOPA_RVT_INTEGER) {
       // 如果保存的值是常量，直接使用立即数
-      outputf("  li t0, %d\n", store.value->kind.data.integer.value);
+      outputf(gen, "  li t0, %d\n", store.value->kind.data.integer.value);
     } else {
       // 从栈中取出值
-      load_from_stack("t0", tv_manager_bget_offset(store.value), "t0");
+      load_from_stack(gen, "t0", tv_manager_bget_offset(gen, store.value),
+                      "t0");
     }
     // 从栈中取出地址
-    load_from_stack("t1", tv_manager_bget_offset(store.dest), "t1");
+    load_from_stack(gen, "t1", tv_manager_bget_offset(gen, store.dest), "t1");
     // 将值保存到对应地址中
-    outputf("  sw t0, 0(t1)\n");
+    outputf(gen, "  sw t0, 0(t1)\n");
   } else {
     fatalf("visit_koopa_raw_store unknown dest kind: %d\n",
            store.dest->kind.tag);
   }
 }
 
-static void visit_koopa_raw_branch(const koopa_raw_branch_t branch) {
-  outputf("    # br xx, %s, %s\n", branch.true_bb->name, branch.false_bb->name);
+// 把值读到寄存器 reg 中
+static void load_operand(RiscvGen *gen, const char *reg,
+                         const koopa_raw_value_t value) {
+  if (value->kind.tag == KOOPA_RVT_INTEGER) {
+    outputf(gen, "  li %s, %d\n", reg, value->kind.data.integer.value);
+  } else {
+    load_from_stack(gen, reg, tv_manager_bget_offset(gen, value), reg);
+  }
+}
+
+// 把跳转的实参复制到目标块参数的槽中
+static void copy_block_args(RiscvGen *gen, const koopa_raw_slice_t args,
+                            const koopa_raw_basic_block_t target) {
+  // 实参是目标块前面的参数时，先复制到中转的槽，避免读到覆盖之后的值
+  bool overlap = riscv_block_args_overlap(args, target);
+  int scratch_offset =
+      gen->tv_manager.base_offset + gen->value_slots.scratch_slot * 4;
+  for (size_t i = 0; i < args.len; i++) {
+    load_operand(gen, "t0", args.buffer[i]);
+    int offset = overlap ? scratch_offset + (int)i * 4
+                         : tv_manager_bget_offset(gen,
+                                                  target->params.buffer[i]);
+    store_to_stack(gen, "t0", offset, "t1");
+  }
+  for (size_t i = 0; overlap && i < args.len; i++) {
+    load_from_stack(gen, "t0", scratch_offset + (int)i * 4, "t0");
+    store_to_stack(gen, "t0",
+                   tv_manager_bget_offset(gen, target->params.buffer[i]), "t1");
+  }
+}
+
+static void visit_koopa_raw_branch(RiscvGen *gen,
+                                   const koopa_raw_branch_t branch) {
+  outputf(gen, "    # br xx, %s, %s\n", branch.true_bb->name,
+          branch.false_bb->name);
   if (branch.cond->kind.tag == KOOPA_RVT_INTEGER) {
-    outputf("  li t0, %d\n", branch.cond->kind.data.integer.value);
+    outputf(gen, "  li t0, %d\n", branch.cond->kind.data.integer.value);
   } else {
     // 从栈中取出值到 t0
-    load_from_stack("t0", tv_manager_bget_offset(branch.cond), "t0");
+    load_from_stack(gen, "t0", tv_manager_bget_offset(gen, branch.cond), "t0");
   }
   // +1 是为了跳过基本块名前的 %
-  outputf("  bnez t0, %s\n", branch.true_bb->name + 1);
-  outputf("  j %s\n", branch.false_bb->name + 1);
+  if (branch.true_args.len == 0) {
+    outputf(gen, "  bnez t0, %s.%s\n", gen->function_name,
+            branch.true_bb->name + 1);
+    copy_block_args(gen, branch.false_args, branch.false_bb);
+    outputf(gen, "  j %s.%s\n", gen->function_name, branch.false_bb->name + 1);
+    return;
+  }
+  // 真分支的边上有实参，条件不成立时跳过复制
+  if (branch.false_args.len == 0) {
+    outputf(gen, "  beqz t0, %s.%s\n", gen->function_name,
+            branch.false_bb->name + 1);
+  } else {
+    outputf(gen, "  beqz t0, %s.%s.false\n", gen->function_name,
+            gen->block_name + 1);
+  }
+  copy_block_args(gen, branch.true_args, branch.true_bb);
+  outputf(gen, "  j %s.%s\n", gen->function_name, branch.true_bb->name + 1);
+  if (branch.false_args.len > 0) {
+    // 块名中没有 . ，这个标签不会和基本块的标签重复
+    outputf(gen, "%s.%s.false:\n", gen->function_name, gen->block_name + 1);
+    copy_block_args(gen, branch.false_args, branch.false_bb);
+    outputf(gen, "  j %s.%s\n", gen->function_name, branch.false_bb->name + 1);
+  }
 }
 
-static void visit_koopa_raw_jump(const koopa_raw_jump_t jump) {
-  outputf("    # jump %s\n", jump.target->name);
-  outputf("  j %s\n", jump.target->name + 1);
+static void visit_koopa_raw_jump(RiscvGen *gen, const koopa_raw_jump_t jump) {
+  outputf(gen, "    # jump %s\n", jump.target->name);
+  copy_block_args(gen, jump.args, jump.target);
+  outputf(gen, "  j %s.%s\n", gen->function_name, jump.target->name + 1);
 }
 
-static void visit_koopa_raw_call(const koopa_raw_call_t call, int tv_offset) {
-  outputf("    # call %s\n", call.callee->name);
+static void visit_koopa_raw_call(RiscvGen *gen, const koopa_raw_call_t call,
+                                 int tv_offset) {
+  outputf(gen, "    # call %s\n", call.callee->name);
   // 参数传递
   for (int i = 0; i < 8 && i < call.args.len; i++) {
     const koopa_raw_value_t arg = call.args.buffer[i];
     if (arg->kind.tag == KOOPA_RVT_INTEGER) {
       // 参数是常量，直接使用立即数
-      outputf("  li a%d, %d\n", i, arg->kind.data.integer.value);
+      outputf(gen, "  li a%d, %d\n", i, arg->kind.data.integer.value);
     } else {
-      int offset = tv_manager_bget_offset(arg);
+      int offset = tv_manager_bget_offset(gen, arg);
       char dst_reg[3] = {'a', '0' + i, '\0'};
-      load_from_stack(dst_reg, offset, "t0");
+      load_from_stack(gen, dst_reg, offset, "t0");
     }
   }
   // 如果参数个数大于 8，需要额外的栈空间保存参数
@@ -470,72 +587,112 @@ static void visit_koopa_raw_call(const koopa_raw_call_t call, int tv_offset) {
     const koopa_raw_value_t arg = call.args.buffer[i];
     if (arg->kind.tag == KOOPA_RVT_INTEGER) {
       // 参数是常量，直接使用立即数
-      outputf("  li t0, %d\n", arg->kind.data.integer.value);
+      outputf(gen, "  li t0, %d\n", arg->kind.data.integer.value);
     } else {
-      int offset = tv_manager_bget_offset(arg);
-      load_from_stack("t0", offset, "t0");
+      int offset = tv_manager_bget_offset(gen, arg);
+      load_from_stack(gen, "t0", offset, "t0");
     }
     int offset = (i - 8) * 4;
-    store_to_stack("t0", offset, "t1");
+    store_to_stack(gen, "t0", offset, "t1");
   }
 
   // 调用函数
-  outputf("  call %s\n", call.callee->name + 1); // + 1 是为了跳过函数名前的 @
+  outputf(gen, "  call %s\n", call.callee->name + 1); // + 1 是为了跳过函数名前的 @
   if (tv_offset >= 0) {
     // 保存返回值
-    store_to_stack("a0", tv_offset, "t0");
-    // outputf("  mv t0, a0\n");
+    store_to_stack(gen, "a0", tv_offset, "t0");
+    // outputf(gen, "  mv t0, a0\n");
   }
 }
 
-static void visit_global_init(const koopa_raw_value_t init) {
+// 所有元素都是 0 的初始值，这样的全局变量放到 .bss 段
+static bool is_zero_global_init(const koopa_raw_value_t init) {
   if (init->kind.tag == KOOPA_RVT_INTEGER) {
-    outputf("  .word %d\n", init->kind.data.integer.value);
+    return init->kind.data.integer.value == 0;
+  } else if (init->kind.tag == KOOPA_RVT_AGGREGATE) {
+    for (size_t i = 0; i < init->kind.data.aggregate.elems.len; i++) {
+      if (!is_zero_global_init(init->kind.data.aggregate.elems.buffer[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return init->kind.tag == KOOPA_RVT_ZERO_INIT;
+}
+
+static void flush_global_zeros(RiscvGen *gen, int *zero_bytes) {
+  if (*zero_bytes > 0) {
+    outputf(gen, "  .zero %d\n", *zero_bytes);
+    *zero_bytes = 0;
+  }
+}
+
+// 连续的 0 累加到 *zero_bytes ，碰到非 0 的值时合并成一条 .zero
+static void visit_global_init(RiscvGen *gen, const koopa_raw_value_t init,
+                              int *zero_bytes) {
+  if (init->kind.tag == KOOPA_RVT_INTEGER) {
+    if (init->kind.data.integer.value == 0) {
+      *zero_bytes += 4;
+    } else {
+      flush_global_zeros(gen, zero_bytes);
+      outputf(gen, "  .word %d\n", init->kind.data.integer.value);
+    }
   } else if (init->kind.tag == KOOPA_RVT_AGGREGATE) {
     for (size_t i = 0; i < init->kind.data.aggregate.elems.len; i++) {
       const koopa_raw_value_t elem = init->kind.data.aggregate.elems.buffer[i];
-      visit_global_init(elem);
+      visit_global_init(gen, elem, zero_bytes);
     }
   } else if (init->kind.tag == KOOPA_RVT_ZERO_INIT) {
-    int size = get_type_size(init->ty);
-    for (size_t i = 0; i < (size / 4); i++) {
-      outputf("  .zero 4\n");
-    }
+    *zero_bytes += get_type_size(init->ty);
   } else {
     fatalf("viist_global_init unknown kind: %d\n", init->kind.tag);
   }
 }
 
-static void visit_koopa_raw_global_alloc(const koopa_raw_global_alloc_t alloc,
+static void visit_koopa_raw_global_alloc(RiscvGen *gen,
+                                         const koopa_raw_global_alloc_t alloc,
                                          const char *name) {
-  new_global_variable(name);
-  outputf("\n");
-  outputf("  .global %s\n", name + 1);
-  outputf("%s:\n", name + 1);
-  visit_global_init(alloc.init);
+  new_global_variable(gen, name);
+  bool zero = is_zero_global_init(alloc.init);
+  outputf(gen, "\n");
+  if (zero) {
+    // 全局变量都在 .data 段中输出，放到 .bss 之后再切换回来
+    outputf(gen, "  .bss\n");
+  }
+  outputf(gen, "  .global %s\n", name + 1);
+  outputf(gen, "%s:\n", name + 1);
+  int zero_bytes = 0;
+  visit_global_init(gen, alloc.init, &zero_bytes);
+  flush_global_zeros(gen, &zero_bytes);
+  if (zero) {
+    outputf(gen, "  .data\n");
+  }
 }
 
-static void visit_koopa_raw_get_elem_ptr(const koopa_raw_get_elem_ptr_t gep,
+static void visit_koopa_raw_get_elem_ptr(RiscvGen *gen,
+                                         const koopa_raw_get_elem_ptr_t gep,
                                          int tv_offset) {
-  outputf("    # get_elem_ptr\n");
+  outputf(gen, "    # get_elem_ptr\n");
   if (gep.src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
     // src type: *[t, len]
     // getelemptr = src + sizeof(t) * index
     // 全局变量
     const char *index_reg = "t0";
     if (gep.index->kind.tag == KOOPA_RVT_INTEGER) {
-      outputf("  li %s, %d\n", index_reg, gep.index->kind.data.integer.value);
+      outputf(gen, "  li %s, %d\n", index_reg,
+              gep.index->kind.data.integer.value);
     } else {
-      load_from_stack(index_reg, tv_manager_bget_offset(gep.index), index_reg);
+      load_from_stack(gen, index_reg, tv_manager_bget_offset(gen, gep.index),
+                      index_reg);
     }
     // 计算 sizeof(t)
     int size = get_type_size(gep.src->ty->data.pointer.base->data.array.base);
-    outputf("  li t1, %d\n", size);
-    outputf("  mul t1, %s, t1\n", index_reg);
+    outputf(gen, "  li t1, %d\n", size);
+    outputf(gen, "  mul t1, %s, t1\n", index_reg);
     // 加载全局变量地址到 t0
-    outputf("  la t0, %s\n", gep.src->name + 1);
-    outputf("  add t0, t0, t1\n");
-    store_to_stack("t0", tv_offset, "t1");
+    outputf(gen, "  la t0, %s\n", gep.src->name + 1);
+    outputf(gen, "  add t0, t0, t1\n");
+    store_to_stack(gen, "t0", tv_offset, "t1");
   } else if (gep.src->kind.tag == KOOPA_RVT_ALLOC) {
     // src type: *[t, len]
     // getelemptr = src + sizeof(t) * index
@@ -545,24 +702,26 @@ static void visit_koopa_raw_get_elem_ptr(const koopa_raw_get_elem_ptr_t gep,
     // 加载索引到 t1
     const char *index_reg = "t0";
     if (gep.index->kind.tag == KOOPA_RVT_INTEGER) {
-      outputf("  li %s, %d\n", index_reg, gep.index->kind.data.integer.value);
+      outputf(gen, "  li %s, %d\n", index_reg,
+              gep.index->kind.data.integer.value);
     } else {
-      load_from_stack(index_reg, tv_manager_bget_offset(gep.index), index_reg);
+      load_from_stack(gen, index_reg, tv_manager_bget_offset(gen, gep.index),
+                      index_reg);
     }
     // 计算 sizeof(t) * index
     int size = get_type_size(gep.src->ty->data.pointer.base->data.array.base);
-    outputf("  li t1, %d\n", size);
-    outputf("  mul t1, %s, t1\n", index_reg);
+    outputf(gen, "  li t1, %d\n", size);
+    outputf(gen, "  mul t1, %s, t1\n", index_reg);
     // 加载变量地址到 t0
-    int offset = get_offset(gep.src->name);
+    int offset = get_offset(gen, gep.src);
     if (offset <= 2048) {
-      outputf("  addi t0, sp, %d\n", offset);
+      outputf(gen, "  addi t0, sp, %d\n", offset);
     } else {
-      outputf("  li t0, %d\n", offset);
-      outputf("  add t0, sp, t0\n");
+      outputf(gen, "  li t0, %d\n", offset);
+      outputf(gen, "  add t0, sp, t0\n");
     }
-    outputf("  add t0, t0, t1\n");
-    store_to_stack("t0", tv_offset, "t1");
+    outputf(gen, "  add t0, t0, t1\n");
+    store_to_stack(gen, "t0", tv_offset, "t1");
   } else if (gep.src->kind.tag == KOOPA_RVT_GET_ELEM_PTR ||
              gep.src->kind.tag == KOOPA_RVT_GET_PTR) {
     // src type: *[t, len]
@@ -572,101 +731,124 @@ static void visit_koopa_raw_get_elem_ptr(const koopa_raw_get_elem_ptr_t gep,
     // 加载索引到 t1
     const char *index_reg = "t0";
     if (gep.index->kind.tag == KOOPA_RVT_INTEGER) {
-      outputf("  li %s, %d\n", index_reg, gep.index->kind.data.integer.value);
+      outputf(gen, "  li %s, %d\n", index_reg,
+              gep.index->kind.data.integer.value);
     } else {
-      load_from_stack(index_reg, tv_manager_bget_offset(gep.index), index_reg);
+      load_from_stack(gen, index_reg, tv_manager_bget_offset(gen, gep.index),
+                      index_reg);
     }
     // 计算 sizeof(t) * index
     int size = get_type_size(gep.src->ty->data.pointer.base->data.array.base);
-    outputf("  li t1, %d\n", size);
-    outputf("  mul t1, %s, t1\n", index_reg);
+    outputf(gen, "  li t1, %d\n", size);
+    outputf(gen, "  mul t1, %s, t1\n", index_reg);
     // 加载地址到 t0
     const char *addr_reg = "t0";
-    load_from_stack(addr_reg, tv_manager_bget_offset(gep.src), addr_reg);
-    outputf("  add t0, %s, t1\n", addr_reg);
-    store_to_stack("t0", tv_offset, "t1");
+    load_from_stack(gen, addr_reg, tv_manager_bget_offset(gen, gep.src),
+                    addr_reg);
+    outputf(gen, "  add t0, %s, t1\n", addr_reg);
+    store_to_stack(gen, "t0", tv_offset, "t1");
   } else {
     fatalf("visit_koopa_raw_get_elem_ptr unknown src kind: %d\n",
            gep.src->kind.tag);
   }
 }
 
-static void visit_koopa_raw_get_ptr(const koopa_raw_get_ptr_t get_ptr,
+static void visit_koopa_raw_get_ptr(RiscvGen *gen,
+                                    const koopa_raw_get_ptr_t get_ptr,
                                     int tv_offset) {
   // get_ptr = src + sizeof(t) * index
-  outputf("    # get_ptr\n");
+  outputf(gen, "    # get_ptr\n");
+  int size = get_type_size(get_ptr.src->ty->data.pointer.base);
+  if (get_ptr.index->kind.tag == KOOPA_RVT_INTEGER) {
+    // 下标是常量，直接加上偏移
+    int offset = size * get_ptr.index->kind.data.integer.value;
+    load_from_stack(gen, "t0", tv_manager_bget_offset(gen, get_ptr.src), "t0");
+    if (offset >= -2048 && offset < 2048) {
+      outputf(gen, "  addi t0, t0, %d\n", offset);
+    } else {
+      outputf(gen, "  li t1, %d\n", offset);
+      outputf(gen, "  add t0, t0, t1\n");
+    }
+    store_to_stack(gen, "t0", tv_offset, "t1");
+    return;
+  }
   // 加载索引到 t0
   const char *index_reg = "t0";
   if (get_ptr.index->kind.tag == KOOPA_RVT_INTEGER) {
-    outputf("  li %s, %d\n", index_reg, get_ptr.index->kind.data.integer.value);
+    outputf(gen, "  li %s, %d\n", index_reg,
+            get_ptr.index->kind.data.integer.value);
   } else {
-    load_from_stack(index_reg, tv_manager_bget_offset(get_ptr.index),
+    load_from_stack(gen, index_reg, tv_manager_bget_offset(gen, get_ptr.index),
                     index_reg);
   }
   // 计算 sizeof(t)
-  int size = get_type_size(get_ptr.src->ty->data.pointer.base);
-  outputf("  li t1, %d\n", size);
-  outputf("  mul t1, %s, t1\n", index_reg);
+  outputf(gen, "  li t1, %d\n", size);
+  outputf(gen, "  mul t1, %s, t1\n", index_reg);
   // 加载地址到 t0
   const char *addr_reg = "t0";
-  load_from_stack(addr_reg, tv_manager_bget_offset(get_ptr.src), addr_reg);
-  outputf("  add t0, %s, t1\n", addr_reg);
-  store_to_stack("t0", tv_offset, "t1");
+  load_from_stack(gen, addr_reg, tv_manager_bget_offset(gen, get_ptr.src),
+                  addr_reg);
+  outputf(gen, "  add t0, %s, t1\n", addr_reg);
+  store_to_stack(gen, "t0", tv_offset, "t1");
 }
 
-static void visit_koopa_raw_value(const koopa_raw_value_t value) {
+static void visit_koopa_raw_value(RiscvGen *gen,
+                                  const koopa_raw_value_t value) {
   koopa_raw_value_kind_t kind = value->kind;
-  int tv_offset = tv_manager_get_offset(value);
+  int tv_offset = tv_manager_get_offset(gen, value);
   switch (kind.tag) {
   case KOOPA_RVT_RETURN:
-    visit_koopa_raw_return(kind.data.ret);
+    visit_koopa_raw_return(gen, kind.data.ret);
     break;
   case KOOPA_RVT_INTEGER:
-    visit_koopa_raw_integer(kind.data.integer);
+    visit_koopa_raw_integer(gen, kind.data.integer);
     break;
   case KOOPA_RVT_BINARY:
-    visit_koopa_raw_binary(kind.data.binary, tv_offset);
+    visit_koopa_raw_binary(gen, kind.data.binary, tv_offset);
     break;
   case KOOPA_RVT_LOAD:
-    visit_koopa_raw_load(kind.data.load, tv_offset);
+    visit_koopa_raw_load(gen, kind.data.load, tv_offset);
     break;
   case KOOPA_RVT_STORE:
-    visit_koopa_raw_store(kind.data.store);
+    visit_koopa_raw_store(gen, kind.data.store);
     break;
   case KOOPA_RVT_ALLOC:
     // 分配局部变量
     // nothing to do
-    outputf("    # alloc %s\n", value->name);
+    outputf(gen, "    # alloc %s\n", value->name);
     break;
   case KOOPA_RVT_BRANCH:
-    visit_koopa_raw_branch(kind.data.branch);
+    visit_koopa_raw_branch(gen, kind.data.branch);
     break;
   case KOOPA_RVT_JUMP:
-    visit_koopa_raw_jump(kind.data.jump);
+    visit_koopa_raw_jump(gen, kind.data.jump);
     break;
   case KOOPA_RVT_CALL:
-    visit_koopa_raw_call(kind.data.call, tv_offset);
+    visit_koopa_raw_call(gen, kind.data.call, tv_offset);
     break;
   case KOOPA_RVT_GLOBAL_ALLOC:
-    visit_koopa_raw_global_alloc(kind.data.global_alloc, value->name);
+    visit_koopa_raw_global_alloc(gen, kind.data.global_alloc, value->name);
     break;
   case KOOPA_RVT_GET_ELEM_PTR:
-    visit_koopa_raw_get_elem_ptr(kind.data.get_elem_ptr, tv_offset);
+    visit_koopa_raw_get_elem_ptr(gen, kind.data.get_elem_ptr, tv_offset);
     break;
   case KOOPA_RVT_GET_PTR:
-    visit_koopa_raw_get_ptr(kind.data.get_ptr, tv_offset);
+    visit_koopa_raw_get_ptr(gen, kind.data.get_ptr, tv_offset);
     break;
   default:
     fatalf("visit_koopa_raw_value unknown kind: %d\n", kind.tag);
   }
 }
 
-static void visit_koopa_raw_basic_block(const koopa_raw_basic_block_t block) {
+static void visit_koopa_raw_basic_block(RiscvGen *gen,
+                                        const koopa_raw_basic_block_t block) {
+  gen->block_name = block->name;
   // %entry 前已经输出了函数名，所以这里不需要输出 %entry 这个基本块名
   if (strcmp(block->name, "%entry") != 0) {
-    outputf("\n%s:\n", block->name + 1); // + 1 是为了跳过基本块名前的 %
+    // + 1 是为了跳过基本块名前的 %
+    outputf(gen, "\n%s.%s:\n", gen->function_name, block->name + 1);
   }
-  visit_koopa_raw_slice(block->insts);
+  visit_koopa_raw_slice(gen, block->insts);
 }
 
 static bool is_temp_value(const koopa_raw_value_t value) {
@@ -681,7 +863,7 @@ static bool is_temp_value(const koopa_raw_value_t value) {
          value->ty->tag != KOOPA_RTT_UNIT;
 }
 
-static void handle_tv_stack(const koopa_raw_value_t value) {
+static void handle_tv_stack(RiscvGen *gen, const koopa_raw_value_t value) {
   switch (value->kind.tag) {
   case KOOPA_RVT_INTEGER:
   case KOOPA_RVT_ZERO_INIT:
@@ -700,7 +882,7 @@ static void handle_tv_stack(const koopa_raw_value_t value) {
   case KOOPA_RVT_LOAD: {
     koopa_raw_value_t src = value->kind.data.load.src;
     if (is_temp_value(src)) {
-      tv_manager_pop(1);
+      tv_manager_pop(gen, 1);
     }
     break;
   }
@@ -709,10 +891,10 @@ static void handle_tv_stack(const koopa_raw_value_t value) {
     koopa_raw_value_t dest = value->kind.data.store.dest;
     koopa_raw_value_t src = value->kind.data.store.value;
     if (is_temp_value(src)) {
-      tv_manager_pop(1);
+      tv_manager_pop(gen, 1);
     }
     if (is_temp_value(dest)) {
-      tv_manager_pop(1);
+      tv_manager_pop(gen, 1);
     }
     break;
   }
@@ -720,7 +902,7 @@ static void handle_tv_stack(const koopa_raw_value_t value) {
   case KOOPA_RVT_GET_PTR: {
     koopa_raw_value_t src = value->kind.data.get_ptr.src;
     if (is_temp_value(src)) {
-      tv_manager_pop(1);
+      tv_manager_pop(gen, 1);
     }
     break;
   }
@@ -728,7 +910,7 @@ static void handle_tv_stack(const koopa_raw_value_t value) {
   case KOOPA_RVT_GET_ELEM_PTR: {
     koopa_raw_value_t src = value->kind.data.get_elem_ptr.src;
     if (is_temp_value(src)) {
-      tv_manager_pop(1);
+      tv_manager_pop(gen, 1);
     }
     break;
   }
@@ -737,10 +919,10 @@ static void handle_tv_stack(const koopa_raw_value_t value) {
     koopa_raw_value_t lhs = value->kind.data.binary.lhs;
     koopa_raw_value_t rhs = value->kind.data.binary.rhs;
     if (is_temp_value(lhs)) {
-      tv_manager_pop(1);
+      tv_manager_pop(gen, 1);
     }
     if (is_temp_value(rhs)) {
-      tv_manager_pop(1);
+      tv_manager_pop(gen, 1);
     }
     break;
   }
@@ -748,7 +930,7 @@ static void handle_tv_stack(const koopa_raw_value_t value) {
   case KOOPA_RVT_BRANCH: {
     koopa_raw_value_t cond = value->kind.data.branch.cond;
     if (is_temp_value(cond)) {
-      tv_manager_pop(1);
+      tv_manager_pop(gen, 1);
     }
     break;
   }
@@ -761,7 +943,7 @@ static void handle_tv_stack(const koopa_raw_value_t value) {
     for (size_t i = 0; i < call.args.len; i++) {
       koopa_raw_value_t arg = call.args.buffer[i];
       if (is_temp_value(arg)) {
-        tv_manager_pop(1);
+        tv_manager_pop(gen, 1);
       }
     }
     break;
@@ -770,7 +952,7 @@ static void handle_tv_stack(const koopa_raw_value_t value) {
   case KOOPA_RVT_RETURN: {
     koopa_raw_value_t ret = value->kind.data.ret.value;
     if (is_temp_value(ret)) {
-      tv_manager_pop(1);
+      tv_manager_pop(gen, 1);
     }
     break;
   }
@@ -782,7 +964,8 @@ static void handle_tv_stack(const koopa_raw_value_t value) {
 
 // 给临时变量分配栈空间
 __attribute__((unused)) static void
-assign_stack_of_temp_value(const koopa_raw_slice_t slice, int base_offset) {
+assign_stack_of_temp_value(RiscvGen *gen, const koopa_raw_slice_t slice,
+                           int base_offset) {
   /*
     由于临时变量都是用完就丢，所以我们可以用表达式栈来确定临时变量的栈偏移，这样可以减少栈空间的使用
     比如
@@ -795,22 +978,42 @@ assign_stack_of_temp_value(const koopa_raw_slice_t slice, int base_offset) {
 
     这种情况我们只需要两个临时变量的栈空间，而不需要三个
   */
-  tv_manager_reinit(base_offset);
+  tv_manager_reinit(gen, base_offset);
   for (size_t i = 0; i < slice.len; i++) {
     const koopa_raw_basic_block_t block = slice.buffer[i];
     for (size_t j = 0; j < block->insts.len; j++) {
       const koopa_raw_value_t value = block->insts.buffer[j];
-      handle_tv_stack(value);
+      handle_tv_stack(gen, value);
       if (value->ty->tag != KOOPA_RTT_UNIT &&
           value->kind.tag != KOOPA_RVT_ALLOC) {
-        tv_manager_push(value);
+        tv_manager_push(gen, value);
       }
     }
   }
 }
 
-static void visit_koopa_raw_function(const koopa_raw_function_t func) {
-  locals_reset();
+// 参数作为操作数时从自己的槽中读取，在函数开头保存进去
+static void save_params(RiscvGen *gen, const koopa_raw_function_t func) {
+  for (size_t i = 0; i < func->params.len; i++) {
+    int offset = tv_manager_get_offset(gen, func->params.buffer[i]);
+    if (offset < 0) {
+      continue;
+    }
+    if (i < 8) {
+      char src_reg[3] = {'a', '0' + i, '\0'};
+      store_to_stack(gen, src_reg, offset, "t0");
+    } else {
+      // 参数在调用者的栈上
+      load_from_stack(gen, "t0", (int)gen->stack_size + ((int)i - 8) * 4, "t0");
+      store_to_stack(gen, "t0", offset, "t1");
+    }
+  }
+}
+
+static void visit_koopa_raw_function(RiscvGen *gen,
+                                     const koopa_raw_function_t func) {
+  gen->function_name = func->name + 1;
+  locals_reset(gen);
   /**
     栈帧变量分配情况，从低到高依次为：
       调用函数参数
@@ -824,10 +1027,13 @@ static void visit_koopa_raw_function(const koopa_raw_function_t func) {
       sp +  0: @x
   */
   // 计算函数需要的栈空间
-  stack_size = 0;
-  has_call = false;
+  gen->stack_size = 0;
+  gen->has_call = false;
   int max_call_args = 0;
   int temp_base_offset = 0; // 临时变量的基地址
+  gen->has_value_slots = riscv_assign_value_slots(func, &gen->tv_manager.depths,
+                                                  &gen->use_counts,
+                                                  &gen->value_slots);
   for (size_t i = 0; i < func->bbs.len; i++) {
     const koopa_raw_basic_block_t block = func->bbs.buffer[i];
     for (size_t j = 0; j < block->insts.len; j++) {
@@ -836,26 +1042,26 @@ static void visit_koopa_raw_function(const koopa_raw_function_t func) {
         // 指令存在返回值，需要分配栈空间
         if (value->kind.tag == KOOPA_RVT_ALLOC) {
           // 分配局部变量
-          Variable *variable = new_variable(value->name);
+          Variable *variable = new_variable(gen, value);
           assert(value->ty->tag == KOOPA_RTT_POINTER);
           const struct koopa_raw_type_kind *pval = value->ty->data.pointer.base;
           switch (pval->tag) {
           case KOOPA_RTT_INT32:
-            stack_size += 4;
+            gen->stack_size += 4;
             variable->size = 4;
             variable->type = VariableType_int;
             temp_base_offset += variable->size;
             break;
           case KOOPA_RTT_ARRAY: {
             int size = get_type_size(pval);
-            stack_size += size;
+            gen->stack_size += size;
             variable->size = size;
             variable->type = VariableType_array;
             temp_base_offset += variable->size;
             break;
           }
           case KOOPA_RTT_POINTER:
-            stack_size += 4;
+            gen->stack_size += 4;
             variable->size = 4;
             variable->type = VariableType_pointer;
             temp_base_offset += variable->size;
@@ -864,52 +1070,61 @@ static void visit_koopa_raw_function(const koopa_raw_function_t func) {
             fatalf("visit_koopa_raw_function alloc unknown type: %d\n",
                    value->ty->tag);
           }
-        } else {
-          stack_size += 4;
+        } else if (!gen->has_value_slots) {
+          gen->stack_size += 4;
         }
       }
       if (value->kind.tag == KOOPA_RVT_CALL) {
-        has_call = true;
+        gen->has_call = true;
         max_call_args = MAX(max_call_args, value->kind.data.call.args.len);
       }
     }
   }
-  if (has_call) {
+  if (gen->has_call) {
     // 如果函数调用了其他函数，需要额外的栈空间保存 ra 寄存器
-    stack_size += 4;
+    gen->stack_size += 4;
   }
   if (max_call_args > 8) {
     // 如果函数调用的参数个数大于 8，需要额外的栈空间保存参数
     int size = (max_call_args - 8) * 4;
-    stack_size += size;
+    gen->stack_size += size;
     temp_base_offset += size;
-    locals_add_offset(size);
+    locals_add_offset(gen, size);
   }
-  assign_stack_of_temp_value(func->bbs, temp_base_offset);
-  stack_size += (tv_manager_get_max_depth() * 4);
+  locals_index(gen);
+  if (gen->has_value_slots) {
+    tv_manager_use_slots(gen, temp_base_offset, gen->value_slots.slot_count);
+  } else {
+    assign_stack_of_temp_value(gen, func->bbs, temp_base_offset);
+  }
+  gen->stack_size += (tv_manager_get_max_depth(gen) * 4);
   // 对齐到 16 字节
-  stack_size = (stack_size + 15) & ~15;
+  gen->stack_size = (gen->stack_size + 15) & ~15;
 
-  outputf("%s:\n", func->name + 1); // + 1 是为了跳过函数名前的 @
-  if (stack_size >= 2048) {
-    outputf("  li t0, -%zu\n", stack_size);
-    outputf("  add sp, sp, t0\n");
+  outputf(gen, "%s:\n", func->name + 1); // + 1 是为了跳过函数名前的 @
+  if (gen->stack_size >= 2048) {
+    outputf(gen, "  li t0, -%zu\n", gen->stack_size);
+    outputf(gen, "  add sp, sp, t0\n");
   } else {
-    outputf("  addi sp, sp, -%zu\n", stack_size);
+    outputf(gen, "  addi sp, sp, -%zu\n", gen->stack_size);
   }
-  if (has_call) {
+  if (gen->has_call) {
     // 保存 ra 寄存器
-    int offset = stack_size - 4;
-    store_to_stack("ra", offset, "t0");
+    int offset = gen->stack_size - 4;
+    store_to_stack(gen, "ra", offset, "t0");
+  }
+  if (gen->has_value_slots) {
+    save_params(gen, func);
   }
   for (size_t i = 0; i < func->bbs.len; i++) {
     assert(func->bbs.kind == KOOPA_RSIK_BASIC_BLOCK);
     const koopa_raw_basic_block_t block = func->bbs.buffer[i];
-    visit_koopa_raw_basic_block(block);
+    visit_koopa_raw_basic_block(gen, block);
   }
 }
 
-static void visit_koopa_raw_slice(const koopa_raw_slice_t slice) {
+static void visit_koopa_raw_slice(RiscvGen *gen,
+                                  const koopa_raw_slice_t slice) {
   for (size_t i = 0; i < slice.len; i++) {
     const void *ptr = slice.buffer[i];
     // 根据 slice 的 kind 决定将 ptr 视作何种元素
@@ -921,16 +1136,16 @@ static void visit_koopa_raw_slice(const koopa_raw_slice_t slice) {
         continue;
       }
       // + 1 是为了跳过函数名前的 @
-      outputf("\n");
-      outputf("  .global %s\n", ((koopa_raw_function_t)ptr)->name + 1);
-      visit_koopa_raw_function(ptr);
+      outputf(gen, "\n");
+      outputf(gen, "  .global %s\n", ((koopa_raw_function_t)ptr)->name + 1);
+      visit_koopa_raw_function(gen, ptr);
       break;
     }
     case KOOPA_RSIK_BASIC_BLOCK:
-      visit_koopa_raw_basic_block(ptr);
+      visit_koopa_raw_basic_block(gen, ptr);
       break;
     case KOOPA_RSIK_VALUE: {
-      visit_koopa_raw_value(ptr);
+      visit_koopa_raw_value(gen, ptr);
       break;
     }
     default:
@@ -939,22 +1154,52 @@ static void visit_koopa_raw_slice(const koopa_raw_slice_t slice) {
   }
 }
 
-static void visit_koopa_raw_program(const koopa_raw_program_t program) {
-  outputf("  .data\n");
-  visit_koopa_raw_slice(program.values); // 全局变量
-  outputf("  .text\n");
-  visit_koopa_raw_slice(program.funcs); // 函数
+static void visit_koopa_raw_program(RiscvGen *gen,
+                                    const koopa_raw_program_t program) {
+  outputf(gen, "  .data\n");
+  visit_koopa_raw_slice(gen, program.values); // 全局变量
+  outputf(gen, "  .text\n");
+  visit_koopa_raw_slice(gen, program.funcs); // 函数
 }
 
 // #endregion
 
-void riscv_codegen(const char *ir, const char *output_file) {
-  fp = fopen(output_file, "w");
-  if (fp == NULL) {
-    fprintf(stderr, "无法打开文件 %s\n", output_file);
-    exit(1);
+static void gen_free(RiscvGen *gen) {
+  free_variables(&gen->globals);
+  free_variables(&gen->locals);
+  value_map_free(&gen->local_offsets);
+  value_map_free(&gen->tv_manager.depths);
+  value_map_free(&gen->use_counts);
+}
+
+void riscv_codegen_program(const koopa_raw_program_t *program,
+                           Emitter *output) {
+  phase_begin(PHASE_BACKEND);
+  RiscvGen gen = {0};
+  gen.emitter = output;
+  value_map_init(&gen.local_offsets);
+  value_map_init(&gen.tv_manager.depths);
+  value_map_init(&gen.use_counts);
+  // 服务模式下出错时先释放状态，再跳回外层设置的位置
+  jmp_buf trap;
+  jmp_buf *outer = set_error_trap(NULL);
+  if (outer != NULL) {
+    set_error_trap(&trap);
+    if (setjmp(trap) != 0) {
+      gen_free(&gen);
+      set_error_trap(outer);
+      compile_error_exit();
+    }
   }
+  visit_koopa_raw_program(&gen, *program);
+  set_error_trap(outer);
+  gen_free(&gen);
+  phase_end(PHASE_BACKEND);
+}
+
+void riscv_codegen(const char *ir, Emitter *output) {
   // 解析字符串, 得到 Koopa IR 程序
+  phase_begin(PHASE_KOOPA_BUILD);
   koopa_program_t program;
   koopa_error_code_t ret = koopa_parse_from_string(ir, &program);
   assert(ret == KOOPA_EC_SUCCESS); // 确保解析时没有出错
@@ -964,14 +1209,15 @@ void riscv_codegen(const char *ir, const char *output_file) {
   koopa_raw_program_t raw = koopa_build_raw_program(builder, program);
   // 释放 Koopa IR 程序占用的内存
   koopa_delete_program(program);
+  phase_end(PHASE_KOOPA_BUILD);
 
   // 处理 raw program
-  visit_koopa_raw_program(raw);
+  riscv_codegen_program(&raw, output);
 
   // 处理完成, 释放 raw program builder 占用的内存
   // 注意, raw program 中所有的指针指向的内存均为 raw program builder 的内存
   // 所以不要在 raw program 处理完毕之前释放 builder
+  phase_begin(PHASE_KOOPA_BUILD);
   koopa_delete_raw_program_builder(builder);
-
-  fclose(fp);
+  phase_end(PHASE_KOOPA_BUILD);
 }
\ No newline at end of file
@@ -1,6 +1,13 @@
 #ifndef SRC_RISCV_H_
 #define SRC_RISCV_H_
 
-void riscv_codegen(const char *ir, const char *output_file);
+#include "emit.h"
+#include "koopa.h"
+
+// 汇编写到 output 中，由调用方打开和关闭
+void riscv_codegen(const char *ir, Emitter *output);
+// 直接处理已经构建好的 raw program（比如 ir_lower 的结果），不经过文本
+void riscv_codegen_program(const koopa_raw_program_t *program,
+                           Emitter *output);
 
 #endif // SRC_RISCV_H_
\ No newline at end of file
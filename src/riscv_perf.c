@@ -1,37 +1,28 @@
-#include "riscv.h"
+#include "riscv_perf.h"
 
 #include <assert.h>
+#include <setjmp.h>
+#include <ctype.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "cache.h"
+#include "emit.h"
+#include "intern.h"
 #include "koopa.h"
+#include "riscv_slots.h"
+#include "riscv_stats.h"
+#include "thread_pool.h"
+#include "time_report.h"
 #include "utils.h"
+#include "value_map.h"
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
-static FILE *fp;
-
-__attribute__((format(printf, 1, 2))) static void outputf(const char *fmt, ...);
-static void outputf(const char *fmt, ...) {
-  va_list args;
-  va_start(args, fmt);
-  // vprintf(fmt, args);
-  vfprintf(fp, fmt, args);
-  va_end(args);
-}
-
-// #region 辅助变量和函数
-
-// 函数返回时，需要恢复 sp ，所以需要记录栈的大小
-// 即生成 ret 指令时，需要将 sp 加上这个大小，恢复栈空间
-static size_t stack_size = 0;
-// 是否调用了其他函数，如果调用了，需要保存 ra
-// 寄存器； ret 指令时，需要恢复 ra 寄存器
-static bool has_call = false;
-
 typedef enum {
   VariableType_int,
   VariableType_array,
@@ -45,159 +36,285 @@ typedef struct Variable {
   int offset;
   int size; // 变量大小
   Variable *next;
-  int count; // 计数
+  int count;               // 计数
+  koopa_raw_value_t value; // 局部变量对应的 alloc 指令
 } Variable;
 
-static Variable globals = {NULL, VariableType_int, 0, 0, NULL, 0}; // 全局变量
-static Variable locals = {NULL, VariableType_int, 0, 0, NULL, 0}; // 局部变量
+typedef struct {
+  ValueMap depths; // 临时变量 -> 在表达式栈中的深度
+  int base_offset;
+  int max_depth;
+  int depth;
+} TempValueManager;
+
+// 寄存器用编号表示，REGISTER_COUNT 之前的寄存器可以分配给 IR 中的值
+typedef enum {
+  REG_A0,
+  REG_A1,
+  REG_A2,
+  REG_A3,
+  REG_A4,
+  REG_A5,
+  REG_A6,
+  REG_A7,
+  // t0 t1 不分配，需要留一些寄存器用来操作
+  REG_T2,
+  REG_T3,
+  REG_T4,
+  REG_T5,
+  REG_T6,
+  REGISTER_COUNT,
+  REG_T0 = REGISTER_COUNT,
+  REG_T1,
+  REG_X0,
+  REG_NONE = -1, // 没有分配到寄存器
+} Register;
+
+typedef struct {
+  // 第 i 位为 1 表示寄存器 i 空闲
+  uint32_t free_mask;
+  // 寄存器中保存的值，只有被占用的寄存器才有意义
+  koopa_raw_value_t values[REGISTER_COUNT];
+  // 值 -> 所在的寄存器，REG_NONE 表示不在寄存器中
+  ValueMap locations;
+} RegisterManager;
+
+// 生成汇编的状态，传给下面所有的函数
+// 每次生成在栈上准备一个，并行生成函数时每个工作线程再各用一个
+typedef struct {
+  CompileContext *ctx;
+  // 输出，并行生成函数时指向该函数自己的缓冲区
+  Emitter *emitter;
+  // 开启 -stats 时是当前函数的统计，否则为 NULL
+  FunctionStats *current_stats;
+  // 函数返回时，需要恢复 sp ，所以需要记录栈的大小
+  // 即生成 ret 指令时，需要将 sp 加上这个大小，恢复栈空间
+  size_t stack_size;
+  // 是否调用了其他函数，如果调用了，需要保存 ra
+  // 寄存器； ret 指令时，需要恢复 ra 寄存器
+  bool has_call;
+  // 当前函数的名字（不含 @）
+  // Koopa IR 的基本块名只在函数内唯一，汇编里的标签要加上函数名作为前缀
+  const char *function_name;
+  // 当前基本块的名字，br 的两条边都有实参时用来生成中间的标签
+  const char *block_name;
+  // 全局变量
+  Variable globals;
+  // 局部变量
+  Variable locals;
+  // alloc 指令 -> 局部变量的栈偏移，偏移量全部确定之后由 locals_index 填充
+  ValueMap local_offsets;
+  TempValueManager tv_manager;
+  // SSA 形式的函数由 riscv_assign_value_slots 分配槽，
+  // 为 false 时是表达式栈分配的
+  bool has_value_slots;
+  ValueSlots value_slots;
+  // 值 -> 还没有生成的使用次数，只有 SSA 形式的函数才有
+  // 值在寄存器中时每次使用减一，用完才释放寄存器
+  ValueMap use_counts;
+  RegisterManager register_manager;
+#ifdef DEBUG_LOG
+  // 没有名字的值在注释里按函数内第一次出现的顺序编号，而不是输出指针，
+  // 同样的输入每次都得到同样的汇编，可以缓存和比较
+  ValueMap comment_ids;
+#endif
+} PerfGen;
+
+#define count_stat(gen, field)                                                \
+  do {                                                                        \
+    if (gen->current_stats != NULL) {                                         \
+      gen->current_stats->field++;                                            \
+    }                                                                         \
+  } while (0)
+
+// 标签、注释和伪指令
+__attribute__((format(printf, 2, 3))) static void
+outputf(PerfGen *gen, const char *fmt, ...);
+static void outputf(PerfGen *gen, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  emitter_vemitf(gen->emitter, fmt, args);
+  va_end(args);
+}
 
-static void new_global_variable(const char *name) {
+// 一条指令，开启 -stats 时计入 insn_class
+__attribute__((format(printf, 3, 4))) static void
+emit_insn(PerfGen *gen, InsnClass insn_class, const char *fmt, ...);
+static void emit_insn(PerfGen *gen, InsnClass insn_class, const char *fmt,
+                      ...) {
+  if (gen->current_stats != NULL) {
+    riscv_stats_count_instruction(gen->current_stats, insn_class);
+  }
+  va_list args;
+  va_start(args, fmt);
+  emitter_vemitf(gen->emitter, fmt, args);
+  va_end(args);
+}
+
+// #region 辅助变量和函数
+
+static void new_global_variable(PerfGen *gen, const char *name) {
   assert(name != NULL);
   Variable *var = (Variable *)malloc(sizeof(Variable));
   var->name = name;
   var->offset = 0;
-  var->next = globals.next;
+  var->next = gen->globals.next;
   var->type = VariableType_int;
   var->size = 4;
-  globals.next = var;
-  globals.count++;
+  gen->globals.next = var;
+  gen->globals.count++;
 }
 
-static Variable *new_variable(const char *name) {
-  assert(name != NULL);
+static Variable *new_variable(PerfGen *gen, koopa_raw_value_t value) {
+  assert(value->name != NULL);
   Variable *var = (Variable *)malloc(sizeof(Variable));
-  var->name = name;
-  var->offset =
-      locals.next == NULL ? 0 : locals.next->offset + locals.next->size;
-  var->next = locals.next;
+  var->name = value->name;
+  var->value = value;
+  Variable *last = gen->locals.next;
+  var->offset = last == NULL ? 0 : last->offset + last->size;
+  var->next = gen->locals.next;
   var->size = 4;
   var->type = VariableType_int;
-  locals.next = var;
-  locals.count++;
+  gen->locals.next = var;
+  gen->locals.count++;
   return var;
 }
 
 // 给所有局部变量的偏移量增加 offset
-static void locals_add_offset(int offset) {
-  Variable *var = locals.next;
+static void locals_add_offset(PerfGen *gen, int offset) {
+  Variable *var = gen->locals.next;
   while (var != NULL) {
     var->offset += offset;
     var = var->next;
   }
 }
 
-static int get_offset(const char *name) {
-  Variable *var = locals.next;
-  while (var != NULL) {
-    if (strcmp(var->name, name) == 0) {
-      return var->offset;
-    }
-    var = var->next;
+static void locals_index(PerfGen *gen) {
+  for (Variable *var = gen->locals.next; var != NULL; var = var->next) {
+    value_map_put(&gen->local_offsets, var->value, var->offset);
   }
-  fatalf("未找到变量 %s\n", name);
-  return -1;
 }
 
-static void locals_reset(void) {
-  Variable *var = locals.next;
+// alloc 是局部变量的 alloc 指令
+static int get_offset(PerfGen *gen, koopa_raw_value_t alloc) {
+  int offset;
+  if (!value_map_get(&gen->local_offsets, alloc, &offset)) {
+    fatalf("未找到变量 %s\n", alloc->name);
+  }
+  return offset;
+}
+
+static void free_variables(Variable *head) {
+  Variable *var = head->next;
   while (var != NULL) {
     Variable *next = var->next;
     free(var);
     var = next;
   }
-  locals.next = NULL;
-  locals.count = 0;
+  head->next = NULL;
+  head->count = 0;
 }
 
-typedef struct {
-  koopa_raw_value_t value;
-  int depth;
-} TempValue;
-
-typedef struct {
-  TempValue *values;
-  size_t len;
-  size_t cap;
-  int base_offset;
-  int max_depth;
-  int depth;
-} TempValueManager;
-
-static TempValueManager tv_manager = {NULL, 0, 0, 0, 0, 0};
+static void locals_reset(PerfGen *gen) {
+  free_variables(&gen->locals);
+  value_map_clear(&gen->local_offsets);
+}
 
-static void tv_manager_reinit(int base_offset) {
-  tv_manager.len = 0;
-  tv_manager.cap = 16;
-  tv_manager.max_depth = 0;
-  tv_manager.depth = 0;
-  tv_manager.base_offset = base_offset;
-  tv_manager.values = (TempValue *)realloc(tv_manager.values,
-                                           tv_manager.cap * sizeof(TempValue));
+static void tv_manager_reinit(PerfGen *gen, int base_offset) {
+  value_map_clear(&gen->tv_manager.depths);
+  gen->tv_manager.max_depth = 0;
+  gen->tv_manager.depth = 0;
+  gen->tv_manager.base_offset = base_offset;
 }
 
-static void tv_manager_push(koopa_raw_value_t value) {
-  if (tv_manager.len >= tv_manager.cap) {
-    tv_manager.cap *= 2;
-    tv_manager.values = (TempValue *)realloc(
-        tv_manager.values, tv_manager.cap * sizeof(TempValue));
+static void tv_manager_push(PerfGen *gen, koopa_raw_value_t value) {
+  int depth = gen->tv_manager.depth;
+  // 同一个值只记录第一次入栈的位置
+  int old_depth;
+  if (!value_map_get(&gen->tv_manager.depths, value, &old_depth)) {
+    value_map_put(&gen->tv_manager.depths, value, depth);
   }
-  int idx = tv_manager.len;
-  int depth = tv_manager.depth;
-  tv_manager.values[idx] = (TempValue){value, depth};
-  tv_manager.max_depth = MAX(tv_manager.max_depth, depth);
-  tv_manager.depth++;
-  tv_manager.len++;
+  gen->tv_manager.max_depth = MAX(gen->tv_manager.max_depth, depth);
+  gen->tv_manager.depth++;
 }
 
-static void tv_manager_pop(int n) {
-  tv_manager.depth -= n;
-  assert(tv_manager.depth >= 0);
+static void tv_manager_pop(PerfGen *gen, int n) {
+  gen->tv_manager.depth -= n;
+  assert(gen->tv_manager.depth >= 0);
 }
 
-static int tv_manager_get_offset(koopa_raw_value_t value) {
-  for (size_t i = 0; i < tv_manager.len; i++) {
-    if (tv_manager.values[i].value == value) {
-      return tv_manager.base_offset + tv_manager.values[i].depth * 4;
-    }
+static int tv_manager_get_offset(PerfGen *gen, koopa_raw_value_t value) {
+  int depth;
+  if (!value_map_get(&gen->tv_manager.depths, value, &depth)) {
+    return -1;
   }
-  return -1;
+  return gen->tv_manager.base_offset + depth * 4;
 }
 
-static int tv_manager_bget_offset(koopa_raw_value_t value) {
-  int offset = tv_manager_get_offset(value);
+static int tv_manager_bget_offset(PerfGen *gen, koopa_raw_value_t value) {
+  int offset = tv_manager_get_offset(gen, value);
   assert(offset >= 0);
   return offset;
 }
 
-static int tv_manager_get_max_depth() { return tv_manager.max_depth; }
+static int tv_manager_get_max_depth(PerfGen *gen) {
+  return gen->tv_manager.max_depth;
+}
+
+// 槽已经写在 tv_manager.depths 中，只需要设置基地址和大小
+static void tv_manager_use_slots(PerfGen *gen, int base_offset,
+                                 int slot_count) {
+  gen->tv_manager.base_offset = base_offset;
+  gen->tv_manager.max_depth = slot_count;
+  gen->tv_manager.depth = 0;
+}
 
-static void store_to_stack(const char *src_register, int offset,
+static void store_to_stack(PerfGen *gen, const char *src_register, int offset,
                            const char *temp_register) {
   if (offset < 0) {
     return;
   }
   if (offset >= 2048) {
-    outputf("  li %s, %d\n", temp_register, offset);
-    outputf("  add %s, sp, %s\n", temp_register, temp_register);
-    outputf("  sw %s, 0(%s)\n", src_register, temp_register);
+    count_stat(gen, large_offsets);
+    emit_insn(gen, INSN_LI, "  li %s, %d\n", temp_register, offset);
+    emit_insn(gen, INSN_ALU, "  add %s, sp, %s\n", temp_register,
+              temp_register);
+    emit_insn(gen, INSN_SW, "  sw %s, 0(%s)\n", src_register, temp_register);
   } else {
-    outputf("  sw %s, %d(sp)\n", src_register, offset);
+    emit_insn(gen, INSN_SW, "  sw %s, %d(sp)\n", src_register, offset);
   }
 }
 
-static void load_from_stack(const char *dst_register, int offset,
+static void load_from_stack(PerfGen *gen, const char *dst_register, int offset,
                             const char *temp_register) {
   if (offset >= 2048) {
-    outputf("  li %s, %d\n", temp_register, offset);
-    outputf("  add %s, sp, %s\n", temp_register, temp_register);
-    outputf("  lw %s, 0(%s)\n", dst_register, temp_register);
+    count_stat(gen, large_offsets);
+    emit_insn(gen, INSN_LI, "  li %s, %d\n", temp_register, offset);
+    emit_insn(gen, INSN_ALU, "  add %s, sp, %s\n", temp_register,
+              temp_register);
+    emit_insn(gen, INSN_LW, "  lw %s, 0(%s)\n", dst_register, temp_register);
   } else {
-    outputf("  lw %s, %d(sp)\n", dst_register, offset);
+    emit_insn(gen, INSN_LW, "  lw %s, %d(sp)\n", dst_register, offset);
+  }
+}
+
+// 没有放在寄存器里的值写到它在栈上的位置
+static void spill_to_stack(PerfGen *gen, const char *src_register, int offset,
+                           const char *temp_register) {
+  if (offset >= 0) {
+    count_stat(gen, spill_stores);
   }
+  store_to_stack(gen, src_register, offset, temp_register);
+}
+
+// 不在寄存器里的值从栈上读出来
+static void reload_from_stack(PerfGen *gen, const char *dst_register,
+                              int offset, const char *temp_register) {
+  count_stat(gen, reloads);
+  load_from_stack(gen, dst_register, offset, temp_register);
 }
 
-#define REGISTER_COUNT 13
-static const char *registers[REGISTER_COUNT] = {
+static const char *register_names[] = {
     "a0",
     "a1",
     "a2",
@@ -206,134 +323,155 @@ static const char *registers[REGISTER_COUNT] = {
     "a5",
     "a6",
     "a7",
-    // t0 t1 不分配，需要留一些寄存器用来操作
     "t2",
     "t3",
     "t4",
     "t5",
     "t6",
+    "t0",
+    "t1",
+    "x0",
 };
 
-typedef struct {
-  koopa_raw_value_t value;
-  const char *reg;
-} RegisterAllocation;
+static const char *register_name(Register reg) {
+  assert(reg >= 0);
+  return register_names[reg];
+}
 
-typedef struct {
-  const char *available[REGISTER_COUNT];
-  int available_count;
-  RegisterAllocation alolcations[REGISTER_COUNT];
-  int allocations_count;
-} RegisterManager;
+#define ALL_REGISTERS_FREE ((1u << REGISTER_COUNT) - 1)
 
-static RegisterManager register_manager;
-void register_manager_init(void) {
-  register_manager.available_count = REGISTER_COUNT;
-  for (int i = 0; i < REGISTER_COUNT; i++) {
-    register_manager.available[i] = (char *)registers[i];
-  }
-  register_manager.allocations_count = 0;
-}
+// 注释会让输出变大，只在调试的时候输出寄存器分配的过程
+#ifdef DEBUG_LOG
+#define register_commentf(gen, ...) outputf(gen, __VA_ARGS__)
 
-const char *register_manager_allocate(koopa_raw_value_t value) {
-  if (register_manager.available_count == 0) {
-    return "";
+static void register_comment(PerfGen *gen, const char *action,
+                             koopa_raw_value_t value, Register reg) {
+  if (value->name != NULL) {
+    outputf(gen, "      # %s %s, %s\n", action, value->name,
+            register_name(reg));
+    return;
   }
-  for (int i = 0; i < register_manager.allocations_count; i++) {
-    if (register_manager.alolcations[i].value == value) {
-      return register_manager.alolcations[i].reg;
-    }
+  int id;
+  if (!value_map_get(&gen->comment_ids, value, &id)) {
+    id = (int)gen->comment_ids.count;
+    value_map_put(&gen->comment_ids, value, id);
   }
+  outputf(gen, "    # %s %%%d, %s\n", action, id, register_name(reg));
+}
+#else
+#define register_commentf(gen, ...) ((void)0)
+#define register_comment(gen, action, value, reg) ((void)0)
+#endif
+
+void register_manager_init(PerfGen *gen) {
+  gen->register_manager.free_mask = ALL_REGISTERS_FREE;
+  value_map_clear(&gen->register_manager.locations);
+}
 
-  const char *reg =
-      register_manager.available[register_manager.available_count - 1];
-  register_manager.available_count--;
-  register_manager.allocations_count++;
-  register_manager.alolcations[register_manager.allocations_count - 1] =
-      (RegisterAllocation){.value = value, .reg = reg};
-
-  if (value->name != NULL) {
-    outputf("      # register_manager_allocate %s, %s\n", value->name, reg);
-  } else {
-    outputf("    # register_manager_allocate %p, %s\n", value, reg);
+// 值所在的寄存器，不在寄存器中时返回 REG_NONE
+static Register register_manager_find(PerfGen *gen, koopa_raw_value_t value) {
+  int reg;
+  if (!value_map_get(&gen->register_manager.locations, value, &reg)) {
+    return REG_NONE;
   }
   return reg;
 }
 
-void register_manager_free(const char *reg) {
+// 给 value 分配一个寄存器，没有空闲寄存器时返回 REG_NONE
+Register register_manager_allocate(PerfGen *gen, koopa_raw_value_t value) {
+  Register reg = register_manager_find(gen, value);
+  if (reg != REG_NONE) {
+    return reg;
+  }
+  if (gen->register_manager.free_mask == 0) {
+    return REG_NONE;
+  }
+  // 优先分配编号最大的寄存器（t6, t5, ...）
+  reg = 31 - __builtin_clz(gen->register_manager.free_mask);
+  gen->register_manager.free_mask &= ~(1u << reg);
+  gen->register_manager.values[reg] = value;
+  value_map_put(&gen->register_manager.locations, value, reg);
 
-  // 从 allocations 中删除
-  for (int i = 0; i < register_manager.allocations_count; i++) {
-    RegisterAllocation allocation = register_manager.alolcations[i];
-    if (strcmp(allocation.reg, reg) == 0) {
-      koopa_raw_value_t value = allocation.value;
-      if (value->name != NULL) {
-        outputf("      # register_manager_free %s, %s\n", value->name, reg);
-      } else {
-        outputf("    # register_manager_free %p, %s\n", value, reg);
-      }
-      for (int j = i; j < register_manager.allocations_count - 1; j++) {
-        register_manager.alolcations[j] = register_manager.alolcations[j + 1];
-      }
-      register_manager.allocations_count--;
-      register_manager.available[register_manager.available_count] = reg;
-      register_manager.available_count++;
-      break;
-    }
+  register_comment(gen, "register_manager_allocate", value, reg);
+  return reg;
+}
+
+// 释放寄存器，reg 不是分配出去的寄存器（比如 t0 x0）时什么也不做
+void register_manager_free(PerfGen *gen, Register reg) {
+  if (reg < 0 || reg >= REGISTER_COUNT ||
+      (gen->register_manager.free_mask & (1u << reg))) {
+    return;
   }
+  koopa_raw_value_t value = gen->register_manager.values[reg];
+  int uses;
+  if (value_map_get(&gen->use_counts, value, &uses) && uses > 1) {
+    // 后面还会用到，留在寄存器中
+    value_map_put(&gen->use_counts, value, uses - 1);
+    return;
+  }
+  register_comment(gen, "register_manager_free", value, reg);
+  value_map_put(&gen->register_manager.locations, value, REG_NONE);
+  gen->register_manager.free_mask |= 1u << reg;
 }
 
 // 保存分配寄存器的值到栈上，释放所有寄存器
-void register_manager_flush(void) {
-  outputf("    # register_manager_flush\n");
-  for (int i = 0; i < register_manager.allocations_count; i++) {
-    RegisterAllocation alloc = register_manager.alolcations[i];
-    if (alloc.value->kind.tag == KOOPA_RVT_ALLOC) {
-      int offset = get_offset(alloc.value->name);
-      store_to_stack(alloc.reg, offset, "t0");
-    } else if (alloc.value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
-      outputf("  la t0, %s\n", alloc.value->name + 1);
-      outputf("  sw %s, 0(t0)\n", alloc.reg);
+void register_manager_flush(PerfGen *gen) {
+  register_commentf(gen, "    # register_manager_flush\n");
+  count_stat(gen, flushes);
+  uint32_t used = ~gen->register_manager.free_mask & ALL_REGISTERS_FREE;
+  while (used != 0) {
+    Register reg = __builtin_ctz(used);
+    used &= used - 1;
+    koopa_raw_value_t value = gen->register_manager.values[reg];
+    if (value->kind.tag == KOOPA_RVT_ALLOC) {
+      int offset = get_offset(gen, value);
+      spill_to_stack(gen, register_name(reg), offset, "t0");
+    } else if (value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
+      count_stat(gen, spill_stores);
+      emit_insn(gen, INSN_LA, "  la t0, %s\n", value->name + 1);
+      emit_insn(gen, INSN_SW, "  sw %s, 0(t0)\n", register_name(reg));
     } else {
-      int offset = tv_manager_bget_offset(alloc.value);
-      store_to_stack(alloc.reg, offset, "t0");
+      int offset = tv_manager_bget_offset(gen, value);
+      spill_to_stack(gen, register_name(reg), offset, "t0");
     }
   }
 
-  register_manager_init();
+  register_manager_init(gen);
 }
 
 // 从内存中加载值到寄存器
 //     如果值已经在寄存器中，直接返回所在寄存器
-//     否则，从内存中加载值到寄存器
+//     否则，从内存中加载值到 reg
 // 返回所在寄存器
-const char *register_manager_load_value(koopa_raw_value_t value,
-                                        const char *reg, const char *temp_reg) {
-  for (int i = 0; i < register_manager.allocations_count; i++) {
-    RegisterAllocation alloc = register_manager.alolcations[i];
-    if (alloc.value == value) {
-      return alloc.reg;
-    }
+Register register_manager_load_value(PerfGen *gen, koopa_raw_value_t value,
+                                     Register reg, const char *temp_reg) {
+  Register found = register_manager_find(gen, value);
+  if (found != REG_NONE) {
+    return found;
   }
   // 从内存中加载值到寄存器
   if (value->kind.tag == KOOPA_RVT_INTEGER) {
     if (value->kind.data.integer.value == 0) {
       // 如果值是 0，直接使用 x0 即可
-      return "x0";
+      return REG_X0;
     }
-    outputf("  li %s, %d\n", reg, value->kind.data.integer.value);
+    emit_insn(gen, INSN_LI, "  li %s, %d\n", register_name(reg),
+              value->kind.data.integer.value);
   } else if (value->kind.tag == KOOPA_RVT_ALLOC) {
-    outputf("      # register_manager_load_value\n");
-    int offset = get_offset(value->name);
-    load_from_stack(reg, offset, temp_reg);
+    register_commentf(gen, "      # register_manager_load_value\n");
+    int offset = get_offset(gen, value);
+    reload_from_stack(gen, register_name(reg), offset, temp_reg);
   } else if (value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
-    outputf("      # register_manager_load_value\n");
-    outputf("  la %s, %s\n", reg, value->name + 1);
-    outputf("  lw %s, 0(%s)\n", reg, reg);
+    register_commentf(gen, "      # register_manager_load_value\n");
+    count_stat(gen, reloads);
+    emit_insn(gen, INSN_LA, "  la %s, %s\n", register_name(reg),
+              value->name + 1);
+    emit_insn(gen, INSN_LW, "  lw %s, 0(%s)\n", register_name(reg),
+              register_name(reg));
   } else {
-    outputf("      # register_manager_load_value\n");
-    int offset = tv_manager_bget_offset(value);
-    load_from_stack(reg, offset, temp_reg);
+    register_commentf(gen, "      # register_manager_load_value\n");
+    int offset = tv_manager_bget_offset(gen, value);
+    reload_from_stack(gen, register_name(reg), offset, temp_reg);
   }
   return reg;
 }
@@ -353,272 +491,365 @@ static int get_type_size(const koopa_raw_type_t ty) {
 // #endregion
 
 // #region visit IR 生成代码
-static void visit_koopa_raw_return(const koopa_raw_return_t ret);
-static void visit_koopa_raw_integer(const koopa_raw_integer_t n);
-static void visit_koopa_raw_value(const koopa_raw_value_t value);
-static void visit_koopa_raw_basic_block(const koopa_raw_basic_block_t block);
-static void visit_koopa_raw_function(const koopa_raw_function_t func);
-static void visit_koopa_raw_slice(const koopa_raw_slice_t slice);
-static void visit_koopa_raw_program(const koopa_raw_program_t program);
-static void visit_koopa_raw_binary(const koopa_raw_binary_t binary,
+static void visit_koopa_raw_return(PerfGen *gen, const koopa_raw_return_t ret);
+static void visit_koopa_raw_integer(PerfGen *gen, const koopa_raw_integer_t n);
+static void visit_koopa_raw_value(PerfGen *gen, const koopa_raw_value_t value);
+static void visit_koopa_raw_basic_block(PerfGen *gen,
+                                        const koopa_raw_basic_block_t block);
+static void visit_koopa_raw_function(PerfGen *gen,
+                                     const koopa_raw_function_t func);
+static void visit_koopa_raw_slice(PerfGen *gen, const koopa_raw_slice_t slice);
+static void visit_koopa_raw_program(PerfGen *gen,
+                                    const koopa_raw_program_t program);
+static void visit_koopa_raw_binary(PerfGen *gen,
+                                   const koopa_raw_binary_t binary,
                                    int tv_offset,
                                    const koopa_raw_value_t value);
-static void visit_koopa_raw_branch(const koopa_raw_branch_t branch);
-static void visit_koopa_raw_jump(const koopa_raw_jump_t jump);
-static void visit_koopa_raw_call(const koopa_raw_call_t call, int tv_offset);
-static void visit_koopa_raw_global_alloc(const koopa_raw_global_alloc_t alloc,
+static void visit_koopa_raw_branch(PerfGen *gen,
+                                   const koopa_raw_branch_t branch);
+static void visit_koopa_raw_jump(PerfGen *gen, const koopa_raw_jump_t jump);
+static void visit_koopa_raw_call(PerfGen *gen, const koopa_raw_call_t call,
+                                 int tv_offset);
+static void visit_koopa_raw_global_alloc(PerfGen *gen,
+                                         const koopa_raw_global_alloc_t alloc,
                                          const char *name);
 static void
-visit_koopa_raw_get_elem_ptr(const koopa_raw_get_elem_ptr_t get_elem_ptr,
+visit_koopa_raw_get_elem_ptr(PerfGen *gen,
+                             const koopa_raw_get_elem_ptr_t get_elem_ptr,
                              int tv_offset);
-static void visit_koopa_raw_get_ptr(const koopa_raw_get_ptr_t get_ptr,
+static void visit_koopa_raw_get_ptr(PerfGen *gen,
+                                    const koopa_raw_get_ptr_t get_ptr,
                                     int tv_offset);
-static void visit_global_init(const koopa_raw_value_t init);
+static void visit_global_init(PerfGen *gen, const koopa_raw_value_t init,
+                              int *zero_bytes);
 
-static void visit_koopa_raw_return(const koopa_raw_return_t ret) {
-  outputf("    # return\n");
+static void visit_koopa_raw_return(PerfGen *gen, const koopa_raw_return_t ret) {
+  outputf(gen, "    # return\n");
   if (ret.value) {
-    const char *reg = register_manager_load_value(ret.value, "t0", "t0");
-    outputf("  mv a0, %s\n", reg);
-    register_manager_free(reg);
+    Register reg = register_manager_load_value(gen, ret.value, REG_T0, "t0");
+    emit_insn(gen, INSN_MV, "  mv a0, %s\n", register_name(reg));
+    register_manager_free(gen, reg);
   }
   // 返回之前，需要将所有分配的寄存器的值保存到栈上
-  register_manager_flush();
-  if (has_call) {
+  register_manager_flush(gen);
+  if (gen->has_call) {
     // 如果调用了其他函数，需要恢复 ra 寄存器
-    int offset = stack_size - 4;
-    load_from_stack("ra", offset, "t0");
+    int offset = gen->stack_size - 4;
+    load_from_stack(gen, "ra", offset, "t0");
   }
 
   // 函数返回，恢复栈空间 epilogue
-  if (stack_size >= 2048) {
-    outputf("  li t0, %zu\n", stack_size);
-    outputf("  add sp, sp, t0\n");
+  if (gen->stack_size >= 2048) {
+    count_stat(gen, large_offsets);
+    emit_insn(gen, INSN_LI, "  li t0, %zu\n", gen->stack_size);
+    emit_insn(gen, INSN_ALU, "  add sp, sp, t0\n");
   } else {
-    outputf("  addi sp, sp, %zu\n", stack_size);
+    emit_insn(gen, INSN_ALU, "  addi sp, sp, %zu\n", gen->stack_size);
   }
-  outputf("  ret\n");
+  emit_insn(gen, INSN_CALL_RET, "  ret\n");
 }
 
-static void visit_koopa_raw_integer(const koopa_raw_integer_t n) {
+static void visit_koopa_raw_integer(PerfGen *gen, const koopa_raw_integer_t n) {
   assert(false);
-  outputf("    # integer\n");
-  outputf("  li t0, %d\n", n.value);
+  outputf(gen, "    # integer\n");
+  emit_insn(gen, INSN_LI, "  li t0, %d\n", n.value);
 }
 
-static void visit_koopa_raw_binary(const koopa_raw_binary_t binary,
+static void visit_koopa_raw_binary(PerfGen *gen,
+                                   const koopa_raw_binary_t binary,
                                    int tv_offset,
                                    const koopa_raw_value_t value) {
-  outputf("    # binary %d\n", binary.op);
-  const char *lhs_register =
-      register_manager_load_value(binary.lhs, "t0", "t0");
-  const char *rhs_register =
-      register_manager_load_value(binary.rhs, "t1", "t1");
+  outputf(gen, "    # binary %d\n", binary.op);
+  Register lhs = register_manager_load_value(gen, binary.lhs, REG_T0, "t0");
+  Register rhs = register_manager_load_value(gen, binary.rhs, REG_T1, "t1");
 
-  register_manager_free(lhs_register);
-  register_manager_free(rhs_register);
+  register_manager_free(gen, lhs);
+  register_manager_free(gen, rhs);
+  const char *lhs_register = register_name(lhs);
+  const char *rhs_register = register_name(rhs);
 
-  // 目前所有变量都存储在栈上，所以这里可以直接使用 t0 作为结果寄存器
+  // 没有空闲的寄存器时，使用 t0 作为结果寄存器，计算完保存到栈上
   bool no_register = false;
-  const char *result_register = register_manager_allocate(value);
-  if (strcmp(result_register, "") == 0) {
-    result_register = "t0";
+  Register result = register_manager_allocate(gen, value);
+  if (result == REG_NONE) {
+    result = REG_T0;
     no_register = true;
   }
+  const char *result_register = register_name(result);
   switch (binary.op) {
   case KOOPA_RBO_SUB:
-    outputf("  sub %s, %s, %s\n", result_register, lhs_register, rhs_register);
+    emit_insn(gen, INSN_ALU, "  sub %s, %s, %s\n", result_register,
+              lhs_register, rhs_register);
     break;
   case KOOPA_RBO_ADD:
-    outputf("  add %s, %s, %s\n", result_register, lhs_register, rhs_register);
+    emit_insn(gen, INSN_ALU, "  add %s, %s, %s\n", result_register,
+              lhs_register, rhs_register);
     break;
   case KOOPA_RBO_MUL:
-    outputf("  mul %s, %s, %s\n", result_register, lhs_register, rhs_register);
+    emit_insn(gen, INSN_MUL_DIV, "  mul %s, %s, %s\n", result_register,
+              lhs_register, rhs_register);
     break;
   case KOOPA_RBO_DIV:
-    outputf("  div %s, %s, %s\n", result_register, lhs_register, rhs_register);
+    emit_insn(gen, INSN_MUL_DIV, "  div %s, %s, %s\n", result_register,
+              lhs_register, rhs_register);
     break;
   case KOOPA_RBO_MOD:
-    outputf("  rem %s, %s, %s\n", result_register, lhs_register, rhs_register);
+    emit_insn(gen, INSN_MUL_DIV, "  rem %s, %s, %s\n", result_register,
+              lhs_register, rhs_register);
     break;
   case KOOPA_RBO_EQ: {
-    outputf("  xor %s, %s, %s\n", result_register, lhs_register, rhs_register);
-    outputf("  seqz %s, %s\n", result_register, result_register);
+    emit_insn(gen, INSN_ALU, "  xor %s, %s, %s\n", result_register,
+              lhs_register, rhs_register);
+    emit_insn(gen, INSN_ALU, "  seqz %s, %s\n", result_register,
+              result_register);
     break;
   }
   case KOOPA_RBO_NOT_EQ: {
-    outputf("  xor %s, %s, %s\n", result_register, lhs_register, rhs_register);
-    outputf("  snez %s, %s\n", result_register, result_register);
+    emit_insn(gen, INSN_ALU, "  xor %s, %s, %s\n", result_register,
+              lhs_register, rhs_register);
+    emit_insn(gen, INSN_ALU, "  snez %s, %s\n", result_register,
+              result_register);
     break;
   }
   case KOOPA_RBO_LT: {
-    outputf("  slt %s, %s, %s\n", result_register, lhs_register, rhs_register);
+    emit_insn(gen, INSN_ALU, "  slt %s, %s, %s\n", result_register,
+              lhs_register, rhs_register);
     break;
   }
   case KOOPA_RBO_LE: {
-    outputf("  slt %s, %s, %s\n", result_register, rhs_register, lhs_register);
-    outputf("  xori %s, %s, 1\n", result_register, result_register);
+    emit_insn(gen, INSN_ALU, "  slt %s, %s, %s\n", result_register,
+              rhs_register, lhs_register);
+    emit_insn(gen, INSN_ALU, "  xori %s, %s, 1\n", result_register,
+              result_register);
     break;
   }
   case KOOPA_RBO_GT: {
-    outputf("  slt %s, %s, %s\n", result_register, rhs_register, lhs_register);
+    emit_insn(gen, INSN_ALU, "  slt %s, %s, %s\n", result_register,
+              rhs_register, lhs_register);
     break;
   }
   case KOOPA_RBO_GE: {
-    outputf("  slt %s, %s, %s\n", result_register, lhs_register, rhs_register);
-    outputf("  xori %s, %s, 1\n", result_register, result_register);
+    emit_insn(gen, INSN_ALU, "  slt %s, %s, %s\n", result_register,
+              lhs_register, rhs_register);
+    emit_insn(gen, INSN_ALU, "  xori %s, %s, 1\n", result_register,
+              result_register);
     break;
   }
   case KOOPA_RBO_AND:
-    outputf("  and %s, %s, %s\n", result_register, lhs_register, rhs_register);
+    emit_insn(gen, INSN_ALU, "  and %s, %s, %s\n", result_register,
+              lhs_register, rhs_register);
     break;
   case KOOPA_RBO_OR:
-    outputf("  or %s, %s, %s\n", result_register, lhs_register, rhs_register);
+    emit_insn(gen, INSN_ALU, "  or %s, %s, %s\n", result_register, lhs_register,
+              rhs_register);
     break;
   default:
     fatalf("visit_koopa_raw_binary unknown op: %d\n", binary.op);
   }
   // 将结果存储到栈上
   if (tv_offset >= 0 && no_register) {
-    store_to_stack(result_register, tv_offset, "t1");
+    spill_to_stack(gen, result_register, tv_offset, "t1");
   }
 }
 
-static void visit_koopa_raw_load(const koopa_raw_load_t load, int tv_offset,
-                                 const koopa_raw_value_t value) {
+static void visit_koopa_raw_load(PerfGen *gen, const koopa_raw_load_t load,
+                                 int tv_offset, const koopa_raw_value_t value) {
   if (load.src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
-    outputf("    # load %s\n", load.src->name);
-    const char *src_reg = register_manager_load_value(load.src, "t0", "t0");
-    const char *dest_reg = register_manager_allocate(value);
-    if (strcmp(dest_reg, "") != 0) {
-      outputf("  mv %s, %s\n", dest_reg, src_reg);
+    outputf(gen, "    # load %s\n", load.src->name);
+    Register src_reg = register_manager_load_value(gen, load.src, REG_T0, "t0");
+    Register dest_reg = register_manager_allocate(gen, value);
+    if (dest_reg != REG_NONE) {
+      emit_insn(gen, INSN_MV, "  mv %s, %s\n", register_name(dest_reg),
+                register_name(src_reg));
     } else {
-      store_to_stack(src_reg, tv_offset, "t1");
+      spill_to_stack(gen, register_name(src_reg), tv_offset, "t1");
     }
   } else if (load.src->kind.tag == KOOPA_RVT_ALLOC) {
-    outputf("    # load %s\n", load.src->name);
-    const char *src_reg = register_manager_load_value(load.src, "t0", "t0");
-    const char *dest_reg = register_manager_allocate(value);
-    if (strcmp(dest_reg, "") != 0) {
-      outputf("  mv %s, %s\n", dest_reg, src_reg);
+    outputf(gen, "    # load %s\n", load.src->name);
+    Register src_reg = register_manager_load_value(gen, load.src, REG_T0, "t0");
+    Register dest_reg = register_manager_allocate(gen, value);
+    if (dest_reg != REG_NONE) {
+      emit_insn(gen, INSN_MV, "  mv %s, %s\n", register_name(dest_reg),
+                register_name(src_reg));
     } else {
-      store_to_stack(src_reg, tv_offset, "t1");
+      spill_to_stack(gen, register_name(src_reg), tv_offset, "t1");
     }
   } else if (load.src->kind.tag == KOOPA_RVT_GET_ELEM_PTR ||
              load.src->kind.tag == KOOPA_RVT_GET_PTR) {
-    outputf("    # load %%xxx\n");
+    outputf(gen, "    # load %%xxx\n");
     // 加载值
-    const char *src_reg = register_manager_load_value(load.src, "t0", "t0");
-    register_manager_free(src_reg);
+    Register src_reg = register_manager_load_value(gen, load.src, REG_T0, "t0");
+    register_manager_free(gen, src_reg);
     // 存的是地址，需要再取一次
-    outputf("  lw t0, 0(%s)\n", src_reg);
-    const char *dest_reg = register_manager_allocate(value);
-    if (strcmp(dest_reg, "") != 0) {
-      outputf("  mv %s, t0\n", dest_reg);
+    emit_insn(gen, INSN_LW, "  lw t0, 0(%s)\n", register_name(src_reg));
+    Register dest_reg = register_manager_allocate(gen, value);
+    if (dest_reg != REG_NONE) {
+      emit_insn(gen, INSN_MV, "  mv %s, t0\n", register_name(dest_reg));
     } else {
-      store_to_stack("t0", tv_offset, "t1");
+      spill_to_stack(gen, "t0", tv_offset, "t1");
     }
   } else {
     fatalf("visit_koopa_raw_load unknown src kind: %d\n", load.src->kind.tag);
   }
 }
 
-static void visit_koopa_raw_store(const koopa_raw_store_t store) {
-  outputf("    # store\n");
+static void visit_koopa_raw_store(PerfGen *gen, const koopa_raw_store_t store) {
+  outputf(gen, "    # store\n");
   if (store.dest->kind.tag == KOOPA_RVT_ALLOC ||
       store.dest->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
-    char src_reg[3] = {'t', '0', '\0'};
     if (store.value->kind.tag == KOOPA_RVT_FUNC_ARG_REF) {
       int index = store.value->kind.data.func_arg_ref.index;
+      const char *src_reg;
       if (index < 8) {
         // 参数在 a0 ~ a7 中
-        src_reg[0] = 'a';
-        src_reg[1] = '0' + index;
+        src_reg = register_name(REG_A0 + index);
       } else {
         // 参数在栈上
-        src_reg[0] = 't';
-        src_reg[1] = '0';
-        int offset = (int)stack_size + (index - 8) * 4;
-        load_from_stack(src_reg, offset, src_reg);
+        src_reg = "t0";
+        int offset = (int)gen->stack_size + (index - 8) * 4;
+        load_from_stack(gen, src_reg, offset, src_reg);
       }
       if (store.dest->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
-        outputf("  la t1, %s\n", store.dest->name + 1);
-        outputf("  sw %s, 0(t1)\n", src_reg);
+        emit_insn(gen, INSN_LA, "  la t1, %s\n", store.dest->name + 1);
+        emit_insn(gen, INSN_SW, "  sw %s, 0(t1)\n", src_reg);
       } else {
-        int offset = get_offset(store.dest->name);
-        store_to_stack(src_reg, offset, "t1");
+        int offset = get_offset(gen, store.dest);
+        store_to_stack(gen, src_reg, offset, "t1");
       }
     } else {
-      const char *reg = register_manager_load_value(store.value, src_reg, "t0");
-      register_manager_free(reg);
-      strncpy(src_reg, reg, 3);
-      const char *dest_reg = register_manager_allocate(store.dest);
-      if (strcmp(dest_reg, "") != 0) {
-        outputf("  mv %s, %s\n", dest_reg, src_reg);
+      Register reg = register_manager_load_value(gen, store.value, REG_T0,
+                                                 "t0");
+      register_manager_free(gen, reg);
+      const char *src_reg = register_name(reg);
+      Register dest_reg = register_manager_allocate(gen, store.dest);
+      if (dest_reg != REG_NONE) {
+        emit_insn(gen, INSN_MV, "  mv %s, %s\n", register_name(dest_reg),
+                  src_reg);
       } else {
         if (store.dest->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
-          outputf("  la t1, %s\n", store.dest->name + 1);
-          outputf("  sw %s, 0(t1)\n", src_reg);
+          emit_insn(gen, INSN_LA, "  la t1, %s\n", store.dest->name + 1);
+          emit_insn(gen, INSN_SW, "  sw %s, 0(t1)\n", src_reg);
         } else {
-          int offset = get_offset(store.dest->name);
-          store_to_stack(src_reg, offset, "t1");
+          int offset = get_offset(gen, store.dest);
+          store_to_stack(gen, src_reg, offset, "t1");
         }
       }
     }
 
   } else if (store.dest->kind.tag == KOOPA_RVT_GET_ELEM_PTR ||
-             store.dest->kind.tag == KOOPA_RVT_GET_PTR) {
-    const char *value_reg =
-        register_manager_load_value(store.value, "t0", "t0");
-    const char *dest_addr_reg =
-        register_manager_load_value(store.dest, "t1", "t1");
-    register_manager_free(value_reg);
-    register_manager_free(dest_addr_reg);
+             store.dest->kind.tag == KOOPA_RVT_GET_PTR ||
+             store.dest->kind.tag == KOOPA_RVT_LOAD ||
+             store.dest->kind.tag == KOOPA_RVT_BLOCK_ARG_REF ||
+             store.dest->kind.tag == KOOPA_RVT_FUNC_ARG_REF) {
+    // 地址是临时值，load 出来的是局部数组清零循环中的指针，
+    // mem2reg 之后这个指针是块参数
+    Register value_reg = register_manager_load_value(gen, store.value, REG_T0,
+                                                     "t0");
+    Register dest_addr_reg =
+        register_manager_load_value(gen, store.dest, REG_T1, "t1");
+    register_manager_free(gen, value_reg);
+    register_manager_free(gen, dest_addr_reg);
 
     // 将值保存到对应地址中
-    outputf("  sw %s, 0(%s)\n", value_reg, dest_addr_reg);
+    emit_insn(gen, INSN_SW, "  sw %s, 0(%s)\n", register_name(value_reg),
+              register_name(dest_addr_reg));
   } else {
     fatalf("visit_koopa_raw_store unknown dest kind: %d\n",
            store.dest->kind.tag);
   }
-  outputf("\n");
+  outputf(gen, "\n");
+}
+
+// 把跳转的实参复制到目标块参数的槽中，实参在寄存器中时直接使用
+static void copy_block_args(PerfGen *gen, const koopa_raw_slice_t args,
+                            const koopa_raw_basic_block_t target) {
+  // 实参是目标块前面的参数时，先复制到中转的槽，避免读到覆盖之后的值
+  bool overlap = riscv_block_args_overlap(args, target);
+  int scratch_offset =
+      gen->tv_manager.base_offset + gen->value_slots.scratch_slot * 4;
+  for (size_t i = 0; i < args.len; i++) {
+    Register reg = register_manager_load_value(gen, args.buffer[i], REG_T0,
+                                               "t0");
+    int offset = overlap ? scratch_offset + (int)i * 4
+                         : tv_manager_bget_offset(gen,
+                                                  target->params.buffer[i]);
+    store_to_stack(gen, register_name(reg), offset, "t1");
+    register_manager_free(gen, reg);
+  }
+  for (size_t i = 0; overlap && i < args.len; i++) {
+    load_from_stack(gen, "t0", scratch_offset + (int)i * 4, "t0");
+    store_to_stack(gen, "t0",
+                   tv_manager_bget_offset(gen, target->params.buffer[i]), "t1");
+  }
 }
 
-static void visit_koopa_raw_branch(const koopa_raw_branch_t branch) {
-  outputf("    # br xx, %s, %s\n", branch.true_bb->name, branch.false_bb->name);
-  const char *cond_register =
-      register_manager_load_value(branch.cond, "t0", "t0");
-  register_manager_free(cond_register);
+static void visit_koopa_raw_branch(PerfGen *gen,
+                                   const koopa_raw_branch_t branch) {
+  outputf(gen, "    # br xx, %s, %s\n", branch.true_bb->name,
+          branch.false_bb->name);
+  Register cond = register_manager_load_value(gen, branch.cond, REG_T0, "t0");
+  register_manager_free(gen, cond);
+  const char *cond_register = register_name(cond);
   // 跳转之前，需要将所有分配的寄存器的值保存到栈上
-  register_manager_flush();
+  // 之后复制实参时所有的值都从栈上读取
+  register_manager_flush(gen);
 
   // +1 是为了跳过基本块名前的 %
-  outputf("  bnez %s, %s\n", cond_register, branch.true_bb->name + 1);
-  outputf("  j %s\n", branch.false_bb->name + 1);
+  if (branch.true_args.len == 0) {
+    emit_insn(gen, INSN_BRANCH, "  bnez %s, %s.%s\n", cond_register,
+              gen->function_name, branch.true_bb->name + 1);
+    copy_block_args(gen, branch.false_args, branch.false_bb);
+    emit_insn(gen, INSN_BRANCH, "  j %s.%s\n", gen->function_name,
+              branch.false_bb->name + 1);
+    return;
+  }
+  // 真分支的边上有实参，条件不成立时跳过复制
+  if (branch.false_args.len == 0) {
+    emit_insn(gen, INSN_BRANCH, "  beqz %s, %s.%s\n", cond_register,
+              gen->function_name, branch.false_bb->name + 1);
+  } else {
+    emit_insn(gen, INSN_BRANCH, "  beqz %s, %s.%s.false\n", cond_register,
+              gen->function_name, gen->block_name + 1);
+  }
+  copy_block_args(gen, branch.true_args, branch.true_bb);
+  emit_insn(gen, INSN_BRANCH, "  j %s.%s\n", gen->function_name,
+            branch.true_bb->name + 1);
+  if (branch.false_args.len > 0) {
+    // 块名中没有 . ，这个标签不会和基本块的标签重复
+    outputf(gen, "%s.%s.false:\n", gen->function_name, gen->block_name + 1);
+    copy_block_args(gen, branch.false_args, branch.false_bb);
+    emit_insn(gen, INSN_BRANCH, "  j %s.%s\n", gen->function_name,
+              branch.false_bb->name + 1);
+  }
 }
 
-static void visit_koopa_raw_jump(const koopa_raw_jump_t jump) {
+static void visit_koopa_raw_jump(PerfGen *gen, const koopa_raw_jump_t jump) {
+  // 实参可能还在寄存器中，先复制再保存其他的值
+  copy_block_args(gen, jump.args, jump.target);
   // 跳转之前，需要将所有分配的寄存器的值保存到栈上
-  register_manager_flush();
-  outputf("    # jump %s\n", jump.target->name);
-  outputf("  j %s\n", jump.target->name + 1);
+  register_manager_flush(gen);
+  outputf(gen, "    # jump %s\n", jump.target->name);
+  emit_insn(gen, INSN_BRANCH, "  j %s.%s\n", gen->function_name,
+            jump.target->name + 1);
 }
 
-static void visit_koopa_raw_call(const koopa_raw_call_t call, int tv_offset) {
+static void visit_koopa_raw_call(PerfGen *gen, const koopa_raw_call_t call,
+                                 int tv_offset) {
   // 调用之前，需要将所有分配的寄存器的值保存到栈上
   // TODO 优化：恢复分配的寄存器
-  register_manager_flush();
-  outputf("    # call %s\n", call.callee->name);
+  register_manager_flush(gen);
+  outputf(gen, "    # call %s\n", call.callee->name);
   // 参数传递
   for (int i = 0; i < 8 && i < call.args.len; i++) {
     const koopa_raw_value_t arg = call.args.buffer[i];
     if (arg->kind.tag == KOOPA_RVT_INTEGER) {
       // 参数是常量，直接使用立即数
-      outputf("  li a%d, %d\n", i, arg->kind.data.integer.value);
+      emit_insn(gen, INSN_LI, "  li a%d, %d\n", i,
+                arg->kind.data.integer.value);
     } else {
-      int offset = tv_manager_bget_offset(arg);
+      int offset = tv_manager_bget_offset(gen, arg);
       char dst_reg[3] = {'a', '0' + i, '\0'};
-      load_from_stack(dst_reg, offset, "t0");
+      reload_from_stack(gen, dst_reg, offset, "t0");
     }
   }
   // 如果参数个数大于 8，需要额外的栈空间保存参数
@@ -626,68 +857,108 @@ static void visit_koopa_raw_call(const koopa_raw_call_t call, int tv_offset) {
     const koopa_raw_value_t arg = call.args.buffer[i];
     if (arg->kind.tag == KOOPA_RVT_INTEGER) {
       // 参数是常量，直接使用立即数
-      outputf("  li t0, %d\n", arg->kind.data.integer.value);
+      emit_insn(gen, INSN_LI, "  li t0, %d\n", arg->kind.data.integer.value);
     } else {
-      int offset = tv_manager_bget_offset(arg);
-      load_from_stack("t0", offset, "t0");
+      int offset = tv_manager_bget_offset(gen, arg);
+      reload_from_stack(gen, "t0", offset, "t0");
     }
     int offset = (i - 8) * 4;
-    store_to_stack("t0", offset, "t1");
+    store_to_stack(gen, "t0", offset, "t1");
   }
 
   // 调用函数
-  outputf("  call %s\n", call.callee->name + 1); // + 1 是为了跳过函数名前的 @
+  emit_insn(gen, INSN_CALL_RET, "  call %s\n",
+            call.callee->name + 1); // + 1 是为了跳过函数名前的 @
   if (tv_offset >= 0) {
     // 保存返回值
-    store_to_stack("a0", tv_offset, "t0");
-    // outputf("  mv t0, a0\n");
+    spill_to_stack(gen, "a0", tv_offset, "t0");
+    // emit_insn(gen, INSN_MV, "  mv t0, a0\n");
+  }
+}
+
+// 所有元素都是 0 的初始值，这样的全局变量放到 .bss 段
+static bool is_zero_global_init(const koopa_raw_value_t init) {
+  if (init->kind.tag == KOOPA_RVT_INTEGER) {
+    return init->kind.data.integer.value == 0;
+  } else if (init->kind.tag == KOOPA_RVT_AGGREGATE) {
+    for (size_t i = 0; i < init->kind.data.aggregate.elems.len; i++) {
+      if (!is_zero_global_init(init->kind.data.aggregate.elems.buffer[i])) {
+        return false;
+      }
+    }
+    return true;
   }
+  return init->kind.tag == KOOPA_RVT_ZERO_INIT;
 }
 
-static void visit_global_init(const koopa_raw_value_t init) {
+static void flush_global_zeros(PerfGen *gen, int *zero_bytes) {
+  if (*zero_bytes > 0) {
+    outputf(gen, "  .zero %d\n", *zero_bytes);
+    *zero_bytes = 0;
+  }
+}
+
+// 连续的 0 累加到 *zero_bytes ，碰到非 0 的值时合并成一条 .zero
+static void visit_global_init(PerfGen *gen, const koopa_raw_value_t init,
+                              int *zero_bytes) {
   if (init->kind.tag == KOOPA_RVT_INTEGER) {
-    outputf("  .word %d\n", init->kind.data.integer.value);
+    if (init->kind.data.integer.value == 0) {
+      *zero_bytes += 4;
+    } else {
+      flush_global_zeros(gen, zero_bytes);
+      outputf(gen, "  .word %d\n", init->kind.data.integer.value);
+    }
   } else if (init->kind.tag == KOOPA_RVT_AGGREGATE) {
     for (size_t i = 0; i < init->kind.data.aggregate.elems.len; i++) {
       const koopa_raw_value_t elem = init->kind.data.aggregate.elems.buffer[i];
-      visit_global_init(elem);
+      visit_global_init(gen, elem, zero_bytes);
     }
   } else if (init->kind.tag == KOOPA_RVT_ZERO_INIT) {
-    int size = get_type_size(init->ty);
-    for (size_t i = 0; i < (size / 4); i++) {
-      outputf("  .zero 4\n");
-    }
+    *zero_bytes += get_type_size(init->ty);
   } else {
     fatalf("viist_global_init unknown kind: %d\n", init->kind.tag);
   }
 }
 
-static void visit_koopa_raw_global_alloc(const koopa_raw_global_alloc_t alloc,
+static void visit_koopa_raw_global_alloc(PerfGen *gen,
+                                         const koopa_raw_global_alloc_t alloc,
                                          const char *name) {
-  new_global_variable(name);
-  outputf("\n");
-  outputf("  .global %s\n", name + 1);
-  outputf("%s:\n", name + 1);
-  visit_global_init(alloc.init);
+  new_global_variable(gen, name);
+  bool zero = is_zero_global_init(alloc.init);
+  outputf(gen, "\n");
+  if (zero) {
+    // 全局变量都在 .data 段中输出，放到 .bss 之后再切换回来
+    outputf(gen, "  .bss\n");
+  }
+  outputf(gen, "  .global %s\n", name + 1);
+  outputf(gen, "%s:\n", name + 1);
+  int zero_bytes = 0;
+  visit_global_init(gen, alloc.init, &zero_bytes);
+  flush_global_zeros(gen, &zero_bytes);
+  if (zero) {
+    outputf(gen, "  .data\n");
+  }
 }
 
-static void visit_koopa_raw_get_elem_ptr(const koopa_raw_get_elem_ptr_t gep,
+static void visit_koopa_raw_get_elem_ptr(PerfGen *gen,
+                                         const koopa_raw_get_elem_ptr_t gep,
                                          int tv_offset) {
-  outputf("    # get_elem_ptr\n");
+  outputf(gen, "    # get_elem_ptr\n");
   if (gep.src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
     // src type: *[t, len]
     // getelemptr = src + sizeof(t) * index
     // 全局变量
-    const char *index_reg = register_manager_load_value(gep.index, "t0", "t0");
-    register_manager_free(index_reg);
+    Register index = register_manager_load_value(gen, gep.index, REG_T0, "t0");
+    register_manager_free(gen, index);
+    const char *index_reg = register_name(index);
     // 计算 sizeof(t) * index
     int size = get_type_size(gep.src->ty->data.pointer.base->data.array.base);
-    outputf("  li t1, %d\n", size);
-    outputf("  mul t1, %s, t1\n", index_reg);
+    emit_insn(gen, INSN_LI, "  li t1, %d\n", size);
+    emit_insn(gen, INSN_MUL_DIV, "  mul t1, %s, t1\n", index_reg);
     // 加载全局变量地址到 t0
-    outputf("  la t0, %s\n", gep.src->name + 1);
-    outputf("  add t0, t0, t1\n");
-    store_to_stack("t0", tv_offset, "t1");
+    emit_insn(gen, INSN_LA, "  la t0, %s\n", gep.src->name + 1);
+    emit_insn(gen, INSN_ALU, "  add t0, t0, t1\n");
+    spill_to_stack(gen, "t0", tv_offset, "t1");
   } else if (gep.src->kind.tag == KOOPA_RVT_ALLOC) {
     // src type: *[t, len]
     // getelemptr = src + sizeof(t) * index
@@ -695,22 +966,24 @@ static void visit_koopa_raw_get_elem_ptr(const koopa_raw_get_elem_ptr_t gep,
     assert(gep.src->ty->data.pointer.base->tag == KOOPA_RTT_ARRAY);
     // 局部变量
     // 加载索引
-    const char *index_reg = register_manager_load_value(gep.index, "t0", "t0");
-    register_manager_free(index_reg);
+    Register index = register_manager_load_value(gen, gep.index, REG_T0, "t0");
+    register_manager_free(gen, index);
+    const char *index_reg = register_name(index);
     // 计算 sizeof(t) * index
     int size = get_type_size(gep.src->ty->data.pointer.base->data.array.base);
-    outputf("  li t1, %d\n", size);
-    outputf("  mul t1, %s, t1\n", index_reg);
+    emit_insn(gen, INSN_LI, "  li t1, %d\n", size);
+    emit_insn(gen, INSN_MUL_DIV, "  mul t1, %s, t1\n", index_reg);
     // 加载变量地址到 t0
-    int offset = get_offset(gep.src->name);
+    int offset = get_offset(gen, gep.src);
     if (offset <= 2048) {
-      outputf("  addi t0, sp, %d\n", offset);
+      emit_insn(gen, INSN_ALU, "  addi t0, sp, %d\n", offset);
     } else {
-      outputf("  li t0, %d\n", offset);
-      outputf("  add t0, sp, t0\n");
+      count_stat(gen, large_offsets);
+      emit_insn(gen, INSN_LI, "  li t0, %d\n", offset);
+      emit_insn(gen, INSN_ALU, "  add t0, sp, t0\n");
     }
-    outputf("  add t0, t0, t1\n");
-    store_to_stack("t0", tv_offset, "t1");
+    emit_insn(gen, INSN_ALU, "  add t0, t0, t1\n");
+    spill_to_stack(gen, "t0", tv_offset, "t1");
   } else if (gep.src->kind.tag == KOOPA_RVT_GET_ELEM_PTR ||
              gep.src->kind.tag == KOOPA_RVT_GET_PTR) {
     // src type: *[t, len] or *t
@@ -718,98 +991,121 @@ static void visit_koopa_raw_get_elem_ptr(const koopa_raw_get_elem_ptr_t gep,
     assert(gep.src->ty->tag == KOOPA_RTT_POINTER);
     assert(gep.src->ty->data.pointer.base->tag == KOOPA_RTT_ARRAY);
     // 加载索引到
-    const char *index_reg = register_manager_load_value(gep.index, "t0", "t0");
-    register_manager_free(index_reg);
+    Register index = register_manager_load_value(gen, gep.index, REG_T0, "t0");
+    register_manager_free(gen, index);
+    const char *index_reg = register_name(index);
 
     // 计算 sizeof(t) * index
     int size = get_type_size(gep.src->ty->data.pointer.base->data.array.base);
-    outputf("  li t1, %d\n", size);
-    outputf("  mul t1, %s, t1\n", index_reg);
+    emit_insn(gen, INSN_LI, "  li t1, %d\n", size);
+    emit_insn(gen, INSN_MUL_DIV, "  mul t1, %s, t1\n", index_reg);
 
     // 加载地址到
-    const char *addr_reg = register_manager_load_value(gep.src, "t0", "t0");
-    register_manager_free(addr_reg);
+    Register addr = register_manager_load_value(gen, gep.src, REG_T0, "t0");
+    register_manager_free(gen, addr);
+    const char *addr_reg = register_name(addr);
 
-    outputf("  add t0, %s, t1\n", addr_reg);
-    store_to_stack("t0", tv_offset, "t1");
+    emit_insn(gen, INSN_ALU, "  add t0, %s, t1\n", addr_reg);
+    spill_to_stack(gen, "t0", tv_offset, "t1");
   } else {
     fatalf("visit_koopa_raw_get_elem_ptr unknown src kind: %d\n",
            gep.src->kind.tag);
   }
 }
 
-static void visit_koopa_raw_get_ptr(const koopa_raw_get_ptr_t get_ptr,
+static void visit_koopa_raw_get_ptr(PerfGen *gen,
+                                    const koopa_raw_get_ptr_t get_ptr,
                                     int tv_offset) {
   // get_ptr = src + sizeof(t) * index
-  outputf("    # get_ptr\n");
+  outputf(gen, "    # get_ptr\n");
+  int size = get_type_size(get_ptr.src->ty->data.pointer.base);
+  if (get_ptr.index->kind.tag == KOOPA_RVT_INTEGER) {
+    // 下标是常量，直接加上偏移
+    int offset = size * get_ptr.index->kind.data.integer.value;
+    Register addr = register_manager_load_value(gen, get_ptr.src, REG_T0, "t0");
+    register_manager_free(gen, addr);
+    if (offset >= -2048 && offset < 2048) {
+      emit_insn(gen, INSN_ALU, "  addi t0, %s, %d\n", register_name(addr),
+                offset);
+    } else {
+      emit_insn(gen, INSN_LI, "  li t1, %d\n", offset);
+      emit_insn(gen, INSN_ALU, "  add t0, %s, t1\n", register_name(addr));
+    }
+    spill_to_stack(gen, "t0", tv_offset, "t1");
+    return;
+  }
   // 加载索引
-  const char *index_reg =
-      register_manager_load_value(get_ptr.index, "t0", "t0");
-  register_manager_free(index_reg);
+  Register index = register_manager_load_value(gen, get_ptr.index, REG_T0,
+                                               "t0");
+  register_manager_free(gen, index);
+  const char *index_reg = register_name(index);
   // 计算 sizeof(t)
-  int size = get_type_size(get_ptr.src->ty->data.pointer.base);
-  outputf("  li t1, %d\n", size);
-  outputf("  mul t1, %s, t1\n", index_reg);
+  emit_insn(gen, INSN_LI, "  li t1, %d\n", size);
+  emit_insn(gen, INSN_MUL_DIV, "  mul t1, %s, t1\n", index_reg);
   // 加载地址
-  const char *addr_reg = register_manager_load_value(get_ptr.src, "t0", "t0");
-  register_manager_free(addr_reg);
-  outputf("  add t0, %s, t1\n", addr_reg);
-  store_to_stack("t0", tv_offset, "t1");
+  Register addr = register_manager_load_value(gen, get_ptr.src, REG_T0, "t0");
+  register_manager_free(gen, addr);
+  const char *addr_reg = register_name(addr);
+  emit_insn(gen, INSN_ALU, "  add t0, %s, t1\n", addr_reg);
+  spill_to_stack(gen, "t0", tv_offset, "t1");
 }
 
-static void visit_koopa_raw_value(const koopa_raw_value_t value) {
+static void visit_koopa_raw_value(PerfGen *gen, const koopa_raw_value_t value) {
   koopa_raw_value_kind_t kind = value->kind;
-  int tv_offset = tv_manager_get_offset(value);
+  int tv_offset = tv_manager_get_offset(gen, value);
   switch (kind.tag) {
   case KOOPA_RVT_RETURN:
-    visit_koopa_raw_return(kind.data.ret);
+    visit_koopa_raw_return(gen, kind.data.ret);
     break;
   case KOOPA_RVT_INTEGER:
-    visit_koopa_raw_integer(kind.data.integer);
+    visit_koopa_raw_integer(gen, kind.data.integer);
     break;
   case KOOPA_RVT_BINARY:
-    visit_koopa_raw_binary(kind.data.binary, tv_offset, value);
+    visit_koopa_raw_binary(gen, kind.data.binary, tv_offset, value);
     break;
   case KOOPA_RVT_LOAD:
-    visit_koopa_raw_load(kind.data.load, tv_offset, value);
+    visit_koopa_raw_load(gen, kind.data.load, tv_offset, value);
     break;
   case KOOPA_RVT_STORE:
-    visit_koopa_raw_store(kind.data.store);
+    visit_koopa_raw_store(gen, kind.data.store);
     break;
   case KOOPA_RVT_ALLOC:
     // 分配局部变量
     // nothing to do
-    outputf("    # alloc %s\n", value->name);
+    outputf(gen, "    # alloc %s\n", value->name);
     break;
   case KOOPA_RVT_BRANCH:
-    visit_koopa_raw_branch(kind.data.branch);
+    visit_koopa_raw_branch(gen, kind.data.branch);
     break;
   case KOOPA_RVT_JUMP:
-    visit_koopa_raw_jump(kind.data.jump);
+    visit_koopa_raw_jump(gen, kind.data.jump);
     break;
   case KOOPA_RVT_CALL:
-    visit_koopa_raw_call(kind.data.call, tv_offset);
+    visit_koopa_raw_call(gen, kind.data.call, tv_offset);
     break;
   case KOOPA_RVT_GLOBAL_ALLOC:
-    visit_koopa_raw_global_alloc(kind.data.global_alloc, value->name);
+    visit_koopa_raw_global_alloc(gen, kind.data.global_alloc, value->name);
     break;
   case KOOPA_RVT_GET_ELEM_PTR:
-    visit_koopa_raw_get_elem_ptr(kind.data.get_elem_ptr, tv_offset);
+    visit_koopa_raw_get_elem_ptr(gen, kind.data.get_elem_ptr, tv_offset);
     break;
   case KOOPA_RVT_GET_PTR:
-    visit_koopa_raw_get_ptr(kind.data.get_ptr, tv_offset);
+    visit_koopa_raw_get_ptr(gen, kind.data.get_ptr, tv_offset);
     break;
   default:
     fatalf("visit_koopa_raw_value unknown kind: %d\n", kind.tag);
   }
 }
 
-static void visit_koopa_raw_basic_block(const koopa_raw_basic_block_t block) {
+static void visit_koopa_raw_basic_block(PerfGen *gen,
+                                        const koopa_raw_basic_block_t block) {
+  gen->block_name = block->name;
   // %entry 前已经输出了函数名，所以这里不需要输出 %entry 这个基本块名
   if (strcmp(block->name, "%entry") != 0) {
-    outputf("\n%s:\n", block->name + 1); // + 1 是为了跳过基本块名前的 %
+    // + 1 是为了跳过基本块名前的 %
+    outputf(gen, "\n%s.%s:\n", gen->function_name, block->name + 1);
   }
-  visit_koopa_raw_slice(block->insts);
+  visit_koopa_raw_slice(gen, block->insts);
 }
 
 static bool is_temp_value(const koopa_raw_value_t value) {
@@ -824,7 +1120,7 @@ static bool is_temp_value(const koopa_raw_value_t value) {
          value->ty->tag != KOOPA_RTT_UNIT;
 }
 
-static void handle_tv_stack(const koopa_raw_value_t value) {
+static void handle_tv_stack(PerfGen *gen, const koopa_raw_value_t value) {
   switch (value->kind.tag) {
   case KOOPA_RVT_INTEGER:
   case KOOPA_RVT_ZERO_INIT:
@@ -843,7 +1139,7 @@ static void handle_tv_stack(const koopa_raw_value_t value) {
   case KOOPA_RVT_LOAD: {
     koopa_raw_value_t src = value->kind.data.load.src;
     if (is_temp_value(src)) {
-      tv_manager_pop(1);
+      tv_manager_pop(gen, 1);
     }
     break;
   }
@@ -852,10 +1148,10 @@ static void handle_tv_stack(const koopa_raw_value_t value) {
     koopa_raw_value_t dest = value->kind.data.store.dest;
     koopa_raw_value_t src = value->kind.data.store.value;
     if (is_temp_value(src)) {
-      tv_manager_pop(1);
+      tv_manager_pop(gen, 1);
     }
     if (is_temp_value(dest)) {
-      tv_manager_pop(1);
+      tv_manager_pop(gen, 1);
     }
     break;
   }
@@ -863,7 +1159,7 @@ static void handle_tv_stack(const koopa_raw_value_t value) {
   case KOOPA_RVT_GET_PTR: {
     koopa_raw_value_t src = value->kind.data.get_ptr.src;
     if (is_temp_value(src)) {
-      tv_manager_pop(1);
+      tv_manager_pop(gen, 1);
     }
     break;
   }
@@ -871,7 +1167,7 @@ static void handle_tv_stack(const koopa_raw_value_t value) {
   case KOOPA_RVT_GET_ELEM_PTR: {
     koopa_raw_value_t src = value->kind.data.get_elem_ptr.src;
     if (is_temp_value(src)) {
-      tv_manager_pop(1);
+      tv_manager_pop(gen, 1);
     }
     break;
   }
@@ -880,10 +1176,10 @@ static void handle_tv_stack(const koopa_raw_value_t value) {
     koopa_raw_value_t lhs = value->kind.data.binary.lhs;
     koopa_raw_value_t rhs = value->kind.data.binary.rhs;
     if (is_temp_value(lhs)) {
-      tv_manager_pop(1);
+      tv_manager_pop(gen, 1);
     }
     if (is_temp_value(rhs)) {
-      tv_manager_pop(1);
+      tv_manager_pop(gen, 1);
     }
     break;
   }
@@ -891,7 +1187,7 @@ static void handle_tv_stack(const koopa_raw_value_t value) {
   case KOOPA_RVT_BRANCH: {
     koopa_raw_value_t cond = value->kind.data.branch.cond;
     if (is_temp_value(cond)) {
-      tv_manager_pop(1);
+      tv_manager_pop(gen, 1);
     }
     break;
   }
@@ -904,7 +1200,7 @@ static void handle_tv_stack(const koopa_raw_value_t value) {
     for (size_t i = 0; i < call.args.len; i++) {
       koopa_raw_value_t arg = call.args.buffer[i];
       if (is_temp_value(arg)) {
-        tv_manager_pop(1);
+        tv_manager_pop(gen, 1);
       }
     }
     break;
@@ -913,7 +1209,7 @@ static void handle_tv_stack(const koopa_raw_value_t value) {
   case KOOPA_RVT_RETURN: {
     koopa_raw_value_t ret = value->kind.data.ret.value;
     if (is_temp_value(ret)) {
-      tv_manager_pop(1);
+      tv_manager_pop(gen, 1);
     }
     break;
   }
@@ -925,7 +1221,8 @@ static void handle_tv_stack(const koopa_raw_value_t value) {
 
 // 给临时变量分配栈空间
 __attribute__((unused)) static void
-assign_stack_of_temp_value(const koopa_raw_slice_t slice, int base_offset) {
+assign_stack_of_temp_value(PerfGen *gen, const koopa_raw_slice_t slice,
+                           int base_offset) {
   /*
     由于临时变量都是用完就丢，所以我们可以用表达式栈来确定临时变量的栈偏移，这样可以减少栈空间的使用
     比如
@@ -938,22 +1235,51 @@ assign_stack_of_temp_value(const koopa_raw_slice_t slice, int base_offset) {
 
     这种情况我们只需要两个临时变量的栈空间，而不需要三个
   */
-  tv_manager_reinit(base_offset);
+  tv_manager_reinit(gen, base_offset);
   for (size_t i = 0; i < slice.len; i++) {
     const koopa_raw_basic_block_t block = slice.buffer[i];
     for (size_t j = 0; j < block->insts.len; j++) {
       const koopa_raw_value_t value = block->insts.buffer[j];
-      handle_tv_stack(value);
+      handle_tv_stack(gen, value);
       if (value->ty->tag != KOOPA_RTT_UNIT &&
           value->kind.tag != KOOPA_RVT_ALLOC) {
-        tv_manager_push(value);
+        tv_manager_push(gen, value);
       }
     }
   }
 }
 
-static void visit_koopa_raw_function(const koopa_raw_function_t func) {
-  locals_reset();
+/*
+ * 入口块开始时参数还在 a0 ~ a7 中，直接作为这些值所在的寄存器，
+ * 用到它们的地方不需要先读栈，flush 时才保存到各自的槽中
+ * 第 8 个之后的参数在调用者的栈上，复制到自己的槽中
+ */
+static void bind_params(PerfGen *gen, const koopa_raw_function_t func) {
+  for (size_t i = 0; i < func->params.len; i++) {
+    koopa_raw_value_t param = func->params.buffer[i];
+    int offset = tv_manager_get_offset(gen, param);
+    if (offset < 0) {
+      continue;
+    }
+    if (i < 8) {
+      Register reg = REG_A0 + i;
+      gen->register_manager.free_mask &= ~(1u << reg);
+      gen->register_manager.values[reg] = param;
+      value_map_put(&gen->register_manager.locations, param, reg);
+    } else {
+      load_from_stack(gen, "t0", (int)gen->stack_size + ((int)i - 8) * 4, "t0");
+      store_to_stack(gen, "t0", offset, "t1");
+    }
+  }
+}
+
+static void visit_koopa_raw_function(PerfGen *gen,
+                                     const koopa_raw_function_t func) {
+  gen->function_name = func->name + 1;
+#ifdef DEBUG_LOG
+  value_map_clear(&gen->comment_ids);
+#endif
+  locals_reset(gen);
   /**
     栈帧变量分配情况，从低到高依次为：
       调用函数参数
@@ -967,10 +1293,13 @@ static void visit_koopa_raw_function(const koopa_raw_function_t func) {
       sp +  0: @x
   */
   // 计算函数需要的栈空间
-  stack_size = 0;
-  has_call = false;
+  gen->stack_size = 0;
+  gen->has_call = false;
   int max_call_args = 0;
   int temp_base_offset = 0; // 临时变量的基地址
+  gen->has_value_slots = riscv_assign_value_slots(func, &gen->tv_manager.depths,
+                                                  &gen->use_counts,
+                                                  &gen->value_slots);
   for (size_t i = 0; i < func->bbs.len; i++) {
     const koopa_raw_basic_block_t block = func->bbs.buffer[i];
     for (size_t j = 0; j < block->insts.len; j++) {
@@ -979,26 +1308,26 @@ static void visit_koopa_raw_function(const koopa_raw_function_t func) {
         // 指令存在返回值，需要分配栈空间
         if (value->kind.tag == KOOPA_RVT_ALLOC) {
           // 分配局部变量
-          Variable *variable = new_variable(value->name);
+          Variable *variable = new_variable(gen, value);
           assert(value->ty->tag == KOOPA_RTT_POINTER);
           const struct koopa_raw_type_kind *pval = value->ty->data.pointer.base;
           switch (pval->tag) {
           case KOOPA_RTT_INT32:
-            stack_size += 4;
+            gen->stack_size += 4;
             variable->size = 4;
             variable->type = VariableType_int;
             temp_base_offset += variable->size;
             break;
           case KOOPA_RTT_ARRAY: {
             int size = get_type_size(pval);
-            stack_size += size;
+            gen->stack_size += size;
             variable->size = size;
             variable->type = VariableType_array;
             temp_base_offset += variable->size;
             break;
           }
           case KOOPA_RTT_POINTER:
-            stack_size += 4;
+            gen->stack_size += 4;
             variable->size = 4;
             variable->type = VariableType_pointer;
             temp_base_offset += variable->size;
@@ -1007,78 +1336,78 @@ static void visit_koopa_raw_function(const koopa_raw_function_t func) {
             fatalf("visit_koopa_raw_function alloc unknown type: %d\n",
                    value->ty->tag);
           }
-        } else {
-          stack_size += 4;
+        } else if (!gen->has_value_slots) {
+          gen->stack_size += 4;
         }
       }
       if (value->kind.tag == KOOPA_RVT_CALL) {
-        has_call = true;
+        gen->has_call = true;
         max_call_args = MAX(max_call_args, value->kind.data.call.args.len);
       }
     }
   }
-  if (has_call) {
+  if (gen->has_call) {
     // 如果函数调用了其他函数，需要额外的栈空间保存 ra 寄存器
-    stack_size += 4;
+    gen->stack_size += 4;
     // 需要额外的栈空间保存 t0-6 a0-7 寄存器
-    stack_size += REGISTER_COUNT * 4;
+    gen->stack_size += REGISTER_COUNT * 4;
   }
   if (max_call_args > 8) {
     // 如果函数调用的参数个数大于 8，需要额外的栈空间保存参数
     int size = (max_call_args - 8) * 4;
-    stack_size += size;
+    gen->stack_size += size;
     temp_base_offset += size;
-    locals_add_offset(size);
+    locals_add_offset(gen, size);
   }
-  assign_stack_of_temp_value(func->bbs, temp_base_offset);
-  stack_size += (tv_manager_get_max_depth() * 4);
+  locals_index(gen);
+  if (gen->has_value_slots) {
+    tv_manager_use_slots(gen, temp_base_offset, gen->value_slots.slot_count);
+  } else {
+    assign_stack_of_temp_value(gen, func->bbs, temp_base_offset);
+  }
+  gen->stack_size += (tv_manager_get_max_depth(gen) * 4);
   // 对齐到 16 字节
-  stack_size = (stack_size + 15) & ~15;
+  gen->stack_size = (gen->stack_size + 15) & ~15;
+  if (gen->current_stats != NULL) {
+    gen->current_stats->frame_size = (int)gen->stack_size;
+  }
 
-  outputf("%s:\n", func->name + 1); // + 1 是为了跳过函数名前的 @
-  if (stack_size >= 2048) {
-    outputf("  li t0, -%zu\n", stack_size);
-    outputf("  add sp, sp, t0\n");
+  outputf(gen, "%s:\n", func->name + 1); // + 1 是为了跳过函数名前的 @
+  if (gen->stack_size >= 2048) {
+    count_stat(gen, large_offsets);
+    emit_insn(gen, INSN_LI, "  li t0, -%zu\n", gen->stack_size);
+    emit_insn(gen, INSN_ALU, "  add sp, sp, t0\n");
   } else {
-    outputf("  addi sp, sp, -%zu\n", stack_size);
+    emit_insn(gen, INSN_ALU, "  addi sp, sp, -%zu\n", gen->stack_size);
   }
-  if (has_call) {
+  if (gen->has_call) {
     // 保存 ra 寄存器
-    int offset = stack_size - 4;
-    store_to_stack("ra", offset, "t0");
+    int offset = gen->stack_size - 4;
+    store_to_stack(gen, "ra", offset, "t0");
   }
 
   for (size_t i = 0; i < func->bbs.len; i++) {
     // 实现基本块的寄存器分配
-    register_manager_init();
+    register_manager_init(gen);
+    if (i == 0 && gen->has_value_slots) {
+      bind_params(gen, func);
+    }
     assert(func->bbs.kind == KOOPA_RSIK_BASIC_BLOCK);
     const koopa_raw_basic_block_t block = func->bbs.buffer[i];
-    visit_koopa_raw_basic_block(block);
+    visit_koopa_raw_basic_block(gen, block);
   }
 }
 
-static void visit_koopa_raw_slice(const koopa_raw_slice_t slice) {
+static void visit_koopa_raw_slice(PerfGen *gen, const koopa_raw_slice_t slice) {
   for (size_t i = 0; i < slice.len; i++) {
     const void *ptr = slice.buffer[i];
     // 根据 slice 的 kind 决定将 ptr 视作何种元素
     switch (slice.kind) {
-    case KOOPA_RSIK_FUNCTION: {
-      koopa_raw_function_t func = ptr;
-      if (func->bbs.len == 0) {
-        // 如果函数没有基本块，说明只是函数声明，直接跳过
-        continue;
-      }
-      // + 1 是为了跳过函数名前的 @
-      outputf("\n");
-      outputf("  .global %s\n", ((koopa_raw_function_t)ptr)->name + 1);
-      visit_koopa_raw_function(ptr);
-      break;
-    }
     case KOOPA_RSIK_BASIC_BLOCK:
-      visit_koopa_raw_basic_block(ptr);
+      visit_koopa_raw_basic_block(gen, ptr);
       break;
     case KOOPA_RSIK_VALUE: {
-      visit_koopa_raw_value(ptr);
+      visit_koopa_raw_value(gen, ptr);
       break;
     }
     default:
@@ -1087,22 +1416,405 @@ static void visit_koopa_raw_slice(const koopa_raw_slice_t slice) {
   }
 }
 
-static void visit_koopa_raw_program(const koopa_raw_program_t program) {
-  outputf("  .data\n");
-  visit_koopa_raw_slice(program.values); // 全局变量
-  outputf("  .text\n");
-  visit_koopa_raw_slice(program.funcs); // 函数
+// 每个线程第一次生成函数之前调用，函数之间复用这些表
+static void function_state_init(PerfGen *gen) {
+#ifdef DEBUG_LOG
+  value_map_init(&gen->comment_ids);
+#endif
+  value_map_init(&gen->local_offsets);
+  value_map_init(&gen->tv_manager.depths);
+  value_map_init(&gen->use_counts);
+  value_map_init(&gen->register_manager.locations);
+}
+
+static void function_state_free(PerfGen *gen) {
+#ifdef DEBUG_LOG
+  value_map_free(&gen->comment_ids);
+#endif
+  free_variables(&gen->locals);
+  value_map_free(&gen->local_offsets);
+  value_map_free(&gen->tv_manager.depths);
+  value_map_free(&gen->use_counts);
+  value_map_free(&gen->register_manager.locations);
+}
+
+// stats 不为 NULL 时把这个函数的统计记在里面
+static void generate_function_definition(PerfGen *gen,
+                                         const koopa_raw_function_t func,
+                                         FunctionStats *stats) {
+  if (stats != NULL) {
+    stats->name = strdup(func->name + 1);
+  }
+  gen->current_stats = stats;
+  // + 1 是为了跳过函数名前的 @
+  outputf(gen, "\n");
+  outputf(gen, "  .global %s\n", func->name + 1);
+  visit_koopa_raw_function(gen, func);
+  gen->current_stats = NULL;
+}
+
+// 开启缓存时，IR 生成阶段记录了函数的键，用它查找之前生成的汇编
+// 需要统计时总是重新生成
+static void visit_function_definition(PerfGen *gen,
+                                      const koopa_raw_function_t func,
+                                      FunctionStats *stats) {
+  CompileContext *ctx = gen->ctx;
+  CacheKey key;
+  if (ctx->cache == NULL || stats != NULL ||
+      !cache_key_map_get(&ctx->function_keys, func->name + 1, &key)) {
+    generate_function_definition(gen, func, stats);
+    return;
+  }
+  StringBuffer text;
+  string_buffer_init(&text);
+  if (!cache_load(ctx->cache, key, CACHE_PERF, &text)) {
+    Emitter *saved = gen->emitter;
+    Emitter output;
+    emitter_init(&output, &text);
+    gen->emitter = &output;
+    generate_function_definition(gen, func, NULL);
+    gen->emitter = saved;
+    cache_store(ctx->cache, key, CACHE_PERF, text.data, text.size);
+  }
+  emit_bytes(gen->emitter, text.data, text.size);
+  string_buffer_free(&text);
+}
+
+typedef struct {
+  CompileContext *ctx;
+  koopa_raw_function_t *funcs;
+  StringBuffer *outputs; // 每个函数的汇编
+  FunctionStats *stats;  // 每个函数的统计，没有开启 -stats 时为 NULL
+} FunctionJobs;
+
+// 在线程池中生成一个函数，结果写到它自己的缓冲区
+// 函数用不到全局变量的记录，每个任务用一份新的状态
+static void function_task(void *arg, int worker, int index) {
+  (void)worker;
+  FunctionJobs *jobs = arg;
+  Emitter output;
+  // 工作线程自己统计，当前线程执行时嵌套在 riscv_perf_codegen 的阶段里
+  phase_begin(PHASE_BACKEND);
+  string_buffer_init(&jobs->outputs[index]);
+  emitter_init(&output, &jobs->outputs[index]);
+  PerfGen gen = {0};
+  gen.ctx = jobs->ctx;
+  gen.emitter = &output;
+  function_state_init(&gen);
+  visit_function_definition(&gen, jobs->funcs[index],
+                            jobs->stats != NULL ? &jobs->stats[index] : NULL);
+  function_state_free(&gen);
+  phase_end(PHASE_BACKEND);
+}
+
+/*
+ * 函数之间互不依赖（全局变量只在 .data 段生成时记录），可以并行生成
+ * threads > 1 时每个函数先生成到自己的缓冲区，最后按原来的顺序拼接，
+ * 所以输出和串行生成完全相同。
+ * 串行时直接写到输出，不需要额外的缓冲区。
+ */
+static void visit_koopa_raw_functions(PerfGen *gen,
+                                      const koopa_raw_slice_t slice) {
+  CompileContext *ctx = gen->ctx;
+  assert(slice.kind == KOOPA_RSIK_FUNCTION);
+  // 没有基本块的函数只是函数声明，直接跳过
+  koopa_raw_function_t *funcs = malloc(sizeof(*funcs) * (slice.len + 1));
+  int func_count = 0;
+  for (size_t i = 0; i < slice.len; i++) {
+    koopa_raw_function_t func = slice.buffer[i];
+    if (func->bbs.len > 0) {
+      funcs[func_count++] = func;
+    }
+  }
+
+  FunctionStats *stats = NULL;
+  if (riscv_stats_enabled()) {
+    stats = calloc(func_count + 1, sizeof(FunctionStats));
+  }
+
+  if (ctx->threads <= 1 || func_count <= 1) {
+    for (int i = 0; i < func_count; i++) {
+      visit_function_definition(gen, funcs[i],
+                                stats != NULL ? &stats[i] : NULL);
+    }
+  } else {
+    FunctionJobs jobs = {ctx, funcs,
+                        malloc(sizeof(StringBuffer) * func_count), stats};
+    thread_pool_run(ctx->threads, func_count, function_task, &jobs);
+    for (int i = 0; i < func_count; i++) {
+      emit_bytes(gen->emitter, jobs.outputs[i].data, jobs.outputs[i].size);
+      string_buffer_free(&jobs.outputs[i]);
+    }
+    free(jobs.outputs);
+  }
+  if (stats != NULL) {
+    riscv_stats_commit(ctx->input_file, ctx->input_index, stats, func_count);
+  }
+  free(funcs);
+}
+
+static void visit_koopa_raw_program(PerfGen *gen,
+                                    const koopa_raw_program_t program) {
+  outputf(gen, "  .data\n");
+  visit_koopa_raw_slice(gen, program.values); // 全局变量
+  outputf(gen, "  .text\n");
+  visit_koopa_raw_functions(gen, program.funcs); // 函数
 }
 
 // #endregion
 
-void riscv_perf_codegen(const char *ir, const char *output_file) {
-  fp = fopen(output_file, "w");
-  if (fp == NULL) {
-    fprintf(stderr, "无法打开文件 %s\n", output_file);
-    exit(1);
+// #region 流式生成
+
+/*
+ * 流式生成时每次收到一个全局定义或者一个函数的 IR 片段。
+ * 片段里引用的其他全局符号没有定义，解析不了，
+ * 所以为每个生成过的全局符号记录一条声明（全局变量写成 zeroinit ），
+ * 解析之前把片段引用到的声明加到前面，组成一个完整的小程序。
+ * 声明只按片段实际引用的符号添加，处理一个片段的代价和前面有多少定义无关。
+ */
+struct PerfStream {
+  PerfGen gen;
+  Emitter output;
+  const char *section;  // 当前所在的段，段变化时才输出 .data 或 .text
+  InternPool names;     // 已经声明的全局符号名
+  ValueMap declared;    // 驻留的符号名 -> declarations 中的编号
+  Arena arena;          // 声明的文本
+  const char **declarations;
+  int *last_used;       // 最后一次被哪个片段引用，避免重复添加
+  int declaration_count;
+  int declaration_capacity;
+  int chunk_index;
+  StringBuffer program; // 声明加上片段
+};
+
+static void emit_type(Emitter *out, const struct koopa_raw_type_kind *ty) {
+  switch (ty->tag) {
+  case KOOPA_RTT_INT32:
+    emit_str(out, "i32");
+    break;
+  case KOOPA_RTT_ARRAY:
+    emit_char(out, '[');
+    emit_type(out, ty->data.array.base);
+    emitf(out, ", %zu]", ty->data.array.len);
+    break;
+  case KOOPA_RTT_POINTER:
+    emit_char(out, '*');
+    emit_type(out, ty->data.pointer.base);
+    break;
+  default:
+    fatalf("emit_type unknown type: %d\n", ty->tag);
+  }
+}
+
+static int find_declaration(PerfStream *stream, const char *name,
+                            size_t length) {
+  const char *interned = intern_find(&stream->names, name, length);
+  int index;
+  if (interned == NULL || !value_map_get(&stream->declared, interned, &index)) {
+    return -1;
+  }
+  return index;
+}
+
+static void add_declaration(PerfStream *stream, const char *name,
+                            StringBuffer *text) {
+  if (stream->declaration_count == stream->declaration_capacity) {
+    stream->declaration_capacity *= 2;
+    stream->declarations =
+        realloc(stream->declarations,
+                sizeof(const char *) * stream->declaration_capacity);
+    stream->last_used =
+        realloc(stream->last_used, sizeof(int) * stream->declaration_capacity);
   }
+  int index = stream->declaration_count++;
+  stream->declarations[index] =
+      arena_strndup(&stream->arena, text->data, text->size);
+  stream->last_used[index] = 0;
+  value_map_put(&stream->declared, intern(&stream->names, name, strlen(name)),
+                index);
+}
+
+// global @x = alloc T, zeroinit
+static void declare_global(PerfStream *stream, const koopa_raw_value_t value) {
+  StringBuffer text = {0};
+  Emitter out;
+  emitter_init(&out, &text);
+  emitf(&out, "global %s = alloc ", value->name);
+  emit_type(&out, value->ty->data.pointer.base);
+  emit_str(&out, ", zeroinit\n");
+  add_declaration(stream, value->name, &text);
+  string_buffer_free(&text);
+}
+
+// decl @f(T1, T2): R
+static void declare_function(PerfStream *stream,
+                             const koopa_raw_function_t func) {
+  StringBuffer text = {0};
+  Emitter out;
+  emitter_init(&out, &text);
+  emitf(&out, "decl %s(", func->name);
+  koopa_raw_slice_t params = func->ty->data.function.params;
+  for (size_t i = 0; i < params.len; i++) {
+    if (i > 0) {
+      emit_str(&out, ", ");
+    }
+    emit_type(&out, params.buffer[i]);
+  }
+  emit_char(&out, ')');
+  if (func->ty->data.function.ret->tag != KOOPA_RTT_UNIT) {
+    emit_str(&out, ": ");
+    emit_type(&out, func->ty->data.function.ret);
+  }
+  emit_char(&out, '\n');
+  add_declaration(stream, func->name, &text);
+  string_buffer_free(&text);
+}
+
+static void stream_section(PerfStream *stream, const char *section) {
+  if (stream->section != section) {
+    outputf(&stream->gen, "%s", section);
+    stream->section = section;
+  }
+}
+
+// 片段里出现的 @name 如果是之前声明过的全局符号，把声明加到 program 前面
+static void add_referenced_declarations(PerfStream *stream, const char *ir,
+                                        Emitter *program) {
+  for (const char *p = strchr(ir, '@'); p != NULL; p = strchr(p, '@')) {
+    const char *start = p++;
+    while (isalnum((unsigned char)*p) || *p == '_') {
+      p++;
+    }
+    int index = find_declaration(stream, start, p - start);
+    if (index >= 0 && stream->last_used[index] != stream->chunk_index) {
+      stream->last_used[index] = stream->chunk_index;
+      emit_str(program, stream->declarations[index]);
+    }
+  }
+}
+
+PerfStream *riscv_perf_stream_begin(CompileContext *ctx,
+                                    const char *output_file) {
+  PerfStream *stream = calloc(1, sizeof(PerfStream));
+  if (stream == NULL) {
+    fatalf("无法分配内存\n");
+  }
+  emitter_open(&stream->output, output_file);
+  stream->gen.ctx = ctx;
+  stream->gen.emitter = &stream->output;
+  stream->section = NULL;
+  intern_pool_init(&stream->names);
+  value_map_init(&stream->declared);
+  arena_init(&stream->arena);
+  stream->declaration_capacity = 64;
+  stream->declaration_count = 0;
+  stream->declarations = malloc(sizeof(const char *) * 64);
+  stream->last_used = malloc(sizeof(int) * 64);
+  stream->chunk_index = 0;
+  string_buffer_init(&stream->program);
+  function_state_init(&stream->gen);
+  return stream;
+}
+
+void riscv_perf_stream_chunk(PerfStream *stream, const char *ir) {
+  PerfGen *gen = &stream->gen;
+  stream->chunk_index++;
+  stream->program.size = 0;
+  Emitter program;
+  emitter_init(&program, &stream->program);
+  add_referenced_declarations(stream, ir, &program);
+  emit_str(&program, ir);
+
+  phase_begin(PHASE_KOOPA_BUILD);
+  koopa_program_t koopa_program;
+  koopa_error_code_t ret =
+      koopa_parse_from_string(stream->program.data, &koopa_program);
+  assert(ret == KOOPA_EC_SUCCESS); // 确保解析时没有出错
+  koopa_raw_program_builder_t builder = koopa_new_raw_program_builder();
+  koopa_raw_program_t raw = koopa_build_raw_program(builder, koopa_program);
+  koopa_delete_program(koopa_program);
+  phase_end(PHASE_KOOPA_BUILD);
+
+  // 加在前面的声明已经生成过了，只处理片段自己定义的符号
+  phase_begin(PHASE_BACKEND);
+  for (size_t i = 0; i < raw.values.len; i++) {
+    koopa_raw_value_t value = raw.values.buffer[i];
+    if (find_declaration(stream, value->name, strlen(value->name)) < 0) {
+      stream_section(stream, "  .data\n");
+      visit_koopa_raw_value(gen, value);
+      declare_global(stream, value);
+    }
+  }
+  for (size_t i = 0; i < raw.funcs.len; i++) {
+    koopa_raw_function_t func = raw.funcs.buffer[i];
+    if (find_declaration(stream, func->name, strlen(func->name)) < 0) {
+      if (func->bbs.len > 0) {
+        stream_section(stream, "  .text\n");
+        FunctionStats *stats = NULL;
+        if (riscv_stats_enabled()) {
+          stats = calloc(1, sizeof(FunctionStats));
+        }
+        visit_function_definition(gen, func, stats);
+        if (stats != NULL) {
+          riscv_stats_commit(gen->ctx->input_file, gen->ctx->input_index, stats,
+                             1);
+        }
+      }
+      declare_function(stream, func);
+    }
+  }
+  phase_end(PHASE_BACKEND);
+  phase_begin(PHASE_KOOPA_BUILD);
+  koopa_delete_raw_program_builder(builder);
+  phase_end(PHASE_KOOPA_BUILD);
+}
+
+void riscv_perf_stream_end(PerfStream *stream) {
+  function_state_free(&stream->gen);
+  free_variables(&stream->gen.globals);
+  string_buffer_free(&stream->program);
+  free(stream->declarations);
+  free(stream->last_used);
+  arena_release(&stream->arena);
+  value_map_free(&stream->declared);
+  intern_pool_free(&stream->names);
+  emitter_close(&stream->output);
+  free(stream);
+}
+
+// #endregion
+
+void riscv_perf_codegen_program(CompileContext *ctx,
+                                const koopa_raw_program_t *program,
+                                Emitter *output) {
+  phase_begin(PHASE_BACKEND);
+  PerfGen gen = {0};
+  gen.ctx = ctx;
+  gen.emitter = output;
+  function_state_init(&gen);
+  // 服务模式下出错时先释放状态，再跳回外层设置的位置
+  jmp_buf trap;
+  jmp_buf *outer = set_error_trap(NULL);
+  if (outer != NULL) {
+    set_error_trap(&trap);
+    if (setjmp(trap) != 0) {
+      function_state_free(&gen);
+      free_variables(&gen.globals);
+      set_error_trap(outer);
+      compile_error_exit();
+    }
+  }
+  visit_koopa_raw_program(&gen, *program);
+  set_error_trap(outer);
+  function_state_free(&gen);
+  free_variables(&gen.globals);
+  phase_end(PHASE_BACKEND);
+}
+
+void riscv_perf_codegen(CompileContext *ctx, const char *ir,
+                        Emitter *output) {
   // 解析字符串, 得到 Koopa IR 程序
+  phase_begin(PHASE_KOOPA_BUILD);
   koopa_program_t program;
   koopa_error_code_t ret = koopa_parse_from_string(ir, &program);
   assert(ret == KOOPA_EC_SUCCESS); // 确保解析时没有出错
@@ -1112,14 +1824,15 @@ void riscv_perf_codegen(const char *ir, const char *output_file) {
   koopa_raw_program_t raw = koopa_build_raw_program(builder, program);
   // 释放 Koopa IR 程序占用的内存
   koopa_delete_program(program);
+  phase_end(PHASE_KOOPA_BUILD);
 
   // 处理 raw program
-  visit_koopa_raw_program(raw);
+  riscv_perf_codegen_program(ctx, &raw, output);
 
   // 处理完成, 释放 raw program builder 占用的内存
   // 注意, raw program 中所有的指针指向的内存均为 raw program builder 的内存
   // 所以不要在 raw program 处理完毕之前释放 builder
+  phase_begin(PHASE_KOOPA_BUILD);
   koopa_delete_raw_program_builder(builder);
-
-  fclose(fp);
+  phase_end(PHASE_KOOPA_BUILD);
 }
\ No newline at end of file
@@ -1,6 +1,29 @@
 #ifndef SRC_RISCV_PERF_H_
 #define SRC_RISCV_PERF_H_
 
-void riscv_perf_codegen(const char *ir, const char *output_file);
+#include "context.h"
+#include "emit.h"
+#include "koopa.h"
+
+// 汇编写到 output 中，由调用方打开和关闭
+// ctx->threads > 1 时多个函数并行生成，输出与串行时相同
+void riscv_perf_codegen(CompileContext *ctx, const char *ir,
+                        Emitter *output);
+// 直接处理已经构建好的 raw program（比如 ir_lower 的结果），不经过文本
+void riscv_perf_codegen_program(CompileContext *ctx,
+                                const koopa_raw_program_t *program,
+                                Emitter *output);
+
+/*
+ * 流式生成，依次传入 koopa_ir_stream_* 输出的每个片段（运行时库的声明、
+ * 一个全局定义或者一个函数），每个片段处理完就输出对应的汇编
+ * 全局变量和函数交替出现时会多次切换 .data 和 .text 段
+ * begin 返回的状态在 chunk 和 end 之间传递，end 关闭输出文件并释放它
+ */
+typedef struct PerfStream PerfStream;
+PerfStream *riscv_perf_stream_begin(CompileContext *ctx,
+                                    const char *output_file);
+void riscv_perf_stream_chunk(PerfStream *stream, const char *ir);
+void riscv_perf_stream_end(PerfStream *stream);
 
 #endif // SRC_RISCV_PERF_H_
\ No newline at end of file
@@ -0,0 +1,262 @@
+#include "riscv_slots.h"
+
+#include <stdlib.h>
+
+#include "utils.h"
+
+// #region 操作数
+
+static size_t operand_count(const koopa_raw_value_t value) {
+  const koopa_raw_value_kind_t *kind = &value->kind;
+  switch (kind->tag) {
+  case KOOPA_RVT_LOAD:
+    return 1;
+  case KOOPA_RVT_STORE:
+  case KOOPA_RVT_GET_PTR:
+  case KOOPA_RVT_GET_ELEM_PTR:
+  case KOOPA_RVT_BINARY:
+    return 2;
+  case KOOPA_RVT_BRANCH:
+    return 1 + kind->data.branch.true_args.len +
+           kind->data.branch.false_args.len;
+  case KOOPA_RVT_JUMP:
+    return kind->data.jump.args.len;
+  case KOOPA_RVT_CALL:
+    return kind->data.call.args.len;
+  case KOOPA_RVT_RETURN:
+    return kind->data.ret.value != NULL ? 1 : 0;
+  default:
+    return 0;
+  }
+}
+
+// 顺序和 ir.h 中 IrValue 的操作数相同
+static koopa_raw_value_t operand_at(const koopa_raw_value_t value, size_t i) {
+  const koopa_raw_value_kind_t *kind = &value->kind;
+  switch (kind->tag) {
+  case KOOPA_RVT_LOAD:
+    return kind->data.load.src;
+  case KOOPA_RVT_STORE:
+    return i == 0 ? kind->data.store.value : kind->data.store.dest;
+  case KOOPA_RVT_GET_PTR:
+    return i == 0 ? kind->data.get_ptr.src : kind->data.get_ptr.index;
+  case KOOPA_RVT_GET_ELEM_PTR:
+    return i == 0 ? kind->data.get_elem_ptr.src
+                  : kind->data.get_elem_ptr.index;
+  case KOOPA_RVT_BINARY:
+    return i == 0 ? kind->data.binary.lhs : kind->data.binary.rhs;
+  case KOOPA_RVT_BRANCH: {
+    const koopa_raw_branch_t *branch = &kind->data.branch;
+    if (i == 0) {
+      return branch->cond;
+    }
+    if (i <= branch->true_args.len) {
+      return branch->true_args.buffer[i - 1];
+    }
+    return branch->false_args.buffer[i - 1 - branch->true_args.len];
+  }
+  case KOOPA_RVT_JUMP:
+    return kind->data.jump.args.buffer[i];
+  case KOOPA_RVT_CALL:
+    return kind->data.call.args.buffer[i];
+  case KOOPA_RVT_RETURN:
+    return kind->data.ret.value;
+  default:
+    fatalf("operand_at unknown kind: %d\n", kind->tag);
+    return NULL;
+  }
+}
+
+// 需要保存在栈上的值：参数和有结果的指令（alloc 除外）
+static bool has_slot(const koopa_raw_value_t value) {
+  switch (value->kind.tag) {
+  case KOOPA_RVT_FUNC_ARG_REF:
+  case KOOPA_RVT_BLOCK_ARG_REF:
+    return true;
+  case KOOPA_RVT_LOAD:
+  case KOOPA_RVT_GET_PTR:
+  case KOOPA_RVT_GET_ELEM_PTR:
+  case KOOPA_RVT_BINARY:
+  case KOOPA_RVT_CALL:
+    return value->ty->tag != KOOPA_RTT_UNIT;
+  default:
+    return false;
+  }
+}
+
+// #endregion
+
+typedef struct {
+  int *items;
+  int count;
+  int capacity;
+} SlotList;
+
+static void slot_list_push(SlotList *list, int slot) {
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity == 0 ? 16 : list->capacity * 2;
+    list->items = realloc(list->items, sizeof(int) * list->capacity);
+  }
+  list->items[list->count++] = slot;
+}
+
+/*
+ * 统计每个值的使用次数，同时记录定义所在的块
+ * 跨块使用的值在 blocks 中记为 -1
+ * 返回函数是否不满足后进先出的假设
+ */
+static bool count_uses(const koopa_raw_function_t func, ValueMap *blocks,
+                       ValueMap *use_counts) {
+  bool ssa = false;
+  for (size_t i = 0; i < func->params.len; i++) {
+    value_map_put(blocks, func->params.buffer[i], 0);
+  }
+  for (size_t i = 0; i < func->bbs.len; i++) {
+    const koopa_raw_basic_block_t block = func->bbs.buffer[i];
+    if (block->params.len > 0) {
+      ssa = true;
+    }
+    for (size_t j = 0; j < block->params.len; j++) {
+      value_map_put(blocks, block->params.buffer[j], (int)i);
+    }
+    for (size_t j = 0; j < block->insts.len; j++) {
+      const koopa_raw_value_t value = block->insts.buffer[j];
+      if (has_slot(value)) {
+        value_map_put(blocks, value, (int)i);
+      }
+    }
+  }
+  for (size_t i = 0; i < func->bbs.len; i++) {
+    const koopa_raw_basic_block_t block = func->bbs.buffer[i];
+    for (size_t j = 0; j < block->insts.len; j++) {
+      const koopa_raw_value_t value = block->insts.buffer[j];
+      size_t count = operand_count(value);
+      for (size_t k = 0; k < count; k++) {
+        koopa_raw_value_t operand = operand_at(value, k);
+        if (!has_slot(operand)) {
+          continue;
+        }
+        int uses = 0;
+        value_map_get(use_counts, operand, &uses);
+        value_map_put(use_counts, operand, ++uses);
+        int def_block = -1;
+        value_map_get(blocks, operand, &def_block);
+        if (def_block != (int)i) {
+          value_map_put(blocks, operand, -1);
+        }
+        // 原来的 IR 中参数只在入口处保存到 alloc 中，
+        // 其他用法（比如 mem2reg 之后直接存到数组元素中）需要参数的槽
+        bool saved_param = operand->kind.tag == KOOPA_RVT_FUNC_ARG_REF &&
+                           value->kind.tag == KOOPA_RVT_STORE && k == 0 &&
+                           value->kind.data.store.dest->kind.tag ==
+                               KOOPA_RVT_ALLOC;
+        if (uses > 1 || def_block != (int)i ||
+            (operand->kind.tag == KOOPA_RVT_FUNC_ARG_REF && !saved_param)) {
+          ssa = true;
+        }
+      }
+    }
+  }
+  return ssa;
+}
+
+bool riscv_assign_value_slots(const koopa_raw_function_t func,
+                              ValueMap *slots, ValueMap *use_counts,
+                              ValueSlots *result) {
+  value_map_clear(slots);
+  value_map_clear(use_counts);
+  ValueMap blocks;
+  value_map_init(&blocks);
+  if (!count_uses(func, &blocks, use_counts)) {
+    value_map_free(&blocks);
+    value_map_clear(use_counts);
+    return false;
+  }
+
+  int slot_count = 0;
+  for (size_t i = 0; i < func->params.len; i++) {
+    int uses;
+    if (value_map_get(use_counts, func->params.buffer[i], &uses)) {
+      value_map_put(slots, func->params.buffer[i], slot_count++);
+    }
+  }
+  size_t max_params = 0;
+  for (size_t i = 0; i < func->bbs.len; i++) {
+    const koopa_raw_basic_block_t block = func->bbs.buffer[i];
+    for (size_t j = 0; j < block->params.len; j++) {
+      value_map_put(slots, block->params.buffer[j], slot_count++);
+    }
+    if (block->params.len > max_params) {
+      max_params = block->params.len;
+    }
+  }
+
+  // 只在定义的块中使用的值，最后一次使用之后把槽放回 free_slots
+  ValueMap remaining;
+  value_map_init(&remaining);
+  SlotList free_slots = {NULL, 0, 0};
+  for (size_t i = 0; i < func->bbs.len; i++) {
+    const koopa_raw_basic_block_t block = func->bbs.buffer[i];
+    for (size_t j = 0; j < block->insts.len; j++) {
+      const koopa_raw_value_t value = block->insts.buffer[j];
+      size_t count = operand_count(value);
+      for (size_t k = 0; k < count; k++) {
+        koopa_raw_value_t operand = operand_at(value, k);
+        int def_block;
+        // 参数和跨块使用的值一直占着自己的槽
+        if (!has_slot(operand) ||
+            operand->kind.tag == KOOPA_RVT_FUNC_ARG_REF ||
+            operand->kind.tag == KOOPA_RVT_BLOCK_ARG_REF ||
+            !value_map_get(&blocks, operand, &def_block) || def_block < 0) {
+          continue;
+        }
+        int uses;
+        if (!value_map_get(&remaining, operand, &uses)) {
+          value_map_get(use_counts, operand, &uses);
+        }
+        value_map_put(&remaining, operand, --uses);
+        if (uses == 0) {
+          int slot;
+          value_map_get(slots, operand, &slot);
+          slot_list_push(&free_slots, slot);
+        }
+      }
+      if (!has_slot(value)) {
+        continue;
+      }
+      int def_block;
+      int uses;
+      value_map_get(&blocks, value, &def_block);
+      bool local = def_block >= 0 && value_map_get(use_counts, value, &uses);
+      if (local && free_slots.count > 0) {
+        value_map_put(slots, value, free_slots.items[--free_slots.count]);
+      } else {
+        value_map_put(slots, value, slot_count++);
+      }
+    }
+  }
+  free(free_slots.items);
+  value_map_free(&remaining);
+  value_map_free(&blocks);
+
+  result->scratch_slot = slot_count;
+  result->slot_count = slot_count + (int)max_params;
+  return true;
+}
+
+bool riscv_block_args_overlap(const koopa_raw_slice_t args,
+                              const koopa_raw_basic_block_t target) {
+  // 第 i 个参数在复制第 i 个实参时写入，之后的实参不能是它
+  for (size_t i = 0; i < args.len; i++) {
+    const koopa_raw_value_t arg = args.buffer[i];
+    if (arg->kind.tag != KOOPA_RVT_BLOCK_ARG_REF) {
+      continue;
+    }
+    size_t index = arg->kind.data.block_arg_ref.index;
+    if (index < i && index < target->params.len &&
+        target->params.buffer[index] == arg) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,50 @@
+#ifndef SRC_RISCV_SLOTS_H_
+#define SRC_RISCV_SLOTS_H_
+
+#include <stdbool.h>
+
+#include "koopa.h"
+#include "value_map.h"
+
+/*
+ * 两个后端共用的 SSA 值栈槽分配
+ *
+ * koopa_ir_codegen 生成的 IR 中每个临时值只使用一次，按后进先出的顺序使用，
+ * 后端用表达式栈给它们分配栈空间（assign_stack_of_temp_value）。
+ * mem2reg 之后的 IR 不满足这个假设：值可以使用多次、在其他基本块中使用，
+ * 函数参数和块参数也会作为操作数。这样的函数由这里分配：
+ *  - 函数参数、块参数、跨块使用和没有使用的值各占一个槽
+ *  - 只在定义它的块中使用的值，最后一次使用之后槽可以给后面的值复用
+ *  - 最后留出 max(块参数个数) 个槽，跳转的实参和目标块参数互相覆盖时中转
+ */
+
+/**
+ * @struct ValueSlots
+ * @brief 一个函数的槽分配结果
+ *
+ * @var ValueSlots::slot_count
+ * 槽的总数（包括中转用的槽），每个槽 4 字节
+ *
+ * @var ValueSlots::scratch_slot
+ * 中转用的第一个槽
+ */
+typedef struct {
+  int slot_count;
+  int scratch_slot;
+} ValueSlots;
+
+/*
+ * 函数不满足后进先出的假设时分配槽，返回 true ：
+ * slots 中是值 -> 槽的编号，use_counts 中是值 -> 作为操作数出现的次数。
+ * 否则返回 false ，两个表都是空的，调用方继续用表达式栈分配。
+ * 两个表由调用方初始化，这里先清空。
+ */
+bool riscv_assign_value_slots(const koopa_raw_function_t func,
+                              ValueMap *slots, ValueMap *use_counts,
+                              ValueSlots *result);
+
+// 按顺序复制实参到目标块参数时，是否会先覆盖后面还要读取的参数
+bool riscv_block_args_overlap(const koopa_raw_slice_t args,
+                              const koopa_raw_basic_block_t target);
+
+#endif // SRC_RISCV_SLOTS_H_
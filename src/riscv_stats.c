@@ -0,0 +1,128 @@
+#include "riscv_stats.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+static const char *const class_names[INSN_CLASS_COUNT] = {
+    "lw", "sw", "li", "la", "mv", "alu", "mul_div", "branch", "call_ret",
+};
+
+static bool enabled = false;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static FunctionStats *functions = NULL;
+static int function_count = 0;
+static int function_capacity = 0;
+
+void riscv_stats_enable(void) { enabled = true; }
+
+bool riscv_stats_enabled(void) { return enabled; }
+
+void riscv_stats_commit(const char *file, int file_index,
+                        FunctionStats *stats, int count) {
+  for (int i = 0; i < count; i++) {
+    stats[i].file = file;
+    stats[i].file_index = file_index;
+  }
+  pthread_mutex_lock(&mutex);
+  if (function_count + count > function_capacity) {
+    function_capacity = MAX(function_capacity * 2, function_count + count);
+    functions =
+        realloc(functions, sizeof(FunctionStats) * function_capacity);
+    if (functions == NULL) {
+      fatalf("无法分配内存\n");
+    }
+  }
+  memcpy(functions + function_count, stats, sizeof(FunctionStats) * count);
+  for (int i = 0; i < count; i++) {
+    functions[function_count + i].order = function_count + i;
+  }
+  function_count += count;
+  pthread_mutex_unlock(&mutex);
+  free(stats);
+}
+
+void riscv_stats_count_instruction(FunctionStats *stats, InsnClass insn_class) {
+  if ((unsigned)insn_class < INSN_CLASS_COUNT) {
+    stats->instructions[insn_class]++;
+  }
+}
+
+static int instruction_count(const FunctionStats *stats) {
+  int count = 0;
+  for (int i = 0; i < INSN_CLASS_COUNT; i++) {
+    count += stats->instructions[i];
+  }
+  return count;
+}
+
+// 先按文件在命令行中的位置，同一个文件中按提交的顺序
+static int compare_stats(const void *a, const void *b) {
+  const FunctionStats *lhs = a;
+  const FunctionStats *rhs = b;
+  if (lhs->file_index != rhs->file_index) {
+    return lhs->file_index < rhs->file_index ? -1 : 1;
+  }
+  return lhs->order < rhs->order ? -1 : lhs->order > rhs->order;
+}
+
+// file_column 为 true 时第一列是文件名
+static void print_row(FILE *file, bool file_column, const char *source,
+                      const char *name, const FunctionStats *stats) {
+  if (file_column) {
+    fprintf(file, "%-24s ", source != NULL ? source : "-");
+  }
+  fprintf(file, "%-16s %8d", name, instruction_count(stats));
+  for (int i = 0; i < INSN_CLASS_COUNT; i++) {
+    fprintf(file, " %8d", stats->instructions[i]);
+  }
+  fprintf(file, " %8d %12d %8d %13d %10d\n", stats->flushes,
+          stats->spill_stores, stats->reloads, stats->large_offsets,
+          stats->frame_size);
+}
+
+void riscv_stats_print(FILE *file) {
+  qsort(functions, function_count, sizeof(FunctionStats), compare_stats);
+  // 只有一个输入文件时不输出文件名这一列
+  bool file_column = false;
+  for (int i = 1; i < function_count; i++) {
+    if (functions[i].file_index != functions[0].file_index) {
+      file_column = true;
+    }
+  }
+  if (file_column) {
+    fprintf(file, "%-24s ", "file");
+  }
+  fprintf(file, "%-16s %8s", "function", "insns");
+  for (int i = 0; i < INSN_CLASS_COUNT; i++) {
+    fprintf(file, " %8s", class_names[i]);
+  }
+  fprintf(file, " %8s %12s %8s %13s %10s\n", "flushes", "spill_stores",
+          "reloads", "large_offsets", "frame_size");
+
+  // 合计行的 frame_size 是所有函数的最大值
+  FunctionStats total;
+  memset(&total, 0, sizeof(total));
+  for (int i = 0; i < function_count; i++) {
+    FunctionStats *stats = &functions[i];
+    print_row(file, file_column, stats->file, stats->name, stats);
+    for (int j = 0; j < INSN_CLASS_COUNT; j++) {
+      total.instructions[j] += stats->instructions[j];
+    }
+    total.flushes += stats->flushes;
+    total.spill_stores += stats->spill_stores;
+    total.reloads += stats->reloads;
+    total.large_offsets += stats->large_offsets;
+    total.frame_size = MAX(total.frame_size, stats->frame_size);
+    free(stats->name);
+  }
+  print_row(file, file_column, "-", "total", &total);
+  free(functions);
+  functions = NULL;
+  function_count = 0;
+  function_capacity = 0;
+}
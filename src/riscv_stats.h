@@ -0,0 +1,83 @@
+#ifndef SRC_RISCV_STATS_H_
+#define SRC_RISCV_STATS_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * -stats ：统计 perf 后端生成的每个函数的代码质量，不用运行程序就能比较优化的效果
+ *
+ * 只统计实际生成的函数，开启统计时不从缓存里读取汇编。
+ * 多个输入文件时按命令行中的顺序输出，每一行前面加上文件名。
+ */
+
+// 指令按助记符分类
+typedef enum {
+  INSN_LW,       // lw
+  INSN_SW,       // sw
+  INSN_LI,       // li
+  INSN_LA,       // la
+  INSN_MV,       // mv
+  INSN_ALU,      // add addi sub and or xor xori slt seqz snez
+  INSN_MUL_DIV,  // mul div rem
+  INSN_BRANCH,   // bnez beqz j
+  INSN_CALL_RET, // call ret
+  INSN_CLASS_COUNT,
+} InsnClass;
+
+/**
+ * @struct FunctionStats
+ * @brief 一个函数的统计
+ *
+ * @var FunctionStats::flushes
+ * register_manager_flush 的调用次数（跳转、调用和返回之前）
+ *
+ * @var FunctionStats::spill_stores
+ * 把 IR 中的值从寄存器写到栈上的次数：flush 写回的值，
+ * 以及没有分配到寄存器、只能放在栈上的临时值
+ *
+ * @var FunctionStats::reloads
+ * 值不在寄存器中，从栈上或者全局变量重新读取的次数
+ *
+ * @var FunctionStats::large_offsets
+ * 偏移超出 12 位立即数范围（>= 2048），用 li + add 计算地址的次数
+ *
+ * @var FunctionStats::frame_size
+ * 栈帧大小，字节
+ *
+ * @var FunctionStats::file
+ * 函数所在的输入文件，由 riscv_stats_commit 填写，可以为 NULL
+ *
+ * @var FunctionStats::file_index
+ * 输入文件在命令行中的位置，由 riscv_stats_commit 填写
+ *
+ * @var FunctionStats::order
+ * 提交的顺序，同一个文件中的函数按它排列，由 riscv_stats_commit 填写
+ */
+typedef struct FunctionStats {
+  char *name;
+  int instructions[INSN_CLASS_COUNT];
+  int flushes;
+  int spill_stores;
+  int reloads;
+  int large_offsets;
+  int frame_size;
+  const char *file;
+  int file_index;
+  int order;
+} FunctionStats;
+
+void riscv_stats_enable(void);
+bool riscv_stats_enabled(void);
+// 把 file 中 count 个函数的统计加到结果里，接管 stats 和其中的 name
+// file 在输出之前不能释放，file_index 是它在命令行中的位置
+// 同一个文件的函数在输出中保持提交的顺序，可以在多个线程中同时调用
+void riscv_stats_commit(const char *file, int file_index,
+                        FunctionStats *stats, int count);
+// 每个函数一行，按文件在命令行中的顺序排列，最后一行是全部函数的合计
+// 输出之后释放所有统计
+void riscv_stats_print(FILE *file);
+// 生成一条指令时由生成它的地方给出类别，不在范围内的类别忽略
+void riscv_stats_count_instruction(FunctionStats *stats, InsnClass insn_class);
+
+#endif // SRC_RISCV_STATS_H_
@@ -0,0 +1,235 @@
+#include "server.h"
+
+#include <setjmp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "compile.h"
+#include "context.h"
+#include "emit.h"
+#include "source.h"
+#include "time_report.h"
+#include "utils.h"
+
+// 头部最长的字节数，包括结尾的 '\n'
+#define HEADER_MAX 64
+// 一个请求的源码最多的字节数，长度由客户端给出，超过时拒绝而不是按它分配内存
+#define SOURCE_MAX ((size_t)64 << 20)
+
+// #region 读写
+
+// 读满 length 个字节，连接提前关闭时返回 false
+static bool read_full(int fd, char *data, size_t length) {
+  while (length > 0) {
+    ssize_t n = read(fd, data, length);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    length -= n;
+  }
+  return true;
+}
+
+static bool write_full(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t n = write(fd, data, length);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    length -= n;
+  }
+  return true;
+}
+
+// 读一行头部，去掉结尾的 '\n' ，连接关闭或者头部太长时返回 false
+static bool read_header(int fd, char *header) {
+  for (int i = 0; i < HEADER_MAX; i++) {
+    if (!read_full(fd, &header[i], 1)) {
+      return false;
+    }
+    if (header[i] == '\n') {
+      header[i] = '\0';
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool write_response(int fd, int status, const char *data,
+                           size_t length) {
+  char header[HEADER_MAX];
+  int n = snprintf(header, sizeof(header), "%d %zu\n", status, length);
+  return write_full(fd, header, n) && write_full(fd, data, length);
+}
+
+// #endregion
+
+// #region 编译
+
+static bool parse_target(const char *name, CodegenTarget *target) {
+  if (strcmp(name, "koopa") == 0) {
+    *target = CODEGEN_TARGET_KOOPA;
+  } else if (strcmp(name, "riscv") == 0) {
+    *target = CODEGEN_TARGET_RISCV;
+  } else if (strcmp(name, "perf") == 0) {
+    *target = CODEGEN_TARGET_PERF;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// 把 file 的全部内容追加到 buffer
+static void read_file(FILE *file, StringBuffer *buffer) {
+  rewind(file);
+  char chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    string_buffer_append(buffer, chunk, n);
+  }
+}
+
+/*
+ * 编译一个请求，成功时结果追加到 output ，失败时错误信息追加到 errors
+ * 编译过程中的错误都输出到 stderr ，所以临时把 stderr 重定向到一个临时文件；
+ * 出错时 compile_error_exit 和 fatalf 跳回这里，而不是结束进程。
+ * 中途跳出时 AST 等都在 ctx 中，照常释放，-time-report 的阶段栈恢复到进入时的深度，
+ * 各个 pass 的状态由它们的入口在跳出前释放。
+ */
+static bool compile_request(Cache *cache, CodegenTarget target,
+                            const char *source, StringBuffer *output,
+                            StringBuffer *errors) {
+  FILE *captured = tmpfile();
+  if (captured == NULL) {
+    fatalf("无法创建临时文件\n");
+  }
+  fflush(stderr);
+  int saved_stderr = dup(STDERR_FILENO);
+  dup2(fileno(captured), STDERR_FILENO);
+
+  CompileContext ctx;
+  compile_context_init(&ctx);
+  if (cache != NULL) {
+    compile_context_set_cache(&ctx, cache);
+  }
+  Emitter emitter;
+  emitter_init(&emitter, output);
+  jmp_buf trap;
+  bool ok = false;
+  int phase_depth = time_report_depth();
+  if (setjmp(trap) == 0) {
+    set_error_trap(&trap);
+    compile_source(&ctx, target, source, &emitter);
+    ok = true;
+  }
+  set_error_trap(NULL);
+  if (!ok) {
+    time_report_unwind(phase_depth);
+  }
+  compile_context_free(&ctx);
+
+  fflush(stderr);
+  dup2(saved_stderr, STDERR_FILENO);
+  close(saved_stderr);
+  if (!ok) {
+    read_file(captured, errors);
+  }
+  fclose(captured);
+  return ok;
+}
+
+// 处理一个连接上的所有请求，协议错误时返回
+static void serve_connection(int in, int out, Cache *cache) {
+  char header[HEADER_MAX];
+  StringBuffer output;
+  StringBuffer errors;
+  string_buffer_init(&output);
+  string_buffer_init(&errors);
+  while (read_header(in, header)) {
+    char name[16];
+    size_t length;
+    CodegenTarget target;
+    if (sscanf(header, "%15s %zu", name, &length) != 2 ||
+        !parse_target(name, &target)) {
+      const char *message = "无效的请求头\n";
+      write_response(out, 1, message, strlen(message));
+      break;
+    }
+    // 没有读取源码，连接上剩下的字节无法再解析，回复之后关闭连接
+    char *source = length <= SOURCE_MAX ? malloc(length + 1) : NULL;
+    if (source == NULL) {
+      const char *message = length <= SOURCE_MAX ? "无法分配内存\n"
+                                                 : "源码太长\n";
+      write_response(out, 1, message, strlen(message));
+      break;
+    }
+    if (!read_full(in, source, length)) {
+      free(source);
+      break;
+    }
+    source[length] = '\0';
+
+    output.size = 0;
+    errors.size = 0;
+    bool ok = compile_request(cache, target, source, &output, &errors);
+    free(source);
+    StringBuffer *reply = ok ? &output : &errors;
+    if (!write_response(out, ok ? 0 : 1, reply->data, reply->size)) {
+      break;
+    }
+  }
+  string_buffer_free(&output);
+  string_buffer_free(&errors);
+}
+
+// #endregion
+
+void serve(const char *address, Cache *cache) {
+  // 客户端提前断开时 write 返回错误，不要因为 SIGPIPE 退出
+  signal(SIGPIPE, SIG_IGN);
+  if (is_stdio_filename(address)) {
+    serve_connection(STDIN_FILENO, STDOUT_FILENO, cache);
+    return;
+  }
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(address) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "socket 路径太长: %s\n", address);
+    exit(1);
+  }
+  strcpy(addr.sun_path, address);
+  // 只删除上次运行留下的 socket 文件，路径上是其他文件时不覆盖
+  struct stat st;
+  if (lstat(address, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      fprintf(stderr, "%s 已经存在并且不是 socket\n", address);
+      exit(1);
+    }
+    unlink(address);
+  }
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0 ||
+      bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(listener, 16) != 0) {
+    fprintf(stderr, "无法监听 %s\n", address);
+    exit(1);
+  }
+  for (;;) {
+    int connection = accept(listener, NULL, NULL);
+    if (connection < 0) {
+      continue;
+    }
+    serve_connection(connection, connection, cache);
+    close(connection);
+  }
+}
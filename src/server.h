@@ -0,0 +1,23 @@
+#ifndef SRC_SERVER_H_
+#define SRC_SERVER_H_
+
+#include "cache.h"
+
+/*
+ * 编译服务：进程常驻，反复接收编译请求，省掉每次启动进程和加载动态库的开销
+ *
+ * 每个请求和回复都是一行头部加上若干字节的内容：
+ *   请求 "<koopa|riscv|perf> <源码字节数>\n" + 源码
+ *   回复 "<状态> <字节数>\n" + 内容
+ * 状态为 0 时内容是 IR 或者汇编，为 1 时是编译错误信息。
+ * 源码最多 64 MiB ，请求头无效或者源码太长时回复状态 1 并关闭连接。
+ * 一个连接上可以依次发送多个请求，客户端关闭连接表示结束。
+ *
+ * address 为 "-" 时通过标准输入和标准输出通信，处理完输入之后返回；
+ * 否则监听这个路径上的 Unix domain socket ，依次处理每个连接，一直运行，
+ * 路径上已经有文件时只在它是 socket 时删除重建。
+ * 请求之间不共享编译状态，cache 不为 NULL 时所有请求共用这个缓存。
+ */
+void serve(const char *address, Cache *cache);
+
+#endif // SRC_SERVER_H_
@@ -0,0 +1,114 @@
+#include "source.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+// 从标准输入、管道读取时每次 read 的最小块大小
+#define SOURCE_READ_CHUNK (1 << 20)
+
+bool is_stdio_filename(const char *filename) {
+  return strcmp(filename, "-") == 0;
+}
+
+// 把 fd 剩下的内容全部读进堆内存，size_hint 是预计的大小
+// 读取失败时释放已经读到的内容，返回 false ，由调用方关闭 fd 并报告错误
+static bool read_all(SourceFile *source, int fd, size_t size_hint) {
+  size_t capacity = size_hint + 1;
+  if (capacity < SOURCE_READ_CHUNK) {
+    capacity = SOURCE_READ_CHUNK;
+  }
+  char *buffer = malloc(capacity);
+  if (buffer == NULL) {
+    fatalf("无法分配内存\n");
+  }
+  size_t length = 0;
+  for (;;) {
+    if (capacity - length < SOURCE_READ_CHUNK / 2) {
+      capacity *= 2;
+      buffer = realloc(buffer, capacity);
+      if (buffer == NULL) {
+        fatalf("无法分配内存\n");
+      }
+    }
+    // 留一个字节放 '\0'
+    ssize_t n = read(fd, buffer + length, capacity - length - 1);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      free(buffer);
+      return false;
+    }
+    if (n == 0) {
+      break;
+    }
+    length += n;
+  }
+  buffer[length] = '\0';
+  source->data = buffer;
+  source->length = length;
+  source->mapped = false;
+  return true;
+}
+
+void source_file_open(SourceFile *source, const char *filename) {
+  if (is_stdio_filename(filename)) {
+    if (!read_all(source, STDIN_FILENO, 0)) {
+      fatalf("读取文件 <stdin> 失败: %s\n", strerror(errno));
+    }
+    return;
+  }
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "无法打开文件 %s\n", filename);
+    compile_error_exit();
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    fatalf("无法读取文件信息 %s\n", filename);
+  }
+
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t length = st.st_size;
+  // 大小为 0 或者刚好是整页时，文件末尾后面没有可以当作 '\0' 的字节
+  if (S_ISREG(st.st_mode) && length % page_size != 0) {
+    void *data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      close(fd);
+      source->data = data;
+      source->length = length;
+      source->mapped = true;
+      return;
+    }
+  }
+
+  bool ok = read_all(source, fd, S_ISREG(st.st_mode) ? length : 0);
+  int error = errno;
+  close(fd);
+  if (!ok) {
+    fatalf("读取文件 %s 失败: %s\n", filename, strerror(error));
+  }
+}
+
+void source_file_close(SourceFile *source) {
+  if (source->data == NULL) {
+    return;
+  }
+  if (source->mapped) {
+    munmap((void *)source->data, source->length);
+  } else {
+    free((void *)source->data);
+  }
+  source->data = NULL;
+  source->length = 0;
+}
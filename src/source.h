@@ -0,0 +1,37 @@
+#ifndef SRC_SOURCE_H_
+#define SRC_SOURCE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @struct SourceFile
+ * @brief 编译器的输入，内容以 '\0' 结尾
+ *
+ * 普通文件直接 mmap 到内存，不做拷贝：文件大小不是页大小的整数倍时，
+ * 最后一页剩下的部分由内核填 0 ，正好充当结尾的 '\0' 。
+ * 其他情况（标准输入、管道、大小刚好是整页的文件）用大块 read 读进堆内存。
+ *
+ * @var SourceFile::data
+ * 文件内容，data[length] == '\0'
+ *
+ * @var SourceFile::length
+ * 文件内容的字节数
+ *
+ * @var SourceFile::mapped
+ * data 是否是 mmap 得到的
+ */
+typedef struct SourceFile {
+  const char *data;
+  size_t length;
+  bool mapped;
+} SourceFile;
+
+// filename 为 "-" 时读取标准输入
+void source_file_open(SourceFile *source, const char *filename);
+void source_file_close(SourceFile *source);
+
+// "-" 表示标准输入（作为输入文件时）或标准输出（作为输出文件时）
+bool is_stdio_filename(const char *filename);
+
+#endif // SRC_SOURCE_H_
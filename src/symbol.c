@@ -0,0 +1,256 @@
+#include "symbol.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "utils.h"
+
+void symbol_table_init(SymbolTable *table) {
+  table->capacity = 64;
+  table->count = 0;
+  table->slots = calloc(table->capacity, sizeof(SymbolSlot));
+  table->level = 0;
+  table->index = 0;
+  table->log_size = 0;
+  table->log_capacity = 64;
+  table->log = malloc(sizeof(Symbol *) * table->log_capacity);
+  int_stack_init(&table->scope_marks);
+  arena_init(&table->arena);
+  arena_init(&table->local_arena);
+}
+
+void symbol_table_free(SymbolTable *table) {
+  free(table->slots);
+  free(table->log);
+  free(table->scope_marks.data);
+  table->slots = NULL;
+  table->log = NULL;
+  table->scope_marks.data = NULL;
+  arena_release(&table->arena);
+  arena_release(&table->local_arena);
+}
+
+static SymbolSlot *find_slot(SymbolTable *table, const char *name,
+                             uint32_t hash) {
+  uint32_t mask = table->capacity - 1;
+  uint32_t i = hash & mask;
+  while (table->slots[i].name != NULL) {
+    SymbolSlot *slot = &table->slots[i];
+    if (slot->name == name) {
+      return slot;
+    }
+    i = (i + 1) & mask;
+  }
+  return &table->slots[i];
+}
+
+// 负载超过 3/4 时扩容
+static void grow_symbol_table(SymbolTable *table) {
+  if ((table->count + 1) * 4 <= table->capacity * 3) {
+    return;
+  }
+  SymbolSlot *old_slots = table->slots;
+  int old_capacity = table->capacity;
+  table->capacity *= 2;
+  table->slots = calloc(table->capacity, sizeof(SymbolSlot));
+  uint32_t mask = table->capacity - 1;
+  for (int i = 0; i < old_capacity; i++) {
+    if (old_slots[i].name == NULL) {
+      continue;
+    }
+    uint32_t j = intern_hash(old_slots[i].name) & mask;
+    while (table->slots[j].name != NULL) {
+      j = (j + 1) & mask;
+    }
+    table->slots[j] = old_slots[i];
+  }
+  free(old_slots);
+}
+
+Symbol *find_symbol(SymbolTable *table, const char *name) {
+  return find_slot(table, name, intern_hash(name))->symbol;
+}
+
+Symbol *new_symbol(SymbolTable *table, const char *name, SymbolType type) {
+  grow_symbol_table(table);
+  SymbolSlot *slot = find_slot(table, name, intern_hash(name));
+  Symbol *found = slot->symbol;
+  if (found != NULL && found->level == table->level) {
+    fprintf(stderr, "符号 %s 已经存在\n", name);
+    compile_error_exit();
+  }
+  if (slot->name == NULL) {
+    slot->name = name;
+    table->count++;
+  }
+  Arena *arena = table->level > 0 ? &table->local_arena : &table->arena;
+  Symbol *symbol = arena_calloc(arena, 1, sizeof(Symbol));
+  symbol->name = name;
+  symbol->is_const_value = false;
+  symbol->value = 0;
+  symbol->level = table->level;
+  symbol->shadowed = found;
+  symbol->index = table->index++;
+  symbol->type = type;
+  slot->symbol = symbol;
+
+  if (table->log_size == table->log_capacity) {
+    table->log_capacity *= 2;
+    table->log = realloc(table->log, sizeof(Symbol *) * table->log_capacity);
+  }
+  table->log[table->log_size++] = symbol;
+  return symbol;
+}
+
+void import_symbols(SymbolTable *table, Symbol **symbols, int count) {
+  for (int i = 0; i < count; i++) {
+    grow_symbol_table(table);
+    const char *name = symbols[i]->name;
+    SymbolSlot *slot = find_slot(table, name, intern_hash(name));
+    if (slot->name == NULL) {
+      slot->name = name;
+      table->count++;
+    }
+    slot->symbol = symbols[i];
+  }
+}
+
+Symbol **symbol_table_symbols(SymbolTable *table, int *count) {
+  *count = table->log_size;
+  return table->log;
+}
+
+int symbol_table_begin_function(SymbolTable *table) {
+  int global_index = table->index;
+  table->index = 0;
+  return global_index;
+}
+
+void symbol_table_end_function(SymbolTable *table, int global_index) {
+  table->index = global_index;
+  // 离开函数作用域时局部符号都已经从哈希表中撤销
+  assert(table->level == 0);
+  arena_reset(&table->local_arena);
+}
+
+void *symbol_table_alloc(SymbolTable *table, size_t size) {
+  return arena_alloc(&table->arena, size);
+}
+
+void *symbol_alloc(SymbolTable *table, Symbol *symbol, size_t size) {
+  if (symbol->level > 0) {
+    return arena_alloc(&table->local_arena, size);
+  }
+  return symbol_table_alloc(table, size);
+}
+
+const char *symbol_unique_name(SymbolTable *table, Symbol *symbol) {
+  if (symbol->unique_name == NULL) {
+    size_t size = strlen(symbol->name) + 32;
+    char *buf = symbol_alloc(table, symbol, size);
+    snprintf(buf, size, "@%s_%d_%d", symbol->name, symbol->level,
+             symbol->index);
+    symbol->unique_name = buf;
+  }
+  return symbol->unique_name;
+}
+
+int eval_symbol(SymbolTable *table, const char *name) {
+  Symbol *symbol = find_symbol(table, name);
+  if (symbol == NULL) {
+    fatalf("eval 未定义的符号 %s\n", name);
+  }
+  if (!symbol->is_const_value) {
+    fprintf(stderr, "符号 %s 不是常量\n", name);
+    compile_error_exit();
+  }
+  return symbol->value;
+}
+
+void enter_scope(SymbolTable *table) {
+  table->level++;
+  int_stack_push(&table->scope_marks, table->log_size);
+}
+
+void leave_scope(SymbolTable *table) {
+  int mark = int_stack_pop(&table->scope_marks);
+  while (table->log_size > mark) {
+    Symbol *symbol = table->log[--table->log_size];
+    SymbolSlot *slot =
+        find_slot(table, symbol->name, intern_hash(symbol->name));
+    slot->symbol = symbol->shadowed;
+  }
+  table->level--;
+}
+
+void update_func_type(SymbolTable *table, AstFuncDef *func_def,
+                      FunctionType *func_type) {
+  func_type->return_type = func_def->func_type;
+  func_type->param_count = func_def->param_count;
+  func_type->param_types =
+      symbol_table_alloc(table, sizeof(BType) * func_type->param_count);
+  FuncParam *param = func_def->params;
+  for (int i = 0; i < func_type->param_count; i++) {
+    func_type->param_types[i] = param->type;
+    param = param->next;
+  }
+}
+
+
+void read_dimensions(ExpArray *exps, int *dimensions) {
+  for (int i = 0; i < exps->count; i++) {
+    assert(exps->elements[i]->type == AST_NUMBER);
+    int n = ((AstNumber *)exps->elements[i])->number;
+    assert(n > 0);
+    dimensions[i] = n;
+  }
+}
+
+void symbol_set_dimensions(SymbolTable *table, Symbol *symbol, ExpArray *exps) {
+  int *dimensions = symbol_alloc(table, symbol, sizeof(int) * exps->count);
+  read_dimensions(exps, dimensions);
+  symbol->dimensions = dimensions;
+  symbol->dimension_count = exps->count;
+}
+
+typedef struct {
+  const char *name;
+  BType return_type;
+  int param_count;
+  BType param_types[2];
+} LibFunction;
+
+static const LibFunction lib_functions[LIB_FUNCTION_COUNT] = {
+    {"getint", BType_INT, 0, {0}},
+    {"getch", BType_INT, 0, {0}},
+    {"getarray", BType_INT, 1, {BType_POINTER}},
+    {"putint", BType_VOID, 1, {BType_INT}},
+    {"putch", BType_VOID, 1, {BType_INT}},
+    {"putarray", BType_VOID, 2, {BType_INT, BType_POINTER}},
+    {"starttime", BType_VOID, 0, {0}},
+    {"stoptime", BType_VOID, 0, {0}},
+};
+
+void declare_lib_symbols(SymbolTable *table, InternPool *pool,
+                         Symbol *symbols[LIB_FUNCTION_COUNT]) {
+  for (int i = 0; i < LIB_FUNCTION_COUNT; i++) {
+    const LibFunction *lib = &lib_functions[i];
+    Symbol *symbol = new_symbol(table, intern_cstr(pool, lib->name),
+                                SymbolType_func);
+    FunctionType *func_type = &symbol->func_type;
+    func_type->return_type = lib->return_type;
+    func_type->param_count = lib->param_count;
+    func_type->param_types = NULL;
+    if (lib->param_count > 0) {
+      func_type->param_types =
+          symbol_table_alloc(table, sizeof(BType) * lib->param_count);
+      memcpy(func_type->param_types, lib->param_types,
+             sizeof(BType) * lib->param_count);
+    }
+    symbols[i] = symbol;
+  }
+}
@@ -0,0 +1,123 @@
+#ifndef SRC_SYMBOL_H_
+#define SRC_SYMBOL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ast.h"
+#include "arena.h"
+#include "intern.h"
+#include "utils.h"
+
+/*
+ * 符号表，koopa_ir.c 和 ir_gen.c 共用
+ * 由生成 IR 的一方持有，并行生成时每个线程各用一个，用 import_symbols 共享全局符号
+ */
+
+typedef enum {
+  SymbolType_int,
+  SymbolType_func,
+  SymbolType_array,
+  SymbolType_pointer,
+  SymbolType_array_pointer,
+} SymbolType;
+
+typedef struct {
+  BType return_type;
+  BType *param_types;
+  int param_count;
+} FunctionType;
+
+typedef struct Symbol Symbol;
+typedef struct Symbol {
+  const char *name;
+  bool is_const_value;
+  int value;
+  int level;        // 符号的作用域
+  int index;        // 符号的计数，用来生成唯一的符号名
+  Symbol *shadowed; // 被当前符号遮蔽的外层同名符号
+  const char *unique_name; // IR 里面的名字，第一次使用时生成
+
+  SymbolType type;
+  FunctionType func_type; // 函数的类型
+  int *dimensions;        // 数组的维度
+  int dimension_count;
+} Symbol;
+
+// 哈希表的槽位，同名的符号共用一个槽位
+// name 是驻留字符串，直接比较指针
+// symbol 指向当前可见的（最内层的）符号，没有可见符号时为 NULL
+typedef struct {
+  const char *name;
+  Symbol *symbol;
+} SymbolSlot;
+
+/*
+ * 符号表，开放寻址（线性探测）哈希表，键是驻留字符串
+ * 槽位只增不删，所以不需要墓碑标记
+ * 声明的符号按顺序记录在 log 里面，离开作用域时逆序撤销，
+ * 恢复被遮蔽的外层符号，代价只和这个作用域里声明的符号数量有关
+ */
+typedef struct {
+  SymbolSlot *slots;
+  int capacity; // 槽位数量，总是 2 的幂
+  int count;    // 已占用的槽位数量
+  int level;    // 当前作用域层级
+  int index;    // 符号计数
+  Symbol **log;
+  int log_size;
+  int log_capacity;
+  IntStack scope_marks; // 每个作用域开始时 log 的大小
+  // 全局符号本身以及名字、数组维度等附属数据，和符号表一起释放
+  Arena arena;
+  // 函数内的局部符号，每个函数生成完就释放
+  Arena local_arena;
+} SymbolTable;
+
+void symbol_table_init(SymbolTable *table);
+void symbol_table_free(SymbolTable *table);
+
+// name 必须是驻留字符串
+Symbol *find_symbol(SymbolTable *table, const char *name);
+// 当前作用域已经有同名符号时报错
+Symbol *new_symbol(SymbolTable *table, const char *name, SymbolType type);
+// 把其他线程的全局符号加入这个符号表，符号本身是共享的，只读不写
+void import_symbols(SymbolTable *table, Symbol **symbols, int count);
+// 按声明顺序排列的当前可见的符号，在全局作用域调用时就是全部全局符号
+// 之后声明新的符号时数组可能被 realloc ，需要保留的话要复制一份
+Symbol **symbol_table_symbols(SymbolTable *table, int *count);
+
+void enter_scope(SymbolTable *table);
+void leave_scope(SymbolTable *table);
+
+/*
+ * 函数内的局部符号从 0 开始编号，返回之前的符号计数，
+ * 交给 symbol_table_end_function 恢复，同时释放函数的局部符号。
+ * 这样函数的 IR 和它前面有多少全局符号、在哪个线程生成都无关。
+ */
+int symbol_table_begin_function(SymbolTable *table);
+void symbol_table_end_function(SymbolTable *table, int global_index);
+
+// 和全局符号一起释放的内存
+void *symbol_table_alloc(SymbolTable *table, size_t size);
+// 符号的附属数据和符号分配在同一个 arena 中，局部符号的随函数一起释放
+void *symbol_alloc(SymbolTable *table, Symbol *symbol, size_t size);
+// 符号在 IR 中的名字 @name_level_index ，生成一次之后缓存在符号上
+const char *symbol_unique_name(SymbolTable *table, Symbol *symbol);
+// 常量符号的值，不是常量时报错
+int eval_symbol(SymbolTable *table, const char *name);
+
+void update_func_type(SymbolTable *table, AstFuncDef *func_def,
+                      FunctionType *func_type);
+// 从 AST 里读出数组每一维的大小（优化阶段已经算成了整数）
+void read_dimensions(ExpArray *exps, int *dimensions);
+// 把数组每一维的大小记录到符号上
+void symbol_set_dimensions(SymbolTable *table, Symbol *symbol, ExpArray *exps);
+
+// SysY 运行时库函数的个数，声明的顺序固定
+#define LIB_FUNCTION_COUNT 8
+// 按固定顺序登记运行时库的函数，名字从 pool 驻留，符号写到 symbols 中
+void declare_lib_symbols(SymbolTable *table, InternPool *pool,
+                         Symbol *symbols[LIB_FUNCTION_COUNT]);
+
+#endif // SRC_SYMBOL_H_
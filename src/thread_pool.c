@@ -0,0 +1,84 @@
+#include "thread_pool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "utils.h"
+
+typedef struct {
+  ThreadTask task;
+  ThreadHook thread_init;
+  ThreadHook thread_exit;
+  void *arg;
+  int task_count;
+  atomic_int next_index; // 下一个还没有被领取的任务
+} ThreadPool;
+
+static void run_tasks(ThreadPool *pool, int worker) {
+  for (;;) {
+    int index = atomic_fetch_add(&pool->next_index, 1);
+    if (index >= pool->task_count) {
+      break;
+    }
+    pool->task(pool->arg, worker, index);
+  }
+}
+
+typedef struct {
+  ThreadPool *pool;
+  int worker;
+} Worker;
+
+static void *run_worker(void *data) {
+  Worker *worker = data;
+  ThreadPool *pool = worker->pool;
+  if (pool->thread_init != NULL) {
+    pool->thread_init(pool->arg, worker->worker);
+  }
+  run_tasks(pool, worker->worker);
+  if (pool->thread_exit != NULL) {
+    pool->thread_exit(pool->arg, worker->worker);
+  }
+  return NULL;
+}
+
+void thread_pool_run(int thread_count, int task_count, ThreadTask task,
+                     void *arg) {
+  thread_pool_run_with_hooks(thread_count, task_count, task, NULL, NULL, arg);
+}
+
+void thread_pool_run_with_hooks(int thread_count, int task_count,
+                                ThreadTask task, ThreadHook thread_init,
+                                ThreadHook thread_exit, void *arg) {
+  if (thread_count > task_count) {
+    thread_count = task_count;
+  }
+  if (thread_count <= 1) {
+    for (int i = 0; i < task_count; i++) {
+      task(arg, 0, i);
+    }
+    return;
+  }
+
+  ThreadPool pool = {task, thread_init, thread_exit, arg, task_count, 0};
+  // 当前线程也参与执行，只需要再创建 thread_count - 1 个线程
+  pthread_t *threads = malloc(sizeof(pthread_t) * (thread_count - 1));
+  Worker *workers = malloc(sizeof(Worker) * (thread_count - 1));
+  if (threads == NULL || workers == NULL) {
+    fatalf("无法分配内存\n");
+  }
+  for (int i = 0; i < thread_count - 1; i++) {
+    workers[i].pool = &pool;
+    workers[i].worker = i + 1;
+    if (pthread_create(&threads[i], NULL, run_worker, &workers[i]) != 0) {
+      fatalf("无法创建线程\n");
+    }
+  }
+  run_tasks(&pool, 0);
+  for (int i = 0; i < thread_count - 1; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(workers);
+  free(threads);
+}
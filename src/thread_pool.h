@@ -0,0 +1,36 @@
+#ifndef SRC_THREAD_POOL_H_
+#define SRC_THREAD_POOL_H_
+
+/*
+ * 任务函数，index 是任务编号，从 0 到 task_count - 1
+ * worker 是执行任务的线程的编号，当前线程为 0 ，新创建的线程从 1 开始，
+ * 小于 thread_count ，任务可以用它找到这个线程自己的状态。
+ */
+typedef void (*ThreadTask)(void *arg, int worker, int index);
+// 线程开始执行任务之前、全部任务结束之后调用，用来准备和释放 worker 的状态
+typedef void (*ThreadHook)(void *arg, int worker);
+
+/*
+ * 用 thread_count 个线程执行 task_count 个任务，全部完成后返回
+ * 线程从共享的计数器里领取下一个任务编号，先做完的线程会接着做剩下的任务，
+ * 大小不一的任务也能把线程都占满。
+ * 这里没有用每个线程一个双端队列再互相窃取（work stealing）：
+ * 任务是一次性给出的一组函数，执行中不会产生新任务，也不需要子任务的局部性，
+ * 每个任务都远大于一次原子加法，一个共享计数器的负载均衡效果相同，实现简单得多。
+ * 以后要支持任务里再提交任务时再换成窃取。
+ * thread_count <= 1 时直接在当前线程按顺序执行。
+ */
+void thread_pool_run(int thread_count, int task_count, ThreadTask task,
+                     void *arg);
+
+/*
+ * 和 thread_pool_run 相同，另外在每个新创建的线程里调用 thread_init 和
+ * thread_exit（可以为 NULL）。
+ * 当前线程（worker 0）也会执行任务，但是不调用这两个函数：
+ * 它的状态由调用方自己准备好。
+ */
+void thread_pool_run_with_hooks(int thread_count, int task_count,
+                                ThreadTask task, ThreadHook thread_init,
+                                ThreadHook thread_exit, void *arg);
+
+#endif // SRC_THREAD_POOL_H_
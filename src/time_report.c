@@ -0,0 +1,236 @@
+#include "time_report.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "utils.h"
+
+// 在启动工作线程之前设置，之后只读
+static bool enabled = false;
+
+/*
+ * 堆内存：阶段开始和结束时各读一次 glibc 的 mallinfo2 ，
+ * 正在使用的字节数（包括直接 mmap 的大块）之差就是这个阶段的净增长，
+ * 阶段中释放的内存会抵消，所以可能是负数。不替换 malloc ，也不影响其他代码的分配。
+ * mallinfo2 统计的是整个进程，并行时同一段时间里其他线程的分配也会算进来。
+ * 没有 mallinfo2（不是 glibc 或者早于 2.33），或者使用 sanitizer 时不统计。
+ */
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && \
+    !defined(__SANITIZE_THREAD__) &&                         \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define COUNT_HEAP 1
+
+static int64_t heap_in_use(void) {
+  struct mallinfo2 info = mallinfo2();
+  return (int64_t)(info.uordblks + info.hblkhd);
+}
+#else
+#define COUNT_HEAP 0
+
+static int64_t heap_in_use(void) { return 0; }
+#endif
+
+static const char *const phase_names[PHASE_COUNT] = {
+    "tokenize", "parse",       "optimize", "ir_emit",
+    "ir_pass",  "koopa_build", "backend",
+};
+
+typedef struct {
+  double wall;         // 秒
+  double cpu;          // 秒，执行阶段的线程的 CPU 时间
+  int64_t heap;        // 堆内存的净增长，字节
+  long peak_rss;       // 阶段结束时进程的峰值 RSS ，KB
+  int64_t calls;       // 进入的次数
+} PhaseStats;
+
+// 阶段栈里的一项，只记录从上次开始或者恢复计时以来的部分
+typedef struct {
+  Phase phase;
+  double wall;
+  double cpu;
+  int64_t heap;
+} PhaseFrame;
+
+#define MAX_PHASE_DEPTH 16
+
+static double start_wall;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static PhaseStats stats[PHASE_COUNT];
+// AST arena 的使用情况，由 stats_mutex 保护
+static int64_t arena_count;
+static size_t arena_used;
+static size_t arena_peak;
+static size_t arena_reserved;
+
+static _Thread_local PhaseFrame frames[MAX_PHASE_DEPTH];
+static _Thread_local int depth;
+
+static double clock_seconds(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long peak_rss_kb(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+static void frame_start(PhaseFrame *frame) {
+  frame->wall = clock_seconds(CLOCK_MONOTONIC);
+  frame->cpu = clock_seconds(CLOCK_THREAD_CPUTIME_ID);
+  frame->heap = heap_in_use();
+}
+
+// 把 frame 从上次开始计时到现在的部分加到它的阶段上
+static void frame_stop(PhaseFrame *frame, bool finished) {
+  double wall = clock_seconds(CLOCK_MONOTONIC) - frame->wall;
+  double cpu = clock_seconds(CLOCK_THREAD_CPUTIME_ID) - frame->cpu;
+  int64_t heap = heap_in_use() - frame->heap;
+  long rss = finished ? peak_rss_kb() : 0;
+  pthread_mutex_lock(&stats_mutex);
+  PhaseStats *s = &stats[frame->phase];
+  s->wall += wall;
+  s->cpu += cpu;
+  s->heap += heap;
+  if (finished) {
+    s->calls++;
+    if (rss > s->peak_rss) {
+      s->peak_rss = rss;
+    }
+  }
+  pthread_mutex_unlock(&stats_mutex);
+}
+
+void time_report_enable(void) {
+  enabled = true;
+  start_wall = clock_seconds(CLOCK_MONOTONIC);
+}
+
+void phase_begin(Phase phase) {
+  if (!enabled) {
+    return;
+  }
+  if (depth >= MAX_PHASE_DEPTH) {
+    fatalf("阶段嵌套太深\n");
+  }
+  if (depth > 0) {
+    frame_stop(&frames[depth - 1], false);
+  }
+  frames[depth].phase = phase;
+  frame_start(&frames[depth]);
+  depth++;
+}
+
+int time_report_depth(void) { return depth; }
+
+void time_report_unwind(int saved_depth) {
+  if (depth <= saved_depth) {
+    return;
+  }
+  // 跳过的阶段算作结束，已经用掉的时间照常计入
+  while (depth > saved_depth) {
+    depth--;
+    frame_stop(&frames[depth], true);
+  }
+  if (depth > 0) {
+    frame_start(&frames[depth - 1]);
+  }
+}
+
+void phase_end(Phase phase) {
+  if (!enabled) {
+    return;
+  }
+  assert(depth > 0 && frames[depth - 1].phase == phase);
+  depth--;
+  frame_stop(&frames[depth], true);
+  if (depth > 0) {
+    frame_start(&frames[depth - 1]);
+  }
+}
+
+// 没有统计堆内存时文本输出 - ，JSON 输出 null
+static void print_heap(FILE *file, bool json, int64_t heap) {
+  if (!COUNT_HEAP) {
+    fprintf(file, json ? "null" : "%12s", "-");
+  } else if (json) {
+    fprintf(file, "%lld", (long long)(heap / 1024));
+  } else {
+    fprintf(file, "%12lld", (long long)(heap / 1024));
+  }
+}
+
+void time_report_arena(const Arena *arena) {
+  if (!enabled) {
+    return;
+  }
+  pthread_mutex_lock(&stats_mutex);
+  arena_count++;
+  arena_used += arena->used;
+  arena_reserved += arena->reserved;
+  if (arena->peak > arena_peak) {
+    arena_peak = arena->peak;
+  }
+  pthread_mutex_unlock(&stats_mutex);
+}
+
+void time_report_print(FILE *file, bool json) {
+  double wall = clock_seconds(CLOCK_MONOTONIC) - start_wall;
+  double cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+  long rss = peak_rss_kb();
+  int64_t heap = 0;
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    heap += stats[i].heap;
+  }
+  if (json) {
+    fprintf(file, "{\"phases\": [");
+    for (int i = 0; i < PHASE_COUNT; i++) {
+      PhaseStats *s = &stats[i];
+      fprintf(file,
+              "%s\n  {\"name\": \"%s\", \"calls\": %lld, "
+              "\"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"heap_kb\": ",
+              i == 0 ? "" : ",", phase_names[i], (long long)s->calls,
+              s->wall * 1000, s->cpu * 1000);
+      print_heap(file, true, s->heap);
+      fprintf(file, ", \"peak_rss_kb\": %ld}", s->peak_rss);
+    }
+    fprintf(file,
+            "\n],\n\"total\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f, "
+            "\"heap_kb\": ",
+            wall * 1000, cpu * 1000);
+    print_heap(file, true, heap);
+    fprintf(file,
+            ", \"peak_rss_kb\": %ld},\n\"ast_arena\": {\"count\": %lld, "
+            "\"used_kb\": %zu, \"peak_kb\": %zu, \"reserved_kb\": %zu}}\n",
+            rss, (long long)arena_count, arena_used / 1024, arena_peak / 1024,
+            arena_reserved / 1024);
+    return;
+  }
+
+  // 列名和 JSON 的字段名相同
+  fprintf(file, "%-12s %8s %12s %12s %12s %12s\n", "phase", "calls",
+          "wall_ms", "cpu_ms", "heap_kb", "peak_rss_kb");
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    PhaseStats *s = &stats[i];
+    fprintf(file, "%-12s %8lld %12.3f %12.3f ", phase_names[i],
+            (long long)s->calls, s->wall * 1000, s->cpu * 1000);
+    print_heap(file, false, s->heap);
+    fprintf(file, " %12ld\n", s->peak_rss);
+  }
+  fprintf(file, "%-12s %8s %12.3f %12.3f ", "total", "-", wall * 1000,
+          cpu * 1000);
+  print_heap(file, false, heap);
+  fprintf(file, " %12ld\n", rss);
+  fprintf(file, "\n%-12s %8s %12s %12s %12s\n", "arena", "count", "used_kb",
+          "peak_kb", "reserved_kb");
+  fprintf(file, "%-12s %8lld %12zu %12zu %12zu\n", "ast_arena",
+          (long long)arena_count, arena_used / 1024, arena_peak / 1024,
+          arena_reserved / 1024);
+}
@@ -0,0 +1,45 @@
+#ifndef SRC_TIME_REPORT_H_
+#define SRC_TIME_REPORT_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "arena.h"
+
+/*
+ * -time-report ：统计每个编译阶段的耗时和内存
+ *
+ * 各阶段用 phase_begin / phase_end 包起来，可以嵌套，
+ * 嵌套时外层阶段暂停计时，每个阶段只统计它自己的部分，各阶段之和不会重复计算。
+ * 统计在执行阶段的线程上进行，并行生成时每个工作线程分别统计再累加，
+ * 所以 wall 是各线程之和，可能超过实际经过的时间。
+ * 没有开启时 phase_begin / phase_end 直接返回。
+ */
+typedef enum {
+  PHASE_TOKENIZE,    // 词法分析
+  PHASE_PARSE,       // 语法分析，生成 AST
+  PHASE_OPTIMIZE,    // 优化 AST ，常量折叠等
+  PHASE_IR_EMIT,     // 生成 Koopa IR 文本，-ir 时是生成 ir.h 中的 IR
+  PHASE_IR_PASS,     // -ir 时在 IR 上运行分析和变换
+  PHASE_KOOPA_BUILD, // 构建和释放 raw program ，-ir 时是 ir_lower
+  PHASE_BACKEND,     // 遍历 raw program 生成汇编
+  PHASE_COUNT,
+} Phase;
+
+void time_report_enable(void);
+void phase_begin(Phase phase);
+void phase_end(Phase phase);
+/*
+ * 出错时 longjmp 会跳过 phase_end ，阶段栈不会弹出。
+ * 设置 error trap 之前用 time_report_depth 记下当前的深度，
+ * 跳回之后用 time_report_unwind 结束更深的阶段，恢复到这个深度。
+ */
+int time_report_depth(void);
+void time_report_unwind(int depth);
+// 在释放 AST 所在的 arena 之前调用，记录它的使用情况，可以在多个线程中同时调用
+// 报告中 used 和 reserved 是所有 arena 释放前的值之和，peak 是单个 arena 的最大值
+void time_report_arena(const Arena *arena);
+// 输出每个阶段和整个进程的统计，json 为 false 时输出文本表格
+void time_report_print(FILE *file, bool json);
+
+#endif // SRC_TIME_REPORT_H_
@@ -1,8 +1,10 @@
 #include "tokenize.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 
+#include "intern.h"
 #include "utils.h"
 
 const char *token_type_to_string(TokenType type) {
@@ -67,74 +69,227 @@ const char *token_type_to_string(TokenType type) {
   return "UNKNOWN";
 }
 
-typedef struct Tokenizer {
-  const char *start;
-  const char *current;
-  int line;
-} Tokenizer;
+// #region 字符分类表
 
-static Tokenizer tokenizer;
-static char *keywords[] = {
-    "const",  "int",   "void",     "if",    "else",
-    "return", "while", "continue", "break",
+enum {
+  CHAR_SPACE = 1 << 0,       // ' ' '\t' '\r' '\n'
+  CHAR_DIGIT = 1 << 1,       // [0-9]
+  CHAR_OCTAL = 1 << 2,       // [0-7]
+  CHAR_HEX = 1 << 3,         // [0-9a-fA-F]
+  CHAR_IDENT_START = 1 << 4, // [a-zA-Z_]
+  CHAR_IDENT = 1 << 5,       // [a-zA-Z0-9_]
 };
 
-void init_tokenizer(const char *input) {
-  tokenizer.start = input;
-  tokenizer.current = input;
-  tokenizer.line = 1;
+#define CHAR_LETTER (CHAR_IDENT_START | CHAR_IDENT)
+
+static const uint8_t char_class[256] = {
+    [' '] = CHAR_SPACE,
+    ['\t'] = CHAR_SPACE,
+    ['\r'] = CHAR_SPACE,
+    ['\n'] = CHAR_SPACE,
+    ['0' ... '7'] = CHAR_DIGIT | CHAR_OCTAL | CHAR_HEX | CHAR_IDENT,
+    ['8' ... '9'] = CHAR_DIGIT | CHAR_HEX | CHAR_IDENT,
+    ['a' ... 'f'] = CHAR_LETTER | CHAR_HEX,
+    ['g' ... 'z'] = CHAR_LETTER,
+    ['A' ... 'F'] = CHAR_LETTER | CHAR_HEX,
+    ['G' ... 'Z'] = CHAR_LETTER,
+    ['_'] = CHAR_LETTER,
+};
+
+// 只有一个字符，并且不会和其他字符组合的 token ，
+// TOKEN_EOF(0) 表示不是这类字符
+static const TokenType single_char_tokens[256] = {
+    [','] = TOKEN_COMMA,    ['%'] = TOKEN_PERCENT,  ['+'] = TOKEN_PLUS,
+    ['-'] = TOKEN_MINUS,    ['*'] = TOKEN_ASTERISK, ['('] = TOKEN_LPAREN,
+    [')'] = TOKEN_RPAREN,   ['{'] = TOKEN_LBRACE,   ['}'] = TOKEN_RBRACE,
+    ['['] = TOKEN_LBRACKET, [']'] = TOKEN_RBRACKET, [';'] = TOKEN_SEMICOLON,
+};
+
+static inline bool char_is(char c, int class) {
+  return (char_class[(uint8_t)c] & class) != 0;
+}
+
+// #endregion
+
+// #region 关键字
+
+/*
+ * 关键字的完美哈希
+ * hash = (长度 + 首字符 * 16 + 尾字符 * 4) % 16
+ * 9 个关键字的哈希值互不相同，所以一次比较就能确定是不是关键字
+ */
+typedef struct {
+  const char *name;
+  int length;
+} Keyword;
+
+static const Keyword keyword_table[16] = {
+    [5] = {"const", 5},     [3] = {"int", 3},    [4] = {"void", 4},
+    [10] = {"if", 2},       [8] = {"else", 4},   [14] = {"return", 6},
+    [9] = {"while", 5},     [12] = {"continue", 8}, [1] = {"break", 5},
+};
+
+#define KEYWORD_MIN_LENGTH 2
+#define KEYWORD_MAX_LENGTH 8
+
+static inline unsigned keyword_hash(const char *s, int length) {
+  return (length + ((unsigned)(uint8_t)s[0] << 4) +
+          ((unsigned)(uint8_t)s[length - 1] << 2)) &
+         15;
 }
 
 static bool is_keyword(const char *s, int length) {
-  for (int i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
-    if ((length == strlen(keywords[i])) &&
-        strncmp(s, keywords[i], length) == 0) {
-      return true;
-    }
+  if (length < KEYWORD_MIN_LENGTH || length > KEYWORD_MAX_LENGTH) {
+    return false;
   }
-  return false;
+  const Keyword *keyword = &keyword_table[keyword_hash(s, length)];
+  return keyword->length == length && memcmp(s, keyword->name, length) == 0;
 }
 
-static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+// #endregion
 
-static bool is_octal_digit(char c) { return c >= '0' && c <= '7'; }
+// #region SIMD 扫描
 
-static bool is_hex_digit(char c) {
-  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
-         (c >= 'A' && c <= 'F');
+/*
+ * 每次检查一整块（SSE2 16 字节，AVX2 32 字节）字符，得到位掩码
+ * 加载地址按块大小对齐，对齐的加载不会跨越内存页，
+ * 所以即使块的一部分在输入字符串结尾 '\0' 之后也不会访问到非法内存
+ * （这和 glibc 的 strlen 是同样的做法）
+ * 块里面位于起始位置之前的字节通过掩码忽略
+ */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_WIDTH 32
+typedef __m256i ScanBlock;
+static inline ScanBlock scan_load(const char *p) {
+  return _mm256_load_si256((const __m256i *)p);
+}
+static inline uint32_t scan_eq(ScanBlock block, char c) {
+  return (uint32_t)_mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(block, _mm256_set1_epi8(c)));
+}
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_WIDTH 16
+typedef __m128i ScanBlock;
+static inline ScanBlock scan_load(const char *p) {
+  return _mm_load_si128((const __m128i *)p);
 }
+static inline uint32_t scan_eq(ScanBlock block, char c) {
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(c)));
+}
+#endif
 
-static bool is_at_end(void) { return *tokenizer.current == '\0'; }
+#ifdef SCAN_WIDTH
+// 低 n 位为 1 的掩码，n < 32
+static inline uint32_t low_bits(int n) { return ((uint32_t)1 << n) - 1; }
 
-static bool is_identifier_start(char c) {
-  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+static inline const char *align_down(const char *p) {
+  return (const char *)((uintptr_t)p & ~(uintptr_t)(SCAN_WIDTH - 1));
 }
+#endif
 
-static bool is_identifier(char c) {
-  return is_identifier_start(c) || is_digit(c);
+/*
+ * 从 p 开始找第一个等于 a 或者 b 的字符，返回它的位置
+ * 如果 newlines 不是 NULL ，统计 p 到返回位置之间的换行符数量
+ * 调用方保证 a 或者 b 是 '\0' ，所以一定会停在字符串结尾
+ */
+static const char *scan_until(const char *p, char a, char b, int *newlines) {
+#ifdef SCAN_WIDTH
+  const char *block = align_down(p);
+  uint32_t ignore = low_bits(p - block);
+  while (true) {
+    ScanBlock data = scan_load(block);
+    uint32_t stop = (scan_eq(data, a) | scan_eq(data, b)) & ~ignore;
+    uint32_t newline = newlines ? scan_eq(data, '\n') & ~ignore : 0;
+    if (stop) {
+      int n = __builtin_ctz(stop);
+      if (newlines) {
+        *newlines += __builtin_popcount(newline & low_bits(n));
+      }
+      return block + n;
+    }
+    if (newlines) {
+      *newlines += __builtin_popcount(newline);
+    }
+    block += SCAN_WIDTH;
+    ignore = 0;
+  }
+#else
+  while (*p != a && *p != b) {
+    if (newlines && *p == '\n') {
+      (*newlines)++;
+    }
+    p++;
+  }
+  return p;
+#endif
+}
+
+// #endregion
+
+void init_tokenizer(Tokenizer *tokenizer, const char *input,
+                    InternPool *pool) {
+  tokenizer->start = input;
+  tokenizer->current = input;
+  tokenizer->line = 1;
+  tokenizer->pool = pool;
+}
+
+static bool is_at_end(Tokenizer *tokenizer) {
+  return *tokenizer->current == '\0';
 }
 
 // Return current character and advance to the next one
-static void advance(void) {
-  if (!is_at_end()) {
-    tokenizer.current++;
+static void advance(Tokenizer *tokenizer) {
+  if (!is_at_end(tokenizer)) {
+    tokenizer->current++;
   }
 }
 
-static char peek(void) { return tokenizer.current[1]; }
+static char peek(Tokenizer *tokenizer) { return tokenizer->current[1]; }
 
-static void skip_whitespace(void) {
+static void skip_whitespace(Tokenizer *tokenizer) {
+  const char *p = tokenizer->current;
+  // 大部分 token 之间只有一个空格或者没有空白，先走标量路径
+  if (!char_is(*p, CHAR_SPACE)) {
+    return;
+  }
+  if (!char_is(p[1], CHAR_SPACE)) {
+    tokenizer->line += *p == '\n';
+    tokenizer->current = p + 1;
+    return;
+  }
+#ifdef SCAN_WIDTH
+  const char *block = align_down(p);
+  uint32_t ignore = low_bits(p - block);
   while (true) {
-    char c = *tokenizer.current;
-    if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
-      if (c == '\n') {
-        tokenizer.line++;
-      }
-      advance();
-    } else {
-      break;
+    ScanBlock data = scan_load(block);
+    uint32_t newline = scan_eq(data, '\n');
+    uint32_t space = scan_eq(data, ' ') | scan_eq(data, '\t') |
+                     scan_eq(data, '\r') | newline;
+    uint32_t stop = ~space & ~ignore;
+#if SCAN_WIDTH < 32
+    stop &= low_bits(SCAN_WIDTH);
+#endif
+    newline &= ~ignore;
+    if (stop) {
+      int n = __builtin_ctz(stop);
+      tokenizer->line += __builtin_popcount(newline & low_bits(n));
+      tokenizer->current = block + n;
+      return;
     }
+    tokenizer->line += __builtin_popcount(newline);
+    block += SCAN_WIDTH;
+    ignore = 0;
   }
+#else
+  while (char_is(*p, CHAR_SPACE)) {
+    tokenizer->line += *p == '\n';
+    p++;
+  }
+  tokenizer->current = p;
+#endif
 }
 
 /*
@@ -142,13 +297,17 @@ static void skip_whitespace(void) {
  * identifier-start ::= [a-zA-Z_]
  * identifier-char ::= identifier-start | [0-9]
  */
-static Token identifier(void) {
-  while (is_identifier(*tokenizer.current))
-    advance();
-  Token token = {TOKEN_IDENTIFIER, tokenizer.start,
-                 tokenizer.current - tokenizer.start, tokenizer.line};
+static Token identifier(Tokenizer *tokenizer) {
+  const char *p = tokenizer->current;
+  while (char_is(*p, CHAR_IDENT))
+    p++;
+  tokenizer->current = p;
+  Token token = {TOKEN_IDENTIFIER, tokenizer->start,
+                 tokenizer->current - tokenizer->start, tokenizer->line, NULL};
   if (is_keyword(token.start, token.length)) {
     token.type = TOKEN_KEYWORD;
+  } else {
+    token.ident = intern(tokenizer->pool, token.start, token.length);
   }
   return token;
 }
@@ -162,190 +321,150 @@ static Token identifier(void) {
  * hexadecimal-const   ::= hexadecimal-prefix hexadecimal-digit+;
  * hexadecimal-prefix  ::= "0x" | "0X";
  */
-static Token integer(void) {
-  if (*tokenizer.current == '0') {
-    advance();
-    if (*tokenizer.current == 'x' || *tokenizer.current == 'X') {
-      advance();
-      while (is_hex_digit(*tokenizer.current))
-        advance();
-      return (Token){TOKEN_INTEGER, tokenizer.start,
-                     tokenizer.current - tokenizer.start, tokenizer.line};
-    } else {
-      while (is_octal_digit(*tokenizer.current))
-        advance();
-      return (Token){TOKEN_INTEGER, tokenizer.start,
-                     tokenizer.current - tokenizer.start, tokenizer.line};
+static Token integer(Tokenizer *tokenizer) {
+  const char *p = tokenizer->current;
+  int class = CHAR_DIGIT;
+  if (*p == '0') {
+    p++;
+    class = CHAR_OCTAL;
+    if (*p == 'x' || *p == 'X') {
+      p++;
+      class = CHAR_HEX;
     }
-  } else {
-    while (is_digit(*tokenizer.current))
-      advance();
-    return (Token){TOKEN_INTEGER, tokenizer.start,
-                   tokenizer.current - tokenizer.start, tokenizer.line};
   }
+  while (char_is(*p, class))
+    p++;
+  tokenizer->current = p;
+  return (Token){TOKEN_INTEGER, tokenizer->start,
+                 tokenizer->current - tokenizer->start, tokenizer->line};
 }
 
 /*
  * single-line-comment  ::= "//" input-char* NEWLINE;
+ * 换行符留给 skip_whitespace 处理
  */
-static Token single_line_comment(void) {
-  while (!is_at_end() && *tokenizer.current != '\n') {
-    advance();
-  }
-  return (Token){TOKEN_COMMENT, tokenizer.start,
-                 tokenizer.current - tokenizer.start, tokenizer.line};
+static void skip_single_line_comment(Tokenizer *tokenizer) {
+  tokenizer->current = scan_until(tokenizer->current, '\n', '\0', NULL);
 }
 
 /*
  * multi-line-comment   ::= SLASH STAR input-char* STAR SLASH;
  */
-static Token multi_line_comment(void) {
+static void skip_multi_line_comment(Tokenizer *tokenizer) {
+  int start_line = tokenizer->line;
+  const char *p = tokenizer->current;
   while (true) {
-    if (is_at_end()) {
-      fatalf("多行注释没有以 */ 结尾 at line %d\n", tokenizer.line);
+    p = scan_until(p, '*', '\0', &tokenizer->line);
+    if (*p == '\0') {
+      fatalf("多行注释没有以 */ 结尾 at line %d\n", start_line);
     }
-    if (*tokenizer.current == '*') {
-      advance();
-      if (*tokenizer.current == '/') {
-        advance();
-        break;
-      }
-    } else {
-      advance();
+    p++;
+    if (*p == '/') {
+      p++;
+      break;
     }
   }
-  return (Token){TOKEN_COMMENT, tokenizer.start,
-                 tokenizer.current - tokenizer.current, tokenizer.line};
+  tokenizer->current = p;
 }
 
-Token next_token(void) {
+Token next_token(Tokenizer *tokenizer) {
   while (true) {
-    skip_whitespace();
-    tokenizer.start = tokenizer.current;
+    skip_whitespace(tokenizer);
+    tokenizer->start = tokenizer->current;
 
-    if (is_at_end()) {
-      return (Token){TOKEN_EOF, tokenizer.start, 0, tokenizer.line};
+    if (is_at_end(tokenizer)) {
+      return (Token){TOKEN_EOF, tokenizer->start, 0, tokenizer->line};
     }
 
-    char c = *tokenizer.current;
-    switch (c) {
-    case ',': {
-      advance();
-      return (Token){TOKEN_COMMA, tokenizer.start, 1, tokenizer.line};
+    char c = *tokenizer->current;
+    TokenType single = single_char_tokens[(uint8_t)c];
+    if (single != TOKEN_EOF) {
+      advance(tokenizer);
+      return (Token){single, tokenizer->start, 1, tokenizer->line};
+    }
+    if (char_is(c, CHAR_IDENT_START)) {
+      return identifier(tokenizer);
+    }
+    if (char_is(c, CHAR_DIGIT)) {
+      return integer(tokenizer);
     }
+    switch (c) {
     case '<': {
-      if (peek() == '=') {
-        advance();
-        advance();
-        return (Token){TOKEN_LESS_EQUAL, tokenizer.start, 2, tokenizer.line};
+      if (peek(tokenizer) == '=') {
+        advance(tokenizer);
+        advance(tokenizer);
+        return (Token){TOKEN_LESS_EQUAL, tokenizer->start, 2, tokenizer->line};
       } else {
-        advance();
-        return (Token){TOKEN_LESS, tokenizer.start, 1, tokenizer.line};
+        advance(tokenizer);
+        return (Token){TOKEN_LESS, tokenizer->start, 1, tokenizer->line};
       }
     }
     case '>': {
-      if (peek() == '=') {
-        advance();
-        advance();
-        return (Token){TOKEN_GREATER_EQUAL, tokenizer.start, 2, tokenizer.line};
+      if (peek(tokenizer) == '=') {
+        advance(tokenizer);
+        advance(tokenizer);
+        return (Token){TOKEN_GREATER_EQUAL, tokenizer->start, 2,
+                       tokenizer->line};
       } else {
-        advance();
-        return (Token){TOKEN_GREATER, tokenizer.start, 1, tokenizer.line};
+        advance(tokenizer);
+        return (Token){TOKEN_GREATER, tokenizer->start, 1, tokenizer->line};
       }
     }
     case '=': {
-      if (peek() == '=') {
-        advance();
-        advance();
-        return (Token){TOKEN_EQUAL, tokenizer.start, 2, tokenizer.line};
+      if (peek(tokenizer) == '=') {
+        advance(tokenizer);
+        advance(tokenizer);
+        return (Token){TOKEN_EQUAL, tokenizer->start, 2, tokenizer->line};
       } else {
-        advance();
-        return (Token){TOKEN_ASSIGN, tokenizer.start, 1, tokenizer.line};
+        advance(tokenizer);
+        return (Token){TOKEN_ASSIGN, tokenizer->start, 1, tokenizer->line};
       }
     }
     case '&': {
-      if (peek() == '&') {
-        advance();
-        advance();
-        return (Token){TOKEN_AND, tokenizer.start, 2, tokenizer.line};
+      if (peek(tokenizer) == '&') {
+        advance(tokenizer);
+        advance(tokenizer);
+        return (Token){TOKEN_AND, tokenizer->start, 2, tokenizer->line};
       } else {
-        fatalf("无法识别的字符 %d at line %d\n", c, tokenizer.line);
+        fatalf("无法识别的字符 %d at line %d\n", c, tokenizer->line);
       }
     }
     case '|': {
-      if (peek() == '|') {
-        advance();
-        advance();
-        return (Token){TOKEN_OR, tokenizer.start, 2, tokenizer.line};
+      if (peek(tokenizer) == '|') {
+        advance(tokenizer);
+        advance(tokenizer);
+        return (Token){TOKEN_OR, tokenizer->start, 2, tokenizer->line};
       } else {
-        fatalf("无法识别的字符 %d at line %d\n", c, tokenizer.line);
+        fatalf("无法识别的字符 %d at line %d\n", c, tokenizer->line);
       }
     }
-    case '%':
-      advance();
-      return (Token){TOKEN_PERCENT, tokenizer.start, 1, tokenizer.line};
-    case '+':
-      advance();
-      return (Token){TOKEN_PLUS, tokenizer.start, 1, tokenizer.line};
-    case '-':
-      advance();
-      return (Token){TOKEN_MINUS, tokenizer.start, 1, tokenizer.line};
-    case '*':
-      advance();
-      return (Token){TOKEN_ASTERISK, tokenizer.start, 1, tokenizer.line};
     case '!': {
-      if (peek() == '=') {
-        advance();
-        advance();
-        return (Token){TOKEN_NOT_EQUAL, tokenizer.start, 2, tokenizer.line};
+      if (peek(tokenizer) == '=') {
+        advance(tokenizer);
+        advance(tokenizer);
+        return (Token){TOKEN_NOT_EQUAL, tokenizer->start, 2, tokenizer->line};
       } else {
-        advance();
-        return (Token){TOKEN_BANG, tokenizer.start, 1, tokenizer.line};
+        advance(tokenizer);
+        return (Token){TOKEN_BANG, tokenizer->start, 1, tokenizer->line};
       }
     }
     case '/': {
-      if (peek() == '/') {
-        advance();
-        advance();
-        single_line_comment();
-      } else if (peek() == '*') {
-        advance();
-        multi_line_comment();
+      if (peek(tokenizer) == '/') {
+        advance(tokenizer);
+        advance(tokenizer);
+        skip_single_line_comment(tokenizer);
+      } else if (peek(tokenizer) == '*') {
+        advance(tokenizer);
+        advance(tokenizer);
+        skip_multi_line_comment(tokenizer);
       } else {
-        advance();
-        return (Token){TOKEN_SLASH, tokenizer.start, 1, tokenizer.line};
+        advance(tokenizer);
+        return (Token){TOKEN_SLASH, tokenizer->start, 1, tokenizer->line};
       }
       break;
     }
-    case '(':
-      advance();
-      return (Token){TOKEN_LPAREN, tokenizer.start, 1, tokenizer.line};
-    case ')':
-      advance();
-      return (Token){TOKEN_RPAREN, tokenizer.start, 1, tokenizer.line};
-    case '{':
-      advance();
-      return (Token){TOKEN_LBRACE, tokenizer.start, 1, tokenizer.line};
-    case '}':
-      advance();
-      return (Token){TOKEN_RBRACE, tokenizer.start, 1, tokenizer.line};
-    case '[':
-      advance();
-      return (Token){TOKEN_LBRACKET, tokenizer.start, 1, tokenizer.line};
-    case ']':
-      advance();
-      return (Token){TOKEN_RBRACKET, tokenizer.start, 1, tokenizer.line};
-    case ';':
-      advance();
-      return (Token){TOKEN_SEMICOLON, tokenizer.start, 1, tokenizer.line};
     default:
-      if (is_identifier_start(c)) {
-        return identifier();
-      }
-      if (is_digit(c)) {
-        return integer();
-      }
-      fatalf("无法识别的字符 %d at line %d\n", c, tokenizer.line);
+      fatalf("无法识别的字符 %d at line %d\n", c, tokenizer->line);
     }
   }
 }
@@ -1,6 +1,8 @@
 #ifndef SRC_TOKENIZE_H_
 #define SRC_TOKENIZE_H_
 
+#include "intern.h"
+
 typedef enum {
   TOKEN_EOF,
   TOKEN_COMMENT,
@@ -39,9 +41,17 @@ typedef struct {
   const char *start;
   int length;
   int line;
+  const char *ident; // 标识符的驻留字符串，其他 token 为 NULL
 } Token;
 
-void init_tokenizer(const char *input);
-Token next_token(void);
+typedef struct Tokenizer {
+  const char *start;
+  const char *current;
+  int line;
+  InternPool *pool; // 标识符驻留到这个池里
+} Tokenizer;
+
+void init_tokenizer(Tokenizer *tokenizer, const char *input, InternPool *pool);
+Token next_token(Tokenizer *tokenizer);
 
 #endif // SRC_TOKENIZE_H_
\ No newline at end of file
@@ -4,12 +4,31 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+static _Thread_local jmp_buf *error_trap = NULL;
+
+jmp_buf *set_error_trap(jmp_buf *trap) {
+  jmp_buf *previous = error_trap;
+  error_trap = trap;
+  return previous;
+}
+
+void compile_error_exit(void) {
+  if (error_trap != NULL) {
+    longjmp(*error_trap, 1);
+  }
+  exit(1);
+}
 
 void internal_fatalf(const char *fmt, ...) {
   va_list args;
   va_start(args, fmt);
   vfprintf(stderr, fmt, args);
   va_end(args);
+  if (error_trap != NULL) {
+    longjmp(*error_trap, 1);
+  }
   assert(0);
 }
 
@@ -45,3 +64,63 @@ int int_stack_top(IntStack *stack) {
 }
 
 bool int_stack_empty(IntStack *stack) { return stack->size == 0; }
+
+void string_buffer_init(StringBuffer *buffer) {
+  buffer->size = 0;
+  buffer->capacity = 4096;
+  buffer->data = (char *)malloc(buffer->capacity);
+  if (buffer->data == NULL) {
+    fatalf("无法分配内存\n");
+  }
+  buffer->data[0] = '\0';
+}
+
+void string_buffer_reserve(StringBuffer *buffer, size_t extra) {
+  size_t need = buffer->size + extra + 1;
+  if (need <= buffer->capacity) {
+    return;
+  }
+  if (buffer->capacity == 0) {
+    // 全零或者已经 free 的缓冲区
+    buffer->capacity = 64;
+  }
+  while (buffer->capacity < need) {
+    buffer->capacity *= 2;
+  }
+  buffer->data = (char *)realloc(buffer->data, buffer->capacity);
+  if (buffer->data == NULL) {
+    fatalf("无法分配内存\n");
+  }
+}
+
+void string_buffer_append(StringBuffer *buffer, const char *str, size_t len) {
+  string_buffer_reserve(buffer, len);
+  memcpy(buffer->data + buffer->size, str, len);
+  buffer->size += len;
+  buffer->data[buffer->size] = '\0';
+}
+
+void string_buffer_vappendf(StringBuffer *buffer, const char *fmt,
+                            va_list args) {
+  va_list copy;
+  va_copy(copy, args);
+  size_t available = buffer->capacity - buffer->size;
+  int n = vsnprintf(buffer->data + buffer->size, available, fmt, args);
+  if (n < 0) {
+    fatalf("格式化输出失败\n");
+  }
+  if ((size_t)n >= available) {
+    // 空间不够，扩容后重新格式化
+    string_buffer_reserve(buffer, n);
+    vsnprintf(buffer->data + buffer->size, n + 1, fmt, copy);
+  }
+  va_end(copy);
+  buffer->size += n;
+}
+
+void string_buffer_free(StringBuffer *buffer) {
+  free(buffer->data);
+  buffer->data = NULL;
+  buffer->size = 0;
+  buffer->capacity = 0;
+}
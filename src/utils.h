@@ -1,7 +1,10 @@
 #ifndef SRC_UTILS_H_
 #define SRC_UTILS_H_
 
+#include <setjmp.h>
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #define fatalf(fmt, ...)                                                       \
   internal_fatalf("%s:%d " fmt, __FILE__, __LINE__, ##__VA_ARGS__)
@@ -10,6 +13,15 @@ void internal_fatalf(const char *fmt, ...)
 #define warnf(fmt, ...) internal_warnf("Warning: " fmt, ##__VA_ARGS__)
 void internal_warnf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
 
+/*
+ * 源程序有错误，输出错误信息之后调用，结束这次编译
+ * 默认直接退出进程。当前线程设置了 error trap 时 longjmp 回到设置的位置，
+ * 服务模式用它在一个请求出错之后继续处理下一个请求。fatalf 也会跳回去。
+ */
+_Noreturn void compile_error_exit(void);
+// trap 为 NULL 时恢复默认行为，返回之前的 trap ，用于嵌套设置
+jmp_buf *set_error_trap(jmp_buf *trap);
+
 /**
  * @struct IntStack
  * @brief A structure to represent a stack of integers.
@@ -39,4 +51,35 @@ int int_stack_pop(IntStack *stack);
 int int_stack_top(IntStack *stack);
 bool int_stack_empty(IntStack *stack);
 
+/**
+ * @struct StringBuffer
+ * @brief 可增长的字符串缓冲区
+ *
+ * 用来在内存中累积输出（例如 Koopa IR 文本），避免写文件再读回来。
+ * data 始终以 '\0' 结尾，可以直接当作 C 字符串使用。
+ * 全零的缓冲区（以及 string_buffer_free 之后）为空，data 为 NULL ，
+ * 第一次写入时才分配内存。
+ *
+ * @var StringBuffer::data
+ * 缓冲区内容
+ *
+ * @var StringBuffer::size
+ * 已写入的字节数（不含结尾的 '\0'）
+ *
+ * @var StringBuffer::capacity
+ * 缓冲区容量
+ */
+typedef struct StringBuffer {
+  char *data;
+  size_t size;
+  size_t capacity;
+} StringBuffer;
+void string_buffer_init(StringBuffer *buffer);
+// 保证还能再写入 extra 个字节（加上结尾的 '\0'）
+void string_buffer_reserve(StringBuffer *buffer, size_t extra);
+void string_buffer_append(StringBuffer *buffer, const char *str, size_t len);
+void string_buffer_vappendf(StringBuffer *buffer, const char *fmt,
+                            va_list args);
+void string_buffer_free(StringBuffer *buffer);
+
 #endif // SRC_UTILS_H_
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "value_map.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+#define VALUE_MAP_MIN_CAPACITY 64
+
+// 指针的低几位总是 0 ，乘一个奇数常量把高位混进来（Fibonacci hashing）
+static size_t hash_pointer(const void *key) {
+  uint64_t h = (uint64_t)(uintptr_t)key * 0x9E3779B97F4A7C15ull;
+  return (size_t)(h >> 32);
+}
+
+static void value_map_alloc(ValueMap *map, size_t capacity) {
+  map->entries = calloc(capacity, sizeof(ValueMapEntry));
+  if (map->entries == NULL) {
+    fatalf("无法分配内存\n");
+  }
+  map->capacity = capacity;
+  map->count = 0;
+}
+
+void value_map_init(ValueMap *map) {
+  value_map_alloc(map, VALUE_MAP_MIN_CAPACITY);
+}
+
+void value_map_clear(ValueMap *map) {
+  if (map->count == 0) {
+    return;
+  }
+  // 处理完一个很大的函数之后，不要让后面每个小函数都清空一张大表
+  if (map->capacity > VALUE_MAP_MIN_CAPACITY &&
+      map->count * 8 < map->capacity) {
+    free(map->entries);
+    value_map_alloc(map, VALUE_MAP_MIN_CAPACITY);
+    return;
+  }
+  memset(map->entries, 0, sizeof(ValueMapEntry) * map->capacity);
+  map->count = 0;
+}
+
+void value_map_free(ValueMap *map) {
+  free(map->entries);
+  map->entries = NULL;
+  map->capacity = 0;
+  map->count = 0;
+}
+
+static ValueMapEntry *find_entry(ValueMapEntry *entries, size_t capacity,
+                                 const void *key) {
+  size_t mask = capacity - 1;
+  size_t i = hash_pointer(key) & mask;
+  while (entries[i].key != NULL && entries[i].key != key) {
+    i = (i + 1) & mask;
+  }
+  return &entries[i];
+}
+
+// 负载超过 1/2 时扩容
+static void value_map_grow(ValueMap *map) {
+  ValueMapEntry *old_entries = map->entries;
+  size_t old_capacity = map->capacity;
+  value_map_alloc(map, old_capacity * 2);
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old_entries[i].key == NULL) {
+      continue;
+    }
+    *find_entry(map->entries, map->capacity, old_entries[i].key) =
+        old_entries[i];
+    map->count++;
+  }
+  free(old_entries);
+}
+
+void value_map_put(ValueMap *map, const void *key, int value) {
+  if ((map->count + 1) * 2 > map->capacity) {
+    value_map_grow(map);
+  }
+  ValueMapEntry *entry = find_entry(map->entries, map->capacity, key);
+  if (entry->key == NULL) {
+    entry->key = key;
+    map->count++;
+  }
+  entry->value = value;
+}
+
+bool value_map_get(const ValueMap *map, const void *key, int *value) {
+  if (map->count == 0) {
+    // 也包括还没有 init 或者已经 free 的表
+    return false;
+  }
+  ValueMapEntry *entry = find_entry(map->entries, map->capacity, key);
+  if (entry->key == NULL) {
+    return false;
+  }
+  *value = entry->value;
+  return true;
+}
@@ -0,0 +1,44 @@
+#ifndef SRC_VALUE_MAP_H_
+#define SRC_VALUE_MAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct ValueMapEntry {
+  const void *key;
+  int value;
+} ValueMapEntry;
+
+/**
+ * @struct ValueMap
+ * @brief 以指针为键、int 为值的哈希表
+ *
+ * 后端用它把 koopa_raw_value_t 映射到栈帧中的偏移，
+ * 查找是 O(1) 的，不用每次都遍历链表或者数组。
+ * 开放寻址 + 线性探测，不支持删除，换函数时整体清空。
+ *
+ * @var ValueMap::entries
+ * 哈希槽，key 为 NULL 表示空槽
+ *
+ * @var ValueMap::capacity
+ * 槽的数量，总是 2 的幂
+ *
+ * @var ValueMap::count
+ * 已经使用的槽数量
+ */
+typedef struct ValueMap {
+  ValueMapEntry *entries;
+  size_t capacity;
+  size_t count;
+} ValueMap;
+
+void value_map_init(ValueMap *map);
+// 清空所有键，之前太大的表会缩小
+void value_map_clear(ValueMap *map);
+void value_map_free(ValueMap *map);
+// key 已经存在时覆盖原来的值
+void value_map_put(ValueMap *map, const void *key, int value);
+// 找到 key 时把值写到 *value 并返回 true ，空表（包括全零的表）总是返回 false
+bool value_map_get(const ValueMap *map, const void *key, int *value);
+
+#endif // SRC_VALUE_MAP_H_